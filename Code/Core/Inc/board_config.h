@@ -0,0 +1,95 @@
+/*
+ * board_config.h
+ *
+ * Board wiring, fixed at build time : LED array, MAX7219, timers of the drivers and notes of the
+ * buzzer. main() builds the driver handles from these lists. The pin names come from main.h, it is
+ * to be included where the lists are expanded.
+ *
+ * With BOARD_STATIC_CONFIG set, the drivers are compiled against these constants instead of their
+ * handle : peripherals and pins are immediate values, the NULL checks of the handles are gone and
+ * the loops over the LEDs are unrolled. The handles then only carry the runtime state (display
+ * message, scheduler tasks, channels of the mixer). Clear it for the handle driven drivers, the API
+ * is the same.
+ */
+
+#ifndef BOARD_CONFIG_H_
+#define BOARD_CONFIG_H_
+
+#include "stm32l1xx_hal.h"
+
+#ifndef BOARD_STATIC_CONFIG
+#define BOARD_STATIC_CONFIG 1
+#endif
+
+// Hot paths at register level : LED writes through BSRR, MAX7219 frames by polling the SPI flags,
+// buttons EXTI dispatched from one read of the pending register. The HAL still initializes the
+// peripherals. Set to 0 to go through the HAL calls, e.g. to compare with BENCH_ENABLE
+#ifndef BOARD_LL_FAST_PATHS
+#define BOARD_LL_FAST_PATHS 1
+#endif
+
+// Interrupt hot paths run from the SRAM, out of the flash wait state of FLASH_LATENCY_1. Set to 0
+// to run them from the flash, e.g. to compare the profiler dumps
+#ifndef BOARD_RAMFUNC_ENABLE
+#define BOARD_RAMFUNC_ENABLE 1
+#endif
+
+/**
+ * @brief Function placed in .RamFunc : STM32L152RETX_FLASH.ld links it in .data, the startup code
+ * copies it to the SRAM with the initialized data. The calls to and from the flash go through veneers.
+ */
+#if BOARD_RAMFUNC_ENABLE
+#define RAMFUNC __attribute__((section(".RamFunc")))
+#else
+#define RAMFUNC
+#endif
+
+/**
+ * @brief LED array, X(index, port, pin) from the P1 border to the P2 border
+ */
+#define BOARD_LED_LIST(X)          \
+	X(0, L1_GPIO_Port, L1_Pin)     \
+	X(1, L2_GPIO_Port, L2_Pin)     \
+	X(2, L3_GPIO_Port, L3_Pin)     \
+	X(3, L4_GPIO_Port, L4_Pin)     \
+	X(4, L5_GPIO_Port, L5_Pin)     \
+	X(5, L6_GPIO_Port, L6_Pin)     \
+	X(6, L7_GPIO_Port, L7_Pin)     \
+	X(7, L8_GPIO_Port, L8_Pin)
+#define BOARD_LED_COUNT 8
+
+/**
+ * @brief MAX7219 on SPI1, software NSS
+ */
+#define BOARD_MAX7219_HSPI hspi1
+#define BOARD_MAX7219_NCS_PORT SPI_CS_GPIO_Port
+#define BOARD_MAX7219_NCS_PIN SPI_CS_Pin
+#define BOARD_MAX7219_DIGITS 4
+
+extern SPI_HandleTypeDef BOARD_MAX7219_HSPI;
+
+/**
+ * @brief Timers : buzzer PWM on CH2, scheduler tick, 32-bit microsecond counter
+ */
+#define BOARD_MUSIC_TIM TIM3
+#define BOARD_TIMER_TIM TIM4
+#define BOARD_CAPTURE_TIM TIM5
+
+/**
+ * @brief Notes of the buzzer, X(name, frequency in Hz). Their ARR is computed by the compiler.
+ */
+#define BOARD_NOTE_LIST(X) \
+	X("C5", 1046.50)       \
+	X("C#5", 1108.73)      \
+	X("D5", 1174.66)       \
+	X("Eb5", 1244.51)      \
+	X("E5", 1318.51)       \
+	X("F5", 1396.91)       \
+	X("F#5", 1479.98)      \
+	X("G5", 1567.98)       \
+	X("G#5", 1661.22)      \
+	X("A5", 1760.00)       \
+	X("A#5", 1864.66)      \
+	X("B5", 1975.53)
+
+#endif /* BOARD_CONFIG_H_ */
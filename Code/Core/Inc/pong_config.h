@@ -0,0 +1,44 @@
+/*
+ * pong_config.h
+ *
+ * Build configuration shared by the drivers : heap policy and capacities of every
+ * statically allocated buffer. All memory is sized here, at compile time.
+ */
+
+#ifndef PONG_CONFIG_H_
+#define PONG_CONFIG_H_
+
+/**
+ * @brief Heap policy. With PONG_NO_HEAP set, no heap is reserved and a call to the allocator
+ * from the firmware does not build. The stdio of newlib still links _sbrk, which refuses and
+ * counts every allocation, and stdout is unbuffered so printf never calls malloc. A refused
+ * stdio buffer only makes newlib fall back to unbuffered output, the count shows in memory_dump.
+ */
+#ifndef PONG_NO_HEAP
+#define PONG_NO_HEAP 1
+#endif
+
+#if PONG_NO_HEAP
+#include <stddef.h>
+
+void *malloc(size_t _size) __attribute__((error("no heap in a PONG_NO_HEAP build")));
+void *calloc(size_t _count, size_t _size) __attribute__((error("no heap in a PONG_NO_HEAP build")));
+void *realloc(void *_ptr, size_t _size) __attribute__((error("no heap in a PONG_NO_HEAP build")));
+#endif
+
+#define PONG_HEAP_SIZE 0x200 // Heap reserved by the linker scripts when PONG_NO_HEAP is clear
+
+/**
+ * @brief Buffers capacities
+ */
+#define LOG_BUFFER_SZ 1024	 // Log ring buffer in bytes, power of 2 and multiple of 4
+#define TRACE_BUFFER_SZ 64	 // FSM trace ring buffer in records, power of 2
+#define REPLAY_BUFFER_SZ 256 // Recorded FSM inputs, kept across resets
+#define NETPLAY_HISTORY_SZ 32	 // Frames of inputs and FSM snapshots kept by the netplay, power of 2
+#define LINK_RX_BUFFER_SZ 1024	 // Link circular RX DMA buffer in bytes, power of 2, 11ms at 921600 bauds
+#define LINK_TX_BUFFER_SZ 256	 // Link TX ring in bytes, power of 2
+#define TELEMETRY_BUFFER_SZ 32	 // Telemetry ring buffer in records, power of 2
+#define TELEMETRY_TX_RECORDS 8	 // Records sent by one telemetry DMA transfer
+#define BENCH_RUNS 31			 // Recorded calls of each benchmark, odd
+
+#endif /* PONG_CONFIG_H_ */
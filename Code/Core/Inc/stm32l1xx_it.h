@@ -27,6 +27,7 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "board_config.h"
 
 /* USER CODE END Includes */
 
@@ -59,6 +60,10 @@ void TIM2_IRQHandler(void);
 void TIM4_IRQHandler(void);
 void EXTI15_10_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+//interrupt handlers run from the SRAM
+RAMFUNC void TIM4_IRQHandler(void);
+RAMFUNC void EXTI15_10_IRQHandler(void);
+RAMFUNC void TIM5_IRQHandler(void);
 
 /* USER CODE END EFP */
 
@@ -0,0 +1,222 @@
+/*
+ * bot.c
+ */
+
+#include "bot.h"
+
+static TypeDef_Bot bots[BOT_PLAYERS_COUNT];
+
+static uint32_t bot_seed = BOT_SEED;
+
+/**
+ * @brief States in which a player has something to do : serve, ball coming, reflex press
+ */
+static const FSM_State_Enum serve_states[BOT_PLAYERS_COUNT] = {STATE_WPP1, STATE_WPP2};
+static const FSM_State_Enum coming_states[BOT_PLAYERS_COUNT] = {STATE_GTP1, STATE_GTP2};
+static const FSM_State_Enum reflex_states[BOT_PLAYERS_COUNT] = {STATE_RPP1, STATE_RPP2};
+
+//lowest LED index at which a too early press still counts, the ball goes up to 7 for P1, down to 0 for P2
+static const int8_t early_led_first[BOT_PLAYERS_COUNT] = {3, 1};
+
+/**
+ * @brief xorshift32 random generator
+ * @retval Random value
+ */
+static uint32_t bot_random(void)
+{
+	bot_seed ^= bot_seed << 13;
+	bot_seed ^= bot_seed >> 17;
+	bot_seed ^= bot_seed << 5;
+
+	return bot_seed;
+}
+
+/**
+ * @param _range Number of possible values
+ * @retval Random value in [0, _range[
+ */
+static uint32_t bot_uniform(uint32_t _range)
+{
+	return (_range == 0) ? 0 : bot_random() % _range;
+}
+
+/**
+ * @brief Draw a reaction latency : the sum of 4 uniform draws (Irwin-Hall) gives a bell shape
+ * of half width BOT_SPREAD_PERMIL around the mean latency of the skill
+ * @param _bot Bot reacting
+ * @param _window_us Duration of the reflex window
+ * @retval Latency in microseconds
+ */
+static uint32_t bot_draw_latency(const TypeDef_Bot *_bot, uint32_t _window_us)
+{
+	uint32_t mean_permil = BOT_LATENCY_WORST_PERMIL - ((BOT_LATENCY_WORST_PERMIL - BOT_LATENCY_BEST_PERMIL) * _bot->skill) / 100;
+	uint32_t sum_permil = 0;
+
+	for (int i = 0; i < 4; i++)
+		sum_permil += bot_uniform(BOT_SPREAD_PERMIL / 2);
+
+	return (_window_us / 1000) * (mean_permil + sum_permil - BOT_SPREAD_PERMIL);
+}
+
+/**
+ * @brief Decide what the bot does in the state just entered
+ * @param _player Player of the bot
+ * @param _fsm_handle FSM watched
+ */
+static void bot_schedule(BOT_Player_Enum _player, const FSM_Handle_TypeDef *_fsm_handle)
+{
+	TypeDef_Bot *bot = &bots[_player];
+	FSM_State_Enum state = _fsm_handle->state.state;
+
+	if (state == serve_states[_player])
+	{
+		bot->press_pending = 1;
+		bot->press_delay_us = BOT_SERVE_DELAY_US;
+	}
+	else if (state == reflex_states[_player])
+	{
+		// The reflex window lasts one LED shift, as long as the last shift of the ball
+		uint32_t window_us = _fsm_handle->controllers.ball_step_period_us;
+
+		if (window_us == 0)
+			window_us = BOT_WINDOW_DEFAULT_US;
+
+		bot->press_pending = 1;
+		bot->press_delay_us = bot_draw_latency(bot, window_us);
+	}
+	else if (state == coming_states[_player])
+	{
+		// The worse the skill, the more often the bot anticipates, up to 1 ball out of 5
+		if (bot_uniform(100) < (uint32_t)(100 - bot->skill) / 5)
+			bot->early_led_index = early_led_first[_player] + bot_uniform(4);
+	}
+	else if (state == STATE_P1WN || state == STATE_P2WN)
+	{
+		bot->press_pending = 1;
+		bot->press_delay_us = BOT_RESTART_DELAY_US;
+	}
+}
+
+/**
+ * @brief Press the button of a bot
+ * @param _bot Bot pressing
+ * @param _time_us Time of the press
+ */
+static void bot_press(TypeDef_Bot *_bot, uint32_t _time_us)
+{
+	_bot->presses++;
+	pong_register_press(_bot->btn_pin, _time_us);
+}
+
+/**
+ * @brief Init the random generator and the bots of BOT_PLAYERS
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef bot_init(void)
+{
+	bot_seed = BOT_SEED;
+
+	bots[BOT_P1].btn_pin = BTN1_Pin;
+	bots[BOT_P2].btn_pin = BTN2_Pin;
+
+	for (int i = 0; i < BOT_PLAYERS_COUNT; i++)
+	{
+		bots[i].enabled = 0;
+		bots[i].skill = BOT_SKILL_DEFAULT;
+		bots[i].state = STATE_START;
+		bots[i].press_pending = 0;
+		bots[i].early_led_index = -1;
+		bots[i].presses = 0;
+
+		if (BOT_PLAYERS & (1 << i))
+			bot_enable(i, BOT_SKILL_DEFAULT);
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Replace a player by a bot, from the next state on
+ * @param _player Player to replace
+ * @param _skill Skill of the bot, 0-100
+ * @retval HAL status
+ */
+HAL_StatusTypeDef bot_enable(BOT_Player_Enum _player, uint8_t _skill)
+{
+	if (_player >= BOT_PLAYERS_COUNT || _skill > 100)
+		return HAL_ERROR;
+
+	bots[_player].skill = _skill;
+	bots[_player].press_pending = 0;
+	bots[_player].early_led_index = -1;
+	bots[_player].enabled = 1;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Give a player back to the human
+ * @param _player Player to give back
+ * @retval HAL status
+ */
+HAL_StatusTypeDef bot_disable(BOT_Player_Enum _player)
+{
+	if (_player >= BOT_PLAYERS_COUNT)
+		return HAL_ERROR;
+
+	bots[_player].enabled = 0;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Let the bots play, called at each pong_run iteration
+ * @param _fsm_handle FSM watched by the bots
+ */
+void bot_step(const FSM_Handle_TypeDef *_fsm_handle)
+{
+	FSM_State_Enum state = _fsm_handle->state.state;
+
+	for (int i = 0; i < BOT_PLAYERS_COUNT; i++)
+	{
+		TypeDef_Bot *bot = &bots[i];
+
+		if (bot->enabled == 0)
+			continue;
+
+		uint32_t now = capture_now_us();
+
+		// New state, nothing scheduled in the previous one matters anymore
+		if (state != bot->state)
+		{
+			bot->state = state;
+			bot->state_time_us = now;
+			bot->press_pending = 0;
+			bot->early_led_index = -1;
+			bot_schedule(i, _fsm_handle);
+		}
+
+		if (bot->early_led_index >= 0 && _fsm_handle->controllers.led_index == bot->early_led_index)
+		{
+			bot->early_led_index = -1;
+			bot_press(bot, now);
+		}
+		else if (bot->press_pending && now - bot->state_time_us >= bot->press_delay_us)
+		{
+			bot->press_pending = 0;
+			bot_press(bot, now);
+		}
+	}
+}
+
+/**
+ * @param _player Player of the bot
+ * @retval The bot, NULL for an invalid player
+ */
+const TypeDef_Bot *bot_get(BOT_Player_Enum _player)
+{
+	if (_player >= BOT_PLAYERS_COUNT)
+		return NULL;
+
+	return &bots[_player];
+}
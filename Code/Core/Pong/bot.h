@@ -0,0 +1,65 @@
+/*
+ * bot.h
+ *
+ * Computer player. A bot watches the FSM at each pong_run iteration and presses the button of its
+ * player through pong_register_press, like the button interrupts. Its reaction latency is a share
+ * of the reflex window, the duration of a LED shift at the current led_shift_period, drawn from a
+ * bell shaped distribution (sum of 4 uniform draws) centered on a mean given by its skill. A low
+ * skill also makes it press too early while the ball is coming. Integer arithmetic only, O(1) per
+ * iteration.
+ */
+
+#ifndef PONG_BOT_H_
+#define PONG_BOT_H_
+
+#include "pong.h"
+
+// Set to 0 to remove the bots from pong_run
+#ifndef BOT_ENABLE
+#define BOT_ENABLE 1
+#endif
+
+// Players replaced by a bot at startup, bit 0 for P1 and bit 1 for P2
+#ifndef BOT_PLAYERS
+#define BOT_PLAYERS 0
+#endif
+
+#define BOT_SKILL_DEFAULT 70			// Skill of the startup bots, 0-100
+#define BOT_LATENCY_BEST_PERMIL 400		// Mean reaction latency at skill 100, in thousandths of the reflex window
+#define BOT_LATENCY_WORST_PERMIL 1200	// Mean reaction latency at skill 0, the ball is mostly missed
+#define BOT_SPREAD_PERMIL 200			// Half width of the latency distribution
+#define BOT_WINDOW_DEFAULT_US 200000	// Reflex window used before the ball speed is known
+#define BOT_SERVE_DELAY_US 700000		// Delay before serving
+#define BOT_RESTART_DELAY_US 3000000	// Delay before restarting after a win
+#define BOT_SEED 0x2545F491				// Seed of the random generator, the same games every run
+
+typedef enum
+{
+	BOT_P1 = 0,
+	BOT_P2 = 1,
+	BOT_PLAYERS_COUNT,
+} BOT_Player_Enum;
+
+/**
+ * @brief Bot of a player, the pending press is due at press_time_us
+ */
+typedef struct
+{
+	uint8_t enabled;
+	uint8_t skill;			  // 0-100
+	uint16_t btn_pin;		  // Button pressed by the bot
+	FSM_State_Enum state;	  // State seen at the last iteration
+	uint8_t press_pending;	  // A press is scheduled in the current state
+	uint32_t state_time_us;	  // Time at which the state was entered
+	uint32_t press_delay_us;  // Delay of the scheduled press since state_time_us
+	int8_t early_led_index;	  // LED index at which the bot presses too early, -1 when it waits for the ball
+	uint32_t presses;		  // Number of presses made
+} TypeDef_Bot;
+
+HAL_StatusTypeDef bot_init(void);
+HAL_StatusTypeDef bot_enable(BOT_Player_Enum _player, uint8_t _skill);
+HAL_StatusTypeDef bot_disable(BOT_Player_Enum _player);
+void bot_step(const FSM_Handle_TypeDef *_fsm_handle);
+const TypeDef_Bot *bot_get(BOT_Player_Enum _player);
+
+#endif /* PONG_BOT_H_ */
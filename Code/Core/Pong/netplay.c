@@ -0,0 +1,284 @@
+/*
+ * netplay.c
+ */
+
+#include "netplay.h"
+
+//snapshots cover the rollback window, inputs the frames both boards can announce ahead of it
+typedef char netplay_history_check[(NETPLAY_HISTORY_SZ > 2 * (NETPLAY_ROLLBACK_FRAMES + NETPLAY_INPUT_DELAY + 1)) ? 1 : -1];
+
+static TypeDef_Netplay netplay;
+
+/**
+ * @param _player Player of the inputs
+ * @param _frame Frame of the inputs
+ * @retval Inputs of the player in the frame
+ */
+static inline TypeDef_Netplay_Input *netplay_input(NETPLAY_Player_Enum _player, uint32_t _frame)
+{
+	return &netplay.inputs[_player][_frame & (NETPLAY_HISTORY_SZ - 1)];
+}
+
+/**
+ * @brief Send again the local inputs not acknowledged by the other board
+ */
+static void netplay_resend(void)
+{
+	for (uint32_t frame = netplay.remote_ack; frame < netplay.local_frame; frame++)
+	{
+		TypeDef_Netplay_Input *input = netplay_input(NETPLAY_LOCAL, frame);
+
+		if (link_send_input(frame, netplay.remote_frame, input->presses, input->offset) != HAL_OK)
+			return;
+		netplay.stats.resends++;
+	}
+}
+
+/**
+ * @brief Give the local presses made during the previous frame to the frame NETPLAY_INPUT_DELAY
+ * frames later, on both boards
+ */
+static void netplay_send_local(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t now = capture_now_us();
+
+	__disable_irq();
+	uint8_t presses = netplay.pending_presses;
+	uint32_t time_us = netplay.pending_time_us;
+	netplay.pending_presses = 0;
+	__set_PRIMASK(primask);
+
+	uint32_t frame = netplay.frame + NETPLAY_INPUT_DELAY;
+	TypeDef_Netplay_Input *input = netplay_input(NETPLAY_LOCAL, frame);
+	uint32_t offset = (time_us - netplay.frame_time_us) / NETPLAY_OFFSET_UNIT_US;
+
+	input->presses = presses;
+	input->offset = 0;
+	if (presses != 0)
+		input->offset = (offset > 255) ? 255 : offset;
+
+	netplay.local_frame = frame + 1;
+	netplay.frame_time_us = now;
+
+	link_send_input(frame, netplay.remote_frame, input->presses, input->offset);
+}
+
+/**
+ * @brief Start the frames from now
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef netplay_init(void)
+{
+	for (int i = 0; i < NETPLAY_PLAYERS_COUNT; i++)
+		for (int j = 0; j < NETPLAY_HISTORY_SZ; j++)
+			netplay.inputs[i][j] = (TypeDef_Netplay_Input){0, 0};
+
+	// Nobody can press during the first frames, their inputs are known
+	netplay.frame = 0;
+	netplay.step = 0;
+	netplay.begun_frame = 0;
+	netplay.local_frame = NETPLAY_INPUT_DELAY;
+	netplay.remote_frame = NETPLAY_INPUT_DELAY;
+	netplay.remote_ack = NETPLAY_INPUT_DELAY;
+	netplay.rollback_frame = NETPLAY_NO_ROLLBACK;
+	netplay.resimulate_frame = 0;
+	netplay.stalled = 0;
+	netplay.input_player = 0;
+	netplay.input_press = 0;
+	netplay.pending_presses = 0;
+	netplay.stats = (TypeDef_Netplay_Stats){0};
+
+	netplay.start_tick = HAL_GetTick();
+	netplay.resend_tick = netplay.start_tick;
+	netplay.frame_time_us = capture_now_us();
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Local press, called from the interrupts
+ * @param _time_us Time of the press
+ */
+void netplay_local_press(uint32_t _time_us)
+{
+	if (netplay.pending_presses == 0)
+		netplay.pending_time_us = _time_us;
+
+	if (netplay.pending_presses < 255)
+		netplay.pending_presses++;
+}
+
+/**
+ * @brief Go back to the earliest frame stepped with a wrong prediction, between two frames only
+ * @retval 1 if the FSM was restored, the frames are then to be stepped again while
+ * netplay_is_resimulating returns 1
+ */
+uint8_t netplay_rollback(void)
+{
+	if (netplay.rollback_frame == NETPLAY_NO_ROLLBACK || netplay.step != 0)
+		return 0;
+
+	uint32_t depth = netplay.frame - netplay.rollback_frame;
+
+	pong_restore_snapshot(&netplay.snapshots[netplay.rollback_frame & (NETPLAY_HISTORY_SZ - 1)]);
+
+	if (netplay.resimulate_frame < netplay.frame)
+		netplay.resimulate_frame = netplay.frame;
+	netplay.frame = netplay.rollback_frame;
+	netplay.rollback_frame = NETPLAY_NO_ROLLBACK;
+
+	netplay.stats.rollbacks++;
+	if (depth > netplay.stats.rollback_max)
+		netplay.stats.rollback_max = depth;
+
+	return 1;
+}
+
+/**
+ * @brief Check if the next step can run. At the start of a frame, wait for the frame time and
+ * for the inputs of the other board, then send the local inputs and save the FSM.
+ * @retval 1 if the step can run
+ */
+uint8_t netplay_begin_step(void)
+{
+	if (netplay.step != 0)
+		return 1;
+
+	if (netplay_is_resimulating() == 0)
+	{
+		// Frames are paced by the HAL tick
+		if ((int32_t)(HAL_GetTick() - netplay.start_tick - netplay.frame * NETPLAY_FRAME_MS) < 0)
+			return 0;
+
+		// Too far ahead of the other board, its inputs may have been lost
+		if (netplay.frame >= netplay.remote_frame + NETPLAY_ROLLBACK_FRAMES)
+		{
+			if (netplay.stalled == 0)
+				netplay.stats.stalls++;
+			netplay.stalled = 1;
+
+			if (HAL_GetTick() - netplay.resend_tick >= NETPLAY_RESEND_MS)
+			{
+				netplay.resend_tick = HAL_GetTick();
+				netplay_resend();
+			}
+			return 0;
+		}
+
+		netplay.stalled = 0;
+		netplay.stats.frames++;
+		netplay_send_local();
+		netplay.begun_frame = netplay.frame + 1;
+	}
+
+	pong_save_snapshot(&netplay.snapshots[netplay.frame & (NETPLAY_HISTORY_SZ - 1)]);
+
+	return 1;
+}
+
+/**
+ * @brief Get the next press to give to the FSM, to be called in a loop at the start of each step.
+ * The presses of the other board not received yet are predicted as none.
+ * @param _btn_pin Filled with the pin of the press
+ * @param _time_us Filled with the time of the press
+ * @retval 1 if a press was returned, 0 when there is none left for this step
+ */
+uint8_t netplay_next_input(uint16_t *_btn_pin, uint32_t *_time_us)
+{
+	if (netplay.step != 0)
+		return 0;
+
+	while (netplay.input_player < NETPLAY_PLAYERS_COUNT)
+	{
+		TypeDef_Netplay_Input *input = netplay_input(netplay.input_player, netplay.frame);
+		uint8_t known = (netplay.input_player == NETPLAY_LOCAL) || (netplay.frame < netplay.remote_frame);
+
+		if (known && netplay.input_press < input->presses)
+		{
+			netplay.input_press++;
+
+			// Time of the press in the frame it was made in, the same on both boards
+			*_btn_pin = (netplay.input_player == NETPLAY_LOCAL) ? NETPLAY_LOCAL_BTN : NETPLAY_REMOTE_BTN;
+			*_time_us = (netplay.frame - NETPLAY_INPUT_DELAY - 1) * NETPLAY_FRAME_US + input->offset * NETPLAY_OFFSET_UNIT_US;
+			return 1;
+		}
+
+		netplay.input_player++;
+		netplay.input_press = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Count the step done
+ */
+void netplay_end_step(void)
+{
+	netplay.input_player = 0;
+	netplay.input_press = 0;
+
+	if (++netplay.step < NETPLAY_FRAME_STEPS)
+		return;
+
+	netplay.step = 0;
+	netplay.frame++;
+}
+
+/**
+ * @retval 1 while frames are stepped again after a rollback
+ */
+uint8_t netplay_is_resimulating(void) { return netplay.frame < netplay.resimulate_frame; }
+
+/**
+ * @retval Time of the current step in microseconds, the FSM clock
+ */
+uint32_t netplay_now_us(void)
+{
+	return netplay.frame * NETPLAY_FRAME_US + (netplay.step * NETPLAY_FRAME_US) / NETPLAY_FRAME_STEPS;
+}
+
+/**
+ * @retval Netplay statistics
+ */
+const TypeDef_Netplay_Stats *netplay_get_stats(void) { return &netplay.stats; }
+
+/**
+ * @brief Print the netplay statistics :
+ * netplay,frame,remote_frame,frames,stalls,rollbacks,rollback_max,resends
+ */
+void netplay_dump(void)
+{
+	TypeDef_Netplay_Stats *stats = &netplay.stats;
+
+	printf("netplay,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", netplay.frame, netplay.remote_frame, stats->frames,
+		   stats->stalls, stats->rollbacks, stats->rollback_max, stats->resends);
+}
+
+/**
+ * @brief Inputs of a frame received from the other board. They are taken in frame order only,
+ * a frame lost on the link is sent again while this board waits for it.
+ * @param _frame Frame of the inputs
+ * @param _ack Local inputs received by the other board, up to this frame excluded
+ * @param _presses Presses in the frame
+ * @param _offset Time of the first press from the start of the frame it was made in
+ */
+void link_input_callback(uint32_t _frame, uint32_t _ack, uint8_t _presses, uint8_t _offset)
+{
+	if (_ack > netplay.remote_ack)
+		netplay.remote_ack = _ack;
+
+	if (_frame != netplay.remote_frame)
+		return;
+
+	TypeDef_Netplay_Input *input = netplay_input(NETPLAY_REMOTE, _frame);
+
+	input->presses = _presses;
+	input->offset = _offset;
+	netplay.remote_frame++;
+
+	// The frame was stepped without this press
+	if (_presses != 0 && _frame < netplay.begun_frame && _frame < netplay.rollback_frame)
+		netplay.rollback_frame = _frame;
+}
@@ -0,0 +1,114 @@
+/*
+ * netplay.h
+ *
+ * Remote match, each player at their own board, both boards running the whole game. The FSM is
+ * stepped in frames of NETPLAY_FRAME_STEPS pong_run steps, one frame per NETPLAY_FRAME_MS, and only
+ * depends on the frame inputs : the presses of both players and the frame clock (netplay_now_us).
+ *
+ * Lockstep : a press is sent over the link with its time and given to the FSM of both boards
+ * NETPLAY_INPUT_DELAY frames later, the same delay for both players. A board waits for the inputs
+ * of the other one before stepping a frame.
+ * Rollback (NETPLAY_ROLLBACK_FRAMES > 0) : a board steps up to NETPLAY_ROLLBACK_FRAMES frames ahead
+ * of the inputs of the other one, predicting no press. The FSM is saved at the start of every frame,
+ * a press received for a frame already stepped restores its snapshot and the frames are stepped
+ * again up to the current one. Sounds, statistics and persistence are muted while stepping again.
+ */
+
+#ifndef PONG_NETPLAY_H_
+#define PONG_NETPLAY_H_
+
+#include "pong.h"
+#include "pong_config.h"
+
+// Set to 1 for a remote match between two linked boards
+#ifndef NETPLAY_ENABLE
+#define NETPLAY_ENABLE 0
+#endif
+
+// Frames stepped ahead of the inputs of the other board, 0 for a strict lockstep
+#ifndef NETPLAY_ROLLBACK_FRAMES
+#define NETPLAY_ROLLBACK_FRAMES 8
+#endif
+
+#if NETPLAY_ENABLE && !LINK_ENABLE
+#error "the netplay runs over the link, set LINK_ENABLE"
+#endif
+
+#define NETPLAY_FRAME_MS 1				// Duration of a frame
+#define NETPLAY_FRAME_US 1000
+#define NETPLAY_FRAME_STEPS 200			// pong_run steps per frame, close to the free running rate
+#define NETPLAY_INPUT_DELAY 2			// Frames between a press and the frame it is given to the FSM at
+#define NETPLAY_OFFSET_UNIT_US 4		// Unit of the press time inside its frame, 255 units cover a frame
+#define NETPLAY_RESEND_MS 10			// Period of the inputs resend while waiting for the other board
+#define NETPLAY_NO_ROLLBACK 0xFFFFFFFF
+
+// Button of the player of this board, the left board is the one of P2
+#define NETPLAY_LOCAL_BTN ((LINK_ROLE == LINK_ROLE_LEFT) ? BTN2_Pin : BTN1_Pin)
+#define NETPLAY_REMOTE_BTN ((LINK_ROLE == LINK_ROLE_LEFT) ? BTN1_Pin : BTN2_Pin)
+
+#if NETPLAY_ENABLE
+#define NETPLAY_EFFECT(_call) do { if (netplay_is_resimulating() == 0) { _call; } } while (0)
+#else
+#define NETPLAY_EFFECT(_call) _call
+#endif
+
+typedef enum
+{
+	NETPLAY_LOCAL = 0,
+	NETPLAY_REMOTE = 1,
+	NETPLAY_PLAYERS_COUNT,
+} NETPLAY_Player_Enum;
+
+/**
+ * @brief Inputs of a player in a frame
+ */
+typedef struct
+{
+	uint8_t presses; // Number of presses
+	uint8_t offset;	 // Time of the first press from the start of the frame it was made in, in NETPLAY_OFFSET_UNIT_US
+} TypeDef_Netplay_Input;
+
+typedef struct
+{
+	uint32_t frames;		// Frames stepped, the frames stepped again are not counted
+	uint32_t stalls;		// Frames delayed waiting for the inputs of the other board
+	uint32_t rollbacks;		// Number of rollbacks
+	uint32_t rollback_max;	// Most frames stepped again by a rollback
+	uint32_t resends;		// Inputs sent again
+} TypeDef_Netplay_Stats;
+
+typedef struct
+{
+	uint32_t frame;				// Frame being stepped
+	uint32_t step;				// Step in the frame
+	uint32_t start_tick;		// HAL tick of the start of frame 0
+	uint32_t begun_frame;		// Frames whose inputs were given to the FSM, up to this one excluded
+	uint32_t local_frame;		// Local inputs known up to this frame excluded
+	uint32_t remote_frame;		// Inputs of the other board known up to this frame excluded
+	uint32_t remote_ack;		// Local inputs received by the other board up to this frame excluded
+	uint32_t rollback_frame;	// Earliest frame stepped with a wrong prediction, NETPLAY_NO_ROLLBACK if none
+	uint32_t resimulate_frame;	// Frame up to which the frames are stepped again
+	uint32_t resend_tick;		// HAL tick of the last resend
+	uint32_t frame_time_us;		// Time of the start of the current frame
+	uint8_t stalled;			// The current frame waits for the other board
+	uint8_t input_player;		// Player of the next input given at the start of the frame
+	uint8_t input_press;		// Presses of input_player already given
+	volatile uint8_t pending_presses;	// Local presses since the start of the frame
+	volatile uint32_t pending_time_us;	// Time of the first of them
+	TypeDef_Netplay_Input inputs[NETPLAY_PLAYERS_COUNT][NETPLAY_HISTORY_SZ];
+	FSM_Snapshot_TypeDef snapshots[NETPLAY_HISTORY_SZ];
+	TypeDef_Netplay_Stats stats;
+} TypeDef_Netplay;
+
+HAL_StatusTypeDef netplay_init(void);
+void netplay_local_press(uint32_t _time_us);
+uint8_t netplay_rollback(void);
+uint8_t netplay_begin_step(void);
+uint8_t netplay_next_input(uint16_t *_btn_pin, uint32_t *_time_us);
+void netplay_end_step(void);
+uint8_t netplay_is_resimulating(void);
+uint32_t netplay_now_us(void);
+const TypeDef_Netplay_Stats *netplay_get_stats(void);
+void netplay_dump(void);
+
+#endif /* PONG_NETPLAY_H_ */
@@ -1,4 +1,6 @@
 #include "pong.h"
+#include "bot.h"
+#include "netplay.h"
 
 // Stores hardware peripherals
 static Pong_Handle_TypeDef *pong_handle = NULL;
@@ -19,8 +21,78 @@ static FSM_State_TypeDef states_list[] = {
 	{STATE_IP2S, &state_ip2s},
 	{STATE_P1WN, &state_p1wn},
 	{STATE_P2WN, &state_p2wn},
+	{STATE_AWAY, &state_away},
 };
 
+// States names, used to dump the accounting
+static const char *states_names[STATES_COUNT] = {
+	"START", "WPP1", "WPP2", "GTP1", "GTP2", "RPP1",
+	"RPP2", "IP1S", "IP2S", "P1WN", "P2WN", "AWAY",
+};
+
+#if PONG_STATS_ENABLE
+// CPU accounting of each state
+static FSM_State_Stats_TypeDef states_stats[STATES_COUNT];
+
+// HAL tick at which the current state started to be accounted
+static uint32_t stats_state_start_time = 0;
+
+// Set once the first state has been entered
+static uint8_t stats_running = 0;
+#endif
+
+// Number of pong_run executions, the time base of the record and replay. Counted in every build,
+// it must stay out of the PONG_STATS_ENABLE block
+static uint32_t run_iteration = 0;
+
+#if LINK_ENABLE
+// Button of the player of this board, the left board is the one of P2
+#define LINK_LOCAL_BTN ((LINK_ROLE == LINK_ROLE_LEFT) ? BTN2_Pin : BTN1_Pin)
+#endif
+
+// The two linked boards make one field, in a remote match each board runs the whole field
+#define PONG_LINKED_FIELD (LINK_ENABLE && !NETPLAY_ENABLE)
+
+// The link baud rate needs the full clock
+#define PONG_CLOCK_POLICY (CLOCK_POLICY_ENABLE && !LINK_ENABLE)
+
+// A linked board must keep answering the other one
+#define PONG_DEEP_IDLE (POWER_DEEP_IDLE_ENABLE && !LINK_ENABLE)
+
+#if PONG_DEEP_IDLE
+// HAL tick of the last press or transition
+static volatile uint32_t activity_tick = 0;
+#endif
+
+/**
+ * @brief States in which the FSM only waits for a player
+ * @param _state State to check
+ * @retval 1 if the state is idle
+ */
+static uint8_t is_idle_state(FSM_State_Enum _state)
+{
+	return (_state == STATE_WPP1) || (_state == STATE_WPP2) || (_state == STATE_P1WN) || (_state == STATE_P2WN);
+}
+
+/**
+ * @brief Publish the game state to the telemetry stream
+ * @param _kind TELEMETRY_TRANSITION or TELEMETRY_BALL
+ */
+static void publish_telemetry(TELEMETRY_Kind_Enum _kind)
+{
+	TypeDef_Telemetry_Record record;
+
+	record.kind = _kind;
+	record.state = fsm_handle->state.state;
+	record.led_index = fsm_handle->controllers.led_index;
+	record.pass_count = (fsm_handle->controllers.pass_count > 255) ? 255 : fsm_handle->controllers.pass_count;
+	record.p1_score = fsm_handle->controllers.p1_score;
+	record.p2_score = fsm_handle->controllers.p2_score;
+	record.reaction_time_us = fsm_handle->controllers.reaction_time_us;
+
+	NETPLAY_EFFECT(TELEMETRY_PUBLISH(&record));
+}
+
 /**
  * @brief Set new FSM state
  * @param _new_state Enum member representing desired state.
@@ -31,9 +103,29 @@ static void set_new_state(FSM_State_Enum _new_state)
 	// Check if desired state is contained in states array
 	if ((_new_state >= 0) && (_new_state < fsm_handle->states_list_sz))
 	{
+		// Trace the transition
+		TRACE_TRANSITION(fsm_handle->state.state, _new_state,
+						 fsm_handle->inputs.nb_press_btn1, fsm_handle->inputs.nb_press_btn2,
+						 fsm_handle->controllers.pass_count);
+		REPLAY_OBSERVE(REPLAY_OBSERVE_TRANSITION, fsm_handle->state.state, _new_state);
+
+#if PONG_STATS_ENABLE
+		// Account the time spent in the state being left
+		if (stats_running)
+			states_stats[fsm_handle->state.state].time_ms += HAL_GetTick() - stats_state_start_time;
+		stats_state_start_time = HAL_GetTick();
+		stats_running = 1;
+		states_stats[_new_state].entries++;
+#endif
+
 		// Set new FSM state UID & callback
 		fsm_handle->state = fsm_handle->states_list[_new_state];
 
+#if PONG_CLOCK_POLICY
+		// Low clock while waiting for a player, full speed for the rally
+		clock_set_mode(is_idle_state(_new_state) ? CLOCK_SLOW : CLOCK_FAST);
+#endif
+
 		// Reset execution count for variables initializations
 		fsm_handle->controllers.state_execution_count = 0;
 
@@ -47,11 +139,166 @@ static void set_new_state(FSM_State_Enum _new_state)
 		fsm_handle->inputs.nb_press_btn1 = 0;
 		fsm_handle->inputs.nb_press_btn2 = 0;
 
-		//stop the timer loop
-		stop_timer();
+		//stop the display blinker of the previous state, the music keeps playing
+		stop_interrupt_launcher(SEGMENT);
+
+#if PONG_DEEP_IDLE
+		activity_tick = HAL_GetTick();
+#endif
+
+		publish_telemetry(TELEMETRY_TRANSITION);
 	}
 }
 
+/**
+ * @brief Set new FSM state after a local event, the other board of a linked field
+ * enters it too with the same scores
+ * @param _new_state Enum member representing desired state.
+ */
+static void set_new_state_linked(FSM_State_Enum _new_state)
+{
+#if PONG_LINKED_FIELD
+	link_send_sync(_new_state, fsm_handle->controllers.p1_score, fsm_handle->controllers.p2_score);
+#endif
+	set_new_state(_new_state);
+}
+
+/**
+ * @brief Give a button press to the FSM
+ * @param _btn_pin BTN1_Pin or BTN2_Pin
+ * @param _time_us Press time in microseconds
+ */
+static void pong_apply_press(uint16_t _btn_pin, uint32_t _time_us) {
+
+	//check the button pushed
+	if (_btn_pin == BTN1_Pin) {
+
+		//keep the time of the first press of the state
+		if (fsm_handle->inputs.nb_press_btn1 == 0)
+			fsm_handle->inputs.btn1_press_time_us = _time_us;
+
+		//increment the push_nb of this button
+		fsm_handle->inputs.nb_press_btn1++;
+	}
+	else if (_btn_pin == BTN2_Pin) {
+
+		//keep the time of the first press of the state
+		if (fsm_handle->inputs.nb_press_btn2 == 0)
+			fsm_handle->inputs.btn2_press_time_us = _time_us;
+
+		//increment the push_nb of this button
+		fsm_handle->inputs.nb_press_btn2++;
+	}
+}
+
+/**
+ * @brief Read the microsecond clock, through the record and replay : the ball arrival, the
+ * reaction times it gives are shown on the display
+ * @retval Time in microseconds
+ */
+static uint32_t pong_now_us(void)
+{
+#if NETPLAY_ENABLE
+	return netplay_now_us();
+#else
+	return REPLAY_CLOCK(run_iteration, capture_now_us());
+#endif
+}
+
+/**
+ * @brief Read the microsecond clock for the statistics, the telemetry and the bots, not recorded :
+ * the outputs of the FSM must not depend on it
+ * @retval Time in microseconds
+ */
+static uint32_t pong_stamp_us(void)
+{
+#if NETPLAY_ENABLE
+	return netplay_now_us();
+#else
+	return capture_now_us();
+#endif
+}
+
+/**
+ * @brief LED shift period of the ball at the current pass
+ * @retval Period in iterations, never below LED_SHIFT_MIN
+ */
+static uint32_t led_shift_period(void)
+{
+	uint32_t pass_count = fsm_handle->controllers.pass_count;
+
+	if (pass_count >= (LED_SHIFT_START - LED_SHIFT_MIN) / LED_SHIFT_STEP)
+		return LED_SHIFT_MIN;
+
+	return LED_SHIFT_START - pass_count * LED_SHIFT_STEP;
+}
+
+/**
+ * @brief Stamp a LED shift of the ball, to estimate its arrival time
+ */
+static void stamp_ball_step(void)
+{
+	uint32_t now = pong_stamp_us();
+
+	fsm_handle->controllers.ball_step_period_us = now - fsm_handle->controllers.ball_step_time_us;
+	fsm_handle->controllers.ball_step_time_us = now;
+
+	publish_telemetry(TELEMETRY_BALL);
+}
+
+/**
+ * @brief Record how early a player pressed before the ball would have reached his border
+ * @param _player Player who pressed
+ * @param _press_time_us Time of the press
+ * @param _remaining_shifts LED shifts left before the ball reaches the border
+ */
+static void record_early_press(STATS_Player_Enum _player, uint32_t _press_time_us, int32_t _remaining_shifts)
+{
+	// The speed of the ball is unknown before its first shift
+	if (fsm_handle->controllers.ball_step_period_us == 0 || _remaining_shifts <= 0)
+		return;
+
+	uint32_t arrival_time_us = fsm_handle->controllers.ball_step_time_us + _remaining_shifts * fsm_handle->controllers.ball_step_period_us;
+	int32_t margin_us = (int32_t)(arrival_time_us - _press_time_us);
+
+	if (margin_us > 0)
+		NETPLAY_EFFECT(stats_record(_player, STATS_EARLY_MARGIN, margin_us));
+}
+
+/**
+ * @brief Reaction time of a return : from the ball arrival to the press
+ * @param _press_time_us Time of the press
+ * @retval Reaction time, 0 for a press stamped before the arrival (the edge of a debounced press,
+ * a netplay press rebuilt from its frame)
+ */
+static uint32_t reaction_time(uint32_t _press_time_us)
+{
+	int32_t reaction_us = (int32_t)(_press_time_us - fsm_handle->controllers.ball_arrival_time_us);
+
+	return (reaction_us > 0) ? (uint32_t)reaction_us : 0;
+}
+
+/**
+ * @brief Display the mean reaction time of the match of a player : "r" followed by milliseconds,
+ * nothing after the "r" before his first return
+ * @param _player Player to display
+ */
+static void display_reaction_stats(STATS_Player_Enum _player)
+{
+	static char message[MAX_DIGITS_COUNT + 1];
+	const TypeDef_Stats_Accumulator *reaction = stats_get(_player, STATS_REACTION, STATS_MATCH);
+
+	if (reaction->count == 0)
+		snprintf(message, sizeof(message), "r   ");
+	else
+	{
+		uint32_t mean_ms = (uint32_t)reaction->mean_us / 1000;
+		snprintf(message, sizeof(message), "r%3lu", (mean_ms > 999) ? 999 : mean_ms);
+	}
+
+	display_on_7segments(message);
+}
+
 /**
  * @brief Initialize pong game
  * @param _pong_handle Handle to pong peripherals
@@ -64,6 +311,13 @@ HAL_StatusTypeDef pong_init(Pong_Handle_TypeDef *_pong_handle, FSM_Handle_TypeDe
 	HAL_StatusTypeDef led_arrray_status = HAL_OK;
 	HAL_StatusTypeDef music_status = HAL_OK;
 	HAL_StatusTypeDef timer_status = HAL_OK;
+	HAL_StatusTypeDef capture_status = HAL_OK;
+	HAL_StatusTypeDef debounce_status = HAL_OK;
+	HAL_StatusTypeDef stats_status = HAL_OK;
+	HAL_StatusTypeDef bot_status = HAL_OK;
+	HAL_StatusTypeDef store_status = HAL_OK;
+	HAL_StatusTypeDef link_status = HAL_OK;
+	HAL_StatusTypeDef netplay_status = HAL_OK;
 
 	/* Attribute input parameters */
 	pong_handle = _pong_handle;
@@ -82,6 +336,24 @@ HAL_StatusTypeDef pong_init(Pong_Handle_TypeDef *_pong_handle, FSM_Handle_TypeDe
 
 	timer_status = timer_init(&pong_handle->timer_handler);
 
+	capture_status = capture_init(&pong_handle->capture_handler);
+
+	debounce_status = debounce_init(&pong_handle->debounce_handler);
+
+	stats_status = stats_init();
+
+	bot_status = bot_init();
+
+	store_status = store_init();
+
+#if LINK_ENABLE
+	link_status = link_init();
+#endif
+
+#if NETPLAY_ENABLE
+	netplay_status = netplay_init();
+#endif
+
 	/* CHECK HARDWARE INIT BEGIN  ----------------------------------------------------------------------------------*/
 
 	if (max7219_status != HAL_OK)
@@ -96,6 +368,27 @@ HAL_StatusTypeDef pong_init(Pong_Handle_TypeDef *_pong_handle, FSM_Handle_TypeDe
 	else if(timer_status != HAL_OK)
 			return timer_status;
 
+	else if(capture_status != HAL_OK)
+			return capture_status;
+
+	else if(debounce_status != HAL_OK)
+			return debounce_status;
+
+	else if(stats_status != HAL_OK)
+			return stats_status;
+
+	else if(bot_status != HAL_OK)
+			return bot_status;
+
+	else if(store_status != HAL_OK)
+			return store_status;
+
+	else if(link_status != HAL_OK)
+			return link_status;
+
+	else if(netplay_status != HAL_OK)
+			return netplay_status;
+
 	/* CHECK HARDWARE INIT END  ----------------------------------------------------------------------------------*/
 
 	/* Init FSM */
@@ -108,19 +401,57 @@ HAL_StatusTypeDef pong_init(Pong_Handle_TypeDef *_pong_handle, FSM_Handle_TypeDe
 }
 
 /**
- * @brief Run pong game, execute FSM callback and check for transition
- * @retval HAL status
+ * @brief Step the FSM : give the inputs, execute FSM callback and check for transition
  */
-HAL_StatusTypeDef pong_run(void)
+static void pong_step(void)
 {
-	CHECK_PONG_PARAMS();
+#if NETPLAY_ENABLE
+	/* INPUTS */
+	uint16_t btn_pin;
+	uint32_t btn_time_us;
+
+	// Presses of both boards are given at the start of their frame
+	while (netplay_next_input(&btn_pin, &btn_time_us))
+		pong_apply_press(btn_pin, btn_time_us);
+#elif REPLAY_ENABLE
+	/* INPUTS */
+	uint16_t btn_pin;
+	uint32_t btn_time_us;
+
+	// Presses are given to the FSM between two iterations only, recorded or replayed
+	while (replay_next(run_iteration, &btn_pin, &btn_time_us))
+		pong_apply_press(btn_pin, btn_time_us);
+#endif
 
 	/* RUN STATE */
+#if PONG_STATS_ENABLE
+	FSM_State_Stats_TypeDef *stats = &states_stats[fsm_handle->state.state];
+	uint32_t start = DWT->CYCCNT;
+#endif
+
 	// Call associated callback
 	fsm_handle->state.state_callback();
 
+#if PONG_STATS_ENABLE
+	// Account the callback execution
+	uint32_t cycles = DWT->CYCCNT - start;
+	stats->steps++;
+	stats->total_cycles += cycles;
+	if (cycles > stats->max_cycles)
+		stats->max_cycles = cycles;
+#endif
+
 	// Increase execution count
 	fsm_handle->controllers.state_execution_count += 1;
+	run_iteration++;
+#if NETPLAY_ENABLE
+	netplay_end_step();
+#endif
+
+	/* PERSISTENCE */
+	// The data EEPROM is written while waiting for a player only, never during a rally
+	if (store_is_pending() && is_idle_state(fsm_handle->state.state))
+		NETPLAY_EFFECT(store_flush());
 
 	/* CHECK TRANSITION */
 	switch (fsm_handle->state.state)
@@ -156,11 +487,21 @@ HAL_StatusTypeDef pong_run(void)
 	case STATE_GTP1:
 
 		//change state if player 2 push the button before the led went tho the right border
-		if (fsm_handle->inputs.nb_press_btn1 >=1 && fsm_handle->controllers.led_index < 7)
-			set_new_state(STATE_IP2S);
+		if (fsm_handle->inputs.nb_press_btn1 >=1 && fsm_handle->controllers.led_index < 7) {
+			record_early_press(STATS_P1, fsm_handle->inputs.btn1_press_time_us, 8 - fsm_handle->controllers.led_index);
+			set_new_state_linked(STATE_IP2S);
+		}
+#if PONG_LINKED_FIELD && (LINK_ROLE == LINK_ROLE_LEFT)
+		//hand the ball off to the board of P1 one shift after the LED 7
+		else if (fsm_handle->controllers.led_index > 8) {
+			link_send_ball(LINK_TOWARD_P1, fsm_handle->controllers.pass_count);
+			set_new_state(STATE_AWAY);
+		}
+#else
 		//change state if led touch the right border
 		else if (fsm_handle->controllers.led_index > 7)
 			set_new_state(STATE_RPP1);
+#endif
 
 		break;
 
@@ -168,11 +509,21 @@ HAL_StatusTypeDef pong_run(void)
 	case STATE_GTP2:
 
 		//change state if player 2 push the button before the led went tho the right border
-		if (fsm_handle->inputs.nb_press_btn2 >=1 && fsm_handle->controllers.led_index > 0)
-			set_new_state(STATE_IP1S);
+		if (fsm_handle->inputs.nb_press_btn2 >=1 && fsm_handle->controllers.led_index > 0) {
+			record_early_press(STATS_P2, fsm_handle->inputs.btn2_press_time_us, fsm_handle->controllers.led_index + 1);
+			set_new_state_linked(STATE_IP1S);
+		}
+#if PONG_LINKED_FIELD && (LINK_ROLE == LINK_ROLE_RIGHT)
+		//hand the ball off to the board of P2 one shift after the LED 0
+		else if (fsm_handle->controllers.led_index < -1) {
+			link_send_ball(LINK_TOWARD_P2, fsm_handle->controllers.pass_count);
+			set_new_state(STATE_AWAY);
+		}
+#else
 		//change state if led touch the right border
 		else if (fsm_handle->controllers.led_index < 0)
 			set_new_state(STATE_RPP2);
+#endif
 
 		break;
 
@@ -181,10 +532,15 @@ HAL_StatusTypeDef pong_run(void)
 		//wait the led_shift_period before to test if the player pushed the button
 		if (fsm_handle->controllers.state_execution_count == fsm_handle->controllers.led_shift_period) {
 			//check if the player pushed his button
-			if (fsm_handle->inputs.nb_press_btn1 >= 1)
+			if (fsm_handle->inputs.nb_press_btn1 >= 1) {
+				fsm_handle->controllers.reaction_time_us = reaction_time(fsm_handle->inputs.btn1_press_time_us);
+				NETPLAY_EFFECT(stats_record(STATS_P1, STATS_REACTION, fsm_handle->controllers.reaction_time_us));
 				set_new_state(STATE_GTP2);
-			else
-				set_new_state(STATE_IP2S);
+			}
+			else {
+				NETPLAY_EFFECT(play_sfx(MISS));
+				set_new_state_linked(STATE_IP2S);
+			}
 		}
 		break;
 
@@ -193,10 +549,15 @@ HAL_StatusTypeDef pong_run(void)
 		//wait the led_shift_period before to test if the player pushed the button
 		if (fsm_handle->controllers.state_execution_count == fsm_handle->controllers.led_shift_period) {
 			//check if the player pushed his button
-			if (fsm_handle->inputs.nb_press_btn2 >= 1)
+			if (fsm_handle->inputs.nb_press_btn2 >= 1) {
+				fsm_handle->controllers.reaction_time_us = reaction_time(fsm_handle->inputs.btn2_press_time_us);
+				NETPLAY_EFFECT(stats_record(STATS_P2, STATS_REACTION, fsm_handle->controllers.reaction_time_us));
 				set_new_state(STATE_GTP1);
-			else
-				set_new_state(STATE_IP1S);
+			}
+			else {
+				NETPLAY_EFFECT(play_sfx(MISS));
+				set_new_state_linked(STATE_IP1S);
+			}
 		}
 		break;
 
@@ -233,7 +594,7 @@ HAL_StatusTypeDef pong_run(void)
 
 		//wait until any button is pressed
 		if (fsm_handle->inputs.nb_press_btn1 >= 1 || fsm_handle->inputs.nb_press_btn2 >= 1)
-			set_new_state(STATE_WPP2);
+			set_new_state_linked(STATE_WPP2);
 
 		break;
 
@@ -242,36 +603,218 @@ HAL_StatusTypeDef pong_run(void)
 
 		//wait until any button is pressed
 		if (fsm_handle->inputs.nb_press_btn1 >= 1 || fsm_handle->inputs.nb_press_btn2 >= 1)
-			set_new_state(STATE_WPP1);
+			set_new_state_linked(STATE_WPP1);
+
+		break;
+
+	/* "Ball on the other board" state */
+	case STATE_AWAY:
 
+		//left by the ball coming back or by a point, both received from the other board
 		break;
 
 	default:
 		set_new_state(STATE_START);
 		break;
 	}
+}
+
+#if PONG_DEEP_IDLE
+/**
+ * @brief Blank the display and the LEDs and stop until a press or the RTC wakeup,
+ * the game goes on from where it was
+ */
+static void pong_deep_idle(void)
+{
+	// The data EEPROM is written first, and a replay runs without the buttons
+	if (store_is_pending() || replay_get_mode() == REPLAY_PLAYBACK)
+		return;
+
+	max7219_set_shutdown(1);
+	led_array_blank(1);
+
+	power_stop();
+
+	led_array_blank(0);
+	max7219_set_shutdown(0);
+
+	activity_tick = HAL_GetTick();
+}
+#endif
+
+/**
+ * @brief Run pong game, one FSM step
+ * @retval HAL status
+ */
+HAL_StatusTypeDef pong_run(void)
+{
+	CHECK_PONG_PARAMS();
+
+#if BOT_ENABLE
+	/* BOTS */
+	bot_step(fsm_handle);
+#endif
+
+#if LINK_ENABLE
+	/* LINK */
+	// Frames of the other board are handled between two iterations only
+	link_poll();
+#endif
+
+#if NETPLAY_ENABLE
+	/* NETPLAY */
+	// A press of the other board came too late : step again from its frame up to the current one
+	// The link is polled at each step : a full rollback outlasts the RX buffer
+	if (netplay_rollback())
+		while (netplay_is_resimulating() && netplay_begin_step())
+		{
+			link_poll();
+			pong_step();
+		}
+
+	// Wait for the frame time and for the inputs of the other board
+	if (netplay_begin_step() == 0)
+		return HAL_OK;
+#endif
+
+#if PONG_DEEP_IDLE
+	/* DEEP IDLE */
+	// Nobody played for POWER_IDLE_TIMEOUT_MS
+	if (is_idle_state(fsm_handle->state.state) && HAL_GetTick() - activity_tick >= POWER_IDLE_TIMEOUT_MS)
+		pong_deep_idle();
+#endif
+
+	pong_step();
+
+#if PONG_DEEP_IDLE
+	// Wake latency, up to the first step
+	power_frame_done();
+#endif
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Save the whole game state
+ * @param _snapshot Filled with the game state
+ */
+void pong_save_snapshot(FSM_Snapshot_TypeDef *_snapshot)
+{
+	_snapshot->state = fsm_handle->state;
+	_snapshot->inputs = fsm_handle->inputs;
+	_snapshot->controllers = fsm_handle->controllers;
+}
+
+/**
+ * @brief Restore a game state, the outputs are updated by the next steps
+ * @param _snapshot Game state saved by pong_save_snapshot
+ */
+void pong_restore_snapshot(const FSM_Snapshot_TypeDef *_snapshot)
+{
+	fsm_handle->state = _snapshot->state;
+	fsm_handle->inputs = _snapshot->inputs;
+	fsm_handle->controllers = _snapshot->controllers;
+}
+
+/**
+ * @brief Get the CPU accounting of a state
+ * @param _state State to query
+ * @param _stats Filled with the state accounting. The time spent in the
+ * current state is included up to now.
+ * @retval HAL status
+ */
+HAL_StatusTypeDef pong_get_state_stats(FSM_State_Enum _state, FSM_State_Stats_TypeDef *_stats)
+{
+	CHECK_PONG_PARAMS();
+
+#if PONG_STATS_ENABLE
+	if ((_state < 0) || (_state >= STATES_COUNT) || (_stats == NULL))
+		return HAL_ERROR;
+
+	*_stats = states_stats[_state];
+
+	if (fsm_handle->state.state == _state)
+		_stats->time_ms += HAL_GetTick() - stats_state_start_time;
 
 	return HAL_OK;
+#else
+	return HAL_ERROR;
+#endif
+}
+
+/**
+ * @brief Clear the CPU accounting of every state
+ */
+void pong_reset_state_stats(void)
+{
+#if PONG_STATS_ENABLE
+	for (int i = 0; i < STATES_COUNT; i++)
+	{
+		states_stats[i].entries = 0;
+		states_stats[i].steps = 0;
+		states_stats[i].total_cycles = 0;
+		states_stats[i].max_cycles = 0;
+		states_stats[i].time_ms = 0;
+	}
+
+	// The current state is accounted from now
+	stats_state_start_time = HAL_GetTick();
+#endif
+}
+
+/**
+ * @param _state State
+ * @retval Short name of the state, "?" if out of range
+ */
+const char *pong_state_name(FSM_State_Enum _state)
+{
+	if ((_state < 0) || (_state >= STATES_COUNT))
+		return "?";
+
+	return states_names[_state];
+}
+
+/**
+ * @brief Print the CPU accounting of every state, one line per state :
+ * state,entries,steps,total_cycles,max_cycles,time_ms
+ * Each line is sent before the next one, as the table follows the rest of the match end dump.
+ */
+void pong_dump_state_stats(void)
+{
+#if PONG_STATS_ENABLE
+	FSM_State_Stats_TypeDef stats;
+
+	printf("state,entries,steps,total_cycles,max_cycles,time_ms\n");
+	log_flush();
+
+	for (int i = 0; i < STATES_COUNT; i++)
+	{
+		if (pong_get_state_stats(i, &stats) != HAL_OK)
+			return;
+
+		printf("%s,%lu,%lu,%llu,%lu,%lu\n", states_names[i], stats.entries, stats.steps,
+			   stats.total_cycles, stats.max_cycles, stats.time_ms);
+		log_flush();
+	}
+#endif
 }
 
 void state_start(void)
 {
 	/* INIT BEGIN  ----------------------------------------------------------------------------------*/
 
-	//init variable declaration
-	static uint32_t buffer7, cnt;
-
 	//init functions of the state
 	if (fsm_handle->controllers.state_execution_count == 0) {
 
 		//clean the 7segments
 		max7219_erase_no_decode();
 
-		//init the timer buffer7
-		buffer7 = fsm_handle->controllers.state_execution_count;
+		//init the timer buffer of the animation
+		fsm_handle->controllers.animation_buffer = fsm_handle->controllers.state_execution_count;
 
 		//init temp counter of the animation
-		cnt = 0;
+		fsm_handle->controllers.animation_step = 0;
+		fsm_handle->controllers.display_state = 0;
 
 		//reset scores
 		fsm_handle->controllers.p1_score = 0;
@@ -281,10 +824,9 @@ void state_start(void)
 		fsm_handle->controllers.pass_count = 0;
 
 		//set music
-		set_music(PACMAN);
+		NETPLAY_EFFECT(set_music(PACMAN));
 		//set_7segment(" P1 ", 1);
 
-		set_interrupt_launcher(MUSIC);
 		start_timer();
 	}
 
@@ -304,31 +846,30 @@ void state_start(void)
 		/* 7SEGMENT BEGIN  ----------------------------------------------------------------------------------*/
 
 		//check if the last animation update happened over than 20000 cycles
-		if (fsm_handle->controllers.state_execution_count-buffer7>80000) {
+		if (fsm_handle->controllers.state_execution_count-fsm_handle->controllers.animation_buffer>80000) {
 
 			//display the message with alternating between nothing and the display
-			static uint8_t display_state = 0;
 
 			/* Checking if the counter is equal to 6. If it is, it sets the animation state to ANIMATION_ENDED. */
-			if (cnt == 6) {
+			if (fsm_handle->controllers.animation_step == 6) {
 				fsm_handle->controllers.animation_state = ANIMATION_ENDED;
 			}
 
 
 			/* Displaying the word "HOLA" on the 7-segment display. */
-			if (display_state == 0) {
+			if (fsm_handle->controllers.display_state == 0) {
 				display_on_7segments("HOLA");
-				display_state=1;
-				cnt++;
+				fsm_handle->controllers.display_state=1;
+				fsm_handle->controllers.animation_step++;
 			}
 			else {
 				max7219_erase_no_decode();
-				display_state=0;
+				fsm_handle->controllers.display_state=0;
 			}
 
 
-			//the buffer7 is actualised
-			buffer7=fsm_handle->controllers.state_execution_count;
+			//the animation buffer is actualised
+			fsm_handle->controllers.animation_buffer=fsm_handle->controllers.state_execution_count;
 		}
 
 		/* 7SEGMENT END  ----------------------------------------------------------------------------------*/
@@ -398,34 +939,43 @@ void state_gtp1(void)
 {
 	/* INIT BEGIN  ----------------------------------------------------------------------------------*/
 
-		//init variables
-		static uint32_t bufferL;
-
 		//init functions of the state
 		if (fsm_handle->controllers.state_execution_count == 0) {
 
 			//clean the 7segments
 			max7219_erase_no_decode();
 
-			//init the timer bufferof the leds
-			bufferL = fsm_handle->controllers.state_execution_count;
+			//init the timer buffer of the leds
+			fsm_handle->controllers.animation_buffer = fsm_handle->controllers.state_execution_count;
 
 			//clear the leds
 			clear_array();
-			write_array(1, 1);
 
 			//set the led shift period to a variable which increase on each pass
-			fsm_handle->controllers.led_shift_period = 80000 - (fsm_handle->controllers.pass_count * 5000);
+			fsm_handle->controllers.led_shift_period = led_shift_period();
+
+			if (fsm_handle->controllers.ball_from_link) {
+				//the ball enters from the board of P2 on the left border
+				write_array(0, 1);
+				fsm_handle->controllers.led_index = 1;
+			}
+			else {
+				write_array(1, 1);
+
+				//set the start led on the right border
+				fsm_handle->controllers.led_index = 2;
+
+				//play the paddle sound effect over the music
+				NETPLAY_EFFECT(play_sfx(P1_REFLEXE));
+			}
+			fsm_handle->controllers.ball_from_link = 0;
 
-			//set the start led on the right border
-			fsm_handle->controllers.led_index = 2;
+			//the ball starts now, its speed is unknown until the first shift
+			fsm_handle->controllers.ball_step_time_us = pong_stamp_us();
+			fsm_handle->controllers.ball_step_period_us = 0;
 
-			/*
-			//set music and start the timer
-			set_music(P1_REFLEXE);
-			set_interrupt_launcher(MUSIC);
+			//start the timer
 			start_timer();
-*/
 		}
 
 		/* INIT END  ----------------------------------------------------------------------------------*/
@@ -438,14 +988,15 @@ void state_gtp1(void)
 			/* LED BEGIN  ----------------------------------------------------------------------------------*/
 
 			//check if the last animation update happened over than a certain amount of cycles
-			if (fsm_handle->controllers.state_execution_count-bufferL > fsm_handle->controllers.led_shift_period) {
+			if (fsm_handle->controllers.state_execution_count-fsm_handle->controllers.animation_buffer > fsm_handle->controllers.led_shift_period) {
 
 				/* Incrementing the led_index by 1. */
 				clear_array();
 				write_array(fsm_handle->controllers.led_index, 1);
 				fsm_handle->controllers.led_index++;
 
-				bufferL=fsm_handle->controllers.state_execution_count;
+				fsm_handle->controllers.animation_buffer=fsm_handle->controllers.state_execution_count;
+				stamp_ball_step();
 			}
 
 			/* LED END  ----------------------------------------------------------------------------------*/
@@ -460,34 +1011,43 @@ void state_gtp2(void)
 
 	/* INIT BEGIN  ----------------------------------------------------------------------------------*/
 
-	//init variables
-	static uint32_t bufferL;
-
 	//init functions of the state
 	if (fsm_handle->controllers.state_execution_count == 0) {
 
 		//clean the 7segments
 		max7219_erase_no_decode();
 
-		//reinit the timer bufferof the leds
-		bufferL = fsm_handle->controllers.state_execution_count;
+		//reinit the timer buffer of the leds
+		fsm_handle->controllers.animation_buffer = fsm_handle->controllers.state_execution_count;
 
 		//clear the leds
 		clear_array();
-		write_array(6, 1);
 
 		//set the led shift period to a variable which increase on each pass
-		fsm_handle->controllers.led_shift_period = 80000 - (fsm_handle->controllers.pass_count * 5000);
+		fsm_handle->controllers.led_shift_period = led_shift_period();
+
+		if (fsm_handle->controllers.ball_from_link) {
+			//the ball enters from the board of P1 on the right border
+			write_array(7, 1);
+			fsm_handle->controllers.led_index = 6;
+		}
+		else {
+			write_array(6, 1);
 
-		//set the start led on the left border
-		fsm_handle->controllers.led_index = 5;
+			//set the start led on the left border
+			fsm_handle->controllers.led_index = 5;
 
-		/*
-		//set music and start the timer
-		set_music(P2_REFLEXE);
-		set_interrupt_launcher(MUSIC);
+			//play the paddle sound effect over the music
+			NETPLAY_EFFECT(play_sfx(P2_REFLEXE));
+		}
+		fsm_handle->controllers.ball_from_link = 0;
+
+		//the ball starts now, its speed is unknown until the first shift
+		fsm_handle->controllers.ball_step_time_us = pong_stamp_us();
+		fsm_handle->controllers.ball_step_period_us = 0;
+
+		//start the timer
 		start_timer();
-		*/
 	}
 
 	/* INIT END  ----------------------------------------------------------------------------------*/
@@ -500,13 +1060,14 @@ void state_gtp2(void)
 		/* LED BEGIN  ----------------------------------------------------------------------------------*/
 
 		//check if the last animation update happened over than a certain amount of cycles
-		if (fsm_handle->controllers.state_execution_count-bufferL > fsm_handle->controllers.led_shift_period) {
+		if (fsm_handle->controllers.state_execution_count-fsm_handle->controllers.animation_buffer > fsm_handle->controllers.led_shift_period) {
 
 			clear_array();
 			write_array(fsm_handle->controllers.led_index, 1);
 			fsm_handle->controllers.led_index--;
 
-			bufferL=fsm_handle->controllers.state_execution_count;
+			fsm_handle->controllers.animation_buffer=fsm_handle->controllers.state_execution_count;
+			stamp_ball_step();
 		}
 
 		/* LED END  ----------------------------------------------------------------------------------*/
@@ -533,6 +1094,9 @@ void state_rpp1(void)
 		//switch on the led border
 		write_array(7, 1);
 
+		//the ball is on the border from now
+		fsm_handle->controllers.ball_arrival_time_us = pong_now_us();
+
 		//increment the speed
 		fsm_handle->controllers.pass_count++;
 	}
@@ -556,6 +1120,9 @@ void state_rpp2(void)
 		//switch on the led border
 		write_array(0, 1);
 
+		//the ball is on the border from now
+		fsm_handle->controllers.ball_arrival_time_us = pong_now_us();
+
 		//increment the speed
 		fsm_handle->controllers.pass_count++;
 	}
@@ -579,6 +1146,10 @@ void state_ip1s(void)
 		//increment player's score
 		fsm_handle->controllers.p1_score++;
 
+		//play the score sound effect, a miss sound effect already playing has the priority
+		NETPLAY_EFFECT(play_sfx(SCORE));
+		start_timer();
+
 		//reset pass count
 		fsm_handle->controllers.pass_count = 0;
 
@@ -597,6 +1168,10 @@ void state_ip1s(void)
 	}
 
 	/* INIT END  ----------------------------------------------------------------------------------*/
+
+	//show the mean reaction time of the match of the scorer for the second half of the display
+	if (fsm_handle->controllers.state_execution_count == STATS_DISPLAY_COUNT)
+		display_reaction_stats(STATS_P1);
 }
 
 void state_ip2s(void)
@@ -616,6 +1191,10 @@ void state_ip2s(void)
 		//increment player's score
 		fsm_handle->controllers.p2_score++;
 
+		//play the score sound effect, a miss sound effect already playing has the priority
+		NETPLAY_EFFECT(play_sfx(SCORE));
+		start_timer();
+
 		//reset pass count
 		fsm_handle->controllers.pass_count = 0;
 
@@ -635,15 +1214,16 @@ void state_ip2s(void)
 	}
 
 	/* INIT END  ----------------------------------------------------------------------------------*/
+
+	//show the mean reaction time of the match of the scorer for the second half of the display
+	if (fsm_handle->controllers.state_execution_count == STATS_DISPLAY_COUNT)
+		display_reaction_stats(STATS_P2);
 }
 
 void state_p1wn(void)
 {
 	/* INIT BEGIN  ----------------------------------------------------------------------------------*/
 
-	//init variables
-	static uint32_t buffer7;
-
 	//init functions of the state
 	if (fsm_handle->controllers.state_execution_count == 0) {
 
@@ -653,8 +1233,12 @@ void state_p1wn(void)
 		//clear the leds
 		clear_array();
 
-		//init the timer buffer7
-		buffer7 = fsm_handle->controllers.state_execution_count;
+		//init the timer buffer of the animation and restart the message
+		fsm_handle->controllers.animation_buffer = fsm_handle->controllers.state_execution_count;
+		fsm_handle->controllers.animation_step = 0;
+
+		//save the result of the match before the scores are reset, written while idle
+		NETPLAY_EFFECT(store_add_match(STATS_P1, fsm_handle->controllers.p1_score, fsm_handle->controllers.p2_score));
 
 		//reset scores
 		fsm_handle->controllers.p1_score = 0;
@@ -663,9 +1247,41 @@ void state_p1wn(void)
 		//reset pass count
 		fsm_handle->controllers.pass_count = 0;
 
+		//log the reaction statistics of the match and start a new one
+		NETPLAY_EFFECT(stats_dump());
+		NETPLAY_EFFECT(stats_reset_match());
+		NETPLAY_EFFECT(timer_dump());
+		NETPLAY_EFFECT(store_dump());
+		memory_dump();
+#if LINK_ENABLE
+		link_dump();
+#endif
+#if NETPLAY_ENABLE
+		netplay_dump();
+#endif
+#if PONG_CLOCK_POLICY
+		clock_dump();
+#endif
+#if TELEMETRY_ENABLE
+		telemetry_dump();
+#endif
+#if PONG_DEEP_IDLE
+		power_dump();
+#endif
+#if PONG_STATS_ENABLE
+		pong_dump_state_stats();
+		pong_reset_state_stats();
+#endif
+#if PROFILER_ENABLE
+		profiler_dump();
+#endif
+#if REPLAY_ENABLE
+		if (replay_get_mode() == REPLAY_RECORD)
+			replay_dump();
+#endif
+
 		/* Setting the music to play, and then it is starting the timer. */
-		set_music(WIN);
-		set_interrupt_launcher(MUSIC);
+		NETPLAY_EFFECT(set_music(WIN));
 		start_timer();
 	}
 
@@ -678,16 +1294,14 @@ void state_p1wn(void)
 
 		/* 7SEGMENT BEGIN  ----------------------------------------------------------------------------------*/
 
-		//check if the last animation update happened over than 20000 cycles
-		if (fsm_handle->controllers.state_execution_count-buffer7>80000) {
+		//check if the last animation update happened over WIN_SCROLL_COUNT iterations at 32MHz
+		if (fsm_handle->controllers.state_execution_count-fsm_handle->controllers.animation_buffer>clock_scale_count(WIN_SCROLL_COUNT)) {
 
 			max7219_erase_no_decode();
 
-			static uint8_t shift_state = 0;
-
 			//display a message with shifting the letter in order to see the overall message
 			for (int i=0;i<4;i++) {
-				switch (i+shift_state) {
+				switch (i+fsm_handle->controllers.animation_step) {
 				case 0: max7219_display_no_decode(i, 0b0); break;
 				case 1: max7219_display_no_decode(i, 0b0); break;
 				case 2: max7219_display_no_decode(i, 0b0); break;
@@ -719,13 +1333,13 @@ void state_p1wn(void)
 				case 28: max7219_display_no_decode(i, 0b0); break;
 				}
 			}
-			shift_state++;
+			fsm_handle->controllers.animation_step++;
 
-			if (shift_state+3 > 28)
-				shift_state = 0;
+			if (fsm_handle->controllers.animation_step+3 > 28)
+				fsm_handle->controllers.animation_step = 0;
 
-			//the buffer7 is actualised
-			buffer7=fsm_handle->controllers.state_execution_count;
+			//the animation buffer is actualised
+			fsm_handle->controllers.animation_buffer=fsm_handle->controllers.state_execution_count;
 		}
 
 		/* 7SEGMENT END  ----------------------------------------------------------------------------------*/
@@ -739,9 +1353,6 @@ void state_p2wn(void)
 {
 	/* INIT BEGIN  ----------------------------------------------------------------------------------*/
 
-	//init variables
-	static uint32_t buffer7;
-
 	//init functions of the state
 	if (fsm_handle->controllers.state_execution_count == 0) {
 
@@ -752,8 +1363,12 @@ void state_p2wn(void)
 		//clear the leds
 		clear_array();
 
-		//init the timer buffer7
-		buffer7 = fsm_handle->controllers.state_execution_count;
+		//init the timer buffer of the animation and restart the message
+		fsm_handle->controllers.animation_buffer = fsm_handle->controllers.state_execution_count;
+		fsm_handle->controllers.animation_step = 0;
+
+		//save the result of the match before the scores are reset, written while idle
+		NETPLAY_EFFECT(store_add_match(STATS_P2, fsm_handle->controllers.p1_score, fsm_handle->controllers.p2_score));
 
 		//reset scores
 		fsm_handle->controllers.p1_score = 0;
@@ -762,8 +1377,40 @@ void state_p2wn(void)
 		//reset pass count
 		fsm_handle->controllers.pass_count = 0;
 
-		set_music(WIN);
-		set_interrupt_launcher(MUSIC);
+		//log the reaction statistics of the match and start a new one
+		NETPLAY_EFFECT(stats_dump());
+		NETPLAY_EFFECT(stats_reset_match());
+		NETPLAY_EFFECT(timer_dump());
+		NETPLAY_EFFECT(store_dump());
+		memory_dump();
+#if LINK_ENABLE
+		link_dump();
+#endif
+#if NETPLAY_ENABLE
+		netplay_dump();
+#endif
+#if PONG_CLOCK_POLICY
+		clock_dump();
+#endif
+#if TELEMETRY_ENABLE
+		telemetry_dump();
+#endif
+#if PONG_DEEP_IDLE
+		power_dump();
+#endif
+#if PONG_STATS_ENABLE
+		pong_dump_state_stats();
+		pong_reset_state_stats();
+#endif
+#if PROFILER_ENABLE
+		profiler_dump();
+#endif
+#if REPLAY_ENABLE
+		if (replay_get_mode() == REPLAY_RECORD)
+			replay_dump();
+#endif
+
+		NETPLAY_EFFECT(set_music(WIN));
 		start_timer();
 	}
 
@@ -776,17 +1423,15 @@ void state_p2wn(void)
 
 		/* 7SEGMENT BEGIN  ----------------------------------------------------------------------------------*/
 
-		//check if the last animation update happened over than 20000 cycles
-		if (fsm_handle->controllers.state_execution_count-buffer7>80000) {
+		//check if the last animation update happened over WIN_SCROLL_COUNT iterations at 32MHz
+		if (fsm_handle->controllers.state_execution_count-fsm_handle->controllers.animation_buffer>clock_scale_count(WIN_SCROLL_COUNT)) {
 
 
 			max7219_erase_no_decode();
 
-			static uint8_t shift_state = 0;
-
 			//display a message with shifting the letter in order to see the overall message
 			for (int i=0;i<4;i++) {
-				switch (i+shift_state) {
+				switch (i+fsm_handle->controllers.animation_step) {
 				case 0: max7219_display_no_decode(i, 0b0); break;
 				case 1: max7219_display_no_decode(i, 0b0); break;
 				case 2: max7219_display_no_decode(i, 0b0); break;
@@ -818,13 +1463,13 @@ void state_p2wn(void)
 				case 28: max7219_display_no_decode(i, 0b0); break;
 				}
 			}
-			shift_state++;
+			fsm_handle->controllers.animation_step++;
 
-			if (shift_state+3 > 28)
-				shift_state = 0;
+			if (fsm_handle->controllers.animation_step+3 > 28)
+				fsm_handle->controllers.animation_step = 0;
 
-			//the buffer7 is actualised
-			buffer7=fsm_handle->controllers.state_execution_count;
+			//the animation buffer is actualised
+			fsm_handle->controllers.animation_buffer=fsm_handle->controllers.state_execution_count;
 		}
 
 		/* 7SEGMENT END  ----------------------------------------------------------------------------------*/
@@ -834,18 +1479,89 @@ void state_p2wn(void)
 	/* ANIMATION END  ----------------------------------------------------------------------------------*/
 }
 
-//button callback function
-void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+void state_away(void)
+{
+	/* INIT BEGIN  ----------------------------------------------------------------------------------*/
 
-	//check the button pushed
-	if (GPIO_Pin == BTN1_Pin) {
+	//init functions of the state
+	if (fsm_handle->controllers.state_execution_count == 0) {
 
-		//increment the push_nb of this button
-		fsm_handle->inputs.nb_press_btn1++;
-	}
-	else if (GPIO_Pin == BTN2_Pin) {
+		//clean the 7segments
+		max7219_erase_no_decode();
 
-		//increment the push_nb of this button
-		fsm_handle->inputs.nb_press_btn2++;
+		//the ball left this board
+		clear_array();
 	}
+
+	/* INIT END  ----------------------------------------------------------------------------------*/
+}
+
+/**
+ * @brief Register a button press, common to every input path
+ * @param _btn_pin BTN1_Pin or BTN2_Pin
+ * @param _time_us Press time in microseconds
+ */
+RAMFUNC void pong_register_press(uint16_t _btn_pin, uint32_t _time_us) {
+#if PONG_DEEP_IDLE
+	activity_tick = HAL_GetTick();
+#endif
+
+#if LINK_ENABLE
+	//the other player plays on the other board
+	if (_btn_pin != LINK_LOCAL_BTN)
+		return;
+#endif
+
+#if NETPLAY_ENABLE
+	//sent to the other board, given to both FSM at the same frame
+	netplay_local_press(_time_us);
+#elif REPLAY_ENABLE
+	//queued until the next iteration of pong_run
+	replay_input(_btn_pin, _time_us);
+#else
+	pong_apply_press(_btn_pin, _time_us);
+#endif
+}
+
+//button callback function, the press is stamped at the EXTI interrupt entry
+RAMFUNC void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+#if DEBOUNCE_ENABLE
+	//the edge only wakes the debouncer up, the press is counted once stable
+	debounce_wakeup(GPIO_Pin, capture_get_exti_time());
+#else
+	pong_register_press(GPIO_Pin, capture_get_exti_time());
+#endif
+}
+
+//debounced button callback function, only the presses are counted
+RAMFUNC void debounce_event_callback(uint16_t _btn_pin, uint8_t _pressed, uint32_t _time_us) {
+	if (_pressed == 1)
+		pong_register_press(_btn_pin, _time_us);
+}
+
+//input capture callback function, the press is stamped by TIM5
+RAMFUNC void capture_press_callback(uint16_t _btn_pin, uint32_t _time_us) {
+#if DEBOUNCE_ENABLE
+	//the input filter is far too short for the bounces, the edge only wakes the debouncer up
+	debounce_wakeup(_btn_pin, _time_us);
+#else
+	pong_register_press(_btn_pin, _time_us);
+#endif
+}
+
+//ball handed off by the other board of a linked field
+void link_ball_callback(uint8_t _direction, uint8_t _pass_count) {
+	fsm_handle->controllers.pass_count = _pass_count;
+	fsm_handle->controllers.ball_from_link = 1;
+	set_new_state((_direction == LINK_TOWARD_P1) ? STATE_GTP1 : STATE_GTP2);
+}
+
+//state entered by the other board of a linked field, with the scores before the state
+void link_sync_callback(uint8_t _state, uint8_t _p1_score, uint8_t _p2_score) {
+	if (_state >= STATES_COUNT)
+		return;
+
+	fsm_handle->controllers.p1_score = _p1_score;
+	fsm_handle->controllers.p2_score = _p2_score;
+	set_new_state(_state);
 }
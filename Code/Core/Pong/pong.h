@@ -6,10 +6,41 @@
 #include "max7219.h"
 #include "music.h"
 #include "timer.h"
+#include "trace.h"
+#include "capture.h"
+#include "debounce.h"
+#include "stats.h"
+#include "replay.h"
+#include "store.h"
+#include "link.h"
+#include "telemetry.h"
+#include "clock.h"
+#include "power.h"
+#include "memory.h"
+#include "profiler.h"
+#include "log.h"
 #include "main.h"
 
 #define MAX_SCORE 5
 
+// Iteration of the IP states at which the score is replaced by the reaction statistics
+#define STATS_DISPLAY_COUNT 250000
+
+// Iterations at 32MHz between two shifts of the winner message, scaled to the clock of the idle states
+#define WIN_SCROLL_COUNT 80000
+
+// Iterations between two LED shifts of the ball : shorter by LED_SHIFT_STEP at each pass, down to
+// LED_SHIFT_MIN, the RPP states end at the iteration of this period
+#define LED_SHIFT_START 80000
+#define LED_SHIFT_STEP 5000
+#define LED_SHIFT_MIN 10000
+
+// Set to 1 to add the per state CPU accounting to pong_run. Off by default : its DWT reads at each
+// step slow down the iterations the LED shift, score and scroll durations are counted in
+#ifndef PONG_STATS_ENABLE
+#define PONG_STATS_ENABLE 0
+#endif
+
 /*
  * @brief Check that pong handle and fsm handle has been correctly
  * passed (not NULL). If NULL, reset parameters to NULL.
@@ -35,6 +66,8 @@ typedef struct
 	MAX7219_Handle_TypeDef max7219_handle;
 	TypeDef_Music_Handler music_handler;
 	TypeDef_Timer_Handler timer_handler;
+	TypeDef_Capture_Handler capture_handler;
+	TypeDef_Debounce_Handler debounce_handler;
 } Pong_Handle_TypeDef;
 
 /**
@@ -54,6 +87,8 @@ typedef enum
 	STATE_IP2S = 8,		// Increment P1 score
 	STATE_P1WN = 9,		// P1 Wins !
 	STATE_P2WN = 10,	// P2 Wins !
+	STATE_AWAY = 11,	// Ball on the other board of a linked field
+	STATES_COUNT = 12,	// Number of states
 } FSM_State_Enum;
 
 /**
@@ -71,8 +106,10 @@ typedef enum
  */
 typedef struct
 {
-	uint8_t nb_press_btn1; // Count of BTN1 press events
-	uint8_t nb_press_btn2; // Count of BTN2 press events
+	uint8_t nb_press_btn1;		 // Count of BTN1 press events
+	uint8_t nb_press_btn2;		 // Count of BTN2 press events
+	uint32_t btn1_press_time_us; // Time of the first BTN1 press in the state
+	uint32_t btn2_press_time_us; // Time of the first BTN2 press in the state
 } FSM_Inputs_TypeDef;
 
 /**
@@ -99,6 +136,14 @@ typedef struct
 	int8_t led_index;					// Actual LED index
 	uint32_t led_shift_period;			// Period at which LED index is incremented
 	uint32_t pass_count;				// Used to store number of pass
+	uint32_t ball_arrival_time_us;		// Time at which the ball reached the border
+	uint32_t reaction_time_us;			// Time between the ball arrival and the last return press
+	uint32_t ball_step_time_us;			// Time of the last LED shift of the ball
+	uint32_t ball_step_period_us;		// Duration of the last LED shift period, 0 before the first shift
+	uint8_t ball_from_link;				// Set when the ball enters from the other board of a linked field
+	uint32_t animation_buffer;			// Execution count of the last animation update
+	uint8_t animation_step;				// Position in the animation of the state
+	uint8_t display_state;				// Blinking display on or off
 } FSM_Controllers_TypeDef;
 
 /**
@@ -114,12 +159,46 @@ typedef struct
 	size_t states_list_sz;				 // Array size
 } FSM_Handle_TypeDef;
 
+/**
+ * @brief Whole game state, saved and restored by the netplay rollback
+ */
+typedef struct
+{
+	FSM_State_TypeDef state;			 // FSM state
+	FSM_Inputs_TypeDef inputs;			 // Inputs states
+	FSM_Controllers_TypeDef controllers; // Controllers
+} FSM_Snapshot_TypeDef;
+
+/**
+ * @brief CPU accounting of a state, updated by pong_run
+ * and set_new_state when PONG_STATS_ENABLE is set.
+ */
+typedef struct
+{
+	uint32_t entries;	   // Number of times the state has been entered
+	uint32_t steps;		   // Number of state callback executions (loop iterations)
+	uint64_t total_cycles; // Cycles spent in the state callback
+	uint32_t max_cycles;   // Worst state callback execution
+	uint32_t time_ms;	   // Time spent in the state, updated when the state is left
+} FSM_State_Stats_TypeDef;
+
 /* Pong functions */
 HAL_StatusTypeDef pong_init(Pong_Handle_TypeDef *_pong_handle, FSM_Handle_TypeDef *_fsm_handle);
 HAL_StatusTypeDef pong_run(void);
+HAL_StatusTypeDef pong_get_state_stats(FSM_State_Enum _state, FSM_State_Stats_TypeDef *_stats);
+void pong_reset_state_stats(void);
+void pong_dump_state_stats(void);
+const char *pong_state_name(FSM_State_Enum _state);
+void pong_save_snapshot(FSM_Snapshot_TypeDef *_snapshot);
+void pong_restore_snapshot(const FSM_Snapshot_TypeDef *_snapshot);
 
 
+void pong_register_press(uint16_t _btn_pin, uint32_t _time_us);
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+void capture_press_callback(uint16_t _btn_pin, uint32_t _time_us);
+void debounce_event_callback(uint16_t _btn_pin, uint8_t _pressed, uint32_t _time_us);
+void link_ball_callback(uint8_t _direction, uint8_t _pass_count);
+void link_sync_callback(uint8_t _state, uint8_t _p1_score, uint8_t _p2_score);
 
 /* States callbacks */
 void state_start(void);
@@ -133,5 +212,6 @@ void state_ip1s(void);
 void state_ip2s(void);
 void state_p1wn(void);
 void state_p2wn(void);
+void state_away(void);
 
 #endif /* PONG_PONG_H_ */
@@ -23,6 +23,10 @@
 /* USER CODE BEGIN Includes */
 #include <stdio.h>
 #include <stdlib.h>
+
+#include "profiler.h"
+#include "log.h"
+#include "bench.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -46,6 +50,7 @@ TIM_HandleTypeDef htim3;
 TIM_HandleTypeDef htim4;
 
 /* USER CODE BEGIN PV */
+TIM_HandleTypeDef htim5;
 
 /* USER CODE END PV */
 
@@ -64,15 +69,51 @@ int _write(int file, char *ptr, int len);
 
 int _write(int file, char *ptr, int len)
 {
-int DataIdx;
-for (DataIdx = 0; DataIdx < len; DataIdx++)
-{
-//__io_putchar(*ptr++);
-ITM_SendChar(*ptr++);
+//buffered, drained to ITM by log_flush in the main loop
+return log_write(ptr, len);
 }
-return len;
+
+#if BENCH_ENABLE
+static volatile uint32_t bench_now;
+
+static void bench_display_digit(void) { max7219_display_no_decode(0, 0b1111111); }
+static void bench_display_message(void) { display_on_7segments("8888"); }
+static void bench_write_array(void) { write_array(3, GPIO_PIN_SET); }
+static void bench_clear_array(void) { clear_array(); }
+static void bench_now_us(void) { bench_now = capture_now_us(); }
+static void bench_play_note(void) { buzzer_play_note_by_name(0, PACMAN); }
+static void bench_pong_step(void) { pong_run(); }
+
+/**
+ * EXTI handler pended with no button line set : its entry, dispatch and exit. The interrupts
+ * are masked around the case, they are let in for the pended one only.
+ */
+static void bench_exti(void)
+{
+	NVIC_SetPendingIRQ(EXTI15_10_IRQn);
+	__enable_irq();
+	__DSB();
+	__ISB();
+	__disable_irq();
 }
 
+/**
+ * Driver and FSM operations measured by the BENCH_ENABLE build. The board line before the table
+ * gives the configuration, to compare builds with and without BOARD_STATIC_CONFIG,
+ * BOARD_LL_FAST_PATHS and BOARD_RAMFUNC_ENABLE.
+ */
+static const TypeDef_Bench_Case bench_cases[] = {
+	{"max7219_display_no_decode", bench_display_digit},
+	{"display_on_7segments", bench_display_message},
+	{"write_array", bench_write_array},
+	{"clear_array", bench_clear_array},
+	{"capture_now_us", bench_now_us},
+	{"EXTI15_10_IRQHandler", bench_exti},
+	{"buzzer_play_note_by_name", bench_play_note},
+	{"pong_run", bench_pong_step},
+};
+#endif
+
 /* USER CODE END 0 */
 
 /**
@@ -82,24 +123,17 @@ return len;
 int main(void)
 {
   /* USER CODE BEGIN 1 */
+#define BOARD_LED_ENTRY(_index, _port, _pin) {_port, _pin},
 	TypeDef_LED_Array array_1 = {
-		(TypeDef_LED [8]){
-			{L1_GPIO_Port, L1_Pin},
-			{L2_GPIO_Port, L2_Pin},
-			{L3_GPIO_Port, L3_Pin},
-			{L4_GPIO_Port, L4_Pin},
-			{L5_GPIO_Port, L5_Pin},
-			{L6_GPIO_Port, L6_Pin},
-			{L7_GPIO_Port, L7_Pin},
-			{L8_GPIO_Port, L8_Pin}},
-		8
+		(TypeDef_LED [BOARD_LED_COUNT]){BOARD_LED_LIST(BOARD_LED_ENTRY)},
+		BOARD_LED_COUNT
 	};
 
 	MAX7219_Handle_TypeDef max7219_handle = {
-			&hspi1,
-			SPI_CS_GPIO_Port,
-			SPI_CS_Pin,
-			4,
+			&BOARD_MAX7219_HSPI,
+			BOARD_MAX7219_NCS_PORT,
+			BOARD_MAX7219_NCS_PIN,
+			BOARD_MAX7219_DIGITS,
 	};
 
 	TypeDef_Music_Handler music_handler;
@@ -110,11 +144,20 @@ int main(void)
 
 	timer_handler.htim = &htim4;
 
+	TypeDef_Capture_Handler capture_handler;
+
+	htim5.Instance = TIM5;
+	capture_handler.htim = &htim5;
+
+	TypeDef_Debounce_Handler debounce_handler = {0};
+
 	Pong_Handle_TypeDef pong_handler = {
 			array_1,
 			max7219_handle,
 			music_handler,
-			timer_handler
+			timer_handler,
+			capture_handler,
+			debounce_handler
 	};
 
 	FSM_Handle_TypeDef fsm_handler;
@@ -130,7 +173,8 @@ int main(void)
 
   /* USER CODE BEGIN Init */
 
-
+  //paint the free stack to follow its high-water mark
+  memory_init();
 
   /* USER CODE END Init */
 
@@ -149,15 +193,82 @@ int main(void)
   /* USER CODE BEGIN 2 */
 
 
+#if PROFILER_ENABLE
+  ///////////////////////////////////////////////////////	PROFILER
+
+  profiler_init();
+#endif
+
+  ///////////////////////////////////////////////////////	LOG
+
+  log_init();
+
+#if PONG_NO_HEAP
+  //no stdout buffer, printf must not allocate one with malloc
+  setvbuf(stdout, NULL, _IONBF, 0);
+#endif
+
+  ///////////////////////////////////////////////////////	TRACE
+
+  trace_init();
+
+#if TELEMETRY_ENABLE
+  ///////////////////////////////////////////////////////	TELEMETRY
+
+  telemetry_init();
+#endif
+
+#if CLOCK_POLICY_ENABLE
+  ///////////////////////////////////////////////////////	CLOCK
+
+  //the core drops to MSI while waiting for a player, started at full speed
+  clock_init();
+#endif
+
+#if POWER_DEEP_IDLE_ENABLE
+  ///////////////////////////////////////////////////////	POWER
+
+  //RTC calendar and wakeup timer of the Stop mode
+  power_init();
+#endif
+
+#if REPLAY_ENABLE
+  ///////////////////////////////////////////////////////	REPLAY
+
+  //BTN1 held during the reset replays the inputs recorded by the previous run
+  replay_init(HAL_GPIO_ReadPin(BTN1_GPIO_Port, BTN1_Pin) == GPIO_PIN_RESET);
+#endif
+
   ///////////////////////////////////////////////////////	PONG
 
   pong_init(&pong_handler, &fsm_handler);
 
+  ///////////////////////////////////////////////////////	MEMORY
+
+  //check the stack guard and high-water mark periodically
+  set_interrupt_launcher(MEMORY);
+
   ///////////////////////////////////////////////////////	MUSIC
 
   //init buzzer clock
   HAL_TIM_PWM_Start(&htim3, TIM_CHANNEL_2);
 
+  //the music task runs from now on with a steady phase, set_music, play_sfx and stop_music gate the playback
+  set_interrupt_launcher(MUSIC);
+
+#if BENCH_ENABLE
+  ///////////////////////////////////////////////////////	BENCH
+
+  bench_init();
+  printf("board,%d,%d,%d\n", BOARD_STATIC_CONFIG, BOARD_LL_FAST_PATHS, BOARD_RAMFUNC_ENABLE);
+  bench_run_all(bench_cases, sizeof(bench_cases) / sizeof(bench_cases[0]));
+
+  //the game starts from a blank board
+  buzzer_mute();
+  clear_array();
+  max7219_erase_no_decode();
+#endif
+
 
 
   /* USER CODE END 2 */
@@ -172,6 +283,13 @@ int main(void)
 
 	pong_run();
 
+	//send the FSM trace, the logs and the telemetry in the background
+	trace_flush();
+	log_flush();
+#if TELEMETRY_ENABLE
+	telemetry_flush();
+#endif
+
   }
   /* USER CODE END 3 */
 }
@@ -326,9 +444,9 @@ static void MX_TIM4_Init(void)
 
   /* USER CODE END TIM4_Init 1 */
   htim4.Instance = TIM4;
-  htim4.Init.Prescaler = 31999;
+  htim4.Init.Prescaler = 3199;
   htim4.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim4.Init.Period = 99;
+  htim4.Init.Period = 9;
   htim4.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
   htim4.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
   if (HAL_TIM_Base_Init(&htim4) != HAL_OK)
@@ -22,6 +22,7 @@
 #include "stm32l1xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "profiler.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -220,13 +221,19 @@ void TIM2_IRQHandler(void)
 void TIM4_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM4_IRQn 0 */
-
+  PROFILER_IRQ_ENTER(PROFILER_IRQ_TIM4, profiler_timer_latency(TIM4));
+#if BOARD_LL_FAST_PATHS
+  //only the update interrupt is enabled, the HAL dispatch and its weak callbacks in flash are skipped
+  TIM4->SR = (uint32_t)~TIM_SR_UIF;
+#else
   /* USER CODE END TIM4_IRQn 0 */
   HAL_TIM_IRQHandler(&htim4);
   /* USER CODE BEGIN TIM4_IRQn 1 */
+#endif
 
   timer_interrupt();
 
+  PROFILER_IRQ_EXIT(PROFILER_IRQ_TIM4);
   /* USER CODE END TIM4_IRQn 1 */
 }
 
@@ -236,15 +243,48 @@ void TIM4_IRQHandler(void)
 void EXTI15_10_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI15_10_IRQn 0 */
-
+  capture_stamp_exti();
+  PROFILER_IRQ_ENTER(PROFILER_IRQ_EXTI15_10, PROFILER_NO_LATENCY);
+#if BOARD_LL_FAST_PATHS
+  //the pending register is read once, each button line set is cleared then dispatched
+  uint32_t pending = EXTI->PR & (BTN1_Pin | BTN2_Pin);
+  EXTI->PR = pending;
+
+  while (pending != 0)
+  {
+    uint32_t line = pending & -pending;
+    pending &= ~line;
+    HAL_GPIO_EXTI_Callback(line);
+  }
+#else
   /* USER CODE END EXTI15_10_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(BTN1_Pin);
   HAL_GPIO_EXTI_IRQHandler(BTN2_Pin);
   /* USER CODE BEGIN EXTI15_10_IRQn 1 */
-
+#endif
+  PROFILER_IRQ_EXIT(PROFILER_IRQ_EXTI15_10);
   /* USER CODE END EXTI15_10_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
+#if LINK_ENABLE
+/**
+  * @brief This function handles DMA1 channel5 global interrupt, link RX buffer wraps.
+  */
+void DMA1_Channel5_IRQHandler(void)
+{
+  link_rx_interrupt();
+}
+#endif
+
+#if BUTTON_INPUT_CAPTURE
+/**
+  * @brief This function handles TIM5 global interrupt, buttons input capture.
+  */
+void TIM5_IRQHandler(void)
+{
+  capture_interrupt();
+}
+#endif
 
 /* USER CODE END 1 */
@@ -23,12 +23,51 @@
 /* Includes */
 #include <errno.h>
 #include <stdint.h>
+#include <stddef.h>
+#include "pong_config.h"
+
+#if PONG_NO_HEAP
+#define SYSMEM_HEAP_SIZE 0
+#else
+#define SYSMEM_HEAP_SIZE PONG_HEAP_SIZE
+#endif
+
+#define SYSMEM_STR(_x) #_x
+#define SYSMEM_XSTR(_x) SYSMEM_STR(_x)
+
+/**
+ * Heap reserved by the linker scripts : _Min_Heap_Size takes this symbol when it is defined
+ */
+__asm__(".global _Pong_Heap_Size\n\t.set _Pong_Heap_Size, " SYSMEM_XSTR(SYSMEM_HEAP_SIZE));
 
 /**
  * Pointer to the current high watermark of the heap usage
  */
 static uint8_t *__sbrk_heap_end = NULL;
 
+/**
+ * Number of allocations refused in the heap-free build
+ */
+static uint32_t __sbrk_refused = 0;
+
+#if PONG_NO_HEAP
+/**
+ * @brief Heap-free build : the firmware cannot call the allocator (pong_config.h), _sbrk is only
+ *        linked by the stdio of newlib, whose stdout buffer main disables. A call is refused and
+ *        counted, memory_dump reports it.
+ *
+ * @param incr Memory size
+ * @return (void *)-1, errno set to ENOMEM
+ */
+void *_sbrk(ptrdiff_t incr)
+{
+  (void)incr;
+
+  __sbrk_refused++;
+  errno = ENOMEM;
+  return (void *)-1;
+}
+#else
 /**
  * @brief _sbrk() allocates memory to the newlib heap and is used by malloc
  *        and others from the C library
@@ -77,3 +116,24 @@ void *_sbrk(ptrdiff_t incr)
 
   return (void *)prev_heap_end;
 }
+#endif
+
+/**
+ * @brief Current end of the newlib heap, used to report the heap usage
+ * @return Pointer to the first byte not given by _sbrk
+ */
+uint8_t *sysmem_heap_end(void)
+{
+  extern uint8_t _end; /* Symbol defined in the linker script */
+
+  return (NULL == __sbrk_heap_end) ? &_end : __sbrk_heap_end;
+}
+
+/**
+ * @brief Number of allocations refused by _sbrk in the heap-free build
+ * @return Refused allocations since reset
+ */
+uint32_t sysmem_heap_refused(void)
+{
+  return __sbrk_refused;
+}
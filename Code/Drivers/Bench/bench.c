@@ -0,0 +1,120 @@
+/*
+ * bench.c
+ */
+
+#include "bench.h"
+#include "log.h"
+
+//the median is the middle sample
+typedef char bench_runs_check[(BENCH_RUNS % 2 == 1) ? 1 : -1];
+
+static TypeDef_Bench bench;
+
+/**
+ * @brief Empty case of the calibration, kept out of line to be called like the others
+ */
+static void __attribute__((noinline)) bench_empty(void) { __asm volatile(""); }
+
+/**
+ * @brief Call a function BENCH_RUNS times after the warm-up and keep the cycles of each call
+ * @param _function Operation to measure
+ */
+static void bench_sample(void (*_function)(void))
+{
+	for (int i = 0; i < BENCH_WARMUP_RUNS; i++)
+		_function();
+
+	for (int i = 0; i < BENCH_RUNS; i++)
+	{
+		uint32_t primask = __get_PRIMASK();
+
+		__disable_irq();
+		uint32_t start = DWT->CYCCNT;
+		_function();
+		uint32_t cycles = DWT->CYCCNT - start;
+		__set_PRIMASK(primask);
+
+		bench.samples[i] = cycles;
+	}
+}
+
+/**
+ * @brief Sort the samples, insertion sort : BENCH_RUNS is small
+ */
+static void bench_sort(void)
+{
+	for (int i = 1; i < BENCH_RUNS; i++)
+	{
+		uint32_t sample = bench.samples[i];
+		int j = i - 1;
+
+		while (j >= 0 && bench.samples[j] > sample)
+		{
+			bench.samples[j + 1] = bench.samples[j];
+			j--;
+		}
+		bench.samples[j + 1] = sample;
+	}
+}
+
+/**
+ * @brief Start the DWT cycle counter and measure the harness overhead
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef bench_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	bench_sample(bench_empty);
+	bench_sort();
+	bench.overhead_cycles = bench.samples[0];
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Measure a case
+ * @param _case Case to run, its function is called BENCH_WARMUP_RUNS + BENCH_RUNS times
+ * @param _result Cycles of the case, the harness overhead subtracted
+ * @retval HAL_ERROR if the case has no function, HAL_OK otherwise
+ */
+HAL_StatusTypeDef bench_run(const TypeDef_Bench_Case *_case, TypeDef_Bench_Result *_result)
+{
+	if (_case == NULL || _case->function == NULL || _result == NULL)
+		return HAL_ERROR;
+
+	bench_sample(_case->function);
+	bench_sort();
+
+	for (int i = 0; i < BENCH_RUNS; i++)
+		bench.samples[i] = (bench.samples[i] > bench.overhead_cycles) ? bench.samples[i] - bench.overhead_cycles : 0;
+
+	_result->min = bench.samples[0];
+	_result->median = bench.samples[BENCH_RUNS / 2];
+	_result->max = bench.samples[BENCH_RUNS - 1];
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Measure every case and print the table, each line is sent before the next case
+ * @param _cases Cases to run
+ * @param _cases_sz Number of cases
+ */
+void bench_run_all(const TypeDef_Bench_Case *_cases, size_t _cases_sz)
+{
+	TypeDef_Bench_Result result;
+
+	printf("bench,overhead,%lu,%lu\n", bench.overhead_cycles, HAL_RCC_GetHCLKFreq());
+	log_flush();
+
+	for (size_t i = 0; i < _cases_sz; i++)
+	{
+		if (bench_run(&_cases[i], &result) != HAL_OK)
+			continue;
+
+		printf("bench,%s,%d,%lu,%lu,%lu\n", _cases[i].name, BENCH_RUNS, result.min, result.median, result.max);
+		log_flush();
+	}
+}
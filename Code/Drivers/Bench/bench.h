@@ -0,0 +1,49 @@
+/*
+ * bench.h
+ *
+ * On-target microbenchmarks. Each case is called BENCH_WARMUP_RUNS times unrecorded, then
+ * BENCH_RUNS times with the interrupts masked around every call, counted with the DWT cycle
+ * counter. The cost of the harness, measured on an empty case by bench_init, is subtracted.
+ *
+ * The results are printed over ITM, one line per case after the calibration :
+ * bench,overhead,cycles,hclk
+ * bench,name,runs,min,median,max
+ *
+ * Build with BENCH_ENABLE=1 : main() runs its cases after pong_init, then the game starts.
+ */
+
+#ifndef BENCH_BENCH_H_
+#define BENCH_BENCH_H_
+
+#include "stm32l1xx_hal.h"
+#include "pong_config.h"
+
+#include <stdio.h>
+
+#ifndef BENCH_ENABLE
+#define BENCH_ENABLE 0
+#endif
+
+#define BENCH_WARMUP_RUNS 4		// Calls before the recorded ones
+
+typedef struct {
+	const char *name;		// Name printed in the table
+	void (*function)(void);	// Operation to measure
+}TypeDef_Bench_Case;
+
+typedef struct {
+	uint32_t min;			// Cycles, harness overhead subtracted
+	uint32_t median;
+	uint32_t max;
+}TypeDef_Bench_Result;
+
+typedef struct {
+	uint32_t overhead_cycles;			// Cost of the harness around an empty case
+	uint32_t samples[BENCH_RUNS];		// Cycles of each recorded call
+}TypeDef_Bench;
+
+HAL_StatusTypeDef bench_init(void);
+HAL_StatusTypeDef bench_run(const TypeDef_Bench_Case *_case, TypeDef_Bench_Result *_result);
+void bench_run_all(const TypeDef_Bench_Case *_cases, size_t _cases_sz);
+
+#endif /* BENCH_BENCH_H_ */
@@ -0,0 +1,159 @@
+/*
+ * capture.c
+ */
+
+#include "capture.h"
+#include "main.h"
+
+static TypeDef_Capture_Handler *capture_handler = NULL;
+
+#if BOARD_STATIC_CONFIG
+#define CAPTURE_TIM BOARD_CAPTURE_TIM
+#else
+#define CAPTURE_TIM (capture_handler->htim->Instance)
+#endif
+
+/**
+ * @brief Start the microsecond counter, and the input capture of both
+ * buttons in BUTTON_INPUT_CAPTURE mode
+ * @param _capture_handler Capture handler
+ * @retval HAL status
+ */
+HAL_StatusTypeDef capture_init(TypeDef_Capture_Handler *_capture_handler)
+{
+	capture_handler = _capture_handler;
+
+	CHECK_CAPTURE_PARAMS();
+
+	TIM_TypeDef *tim = CAPTURE_TIM;
+
+	__HAL_RCC_TIM5_CLK_ENABLE();
+
+	// Free running 32-bit counter at 1MHz
+	tim->CR1 = 0;
+	tim->PSC = (HAL_RCC_GetPCLK1Freq() / CAPTURE_FREQ) - 1;
+	tim->ARR = 0xFFFFFFFF;
+	tim->EGR = TIM_EGR_UG;
+
+#if BUTTON_INPUT_CAPTURE
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	// BTN1 on TIM5_CH1, BTN2 on TIM5_CH2
+	__HAL_RCC_GPIOA_CLK_ENABLE();
+	GPIO_InitStruct.Pin = CAPTURE_BTN1_Pin | CAPTURE_BTN2_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	GPIO_InitStruct.Alternate = GPIO_AF2_TIM5;
+	HAL_GPIO_Init(CAPTURE_GPIO_Port, &GPIO_InitStruct);
+
+	// Capture TI1 on CCR1 and TI2 on CCR2, filtered over 8 samples, on falling edges
+	tim->CCMR1 = TIM_CCMR1_CC1S_0 | (3 << TIM_CCMR1_IC1F_Pos) |
+				 TIM_CCMR1_CC2S_0 | (3 << TIM_CCMR1_IC2F_Pos);
+	tim->CCER = TIM_CCER_CC1E | TIM_CCER_CC1P | TIM_CCER_CC2E | TIM_CCER_CC2P;
+	tim->SR = 0;
+	tim->DIER = TIM_DIER_CC1IE | TIM_DIER_CC2IE;
+
+	HAL_NVIC_SetPriority(TIM5_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(TIM5_IRQn);
+#endif
+
+	tim->CR1 = TIM_CR1_CEN;
+
+	capture_handler->exti_time_us = 0;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Set the prescaler for a new TIM5 clock, the counter goes on from its value
+ * @param _timer_clock New TIM5 clock in Hz
+ */
+void capture_retime(uint32_t _timer_clock)
+{
+	TIM_TypeDef *tim = CAPTURE_TIM;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	uint32_t cnt = tim->CNT;
+
+	// The prescaler is loaded by an update event, which clears the counter
+	tim->PSC = (_timer_clock + CAPTURE_FREQ / 2) / CAPTURE_FREQ - 1;
+	tim->EGR = TIM_EGR_UG;
+	tim->CNT = cnt;
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @retval Current time in microseconds
+ */
+RAMFUNC uint32_t capture_now_us(void) { return CAPTURE_TIM->CNT; }
+
+/**
+ * @brief Stamp the EXTI interrupt, to be called first in the EXTI handler
+ */
+RAMFUNC void capture_stamp_exti(void) { capture_handler->exti_time_us = CAPTURE_TIM->CNT; }
+
+/**
+ * @retval Time in microseconds of the last EXTI interrupt entry
+ */
+RAMFUNC uint32_t capture_get_exti_time(void) { return capture_handler->exti_time_us; }
+
+/**
+ * @brief Read the captured presses and give them to the application,
+ * called by TIM5_IRQHandler in BUTTON_INPUT_CAPTURE mode
+ */
+RAMFUNC void capture_interrupt(void)
+{
+	TIM_TypeDef *tim = CAPTURE_TIM;
+	uint32_t status = tim->SR;
+	uint32_t enabled = tim->DIER;
+
+	// Reading CCRx clears the capture flag, the flag of a masked button is left for capture_enable_press
+	if ((status & TIM_SR_CC1IF) && (enabled & TIM_DIER_CC1IE))
+		capture_press_callback(BTN1_Pin, tim->CCR1);
+
+	if ((status & TIM_SR_CC2IF) && (enabled & TIM_DIER_CC2IE))
+		capture_press_callback(BTN2_Pin, tim->CCR2);
+
+	// Drop the overcaptures seen, only the first press matters. SR is rc_w0 : the bits written to 0
+	// are cleared, a capture flag raised since the read is kept
+	tim->SR = ~(status & (TIM_SR_CC1OF | TIM_SR_CC2OF));
+}
+
+/**
+ * @brief Mask or unmask the capture interrupt of buttons, BUTTON_INPUT_CAPTURE mode only.
+ * The edges captured while masked are dropped when unmasking.
+ * @param _btn_pin BTN1_Pin, BTN2_Pin or both
+ * @param _enable 1 to unmask, 0 to mask
+ */
+RAMFUNC void capture_enable_press(uint16_t _btn_pin, uint8_t _enable)
+{
+	TIM_TypeDef *tim = CAPTURE_TIM;
+	uint32_t interrupts = ((_btn_pin & BTN1_Pin) ? TIM_DIER_CC1IE : 0) | ((_btn_pin & BTN2_Pin) ? TIM_DIER_CC2IE : 0);
+	uint32_t flags = ((_btn_pin & BTN1_Pin) ? (TIM_SR_CC1IF | TIM_SR_CC1OF) : 0) |
+					 ((_btn_pin & BTN2_Pin) ? (TIM_SR_CC2IF | TIM_SR_CC2OF) : 0);
+
+	if (_enable == 0)
+	{
+		tim->DIER &= ~interrupts;
+		return;
+	}
+
+	// SR is rc_w0, only the flags of these buttons are cleared
+	tim->SR = ~flags;
+	tim->DIER |= interrupts;
+}
+
+/**
+ * @brief Press stamped by the input capture. Reported with the BTN1/BTN2 pin
+ * so the application handles it as an EXTI press.
+ * @param _btn_pin BTN1_Pin or BTN2_Pin
+ * @param _time_us Press time in microseconds
+ */
+__weak void capture_press_callback(uint16_t _btn_pin, uint32_t _time_us)
+{
+	UNUSED(_btn_pin);
+	UNUSED(_time_us);
+}
@@ -0,0 +1,62 @@
+/*
+ * capture.h
+ *
+ * Microsecond timestamps of the button presses, from the 32-bit timer TIM5 counting at 1MHz.
+ *
+ * Default mode : BTN1/BTN2 stay on the EXTI lines PA11/PA12 (which have no timer channel),
+ * the counter is read first thing in EXTI15_10_IRQHandler.
+ * BUTTON_INPUT_CAPTURE mode : BTN1/BTN2 are wired to PA0/PA1 (TIM5_CH1/TIM5_CH2), the press is
+ * stamped by the timer input capture itself, the interrupt latency does not matter anymore.
+ */
+
+#ifndef CAPTURE_CAPTURE_H_
+#define CAPTURE_CAPTURE_H_
+
+#include "stm32l1xx_hal.h"
+#include "board_config.h"
+
+#ifndef BUTTON_INPUT_CAPTURE
+#define BUTTON_INPUT_CAPTURE 0
+#endif
+
+#define CAPTURE_FREQ 1000000	// Counter frequency, 1 count per microsecond
+
+/**
+ * @brief Input capture pins, BUTTON_INPUT_CAPTURE mode only
+ */
+#define CAPTURE_BTN1_Pin GPIO_PIN_0
+#define CAPTURE_BTN2_Pin GPIO_PIN_1
+#define CAPTURE_GPIO_Port GPIOA
+
+#if BOARD_STATIC_CONFIG
+// The timer is constant, the handle is set by capture_init before any use
+#define CHECK_CAPTURE_PARAMS() do {} while (0)
+#else
+#define CHECK_CAPTURE_PARAMS()       \
+	do                               \
+	{                                \
+		if (capture_handler == NULL) \
+		{                            \
+			return HAL_ERROR;        \
+		}                            \
+	} while (0)
+#endif
+
+typedef struct
+{
+	TIM_HandleTypeDef *htim;		// 32-bit timer used as microsecond counter (TIM5)
+	volatile uint32_t exti_time_us; // Counter value at the last EXTI interrupt entry
+} TypeDef_Capture_Handler;
+
+HAL_StatusTypeDef capture_init(TypeDef_Capture_Handler *_capture_handler);
+uint32_t capture_now_us(void);
+void capture_stamp_exti(void);
+uint32_t capture_get_exti_time(void);
+void capture_interrupt(void);
+void capture_enable_press(uint16_t _btn_pin, uint8_t _enable);
+void capture_retime(uint32_t _timer_clock);
+
+//Called for each press stamped by the input capture, to be overridden by the application
+void capture_press_callback(uint16_t _btn_pin, uint32_t _time_us);
+
+#endif /* CAPTURE_CAPTURE_H_ */
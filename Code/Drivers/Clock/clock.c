@@ -0,0 +1,195 @@
+/*
+ * clock.c
+ */
+
+#include "clock.h"
+#include "timer.h"
+#include "capture.h"
+#include "music.h"
+#include "max7219.h"
+#include "telemetry.h"
+
+static TypeDef_Clock clock_state = {.mode = CLOCK_FAST, .hclk = CLOCK_FAST_HZ, .count_scale = 1 << 16};
+
+/**
+ * @brief Change the regulator range, the core clock must fit both ranges
+ * @param _vos PWR_REGULATOR_VOLTAGE_SCALE1 or PWR_REGULATOR_VOLTAGE_SCALE2
+ */
+static void clock_set_range(uint32_t _vos)
+{
+	while (PWR->CSR & PWR_CSR_VOSF);
+	PWR->CR = (PWR->CR & ~PWR_CR_VOS) | _vos;
+	while (PWR->CSR & PWR_CSR_VOSF);
+}
+
+/**
+ * @brief Keep the HAL tick at 1ms, the counter keeps its position in the period
+ * @param _timer_clock New TIM2 clock in Hz
+ */
+static void clock_retime_timebase(uint32_t _timer_clock)
+{
+	TIM_TypeDef *tim = CLOCK_TIMEBASE_TIM;
+	uint32_t arr = _timer_clock / CLOCK_TICK_FREQ - 1;
+	uint32_t cnt = ((uint64_t)tim->CNT * (arr + 1)) / (tim->ARR + 1);
+
+	// The prescaler is loaded by an update event, which must not be taken for a tick
+	tim->CR1 |= TIM_CR1_URS;
+	tim->PSC = 0;
+	tim->ARR = arr;
+	tim->EGR = TIM_EGR_UG;
+	tim->CNT = cnt;
+	tim->CR1 &= ~TIM_CR1_URS;
+}
+
+/**
+ * @brief Retime every peripheral clocked from the buses to the current clock
+ */
+static void clock_retime(void)
+{
+	SystemCoreClockUpdate();
+
+	uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+	uint32_t pclk2 = HAL_RCC_GetPCLK2Freq();
+
+	clock_state.hclk = SystemCoreClock;
+	clock_state.count_scale = ((uint64_t)clock_state.hclk << 16) / CLOCK_FAST_HZ;
+
+	clock_retime_timebase(pclk1);
+	timer_retime(pclk1);
+	capture_retime(pclk1);
+	music_retime(pclk1);
+	max7219_retime(pclk2);
+#if TELEMETRY_ENABLE
+	telemetry_retime(pclk1);
+#endif
+
+	if (clock_state.swo_baudrate != 0)
+		TPI->ACPR = (clock_state.hclk + clock_state.swo_baudrate / 2) / clock_state.swo_baudrate - 1;
+}
+
+/**
+ * @brief Start at full speed, to be called after SystemClock_Config
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef clock_init(void)
+{
+	SystemCoreClockUpdate();
+
+	clock_state.mode = CLOCK_FAST;
+	clock_state.hclk = SystemCoreClock;
+	clock_state.count_scale = 1 << 16;
+	clock_state.stats = (TypeDef_Clock_Stats){0};
+
+	// Keep the SWO baud rate chosen by the debugger
+	clock_state.swo_baudrate = 0;
+	if ((CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk) && (ITM->TCR & ITM_TCR_ITMENA_Msk))
+		clock_state.swo_baudrate = clock_state.hclk / (TPI->ACPR + 1);
+
+	// The switch latency is counted in core cycles
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Switch the core clock and retime the peripherals, nothing is done if the mode is already set
+ * @param _mode CLOCK_FAST for the rally, CLOCK_SLOW while waiting
+ * @retval HAL status
+ */
+HAL_StatusTypeDef clock_set_mode(CLOCK_Mode_Enum _mode)
+{
+	if (_mode >= CLOCK_MODES_COUNT)
+		return HAL_ERROR;
+
+	if (_mode == clock_state.mode)
+		return HAL_OK;
+
+	uint32_t primask = __get_PRIMASK();
+	uint32_t old_hclk = clock_state.hclk;
+
+	__disable_irq();
+	uint32_t start = DWT->CYCCNT;
+	uint32_t switched;
+
+	if (_mode == CLOCK_SLOW)
+	{
+		RCC->ICSCR = (RCC->ICSCR & ~RCC_ICSCR_MSIRANGE) | CLOCK_SLOW_MSI_RANGE;
+		RCC->CR |= RCC_CR_MSION;
+		while ((RCC->CR & RCC_CR_MSIRDY) == 0);
+
+		RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_MSI;
+		while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_MSI);
+		switched = DWT->CYCCNT;
+
+		// The PLL and HSI are not needed anymore, lower the core voltage
+		RCC->CR &= ~RCC_CR_PLLON;
+		RCC->CR &= ~RCC_CR_HSION;
+		clock_set_range(PWR_REGULATOR_VOLTAGE_SCALE2);
+	}
+	else
+	{
+		// Range 1 first, 32MHz is out of range 2. The PLL keeps its configuration
+		clock_set_range(PWR_REGULATOR_VOLTAGE_SCALE1);
+
+		RCC->CR |= RCC_CR_HSION;
+		while ((RCC->CR & RCC_CR_HSIRDY) == 0);
+		RCC->CR |= RCC_CR_PLLON;
+		while ((RCC->CR & RCC_CR_PLLRDY) == 0);
+
+		RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+		while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL);
+		switched = DWT->CYCCNT;
+
+		RCC->CR &= ~RCC_CR_MSION;
+	}
+
+	clock_state.mode = _mode;
+	clock_retime();
+
+	uint32_t end = DWT->CYCCNT;
+	__set_PRIMASK(primask);
+
+	// Cycles counted at the old clock up to the switch, at the new one after
+	uint32_t latency_us = ((uint64_t)(switched - start) * 1000000) / old_hclk +
+						  ((uint64_t)(end - switched) * 1000000) / clock_state.hclk;
+
+	TypeDef_Clock_Stats *stats = &clock_state.stats;
+
+	stats->switches[_mode]++;
+	stats->last_latency_us[_mode] = latency_us;
+	if (latency_us > stats->max_latency_us[_mode])
+		stats->max_latency_us[_mode] = latency_us;
+
+	return HAL_OK;
+}
+
+/**
+ * @retval Current clock mode
+ */
+CLOCK_Mode_Enum clock_get_mode(void) { return clock_state.mode; }
+
+/**
+ * @brief Scale a loop iteration count tuned at 32MHz to the current clock
+ * @param _count Iterations at 32MHz
+ * @retval Iterations taking the same time at the current clock
+ */
+uint32_t clock_scale_count(uint32_t _count) { return ((uint64_t)_count * clock_state.count_scale) >> 16; }
+
+/**
+ * @retval Clock switch statistics
+ */
+const TypeDef_Clock_Stats *clock_get_stats(void) { return &clock_state.stats; }
+
+/**
+ * @brief Print the clock switch statistics :
+ * clock,hclk,fast_switches,fast_last_us,fast_max_us,slow_switches,slow_last_us,slow_max_us
+ */
+void clock_dump(void)
+{
+	TypeDef_Clock_Stats *stats = &clock_state.stats;
+
+	printf("clock,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", clock_state.hclk,
+		   stats->switches[CLOCK_FAST], stats->last_latency_us[CLOCK_FAST], stats->max_latency_us[CLOCK_FAST],
+		   stats->switches[CLOCK_SLOW], stats->last_latency_us[CLOCK_SLOW], stats->max_latency_us[CLOCK_SLOW]);
+}
@@ -0,0 +1,68 @@
+/*
+ * clock.h
+ *
+ * Clock policy : the core runs at 32MHz (HSI x4 / 2, regulator range 1) for the rally and drops to
+ * the 4.194MHz MSI (regulator range 2, the data EEPROM can still be written) while waiting for a
+ * player. The switch is made at register level with the interrupts masked, then every peripheral
+ * timed from the bus clocks is retimed so that nothing changes for the players :
+ * 	TIM2 : HAL tick, 1ms
+ * 	TIM3 : buzzer, pitch and volume of the notes
+ * 	TIM4 : scheduler tick, display blink and music tempo
+ * 	TIM5 : microsecond counter
+ * 	SPI1 : MAX7219, 8MHz or below
+ * 	USART2 : telemetry baud rate
+ * 	SWO prescaler, when the debugger enabled the ITM
+ *
+ * MSI is not a multiple of 1MHz : while slow, TIM5 counts 4.194MHz / 4, 4.9% fast, and the SWO
+ * baud rate is off by up to the same amount. No reaction time is measured in the idle states.
+ * The link baud rate cannot be reached from MSI, the policy is not used on a linked field.
+ *
+ * The switch latency, from the request to the peripherals retimed, is measured with the DWT cycle
+ * counter, the cycles before and after the SYSCLK switch being counted at their own clock.
+ */
+
+#ifndef CLOCK_CLOCK_H_
+#define CLOCK_CLOCK_H_
+
+#include "stm32l1xx_hal.h"
+
+#include <stdio.h>
+
+// Set to 0 to run at 32MHz in every state
+#ifndef CLOCK_POLICY_ENABLE
+#define CLOCK_POLICY_ENABLE 1
+#endif
+
+#define CLOCK_FAST_HZ 32000000						// SystemClock_Config
+#define CLOCK_SLOW_MSI_RANGE RCC_ICSCR_MSIRANGE_6	// 4.194MHz
+#define CLOCK_TIMEBASE_TIM TIM2						// HAL timebase
+#define CLOCK_TICK_FREQ 1000						// HAL tick frequency
+
+typedef enum {
+	CLOCK_FAST = 0,		// HSI + PLL, 32MHz
+	CLOCK_SLOW = 1,		// MSI, 4.194MHz
+	CLOCK_MODES_COUNT,
+}CLOCK_Mode_Enum;
+
+typedef struct {
+	uint32_t switches[CLOCK_MODES_COUNT];			// Switches to each mode
+	uint32_t last_latency_us[CLOCK_MODES_COUNT];	// Duration of the last switch to each mode
+	uint32_t max_latency_us[CLOCK_MODES_COUNT];		// Longest switch to each mode
+}TypeDef_Clock_Stats;
+
+typedef struct {
+	CLOCK_Mode_Enum mode;
+	uint32_t hclk;			// Core clock, the APB prescalers are 1
+	uint32_t count_scale;	// hclk / CLOCK_FAST_HZ in 1/65536
+	uint32_t swo_baudrate;	// SWO baud rate set by the debugger, 0 if the ITM is off
+	TypeDef_Clock_Stats stats;
+}TypeDef_Clock;
+
+HAL_StatusTypeDef clock_init(void);
+HAL_StatusTypeDef clock_set_mode(CLOCK_Mode_Enum _mode);
+CLOCK_Mode_Enum clock_get_mode(void);
+uint32_t clock_scale_count(uint32_t _count);
+const TypeDef_Clock_Stats *clock_get_stats(void);
+void clock_dump(void);
+
+#endif /* CLOCK_CLOCK_H_ */
@@ -0,0 +1,187 @@
+/*
+ * debounce.c
+ */
+
+#include "debounce.h"
+#include "main.h"
+#include "timer.h"
+#include "capture.h"
+
+static TypeDef_Debounce_Handler *debounce_handler = NULL;
+
+/**
+ * @brief Init the debouncer, BTN1/BTN2 released and the INPUT task stopped
+ * @param _debounce_handler Debounce handler
+ * @retval HAL status
+ */
+HAL_StatusTypeDef debounce_init(TypeDef_Debounce_Handler *_debounce_handler)
+{
+	debounce_handler = _debounce_handler;
+
+	CHECK_DEBOUNCE_PARAMS();
+
+#if BUTTON_INPUT_CAPTURE
+	// The buttons are wired to the input capture pins
+	debounce_handler->buttons[DEBOUNCE_BTN1].port = CAPTURE_GPIO_Port;
+	debounce_handler->buttons[DEBOUNCE_BTN1].pin = CAPTURE_BTN1_Pin;
+	debounce_handler->buttons[DEBOUNCE_BTN2].port = CAPTURE_GPIO_Port;
+	debounce_handler->buttons[DEBOUNCE_BTN2].pin = CAPTURE_BTN2_Pin;
+#else
+	debounce_handler->buttons[DEBOUNCE_BTN1].port = BTN1_GPIO_Port;
+	debounce_handler->buttons[DEBOUNCE_BTN1].pin = BTN1_Pin;
+	debounce_handler->buttons[DEBOUNCE_BTN2].port = BTN2_GPIO_Port;
+	debounce_handler->buttons[DEBOUNCE_BTN2].pin = BTN2_Pin;
+#endif
+	debounce_handler->buttons[DEBOUNCE_BTN1].btn_pin = BTN1_Pin;
+	debounce_handler->buttons[DEBOUNCE_BTN2].btn_pin = BTN2_Pin;
+
+	for (uint8_t i = 0; i < DEBOUNCE_BUTTONS_COUNT; i++)
+	{
+		debounce_handler->buttons[i].history = 0;
+		debounce_handler->buttons[i].pressed = 0;
+		debounce_handler->buttons[i].edge_pending = 0;
+		debounce_handler->buttons[i].edge_samples = 0;
+		debounce_handler->buttons[i].edge_time_us = 0;
+	}
+
+	debounce_handler->sampling = 0;
+
+	return debounce_set_window(DEBOUNCE_WINDOW);
+}
+
+/**
+ * @brief Set the number of equal samples needed to change the state of a button
+ * @param _window Window length in samples, 1 to DEBOUNCE_WINDOW_MAX
+ * @retval HAL status
+ */
+HAL_StatusTypeDef debounce_set_window(uint8_t _window)
+{
+	CHECK_DEBOUNCE_PARAMS();
+
+	if (_window == 0 || _window > DEBOUNCE_WINDOW_MAX)
+		return HAL_ERROR;
+
+	debounce_handler->window = _window;
+	debounce_handler->mask = (_window == DEBOUNCE_WINDOW_MAX) ? 0xFFFFFFFF : ((1UL << _window) - 1);
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Keep the first edge of a press
+ * @param _button Button pressed
+ * @param _time_us Time of the edge in microseconds
+ */
+static inline void debounce_stamp_edge(TypeDef_Debounce_Button *_button, uint32_t _time_us)
+{
+	_button->edge_time_us = _time_us;
+	_button->edge_samples = 0;
+	_button->edge_pending = 1;
+}
+
+/**
+ * @brief Wake the debouncer up, called by the EXTI callback, or by the input capture callback in
+ * BUTTON_INPUT_CAPTURE mode. The interrupt of the button is masked until the buttons are stable
+ * again, the bounces do not interrupt anymore.
+ * @param _btn_pin BTN1_Pin or BTN2_Pin
+ * @param _time_us Time of the edge in microseconds
+ */
+RAMFUNC void debounce_wakeup(uint16_t _btn_pin, uint32_t _time_us)
+{
+	for (uint8_t i = 0; i < DEBOUNCE_BUTTONS_COUNT; i++)
+	{
+		TypeDef_Debounce_Button *button = &debounce_handler->buttons[i];
+
+		if (button->btn_pin != _btn_pin)
+			continue;
+
+		if (button->pressed == 0 && button->edge_pending == 0)
+			debounce_stamp_edge(button, _time_us);
+	}
+
+#if BUTTON_INPUT_CAPTURE
+	capture_enable_press(_btn_pin, 0);
+#else
+	// EXTI line n is GPIO pin n
+	EXTI->IMR &= ~(uint32_t)_btn_pin;
+#endif
+
+	if (debounce_handler->sampling == 0)
+	{
+		debounce_handler->sampling = 1;
+		set_interrupt_launcher(INPUT);
+	}
+}
+
+/**
+ * @brief INPUT task, sample both buttons and emit the debounced events
+ */
+RAMFUNC void debounce_sample(void)
+{
+	uint8_t idle = 1;
+
+	for (uint8_t i = 0; i < DEBOUNCE_BUTTONS_COUNT; i++)
+	{
+		TypeDef_Debounce_Button *button = &debounce_handler->buttons[i];
+
+		// Buttons are active low
+		uint32_t sample = ((button->port->IDR & button->pin) == 0) ? 1 : 0;
+		button->history = (button->history << 1) | sample;
+
+		uint32_t window = button->history & debounce_handler->mask;
+
+		// First pressed sample of a press which did not wake the debouncer up
+		if (sample == 1 && button->pressed == 0 && button->edge_pending == 0)
+			debounce_stamp_edge(button, capture_now_us());
+
+		if (button->edge_pending == 1 && button->edge_samples < debounce_handler->window)
+			button->edge_samples++;
+
+		if (button->pressed == 0 && window == debounce_handler->mask)
+		{
+			button->pressed = 1;
+			button->edge_pending = 0;
+			debounce_event_callback(button->btn_pin, 1, button->edge_time_us);
+		}
+		else if (button->pressed == 1 && window == 0)
+		{
+			button->pressed = 0;
+			debounce_event_callback(button->btn_pin, 0, capture_now_us());
+		}
+		else if (button->pressed == 0 && window == 0 && button->edge_samples >= debounce_handler->window)
+		{
+			// A whole window released since the edge : a glitch, its time must not stamp the next press
+			button->edge_pending = 0;
+		}
+
+		if (button->pressed == 1 || window != 0 || button->edge_pending == 1)
+			idle = 0;
+	}
+
+	if (idle == 0)
+		return;
+
+	// Both buttons released and stable, back to interrupt wakeups
+	debounce_handler->sampling = 0;
+	stop_interrupt_launcher(INPUT);
+
+#if BUTTON_INPUT_CAPTURE
+	capture_enable_press(BTN1_Pin | BTN2_Pin, 1);
+#else
+	EXTI->PR = BTN1_Pin | BTN2_Pin;
+	EXTI->IMR |= BTN1_Pin | BTN2_Pin;
+#endif
+}
+
+/**
+ * @brief Debounced event. Reported with the BTN1/BTN2 pin.
+ * @param _btn_pin BTN1_Pin or BTN2_Pin
+ * @param _pressed 1 for a press, 0 for a release
+ * @param _time_us Time of the first press edge, or of the release detection
+ */
+__weak void debounce_event_callback(uint16_t _btn_pin, uint8_t _pressed, uint32_t _time_us)
+{
+	UNUSED(_btn_pin);
+	UNUSED(_pressed);
+	UNUSED(_time_us);
+}
@@ -0,0 +1,73 @@
+/*
+ * debounce.h
+ *
+ * Digital debouncer of BTN1/BTN2. The EXTI interrupt is only a wakeup : it masks its line and
+ * enables the INPUT timer task, which samples both buttons into a shift register. A button changes
+ * state once the last DEBOUNCE_WINDOW samples agree, then a press or release event is emitted.
+ * The task stops and the EXTI lines are unmasked when both buttons are released and stable.
+ * In BUTTON_INPUT_CAPTURE mode the input capture wakes the debouncer up instead of the EXTI,
+ * the capture pins are sampled and the capture interrupts are masked.
+ *
+ * The time of a press is the time of its first edge. An edge followed by a whole window of
+ * released samples was a glitch, it is forgotten.
+ */
+
+#ifndef DEBOUNCE_DEBOUNCE_H_
+#define DEBOUNCE_DEBOUNCE_H_
+
+#include "stm32l1xx_hal.h"
+
+//set to 0 to count every EXTI edge as a press, as before
+#ifndef DEBOUNCE_ENABLE
+#define DEBOUNCE_ENABLE 1
+#endif
+
+#define DEBOUNCE_SAMPLE_MS 1	// Period of the INPUT task
+#define DEBOUNCE_WINDOW 5		// Default number of equal samples needed to change state
+#define DEBOUNCE_WINDOW_MAX 32	// Size of the shift register
+
+typedef enum
+{
+	DEBOUNCE_BTN1 = 0,
+	DEBOUNCE_BTN2 = 1,
+	DEBOUNCE_BUTTONS_COUNT = 2,
+} DEBOUNCE_Button_Enum;
+
+#define CHECK_DEBOUNCE_PARAMS()       \
+	do                                \
+	{                                 \
+		if (debounce_handler == NULL) \
+		{                             \
+			return HAL_ERROR;         \
+		}                             \
+	} while (0)
+
+typedef struct
+{
+	GPIO_TypeDef *port;	   // Line sampled
+	uint16_t pin;
+	uint16_t btn_pin;	   // BTN1_Pin or BTN2_Pin, the pin of the wakeups and events
+	uint32_t history;	   // Last samples, bit 0 is the newest, 1 when pressed
+	uint8_t pressed;	   // Debounced state
+	uint8_t edge_pending;  // A press edge has been stamped and is not yet reported
+	uint8_t edge_samples;  // Samples taken since the edge was stamped, up to the window
+	uint32_t edge_time_us; // Time of the first press edge, reported with the press event
+} TypeDef_Debounce_Button;
+
+typedef struct
+{
+	TypeDef_Debounce_Button buttons[DEBOUNCE_BUTTONS_COUNT];
+	uint32_t mask;			   // Samples of the history taken into account
+	uint8_t window;			   // Number of samples of the window
+	volatile uint8_t sampling; // The INPUT task is enabled
+} TypeDef_Debounce_Handler;
+
+HAL_StatusTypeDef debounce_init(TypeDef_Debounce_Handler *_debounce_handler);
+HAL_StatusTypeDef debounce_set_window(uint8_t _window);
+void debounce_wakeup(uint16_t _btn_pin, uint32_t _time_us);
+void debounce_sample(void);
+
+//Called for each debounced press (_pressed = 1) or release (_pressed = 0), to be overridden by the application
+void debounce_event_callback(uint16_t _btn_pin, uint8_t _pressed, uint32_t _time_us);
+
+#endif /* DEBOUNCE_DEBOUNCE_H_ */
@@ -6,9 +6,44 @@
  */
 
 #include "led_array.h"
+#include "replay.h"
+#include "main.h"
 
 static TypeDef_LED_Array *led_array = NULL;
 
+#if BOARD_STATIC_CONFIG
+#define LED_MAP_ENTRY(_index, _port, _pin) {_port, _pin},
+
+static const TypeDef_LED led_map[BOARD_LED_COUNT] = {BOARD_LED_LIST(LED_MAP_ENTRY)};
+
+#define LED_ARRAY_MAP led_map
+#define LED_ARRAY_SZ BOARD_LED_COUNT
+#else
+#define LED_ARRAY_MAP (led_array->array)
+#define LED_ARRAY_SZ (led_array->array_sz)
+#endif
+
+#if BOARD_LL_FAST_PATHS
+// Set in the low half of BSRR, reset in the high half : a single store, no read-modify-write
+#define LED_PIN_WRITE(_port, _pin, _state) \
+	((_port)->BSRR = ((_state) == GPIO_PIN_RESET) ? (uint32_t)(_pin) << 16 : (uint32_t)(_pin))
+#else
+#define LED_PIN_WRITE(_port, _pin, _state) HAL_GPIO_WritePin(_port, _pin, _state)
+#endif
+
+/**
+ * @brief Write a LED, an output of the FSM
+ * @param _led_index LED index
+ * @param _port GPIO port of the LED
+ * @param _pin GPIO pin of the LED
+ * @param _state Pin state
+ */
+static inline void write_led(int _led_index, GPIO_TypeDef *_port, uint16_t _pin, GPIO_PinState _state)
+{
+	LED_PIN_WRITE(_port, _pin, _state);
+	REPLAY_OBSERVE(REPLAY_OBSERVE_LED, _led_index, _state);
+}
+
 /*
  * @brief Initialize LED array from parameters
  * @param _led_array Sructure containing LED array and array size
@@ -39,11 +74,11 @@ HAL_StatusTypeDef write_array(int _led_index, GPIO_PinState _state)
 	CHECK_LED_PARAMS();
 
 	// Check led index
-	if ((_led_index < 0) || (_led_index >= led_array->array_sz))
+	if ((_led_index < 0) || (_led_index >= LED_ARRAY_SZ))
 		return HAL_ERROR;
 
 	// Write pin state to led index
-	HAL_GPIO_WritePin(led_array->array[_led_index].port, led_array->array[_led_index].pin, _state);
+	write_led(_led_index, LED_ARRAY_MAP[_led_index].port, LED_ARRAY_MAP[_led_index].pin, _state);
 
 	return HAL_OK;
 }
@@ -53,10 +88,16 @@ HAL_StatusTypeDef clear_array(void)
 	CHECK_LED_PARAMS();
 
 	// Clear LED array
+#if BOARD_STATIC_CONFIG
+#define LED_CLEAR(_index, _port, _pin) write_led(_index, _port, _pin, GPIO_PIN_RESET);
+	BOARD_LED_LIST(LED_CLEAR)
+#undef LED_CLEAR
+#else
 	for (int i = 0; i < led_array->array_sz; i++)
 	{
 		write_array(i, GPIO_PIN_RESET);
 	}
+#endif
 
 	return HAL_OK;
 }
@@ -66,10 +107,48 @@ HAL_StatusTypeDef set_array(void)
 	CHECK_LED_PARAMS();
 
 	// Set LED array
+#if BOARD_STATIC_CONFIG
+#define LED_SET(_index, _port, _pin) write_led(_index, _port, _pin, GPIO_PIN_SET);
+	BOARD_LED_LIST(LED_SET)
+#undef LED_SET
+#else
 	for (int i = 0; i < led_array->array_sz; i++)
 	{
 		write_array(i, GPIO_PIN_SET);
 	}
+#endif
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Turn the LEDs off, then back on as they were. This is not an output of the FSM,
+ * it is not observed by the record and replay.
+ * @param _blank 1 to turn the LEDs off, 0 to restore them
+ * @retval HAL status
+ */
+HAL_StatusTypeDef led_array_blank(uint8_t _blank)
+{
+	CHECK_LED_PARAMS();
+
+	if (_blank == 1)
+		led_array->blanked_states = 0;
+
+	for (int i = 0; i < LED_ARRAY_SZ && i < 32; i++)
+	{
+		const TypeDef_LED *led = &LED_ARRAY_MAP[i];
+
+		if (_blank == 1)
+		{
+			if (led->port->ODR & led->pin)
+				led_array->blanked_states |= 1UL << i;
+			LED_PIN_WRITE(led->port, led->pin, GPIO_PIN_RESET);
+		}
+		else if (led_array->blanked_states & (1UL << i))
+		{
+			LED_PIN_WRITE(led->port, led->pin, GPIO_PIN_SET);
+		}
+	}
 
 	return HAL_OK;
 }
@@ -9,7 +9,12 @@
 #define LED_ARRAY_LED_ARRAY_H_
 
 #include "stm32l1xx_hal.h"
+#include "board_config.h"
 
+#if BOARD_STATIC_CONFIG
+// The pins are constants, the handle is set by led_array_init before any use
+#define CHECK_LED_PARAMS() do {} while (0)
+#else
 #define CHECK_LED_PARAMS()     \
 	do                         \
 	{                          \
@@ -18,6 +23,7 @@
 			return HAL_ERROR;  \
 		}                      \
 	} while (0)
+#endif
 
 typedef struct
 {
@@ -30,12 +36,14 @@ typedef struct
 	TypeDef_LED *array;
 	size_t array_sz;
 	uint8_t interrupt_state;
+	uint32_t blanked_states; // LEDs lit when the array was blanked, one bit per LED
 } TypeDef_LED_Array;
 
 HAL_StatusTypeDef led_array_init(TypeDef_LED_Array *_led_array);
 HAL_StatusTypeDef write_array(int _led_index, GPIO_PinState _state);
 HAL_StatusTypeDef clear_array(void);
 HAL_StatusTypeDef set_array(void);
+HAL_StatusTypeDef led_array_blank(uint8_t _blank);
 void change_interrupt_state(void);
 uint8_t check_interrupt(void);
 
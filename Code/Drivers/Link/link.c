@@ -0,0 +1,456 @@
+/*
+ * link.c
+ */
+
+#include "link.h"
+#include "capture.h"
+
+#include <string.h>
+
+#define LINK_USART USART1
+#define LINK_DMA_TX DMA1_Channel4
+#define LINK_DMA_RX DMA1_Channel5
+
+//position in the frame being received
+#define PARSE_SYNC 0
+#define PARSE_TYPE 1
+#define PARSE_SEQUENCE 2
+#define PARSE_LENGTH 3
+#define PARSE_PAYLOAD 4
+#define PARSE_CRC 5
+
+//the rings are indexed by masking free running counters
+typedef char link_rx_buffer_check[((LINK_RX_BUFFER_SZ & (LINK_RX_BUFFER_SZ - 1)) == 0) ? 1 : -1];
+typedef char link_tx_buffer_check[((LINK_TX_BUFFER_SZ & (LINK_TX_BUFFER_SZ - 1)) == 0) ? 1 : -1];
+
+static TypeDef_Link link;
+
+/**
+ * @brief CRC-8, polynomial 0x07
+ * @param _crc Previous CRC
+ * @param _byte Byte to add
+ * @retval New CRC
+ */
+static uint8_t link_crc8(uint8_t _crc, uint8_t _byte)
+{
+	_crc ^= _byte;
+
+	for (int i = 0; i < 8; i++)
+		_crc = (_crc & 0x80) ? (uint8_t)((_crc << 1) ^ 0x07) : (uint8_t)(_crc << 1);
+
+	return _crc;
+}
+
+/**
+ * @brief Start the DMA transfer of the next contiguous part of the TX ring, if the previous one is done
+ */
+static void link_kick_tx(void)
+{
+	if ((LINK_DMA_TX->CCR & DMA_CCR_EN) && LINK_DMA_TX->CNDTR != 0)
+		return;
+
+	// Previous transfer done
+	link.tx_tail += link.tx_dma_length;
+	link.tx_dma_length = 0;
+	LINK_DMA_TX->CCR &= ~DMA_CCR_EN;
+
+	uint32_t pending = link.tx_head - link.tx_tail;
+	if (pending == 0)
+		return;
+
+	uint32_t start = link.tx_tail & (LINK_TX_BUFFER_SZ - 1);
+	uint32_t length = LINK_TX_BUFFER_SZ - start;
+	if (length > pending)
+		length = pending;
+
+	link.tx_dma_length = length;
+	LINK_DMA_TX->CMAR = (uint32_t)&link.tx_buffer[start];
+	LINK_DMA_TX->CNDTR = length;
+	LINK_DMA_TX->CCR |= DMA_CCR_EN;
+}
+
+/**
+ * @brief Write a frame to the TX ring and start sending it
+ * @param _type Frame type
+ * @param _payload Payload
+ * @param _length Payload length, up to LINK_PAYLOAD_MAX
+ * @retval HAL_BUSY when the TX ring is full
+ */
+static HAL_StatusTypeDef link_send(LINK_Frame_Enum _type, const uint8_t *_payload, uint8_t _length)
+{
+	if (_length > LINK_PAYLOAD_MAX)
+		return HAL_ERROR;
+
+	if (LINK_TX_BUFFER_SZ - (link.tx_head - link.tx_tail) < (uint32_t)_length + 5)
+	{
+		link.stats.tx_overflows++;
+		return HAL_BUSY;
+	}
+
+	uint8_t header[] = {LINK_SYNC, _type, link.tx_sequence++, _length};
+	uint8_t crc = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		link.tx_buffer[link.tx_head++ & (LINK_TX_BUFFER_SZ - 1)] = header[i];
+		if (i > 0)
+			crc = link_crc8(crc, header[i]);
+	}
+
+	for (int i = 0; i < _length; i++)
+	{
+		link.tx_buffer[link.tx_head++ & (LINK_TX_BUFFER_SZ - 1)] = _payload[i];
+		crc = link_crc8(crc, _payload[i]);
+	}
+
+	link.tx_buffer[link.tx_head++ & (LINK_TX_BUFFER_SZ - 1)] = crc;
+	link.stats.frames_tx++;
+
+	link_kick_tx();
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Handle a valid frame
+ * @param _frame Frame received
+ */
+static void link_receive(const TypeDef_Link_Frame *_frame)
+{
+	uint32_t now = capture_now_us();
+	uint32_t t0, t1;
+
+	link.stats.frames_rx++;
+
+	switch (_frame->type)
+	{
+	case LINK_FRAME_BALL:
+		if (_frame->length < 6)
+			break;
+
+		// One way latency, from the sender clock converted to the local clock
+		memcpy(&t0, &_frame->payload[2], 4);
+		if (link.stats.rtt_last_us != 0)
+		{
+			link.stats.hop_last_us = now - (t0 - link.stats.clock_offset_us);
+			if (link.stats.hop_last_us > link.stats.hop_max_us)
+				link.stats.hop_max_us = link.stats.hop_last_us;
+		}
+
+		link_ball_callback(_frame->payload[0], _frame->payload[1]);
+		break;
+
+	case LINK_FRAME_SYNC:
+		if (_frame->length >= 3)
+			link_sync_callback(_frame->payload[0], _frame->payload[1], _frame->payload[2]);
+		break;
+
+	case LINK_FRAME_INPUT:
+		if (_frame->length < 10)
+			break;
+
+		memcpy(&t0, &_frame->payload[0], 4);
+		memcpy(&t1, &_frame->payload[4], 4);
+		link_input_callback(t0, t1, _frame->payload[8], _frame->payload[9]);
+		break;
+
+	case LINK_FRAME_CLOCK_REQ:
+		if (_frame->length >= 4)
+		{
+			// Pong with the ping time and the local time
+			uint8_t payload[8];
+
+			memcpy(&payload[0], &_frame->payload[0], 4);
+			memcpy(&payload[4], &now, 4);
+			link_send(LINK_FRAME_CLOCK_RESP, payload, sizeof(payload));
+		}
+		break;
+
+	case LINK_FRAME_CLOCK_RESP:
+		if (_frame->length < 8)
+			break;
+
+		// The remote time was read half a round trip after the ping
+		memcpy(&t0, &_frame->payload[0], 4);
+		memcpy(&t1, &_frame->payload[4], 4);
+		link.stats.rtt_last_us = now - t0;
+		if (link.stats.rtt_last_us > link.stats.rtt_max_us)
+			link.stats.rtt_max_us = link.stats.rtt_last_us;
+		link.stats.clock_offset_us = (int32_t)(t1 - (t0 + link.stats.rtt_last_us / 2));
+		break;
+
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief Feed a received byte to the frame parser
+ * @param _byte Byte received
+ */
+static void link_parse(uint8_t _byte)
+{
+	TypeDef_Link_Frame *frame = &link.parse_frame;
+
+	switch (link.parse_state)
+	{
+	case PARSE_SYNC:
+		if (_byte == LINK_SYNC)
+		{
+			link.parse_crc = 0;
+			link.parse_state = PARSE_TYPE;
+		}
+		return;
+
+	case PARSE_TYPE:
+		frame->type = _byte;
+		link.parse_state = PARSE_SEQUENCE;
+		break;
+
+	case PARSE_SEQUENCE:
+		frame->sequence = _byte;
+		link.parse_state = PARSE_LENGTH;
+		break;
+
+	case PARSE_LENGTH:
+		// Not a frame, look for the next sync byte
+		if (_byte > LINK_PAYLOAD_MAX)
+		{
+			link.stats.crc_errors++;
+			link.parse_state = PARSE_SYNC;
+			return;
+		}
+		link.parse_length = _byte;
+		frame->length = 0;
+		link.parse_state = (_byte == 0) ? PARSE_CRC : PARSE_PAYLOAD;
+		break;
+
+	case PARSE_PAYLOAD:
+		frame->payload[frame->length++] = _byte;
+		if (frame->length == link.parse_length)
+			link.parse_state = PARSE_CRC;
+		break;
+
+	case PARSE_CRC:
+		if (_byte == link.parse_crc)
+			link_receive(frame);
+		else
+			link.stats.crc_errors++;
+		link.parse_state = PARSE_SYNC;
+		return;
+	}
+
+	link.parse_crc = link_crc8(link.parse_crc, _byte);
+}
+
+/**
+ * @brief Start USART1 and its DMA channels
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef link_init(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	__HAL_RCC_GPIOA_CLK_ENABLE();
+	__HAL_RCC_USART1_CLK_ENABLE();
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	// PA9 USART1_TX, PA10 USART1_RX
+	GPIO_InitStruct.Pin = GPIO_PIN_9 | GPIO_PIN_10;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Pull = GPIO_PULLUP;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+	GPIO_InitStruct.Alternate = GPIO_AF7_USART1;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+	memset(&link, 0, sizeof(link));
+
+	// 8N1, oversampling by 16
+	LINK_USART->CR1 = 0;
+	LINK_USART->BRR = (HAL_RCC_GetPCLK2Freq() + LINK_BAUDRATE / 2) / LINK_BAUDRATE;
+	LINK_USART->CR3 = USART_CR3_DMAR | USART_CR3_DMAT;
+
+	// RX : peripheral to memory, circular
+	LINK_DMA_RX->CCR = 0;
+	LINK_DMA_RX->CPAR = (uint32_t)&LINK_USART->DR;
+	LINK_DMA_RX->CMAR = (uint32_t)link.rx_buffer;
+	LINK_DMA_RX->CNDTR = LINK_RX_BUFFER_SZ;
+	LINK_DMA_RX->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PL_1 | DMA_CCR_TCIE | DMA_CCR_EN;
+
+	// Counts the wraps of the RX buffer
+	HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+
+	// TX : memory to peripheral, one transfer per contiguous part of the ring
+	LINK_DMA_TX->CCR = 0;
+	LINK_DMA_TX->CPAR = (uint32_t)&LINK_USART->DR;
+	LINK_DMA_TX->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_PL_1;
+
+	LINK_USART->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE;
+
+	link.clock_mark_ms = HAL_GetTick();
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Parse the bytes received, send the pending bytes and ping the other board,
+ * called at each pong_run iteration
+ */
+void link_poll(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	// Bytes written by the circular DMA since init
+	__disable_irq();
+	uint32_t wraps = link.rx_wraps;
+	uint32_t position = (LINK_RX_BUFFER_SZ - LINK_DMA_RX->CNDTR) & (LINK_RX_BUFFER_SZ - 1);
+
+	// The DMA restarted from the buffer start, its interrupt has not counted it yet
+	if ((DMA1->ISR & DMA_ISR_TCIF5) && position < LINK_RX_BUFFER_SZ / 2)
+		wraps++;
+	__set_PRIMASK(primask);
+
+	uint32_t head = wraps * LINK_RX_BUFFER_SZ + position;
+
+	// The DMA went round the buffer over unread bytes : drop them all and wait for the next frame
+	if (head - link.rx_tail > LINK_RX_BUFFER_SZ)
+	{
+		link.stats.rx_overruns++;
+		link.stats.rx_lost += head - link.rx_tail;
+		link.rx_tail = head;
+		link.parse_state = PARSE_SYNC;
+	}
+
+	while (link.rx_tail != head)
+	{
+		link_parse(link.rx_buffer[link.rx_tail & (LINK_RX_BUFFER_SZ - 1)]);
+		link.rx_tail++;
+	}
+
+	if (HAL_GetTick() - link.clock_mark_ms >= LINK_CLOCK_PERIOD_MS)
+	{
+		uint32_t now = capture_now_us();
+
+		link.clock_mark_ms = HAL_GetTick();
+		link_send(LINK_FRAME_CLOCK_REQ, (const uint8_t *)&now, sizeof(now));
+	}
+
+	link_kick_tx();
+}
+
+/**
+ * @brief Count a wrap of the RX buffer, called by DMA1_Channel5_IRQHandler at the end of each pass
+ */
+void link_rx_interrupt(void)
+{
+	DMA1->IFCR = DMA_IFCR_CTCIF5 | DMA_IFCR_CGIF5;
+	link.rx_wraps++;
+}
+
+/**
+ * @brief Hand the ball off to the other board
+ * @param _direction LINK_TOWARD_P1 or LINK_TOWARD_P2
+ * @param _pass_count Pass count, gives the ball speed
+ * @retval HAL status
+ */
+HAL_StatusTypeDef link_send_ball(uint8_t _direction, uint8_t _pass_count)
+{
+	uint32_t now = capture_now_us();
+	uint8_t payload[6] = {_direction, _pass_count};
+
+	memcpy(&payload[2], &now, 4);
+
+	return link_send(LINK_FRAME_BALL, payload, sizeof(payload));
+}
+
+/**
+ * @brief Make the other board follow a state entered after a local event
+ * @param _state State entered
+ * @param _p1_score P1 score before the state
+ * @param _p2_score P2 score before the state
+ * @retval HAL status
+ */
+HAL_StatusTypeDef link_send_sync(uint8_t _state, uint8_t _p1_score, uint8_t _p2_score)
+{
+	uint8_t payload[3] = {_state, _p1_score, _p2_score};
+
+	return link_send(LINK_FRAME_SYNC, payload, sizeof(payload));
+}
+
+/**
+ * @brief Send the inputs of a game frame
+ * @param _frame Frame of the inputs
+ * @param _ack Frames of the other board received, up to this one excluded
+ * @param _presses Presses in the frame
+ * @param _offset Time of the first press, from the start of the frame it was made in
+ * @retval HAL status
+ */
+HAL_StatusTypeDef link_send_input(uint32_t _frame, uint32_t _ack, uint8_t _presses, uint8_t _offset)
+{
+	uint8_t payload[10];
+
+	memcpy(&payload[0], &_frame, 4);
+	memcpy(&payload[4], &_ack, 4);
+	payload[8] = _presses;
+	payload[9] = _offset;
+
+	return link_send(LINK_FRAME_INPUT, payload, sizeof(payload));
+}
+
+/**
+ * @retval Link statistics
+ */
+const TypeDef_Link_Stats * link_get_stats(void) { return &link.stats; }
+
+/**
+ * @brief Print the link statistics :
+ * link,tx,rx,crc_errors,tx_overflows,rx_overruns,rx_lost,rtt_last,rtt_max,offset,hop_last,hop_max
+ */
+void link_dump(void)
+{
+	TypeDef_Link_Stats *stats = &link.stats;
+
+	printf("link,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%ld,%lu,%lu\n", stats->frames_tx, stats->frames_rx,
+		   stats->crc_errors, stats->tx_overflows, stats->rx_overruns, stats->rx_lost, stats->rtt_last_us,
+		   stats->rtt_max_us, stats->clock_offset_us, stats->hop_last_us, stats->hop_max_us);
+}
+
+/**
+ * @brief Ball received from the other board
+ * @param _direction LINK_TOWARD_P1 or LINK_TOWARD_P2
+ * @param _pass_count Pass count of the ball
+ */
+__weak void link_ball_callback(uint8_t _direction, uint8_t _pass_count)
+{
+	UNUSED(_direction);
+	UNUSED(_pass_count);
+}
+
+/**
+ * @brief State entered by the other board
+ * @param _state State entered
+ * @param _p1_score P1 score before the state
+ * @param _p2_score P2 score before the state
+ */
+__weak void link_sync_callback(uint8_t _state, uint8_t _p1_score, uint8_t _p2_score)
+{
+	UNUSED(_state);
+	UNUSED(_p1_score);
+	UNUSED(_p2_score);
+}
+
+/**
+ * @brief Inputs of a game frame received from the other board
+ * @param _frame Frame of the inputs
+ * @param _ack Frames of this board received by the other one, up to this one excluded
+ * @param _presses Presses in the frame
+ * @param _offset Time of the first press, from the start of the frame it was made in
+ */
+__weak void link_input_callback(uint32_t _frame, uint32_t _ack, uint8_t _presses, uint8_t _offset)
+{
+	UNUSED(_frame);
+	UNUSED(_ack);
+	UNUSED(_presses);
+	UNUSED(_offset);
+}
\ No newline at end of file
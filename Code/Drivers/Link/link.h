@@ -0,0 +1,104 @@
+/*
+ * link.h
+ *
+ * Link between two boards making a longer field, over USART1 (PA9 TX, PA10 RX, crossed between the
+ * boards). RX runs in a circular DMA buffer and TX is a ring drained by one-shot DMA transfers.
+ * Frames are only parsed by link_poll(), called at each pong_run iteration : the latency of a frame
+ * is its time on the wire (about 110us for a ball hand-off at 921600 bauds) plus one iteration.
+ * The RX buffer lasts about 11ms at that rate, the RX DMA interrupt only counts its wraps so that a
+ * poll coming later than that finds the lost bytes, counts them and resyncs on the next frame.
+ *
+ * Frame : LINK_SYNC, type, sequence, payload length, payload, CRC-8 of type to payload.
+ * Both boards ping each other every LINK_CLOCK_PERIOD_MS to measure the round trip and the offset
+ * between their microsecond clocks, the one way latency of each ball hand-off is then measured.
+ */
+
+#ifndef LINK_LINK_H_
+#define LINK_LINK_H_
+
+#include "stm32l1xx_hal.h"
+#include "pong_config.h"
+
+#include <stdio.h>
+
+//set to 1 to play on a field of two linked boards
+#ifndef LINK_ENABLE
+#define LINK_ENABLE 0
+#endif
+
+#define LINK_ROLE_LEFT 0	// Board of P2, the ball leaves it on the LED 7 side
+#define LINK_ROLE_RIGHT 1	// Board of P1, the ball leaves it on the LED 0 side
+
+#ifndef LINK_ROLE
+#define LINK_ROLE LINK_ROLE_LEFT
+#endif
+
+#define LINK_BAUDRATE 921600
+#define LINK_PAYLOAD_MAX 12
+#define LINK_SYNC 0x7E
+#define LINK_CLOCK_PERIOD_MS 1000
+
+#define LINK_TOWARD_P1 0	// Ball going to the LED 7 side
+#define LINK_TOWARD_P2 1	// Ball going to the LED 0 side
+
+typedef enum {
+	LINK_FRAME_BALL = 1,		// Ball hand-off : direction, pass count, sender time
+	LINK_FRAME_SYNC = 2,		// State and scores sync : state, P1 score, P2 score
+	LINK_FRAME_CLOCK_REQ = 3,	// Clock ping : sender time
+	LINK_FRAME_CLOCK_RESP = 4,	// Clock pong : ping time, responder time
+	LINK_FRAME_INPUT = 5,		// Inputs of a game frame : frame, acknowledged frame, presses, press offset
+}LINK_Frame_Enum;
+
+typedef struct {
+	uint8_t type;
+	uint8_t sequence;
+	uint8_t length;
+	uint8_t payload[LINK_PAYLOAD_MAX];
+}TypeDef_Link_Frame;
+
+typedef struct {
+	uint32_t frames_tx;
+	uint32_t frames_rx;
+	uint32_t crc_errors;
+	uint32_t tx_overflows;		// Frames dropped because the TX ring was full
+	uint32_t rx_overruns;		// Polls which found unread bytes overwritten by the RX DMA
+	uint32_t rx_lost;			// Bytes overwritten before being parsed
+	uint32_t rtt_last_us;		// Last clock ping round trip
+	uint32_t rtt_max_us;
+	int32_t clock_offset_us;	// Remote clock minus local clock, valid once rtt_last_us is set
+	uint32_t hop_last_us;		// One way latency of the last ball received
+	uint32_t hop_max_us;
+}TypeDef_Link_Stats;
+
+typedef struct {
+	uint8_t rx_buffer[LINK_RX_BUFFER_SZ];
+	uint32_t rx_tail;				// Position of the next byte to parse
+	volatile uint32_t rx_wraps;		// Complete passes of the RX DMA over the buffer
+	uint8_t tx_buffer[LINK_TX_BUFFER_SZ];
+	uint32_t tx_head;				// Bytes written
+	uint32_t tx_tail;				// Bytes sent
+	uint32_t tx_dma_length;			// Length of the DMA transfer in progress
+	uint8_t tx_sequence;
+	uint8_t parse_state;			// Position in the frame being received
+	uint8_t parse_length;			// Payload length announced by the frame being received
+	uint8_t parse_crc;
+	TypeDef_Link_Frame parse_frame;
+	uint32_t clock_mark_ms;			// HAL tick of the last clock ping
+	TypeDef_Link_Stats stats;
+}TypeDef_Link;
+
+HAL_StatusTypeDef link_init(void);
+void link_poll(void);
+void link_rx_interrupt(void);
+HAL_StatusTypeDef link_send_ball(uint8_t _direction, uint8_t _pass_count);
+HAL_StatusTypeDef link_send_sync(uint8_t _state, uint8_t _p1_score, uint8_t _p2_score);
+HAL_StatusTypeDef link_send_input(uint32_t _frame, uint32_t _ack, uint8_t _presses, uint8_t _offset);
+const TypeDef_Link_Stats * link_get_stats(void);
+void link_dump(void);
+
+//Called by link_poll for each frame received, to be overridden by the application
+void link_ball_callback(uint8_t _direction, uint8_t _pass_count);
+void link_sync_callback(uint8_t _state, uint8_t _p1_score, uint8_t _p2_score);
+void link_input_callback(uint32_t _frame, uint32_t _ack, uint8_t _presses, uint8_t _offset);
+
+#endif /* LINK_LINK_H_ */
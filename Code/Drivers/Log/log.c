@@ -0,0 +1,93 @@
+/*
+ * log.c
+ */
+
+#include "log.h"
+
+static TypeDef_Log log_buffer;
+
+/**
+ * @brief Reset the log buffer
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef log_init(void)
+{
+	log_buffer.head = 0;
+	log_buffer.tail = 0;
+	log_buffer.dropped = 0;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Copy text to the log buffer, never blocks.
+ * @param _data Text to log
+ * @param _len Text length
+ * @retval _len, the bytes which did not fit are dropped and counted
+ */
+int log_write(const char *_data, int _len)
+{
+	// Only thread mode may produce, an interrupt could preempt a copy in progress
+	if (__get_IPSR() != 0)
+	{
+		log_buffer.dropped += _len;
+		return _len;
+	}
+
+	uint32_t head = log_buffer.head;
+	uint32_t space = LOG_BUFFER_SZ - (head - log_buffer.tail);
+	int count = ((uint32_t)_len > space) ? (int)space : _len;
+
+	for (int i = 0; i < count; i++)
+		log_buffer.buffer[(head + i) & (LOG_BUFFER_SZ - 1)] = _data[i];
+
+	// Publish the bytes once they are copied
+	log_buffer.head = head + count;
+	log_buffer.dropped += _len - count;
+
+	return _len;
+}
+
+/**
+ * @brief Send the buffered text over ITM, as long as the stimulus port accepts data.
+ * Aligned words are sent with 32-bit writes. To be called from the main loop.
+ */
+void log_flush(void)
+{
+	// No debugger listening : nothing can be sent, forget the text
+	if (((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0) || ((ITM->TER & (1UL << LOG_ITM_PORT)) == 0))
+	{
+		log_buffer.tail = log_buffer.head;
+		return;
+	}
+
+	uint32_t tail = log_buffer.tail;
+	uint32_t head = log_buffer.head;
+
+	while (tail != head)
+	{
+		// Stimulus port busy, try again at next call
+		if (ITM->PORT[LOG_ITM_PORT].u32 == 0)
+			break;
+
+		uint32_t index = tail & (LOG_BUFFER_SZ - 1);
+
+		if (((index & 3) == 0) && (head - tail >= 4))
+		{
+			ITM->PORT[LOG_ITM_PORT].u32 = *(uint32_t *)&log_buffer.buffer[index];
+			tail += 4;
+		}
+		else
+		{
+			ITM->PORT[LOG_ITM_PORT].u8 = log_buffer.buffer[index];
+			tail++;
+		}
+	}
+
+	log_buffer.tail = tail;
+}
+
+/**
+ * @retval Number of bytes lost because the buffer was full or written from an interrupt
+ */
+uint32_t log_get_dropped(void) { return log_buffer.dropped; }
@@ -0,0 +1,72 @@
+/*
+ * log.h
+ *
+ * Non blocking logging backend for printf. _write copies the text to a RAM ring buffer and
+ * returns at once, the buffer is drained to ITM stimulus port 0 by log_flush from the main
+ * loop. Text which does not fit in the buffer is dropped and counted.
+ *
+ * The buffer has a single producer (thread mode) and a single consumer (log_flush), so it
+ * needs no lock. Text written from an interrupt is dropped.
+ */
+
+#ifndef LOG_LOG_H_
+#define LOG_LOG_H_
+
+#include "stm32l1xx_hal.h"
+#include "pong_config.h"
+
+#include <stdio.h>
+
+#define LOG_ITM_PORT 0
+
+/**
+ * @brief Log levels, messages above LOG_LEVEL compile to nothing
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) printf(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) printf(__VA_ARGS__)
+#else
+#define LOG_WARNING(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) printf(__VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) printf(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+typedef struct
+{
+	uint8_t buffer[LOG_BUFFER_SZ] __attribute__((aligned(4)));
+	volatile uint32_t head; // Number of bytes written
+	volatile uint32_t tail; // Number of bytes sent
+	uint32_t dropped;		// Number of bytes lost
+} TypeDef_Log;
+
+HAL_StatusTypeDef log_init(void);
+int log_write(const char *_data, int _len);
+void log_flush(void);
+uint32_t log_get_dropped(void);
+
+#endif /* LOG_LOG_H_ */
@@ -6,6 +6,22 @@
  */
 
 #include "max7219.h"
+#include "replay.h"
+#include "main.h"
+
+#if BOARD_STATIC_CONFIG
+#define MAX7219_HSPI (&BOARD_MAX7219_HSPI)
+#define MAX7219_NCS_PORT BOARD_MAX7219_NCS_PORT
+#define MAX7219_NCS_PIN BOARD_MAX7219_NCS_PIN
+#define MAX7219_DIGITS BOARD_MAX7219_DIGITS
+
+// The wiring is constant, the handle is set by max7219_init before any use
+#define CHECK_MAX7219_PARAMS() do {} while (0)
+#else
+#define MAX7219_HSPI (max7219_handle->hspi)
+#define MAX7219_NCS_PORT (max7219_handle->spi_ncs_port)
+#define MAX7219_NCS_PIN (max7219_handle->spi_ncs_pin)
+#define MAX7219_DIGITS (max7219_handle->digits_count)
 
 #define RESET_MAX7219_PARAMS() \
 	do                         \
@@ -22,6 +38,7 @@
 			return HAL_ERROR;       \
 		}                           \
 	} while (0)
+#endif
 
 /* Static variables used to store MAX7219 related objects */
 static MAX7219_Handle_TypeDef *max7219_handle = NULL;
@@ -38,24 +55,72 @@ static uint8_t digits_registers[] = {
 };
 
 /*
- * @brief Send data to address
+ * @brief Send data to address, not observed by the record and replay
  * @param _address Address on 8 bits
  * @param _data Data on 8 bits
  */
-static HAL_StatusTypeDef max7219_transmit(uint8_t _address, uint8_t _data)
+#if BOARD_LL_FAST_PATHS
+static RAMFUNC HAL_StatusTypeDef max7219_write(uint8_t _address, uint8_t _data)
+{
+	SPI_TypeDef *spi = MAX7219_HSPI->Instance;
+
+	// The display is written from the main loop and from the scheduler : one frame at a time
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((spi->CR1 & SPI_CR1_SPE) == 0)
+		spi->CR1 |= SPI_CR1_SPE;
+
+	// Select MAX7219, send data, de-select MAX7219 once the last bit is out
+	MAX7219_NCS_PORT->BSRR = (uint32_t)MAX7219_NCS_PIN << 16;
+
+	while ((spi->SR & SPI_SR_TXE) == 0);
+	spi->DR = _address;
+	while ((spi->SR & SPI_SR_TXE) == 0);
+	spi->DR = _data;
+	while ((spi->SR & SPI_SR_TXE) == 0);
+	while (spi->SR & SPI_SR_BSY);
+
+	MAX7219_NCS_PORT->BSRR = MAX7219_NCS_PIN;
+
+	// Full duplex : the received bytes are dropped, clear the overrun
+	(void)spi->DR;
+	(void)spi->SR;
+
+	__set_PRIMASK(primask);
+
+	return HAL_OK;
+}
+#else
+static RAMFUNC HAL_StatusTypeDef max7219_write(uint8_t _address, uint8_t _data)
 {
 	uint8_t data[] = {_address, _data};				 // SPI transmit buffer
 	size_t data_sz = sizeof(data) / sizeof(uint8_t); // Size of SPI transmit buffer
 	HAL_StatusTypeDef max7219_status = HAL_OK;		 // Return value
 
 	// Select MAX7219, send data, de-select MAX7219
-	HAL_GPIO_WritePin(max7219_handle->spi_ncs_port, max7219_handle->spi_ncs_pin, GPIO_PIN_RESET);
-	max7219_status = HAL_SPI_Transmit(max7219_handle->hspi, data, data_sz, 100);
-	HAL_GPIO_WritePin(max7219_handle->spi_ncs_port, max7219_handle->spi_ncs_pin, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(MAX7219_NCS_PORT, MAX7219_NCS_PIN, GPIO_PIN_RESET);
+	max7219_status = HAL_SPI_Transmit(MAX7219_HSPI, data, data_sz, 100);
+	HAL_GPIO_WritePin(MAX7219_NCS_PORT, MAX7219_NCS_PIN, GPIO_PIN_SET);
 
 	// Return transmit status
 	return max7219_status;
 }
+#endif
+
+/*
+ * @brief Send data to address, an output of the FSM
+ * @param _address Address on 8 bits
+ * @param _data Data on 8 bits
+ */
+static RAMFUNC HAL_StatusTypeDef max7219_transmit(uint8_t _address, uint8_t _data)
+{
+	HAL_StatusTypeDef max7219_status = max7219_write(_address, _data);
+
+	REPLAY_OBSERVE(REPLAY_OBSERVE_SPI, _address, _data);
+
+	return max7219_status;
+}
 
 /**
  * @brief Init function. Pass hardware handles and constants.
@@ -84,7 +149,7 @@ HAL_StatusTypeDef max7219_init(MAX7219_Handle_TypeDef *_max_7219_handle)
 		return max7219_status;
 
 	// Set scan limit to number of digits
-	max7219_status = max7219_transmit(SCAN_LIMIT_REGG_BASE, max7219_handle->digits_count - 1);
+	max7219_status = max7219_transmit(SCAN_LIMIT_REGG_BASE, MAX7219_DIGITS - 1);
 	if (max7219_status != HAL_OK)
 		return max7219_status;
 
@@ -113,7 +178,7 @@ HAL_StatusTypeDef max7219_init(MAX7219_Handle_TypeDef *_max_7219_handle)
  * @param _digit_value Desired digit value to be written
  * @retval HAL_OK on success
  */
-HAL_StatusTypeDef max7219_display_no_decode(uint8_t _digit_index, uint8_t _digit_value)
+RAMFUNC HAL_StatusTypeDef max7219_display_no_decode(uint8_t _digit_index, uint8_t _digit_value)
 {
 	HAL_StatusTypeDef max7219_status = HAL_OK;
 
@@ -126,7 +191,7 @@ HAL_StatusTypeDef max7219_display_no_decode(uint8_t _digit_index, uint8_t _digit
 		return max7219_status;
 
 	/* Check if digit index does not overflow actual hardware setup */
-	if (_digit_index > max7219_handle->digits_count)
+	if (_digit_index > MAX7219_DIGITS)
 		return HAL_ERROR;
 
 	// Display value
@@ -150,7 +215,7 @@ HAL_StatusTypeDef max7219_display_decode(uint8_t _digit_index, uint8_t _digit_va
 	CHECK_MAX7219_PARAMS();
 
 	/* Check if digit index does not overflow actual hardware setup */
-	if (_digit_index > max7219_handle->digits_count)
+	if (_digit_index > MAX7219_DIGITS)
 		return HAL_ERROR;
 
 	// Set decode mode to 'decode'
@@ -170,7 +235,7 @@ HAL_StatusTypeDef max7219_display_decode(uint8_t _digit_index, uint8_t _digit_va
  * @brief Erase display
  * @retval HAL_OK on success
  */
-HAL_StatusTypeDef max7219_erase_no_decode(void)
+RAMFUNC HAL_StatusTypeDef max7219_erase_no_decode(void)
 {
 	HAL_StatusTypeDef max7219_status = HAL_OK;
 
@@ -182,7 +247,7 @@ HAL_StatusTypeDef max7219_erase_no_decode(void)
 	if (max7219_status != HAL_OK)
 		return max7219_status;
 
-	for (int i = 0; i < max7219_handle->digits_count; i++)
+	for (int i = 0; i < MAX7219_DIGITS; i++)
 	{
 		max7219_status = max7219_transmit(digits_registers[i], DIGIT_OFF);
 		if (max7219_status != HAL_OK)
@@ -208,7 +273,7 @@ HAL_StatusTypeDef max7219_erase_decode(void)
 	if (max7219_status != HAL_OK)
 		return max7219_status;
 
-	for (int i = 0; i < max7219_handle->digits_count; i++)
+	for (int i = 0; i < MAX7219_DIGITS; i++)
 	{
 		max7219_status = max7219_transmit(digits_registers[i], DIGIT_OFF_DECODE);
 		if (max7219_status != HAL_OK)
@@ -242,7 +307,7 @@ HAL_StatusTypeDef set_7segment(char * _message, uint8_t _is_blinking) {
  * If the display is not blinking, display the message. If the display is blinking, display nothing
  * this function is called by the interrupt function
  */
-void callback_display(void) {
+RAMFUNC void callback_display(void) {
 	static uint8_t display_state = 1;
 
 	if (display_state == 1) {
@@ -257,6 +322,40 @@ void callback_display(void) {
 	}
 }
 
+/**
+ * It blanks the display with the shutdown register, the digits are kept by the MAX7219 and shown
+ * again in normal mode. This is not an output of the FSM, it is not observed by the record and replay.
+ *
+ * @param _shutdown 1 to blank the display, 0 to show it again
+ */
+HAL_StatusTypeDef max7219_set_shutdown(uint8_t _shutdown) {
+	CHECK_MAX7219_PARAMS();
+
+	return max7219_write(SHUTDOWN_REG_BASE, (_shutdown == 1) ? SHUTDOWN_REG_SHUTDOWN_MODE : SHUTDOWN_REG_NORMAL_MODE);
+}
+
+/**
+ * It sets the SPI prescaler for a new bus clock, the SPI clock stays at MAX7219_SPI_MAX_HZ or below
+ *
+ * @param _spi_clock the new SPI1 bus clock in Hz
+ */
+void max7219_retime(uint32_t _spi_clock) {
+	SPI_TypeDef * spi = MAX7219_HSPI->Instance;
+	uint32_t br = 0;
+
+	//the prescaler goes from 2 to 256
+	while (br < 7 && (_spi_clock >> (br + 1)) > MAX7219_SPI_MAX_HZ)
+		br++;
+
+	while (spi->SR & SPI_SR_BSY);
+
+	spi->CR1 &= ~SPI_CR1_SPE;
+	spi->CR1 = (spi->CR1 & ~SPI_CR1_BR) | (br << SPI_CR1_BR_Pos);
+	spi->CR1 |= SPI_CR1_SPE;
+
+	MAX7219_HSPI->Init.BaudRatePrescaler = br << SPI_CR1_BR_Pos;
+}
+
 /**
  * It takes a string and displays it on the 7-segment display
  * 
@@ -264,13 +363,13 @@ void callback_display(void) {
  * 
  * @return The HAL_StatusTypeDef is a variable that is returned by the function.
  */
-HAL_StatusTypeDef display_on_7segments(char * _message) {
+RAMFUNC HAL_StatusTypeDef display_on_7segments(char * _message) {
 	if (sizeof(_message)/sizeof(char*) > 4)
 			return HAL_ERROR;
 
 	max7219_erase_no_decode();
 
-	for (int i=0;i<max7219_handle->digits_count;i++) {
+	for (int i=0;i<MAX7219_DIGITS;i++) {
 		switch ((int) _message[i]) {
 		case 48: max7219_display_no_decode(i, 0b1111110); break; //0
 		case 49: max7219_display_no_decode(i, 0b0110000); break; //1
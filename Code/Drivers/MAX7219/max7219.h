@@ -9,8 +9,10 @@
 #define MAX7219_MAX7219_H_
 
 #include "stm32l1xx_hal.h"
+#include "board_config.h"
 
 #define MAX_DIGITS_COUNT 8
+#define MAX7219_SPI_MAX_HZ 8000000	// Fastest SPI clock used, 32MHz / 4
 
 typedef struct
 {
@@ -60,6 +62,8 @@ HAL_StatusTypeDef max7219_erase_no_decode(void);
 HAL_StatusTypeDef max7219_erase_decode(void);
 HAL_StatusTypeDef set_7segment(char * _message, uint8_t _is_blinking);
 HAL_StatusTypeDef display_on_7segments(char * _message);
+void max7219_retime(uint32_t _spi_clock);
+HAL_StatusTypeDef max7219_set_shutdown(uint8_t _shutdown);
 
 //A callback function that is called by the HAL_TIM_PeriodElapsedCallback() function.
 void callback_display(void);
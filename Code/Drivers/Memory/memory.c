@@ -0,0 +1,113 @@
+/*
+ * memory.c
+ */
+
+#include "memory.h"
+
+/* Symbols defined in the linker script */
+extern uint32_t _sdata;
+extern uint32_t _end;
+extern uint32_t _estack;
+extern uint32_t _Min_Heap_Size;
+extern uint32_t _Min_Stack_Size;
+
+/* Heap end and refused allocations, defined in sysmem.c */
+extern uint8_t *sysmem_heap_end(void);
+extern uint32_t sysmem_heap_refused(void);
+
+static uint32_t stack_used_max = 0;
+static uint32_t guard_breaches = 0;
+
+/**
+ * @brief Lowest address of the stack reserved by _Min_Stack_Size
+ */
+static inline uint32_t *memory_stack_limit(void)
+{
+	return (uint32_t *)((uint32_t)&_estack - (uint32_t)&_Min_Stack_Size);
+}
+
+/**
+ * @brief Paint the free stack and write the guard words. To be called
+ * early from main, the stack above the current frame is not painted.
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef memory_init(void)
+{
+	uint32_t *limit = memory_stack_limit();
+	uint32_t *top = (uint32_t *)((__get_MSP() - MEMORY_PAINT_MARGIN) & ~3UL);
+
+	for (uint32_t *p = limit; p < top; p++)
+		*p = (p < limit + MEMORY_GUARD_WORDS) ? MEMORY_GUARD : MEMORY_PAINT;
+
+	stack_used_max = 0;
+	guard_breaches = 0;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Update the stack high-water mark and check the guard words.
+ * In DEBUG builds a breach stops the program on a HardFault.
+ *
+ * this function is called by the interrupt function in timer
+ */
+void memory_check(void)
+{
+	uint32_t *limit = memory_stack_limit();
+	uint32_t *p = limit + MEMORY_GUARD_WORDS;
+
+	for (int i = 0; i < MEMORY_GUARD_WORDS; i++)
+	{
+		if (limit[i] != MEMORY_GUARD)
+		{
+			guard_breaches++;
+#ifdef DEBUG
+			// Undefined instruction, escalated to HardFault
+			__builtin_trap();
+#endif
+			break;
+		}
+	}
+
+	// The first word not painted anymore is the deepest stack use
+	while ((p < (uint32_t *)&_estack) && (*p == MEMORY_PAINT))
+		p++;
+
+	uint32_t used = (uint32_t)&_estack - (uint32_t)p;
+	if (used > stack_used_max)
+		stack_used_max = used;
+}
+
+/**
+ * @brief Get the RAM budget
+ * @param _report Filled with the RAM use
+ */
+void memory_get_report(TypeDef_Memory_Report *_report)
+{
+	uint32_t ram_size = (uint32_t)&_estack - (uint32_t)&_sdata;
+
+	_report->static_ram = (uint32_t)&_end - (uint32_t)&_sdata;
+	_report->heap_reserved = (uint32_t)&_Min_Heap_Size;
+	_report->heap_used = (uint32_t)sysmem_heap_end() - (uint32_t)&_end;
+	_report->heap_refused = sysmem_heap_refused();
+	_report->stack_reserved = (uint32_t)&_Min_Stack_Size;
+	_report->stack_used_max = stack_used_max;
+	_report->ram_free = ram_size - _report->static_ram - _report->heap_used - stack_used_max;
+	_report->guard_breaches = guard_breaches;
+}
+
+/**
+ * @brief Print the RAM budget, in bytes
+ */
+void memory_dump(void)
+{
+	TypeDef_Memory_Report report;
+
+	memory_get_report(&report);
+
+	printf("memory,static,%lu\n", report.static_ram);
+	printf("memory,heap,%lu,%lu,%lu\n", report.heap_used, report.heap_reserved, report.heap_refused);
+	printf("memory,stack,%lu,%lu\n", report.stack_used_max, report.stack_reserved);
+	printf("memory,free,%lu\n", report.ram_free);
+	printf("memory,guard_breaches,%lu\n", report.guard_breaches);
+}
@@ -0,0 +1,44 @@
+/*
+ * memory.h
+ *
+ * RAM budget monitor. The free stack is painted at startup, memory_check (a timer task)
+ * then finds the stack high-water mark and checks the guard words placed at the limit of
+ * the stack reserved by _Min_Stack_Size. In DEBUG builds a guard breach raises a HardFault.
+ * The budget is printed in the match end report.
+ *
+ * The host simulator gives the same symbols from Host/firmware.ld, the stack being the one
+ * pong_sim runs the firmware on. The host C library allocates outside of the firmware RAM :
+ * the heap in use stays 0 there.
+ */
+
+#ifndef MEMORY_MEMORY_H_
+#define MEMORY_MEMORY_H_
+
+#include "stm32l1xx_hal.h"
+
+#include <stdio.h>
+
+#define MEMORY_PAINT 0xDEADBEEF		 // Value of a stack word never used
+#define MEMORY_GUARD 0x5AFE5AFE		 // Value of the guard words
+#define MEMORY_GUARD_WORDS 4		 // Guard words at the stack limit
+#define MEMORY_PAINT_MARGIN 64		 // Bytes left unpainted below the stack pointer
+#define MEMORY_CHECK_PERIOD_MS 1000	 // Period of memory_check
+
+typedef struct
+{
+	uint32_t static_ram;	  // .data + .bss + .noinit
+	uint32_t heap_reserved;	  // _Min_Heap_Size
+	uint32_t heap_used;		  // Bytes given by _sbrk
+	uint32_t heap_refused;	  // Allocations refused by _sbrk, PONG_NO_HEAP builds only
+	uint32_t stack_reserved;  // _Min_Stack_Size
+	uint32_t stack_used_max;  // Stack high-water mark
+	uint32_t ram_free;		  // RAM neither used by the heap nor ever reached by the stack
+	uint32_t guard_breaches;  // Number of checks which found a guard word overwritten
+} TypeDef_Memory_Report;
+
+HAL_StatusTypeDef memory_init(void);
+void memory_check(void);
+void memory_get_report(TypeDef_Memory_Report *_report);
+void memory_dump(void);
+
+#endif /* MEMORY_MEMORY_H_ */
@@ -0,0 +1,235 @@
+/*
+ * power.c
+ */
+
+#include "power.h"
+#include "clock.h"
+#include "capture.h"
+#include "main.h"
+
+// Buttons read at the wakeup, both on GPIOA
+#if BUTTON_INPUT_CAPTURE
+#define POWER_BTN_PORT CAPTURE_GPIO_Port
+#define POWER_BTN_PINS (CAPTURE_BTN1_Pin | CAPTURE_BTN2_Pin)
+#else
+#define POWER_BTN_PORT BTN1_GPIO_Port
+#define POWER_BTN_PINS (BTN1_Pin | BTN2_Pin)
+#endif
+
+//the wakeup timer counts up to 65536 seconds
+typedef char power_rtc_wakeup_check[(POWER_RTC_WAKEUP_S >= 1 && POWER_RTC_WAKEUP_S <= 65536) ? 1 : -1];
+
+static TypeDef_Power power;
+
+/**
+ * @brief Unlock the RTC registers
+ */
+static inline void power_rtc_unlock(void)
+{
+	RTC->WPR = 0xCA;
+	RTC->WPR = 0x53;
+}
+
+/**
+ * @brief Lock the RTC registers
+ */
+static inline void power_rtc_lock(void) { RTC->WPR = 0xFF; }
+
+/**
+ * @retval Time of the day from the RTC calendar, in milliseconds
+ */
+static uint32_t power_rtc_now_ms(void)
+{
+	uint32_t tr;
+	uint32_t ssr;
+
+	// The shadow registers are bypassed : read again if the second changed in between
+	do
+	{
+		tr = RTC->TR;
+		ssr = RTC->SSR;
+	} while (tr != RTC->TR);
+
+	uint32_t seconds = ((tr >> 20) & 0x3) * 36000 + ((tr >> 16) & 0xF) * 3600 +
+					   ((tr >> 12) & 0x7) * 600 + ((tr >> 8) & 0xF) * 60 +
+					   ((tr >> 4) & 0x7) * 10 + (tr & 0xF);
+
+	// The sub-second counter counts down
+	return seconds * 1000 + ((POWER_RTC_PREDIV_S - ssr) * 1000) / (POWER_RTC_PREDIV_S + 1);
+}
+
+/**
+ * @brief Start the RTC calendar on the LSI and set up its wakeup timer
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef power_init(void)
+{
+	__HAL_RCC_PWR_CLK_ENABLE();
+
+	// The RTC is in the backup domain
+	PWR->CR |= PWR_CR_DBP;
+
+	RCC->CSR |= RCC_CSR_LSION;
+	while ((RCC->CSR & RCC_CSR_LSIRDY) == 0);
+
+	// The RTC clock source can only be changed by a reset of the backup domain
+	if ((RCC->CSR & RCC_CSR_RTCSEL) != RCC_CSR_RTCSEL_LSI)
+	{
+		RCC->CSR |= RCC_CSR_RTCRST;
+		RCC->CSR &= ~RCC_CSR_RTCRST;
+		RCC->CSR |= RCC_CSR_RTCSEL_LSI;
+	}
+	RCC->CSR |= RCC_CSR_RTCEN;
+
+	power_rtc_unlock();
+
+	// 1Hz calendar, its counters read directly
+	RTC->ISR |= RTC_ISR_INIT;
+	while ((RTC->ISR & RTC_ISR_INITF) == 0);
+	RTC->PRER = POWER_RTC_PREDIV_S;
+	RTC->PRER |= POWER_RTC_PREDIV_A << 16;
+	RTC->CR = RTC_CR_BYPSHAD;
+	RTC->ISR &= ~RTC_ISR_INIT;
+
+	// Wakeup timer on the 1Hz clock, started by each Stop mode
+	while ((RTC->ISR & RTC_ISR_WUTWF) == 0);
+	RTC->WUTR = POWER_RTC_WAKEUP_S - 1;
+	RTC->CR |= RTC_CR_WUCKSEL_2 | RTC_CR_WUTIE;
+
+	power_rtc_lock();
+
+	// The RTC wakeup is EXTI line 20, as an event : no interrupt handler
+	EXTI->RTSR |= EXTI_RTSR_TR20;
+	EXTI->EMR |= EXTI_EMR_MR20;
+
+	power.waking = 0;
+	power.stats = (TypeDef_Power_Stats){0};
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Enter the Stop mode until a press or the RTC wakeup. The interrupts pending or coming
+ * in between (timers, DMA) are served and the core goes back to Stop.
+ * @retval POWER_WAKE_BUTTON or POWER_WAKE_RTC
+ */
+POWER_Wake_Enum power_stop(void)
+{
+	POWER_Wake_Enum source = POWER_WAKE_NONE;
+	CLOCK_Mode_Enum mode = clock_get_mode();
+
+	// The core wakes up on the MSI, it is stopped on it
+	clock_set_mode(CLOCK_SLOW);
+
+	power_rtc_unlock();
+	RTC->CR &= ~RTC_CR_WUTE;
+	while ((RTC->ISR & RTC_ISR_WUTWF) == 0);
+	RTC->ISR &= ~RTC_ISR_WUTF;
+	RTC->CR |= RTC_CR_WUTE;
+	power_rtc_lock();
+	EXTI->PR = EXTI_PR_PR20;
+
+#if BUTTON_INPUT_CAPTURE
+	// The buttons are on timer inputs, which are stopped : their EXTI lines give a wakeup event
+	EXTI->FTSR |= POWER_BTN_PINS;
+	EXTI->EMR |= POWER_BTN_PINS;
+#endif
+
+	uint32_t start_ms = power_rtc_now_ms();
+
+	// Button lines unmasked before the Stop mode : the EXTI handler masks the line of an edge until
+	// the debouncer samples the buttons, which TIM4 only does once awake
+	uint32_t btn_imr = EXTI->IMR & POWER_BTN_PINS;
+
+	// Regulator in low power, Vrefint off and not waited for at the wakeup
+	PWR->CR = (PWR->CR & ~PWR_CR_PDDS) | PWR_CR_LPSDSR | PWR_CR_ULP | PWR_CR_FWU | PWR_CR_CWUF;
+	SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+
+	while (source == POWER_WAKE_NONE)
+	{
+		// The first WFE clears the event register
+		__SEV();
+		__WFE();
+		__WFE();
+		power.wake_cycles = DWT->CYCCNT;
+
+		if (RTC->ISR & RTC_ISR_WUTF)
+			source = POWER_WAKE_RTC;
+		else if ((POWER_BTN_PORT->IDR & POWER_BTN_PINS) != POWER_BTN_PINS)
+			source = POWER_WAKE_BUTTON;
+		// An edge already released, a bounce or a glitch : its line stays masked until awake
+		else if ((EXTI->IMR & POWER_BTN_PINS) != btn_imr || (EXTI->PR & btn_imr) != 0)
+			source = POWER_WAKE_BUTTON;
+	}
+
+	SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+	PWR->CR &= ~PWR_CR_LPSDSR;
+
+#if BUTTON_INPUT_CAPTURE
+	EXTI->EMR &= ~POWER_BTN_PINS;
+	EXTI->FTSR &= ~POWER_BTN_PINS;
+	EXTI->PR = POWER_BTN_PINS;
+#endif
+
+	power_rtc_unlock();
+	RTC->CR &= ~RTC_CR_WUTE;
+	RTC->ISR &= ~RTC_ISR_WUTF;
+	power_rtc_lock();
+	EXTI->PR = EXTI_PR_PR20;
+
+	// The HAL tick did not count while stopped
+	uint32_t stop_ms = (power_rtc_now_ms() + POWER_DAY_MS - start_ms) % POWER_DAY_MS;
+	uwTick += stop_ms;
+
+	clock_set_mode(mode);
+
+	TypeDef_Power_Stats *stats = &power.stats;
+
+	stats->stops++;
+	stats->stop_ms += stop_ms;
+	if (source == POWER_WAKE_RTC)
+		stats->rtc_wakes++;
+	else
+		stats->button_wakes++;
+
+	power.waking = 1;
+
+	return source;
+}
+
+/**
+ * @brief End of an FSM step, the first one after a wakeup gives the wake latency
+ */
+void power_frame_done(void)
+{
+	if (power.waking == 0)
+		return;
+
+	power.waking = 0;
+
+	TypeDef_Power_Stats *stats = &power.stats;
+	uint32_t wake_us = ((uint64_t)(DWT->CYCCNT - power.wake_cycles) * 1000000) / HAL_RCC_GetHCLKFreq();
+
+	stats->last_wake_us = wake_us;
+	if (wake_us > stats->max_wake_us)
+		stats->max_wake_us = wake_us;
+	if (wake_us > POWER_WAKE_TARGET_US)
+		stats->late_wakes++;
+}
+
+/**
+ * @retval Deep idle statistics
+ */
+const TypeDef_Power_Stats *power_get_stats(void) { return &power.stats; }
+
+/**
+ * @brief Print the deep idle statistics :
+ * power,stops,button_wakes,rtc_wakes,stop_ms,last_wake_us,max_wake_us,late_wakes
+ */
+void power_dump(void)
+{
+	TypeDef_Power_Stats *stats = &power.stats;
+
+	printf("power,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", stats->stops, stats->button_wakes, stats->rtc_wakes,
+		   stats->stop_ms, stats->last_wake_us, stats->max_wake_us, stats->late_wakes);
+}
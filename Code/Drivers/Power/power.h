@@ -0,0 +1,76 @@
+/*
+ * power.h
+ *
+ * Deep idle : Stop mode with the regulator in low power, every clock stopped but the LSI and the
+ * RTC. The core is moved to the MSI first (see clock.h), so that it wakes up on the same clock and
+ * nothing is to be retimed. It wakes up on a press of BTN1 or BTN2 (EXTI lines 11/12, or event
+ * lines 0/1 in BUTTON_INPUT_CAPTURE mode) or on the RTC wakeup timer, every POWER_RTC_WAKEUP_S.
+ *
+ * The RTC calendar runs from the LSI and is read around the Stop mode, the HAL tick is moved on by
+ * the time spent stopped. The TIM4 scheduler and the TIM5 microsecond counter are paused.
+ *
+ * Wake latency : from the first instruction after the wakeup to the end of the first FSM step,
+ * counted with the DWT cycle counter and checked against POWER_WAKE_TARGET_US. The Stop mode exit
+ * itself, a few microseconds with the fast wakeup, is not seen by the core.
+ */
+
+#ifndef POWER_POWER_H_
+#define POWER_POWER_H_
+
+#include "stm32l1xx_hal.h"
+
+#include <stdio.h>
+
+// Set to 0 to keep the board running while nobody plays
+#ifndef POWER_DEEP_IDLE_ENABLE
+#define POWER_DEEP_IDLE_ENABLE 1
+#endif
+
+// Time without a press in an idle state before the Stop mode
+#ifndef POWER_IDLE_TIMEOUT_MS
+#define POWER_IDLE_TIMEOUT_MS 120000
+#endif
+
+// Period of the RTC wakeup, the board then resumes until the next timeout
+#ifndef POWER_RTC_WAKEUP_S
+#define POWER_RTC_WAKEUP_S 600
+#endif
+
+// Longest wake to first FSM step
+#ifndef POWER_WAKE_TARGET_US
+#define POWER_WAKE_TARGET_US 1000
+#endif
+
+#define POWER_RTC_PREDIV_A 127								// LSI / 128 to the synchronous prescaler
+#define POWER_RTC_PREDIV_S ((LSI_VALUE / 128) - 1)			// 1Hz calendar
+#define POWER_DAY_MS 86400000
+
+typedef enum {
+	POWER_WAKE_NONE = 0,
+	POWER_WAKE_BUTTON = 1,
+	POWER_WAKE_RTC = 2,
+}POWER_Wake_Enum;
+
+typedef struct {
+	uint32_t stops;				// Stop modes entered
+	uint32_t button_wakes;		// Wakeups by a press
+	uint32_t rtc_wakes;			// Wakeups by the RTC
+	uint32_t stop_ms;			// Time spent stopped
+	uint32_t last_wake_us;		// Last wake to first FSM step
+	uint32_t max_wake_us;		// Longest wake to first FSM step
+	uint32_t late_wakes;		// Wakes over POWER_WAKE_TARGET_US
+}TypeDef_Power_Stats;
+
+typedef struct {
+	uint8_t waking;				// A wake is being measured
+	uint32_t wake_cycles;		// DWT cycle counter at the wakeup
+	TypeDef_Power_Stats stats;
+}TypeDef_Power;
+
+HAL_StatusTypeDef power_init(void);
+POWER_Wake_Enum power_stop(void);
+void power_frame_done(void);
+const TypeDef_Power_Stats *power_get_stats(void);
+void power_dump(void);
+
+#endif /* POWER_POWER_H_ */
@@ -0,0 +1,189 @@
+/*
+ * profiler.c
+ */
+
+#include "profiler.h"
+#include "board_config.h"
+#include "log.h"
+
+static TypeDef_Profiler profiler;
+
+static const char * irq_names[] = {
+	"TIM4",
+	"EXTI15_10",
+};
+
+/**
+ * @brief Get the log2 histogram bucket of a cycle count
+ * @param _cycles Cycle count
+ * @retval Bucket index, 0 for 0 cycles, the last bucket for longer counts
+ */
+static inline uint32_t profiler_bucket(uint32_t _cycles)
+{
+	uint32_t bucket = 32 - __CLZ(_cycles);
+
+	return (bucket < PROFILER_BUCKETS) ? bucket : PROFILER_BUCKETS - 1;
+}
+
+/**
+ * @brief Enable the DWT cycle counter and measure the cost of the profiler hooks
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef profiler_init(void)
+{
+	// The counter is not reset, the timer phase may already be stamped
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	profiler.overhead_cycles = 0;
+
+	// Calibrate : the smallest duration seen right after an empty enter hook is the hooks overhead
+	uint32_t overhead = 0xFFFFFFFF;
+	for (int i = 0; i < 8; i++)
+	{
+		uint32_t start = profiler_irq_enter(PROFILER_IRQ_TIM4, PROFILER_NO_LATENCY);
+		uint32_t cycles = DWT->CYCCNT - start;
+
+		if (cycles < overhead)
+			overhead = cycles;
+	}
+	profiler.overhead_cycles = overhead;
+
+	profiler_reset();
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Record the entry of an interrupt, to be called first in the handler
+ * @param _irq Profiled interrupt
+ * @param _latency Cycles elapsed between the event and the handler entry,
+ * PROFILER_NO_LATENCY if unknown
+ * @retval Cycle counter value to give to profiler_irq_exit
+ */
+RAMFUNC uint32_t profiler_irq_enter(PROFILER_IRQ_Enum _irq, uint32_t _latency)
+{
+	uint32_t start = DWT->CYCCNT;
+	TypeDef_Profiler_IRQ *irq = &profiler.irqs[_irq];
+
+	if (_latency != PROFILER_NO_LATENCY)
+	{
+		irq->latency_histogram[profiler_bucket(_latency)]++;
+
+		if (_latency > irq->max_latency)
+			irq->max_latency = _latency;
+	}
+
+	return start;
+}
+
+/**
+ * @brief Record the exit of an interrupt, to be called last in the handler
+ * @param _irq Profiled interrupt
+ * @param _start Value returned by profiler_irq_enter
+ */
+RAMFUNC void profiler_irq_exit(PROFILER_IRQ_Enum _irq, uint32_t _start)
+{
+	uint32_t duration = DWT->CYCCNT - _start;
+	TypeDef_Profiler_IRQ *irq = &profiler.irqs[_irq];
+
+	// Remove the hooks cost
+	duration = (duration > profiler.overhead_cycles) ? duration - profiler.overhead_cycles : 0;
+
+	irq->count++;
+	irq->duration_histogram[profiler_bucket(duration)]++;
+
+	if (duration > irq->max_duration)
+		irq->max_duration = duration;
+}
+
+/**
+ * @brief Stamp the restart of the timer prescaler, to be called right after the timer update
+ * generation (or the counter enable) which restarted it. The timer counts at HCLK / (PSC + 1).
+ */
+RAMFUNC void profiler_timer_restart(void)
+{
+	profiler.timer_phase = DWT->CYCCNT;
+}
+
+/**
+ * @brief Entry latency of a timer update interrupt : the counts reached since the update,
+ * plus the cycles elapsed in the current count, known from the prescaler phase
+ * @param _tim Timer which raised the update interrupt
+ * @retval Latency in cycles
+ */
+RAMFUNC uint32_t profiler_timer_latency(TIM_TypeDef *_tim)
+{
+	uint32_t period = _tim->PSC + 1;
+	uint32_t cnt, now;
+
+	// Both reads in the same count, at most one retry as a count lasts PSC + 1 cycles
+	do
+	{
+		cnt = _tim->CNT;
+		now = DWT->CYCCNT;
+	} while (_tim->CNT != cnt);
+
+	return cnt * period + (now - profiler.timer_phase) % period;
+}
+
+/**
+ * @brief Get the statistics of an interrupt
+ * @param _irq Profiled interrupt
+ * @retval Pointer to the statistics
+ */
+const TypeDef_Profiler_IRQ *profiler_get_irq(PROFILER_IRQ_Enum _irq)
+{
+	return &profiler.irqs[_irq];
+}
+
+/**
+ * @brief Clear every statistic, the hooks overhead is kept
+ */
+void profiler_reset(void)
+{
+	for (int i = 0; i < PROFILER_IRQ_COUNT; i++)
+	{
+		TypeDef_Profiler_IRQ *irq = &profiler.irqs[i];
+
+		irq->count = 0;
+		irq->max_duration = 0;
+		irq->max_latency = 0;
+
+		for (int j = 0; j < PROFILER_BUCKETS; j++)
+		{
+			irq->duration_histogram[j] = 0;
+			irq->latency_histogram[j] = 0;
+		}
+	}
+}
+
+/**
+ * @brief Print the statistics over ITM, the hook overhead and whether the handlers run from the SRAM :
+ * profiler,overhead,cycles,ramfunc
+ * then one line per interrupt and histogram :
+ * name,kind,count,max,bucket0,bucket1,...
+ * Each line is sent before the next one, a whole dump does not fit in the log buffer.
+ */
+void profiler_dump(void)
+{
+	printf("profiler,overhead,%lu,%d\n", profiler.overhead_cycles, BOARD_RAMFUNC_ENABLE);
+	log_flush();
+
+	for (int i = 0; i < PROFILER_IRQ_COUNT; i++)
+	{
+		TypeDef_Profiler_IRQ *irq = &profiler.irqs[i];
+
+		printf("%s,duration,%lu,%lu", irq_names[i], irq->count, irq->max_duration);
+		for (int j = 0; j < PROFILER_BUCKETS; j++)
+			printf(",%lu", irq->duration_histogram[j]);
+		printf("\n");
+		log_flush();
+
+		printf("%s,latency,%lu,%lu", irq_names[i], irq->count, irq->max_latency);
+		for (int j = 0; j < PROFILER_BUCKETS; j++)
+			printf(",%lu", irq->latency_histogram[j]);
+		printf("\n");
+		log_flush();
+	}
+}
@@ -0,0 +1,77 @@
+/*
+ * profiler.h
+ *
+ * Interrupt profiler based on the DWT cycle counter. For each profiled IRQ it records the
+ * entry latency and the execution time in log2 histograms kept in RAM, readable from the
+ * debugger (static variable "profiler") or printed over ITM with profiler_dump().
+ *
+ * Build with PROFILER_ENABLE=1 to enable it, otherwise the IRQ hooks compile to nothing.
+ * The cost of a pair of hooks is measured by profiler_init() and stored in overhead_cycles,
+ * it is subtracted from every recorded duration. profiler_dump() prints it on its first line.
+ * From the Cortex-M3 instruction timings, with the hooks in SRAM, a pair costs about 60 cycles
+ * (under 2us at 32MHz) and the TIM4 latency computation about 20 more, of which the calibration
+ * removes the 25 or so spent between the two DWT reads. Measure it on the board before relying
+ * on durations shorter than a few hundred cycles.
+ *
+ * The TIM4 latency is measured in CPU cycles : the timer module stamps the DWT counter each time
+ * it restarts the TIM4 prescaler (PROFILER_TIMER_RESTART), the update instant is then known to the
+ * cycle from the counter value and the position in the current count.
+ */
+
+#ifndef PROFILER_PROFILER_H_
+#define PROFILER_PROFILER_H_
+
+#include "stm32l1xx_hal.h"
+
+#include <stdio.h>
+
+#ifndef PROFILER_ENABLE
+#define PROFILER_ENABLE 0
+#endif
+
+//one bucket per power of two of cycles, bucket n holds values in [2^(n-1), 2^n[
+#define PROFILER_BUCKETS 32
+
+//latency value given when the IRQ source has no way to timestamp the event
+#define PROFILER_NO_LATENCY 0xFFFFFFFF
+
+typedef enum {
+	PROFILER_IRQ_TIM4 = 0,
+	PROFILER_IRQ_EXTI15_10 = 1,
+	PROFILER_IRQ_COUNT,
+}PROFILER_IRQ_Enum;
+
+typedef struct {
+	uint32_t count;								// Number of recorded interrupts
+	uint32_t max_duration;						// Worst execution time in cycles
+	uint32_t max_latency;						// Worst entry latency in cycles
+	uint32_t duration_histogram[PROFILER_BUCKETS];
+	uint32_t latency_histogram[PROFILER_BUCKETS];
+}TypeDef_Profiler_IRQ;
+
+typedef struct {
+	TypeDef_Profiler_IRQ irqs[PROFILER_IRQ_COUNT];
+	uint32_t overhead_cycles;	// Cost of a profiler_irq_enter / profiler_irq_exit pair
+	uint32_t timer_phase;		// DWT cycle at which the timer prescaler last restarted
+}TypeDef_Profiler;
+
+#if PROFILER_ENABLE
+#define PROFILER_IRQ_ENTER(_irq, _latency) uint32_t profiler_start = profiler_irq_enter((_irq), (_latency))
+#define PROFILER_IRQ_EXIT(_irq) profiler_irq_exit((_irq), profiler_start)
+#define PROFILER_TIMER_RESTART() profiler_timer_restart()
+#else
+#define PROFILER_IRQ_ENTER(_irq, _latency) do {} while (0)
+#define PROFILER_IRQ_EXIT(_irq) do {} while (0)
+#define PROFILER_TIMER_RESTART() do {} while (0)
+#endif
+
+HAL_StatusTypeDef profiler_init(void);
+uint32_t profiler_irq_enter(PROFILER_IRQ_Enum _irq, uint32_t _latency);
+void profiler_irq_exit(PROFILER_IRQ_Enum _irq, uint32_t _start);
+void profiler_timer_restart(void);
+uint32_t profiler_timer_latency(TIM_TypeDef * _tim);
+const TypeDef_Profiler_IRQ * profiler_get_irq(PROFILER_IRQ_Enum _irq);
+void profiler_reset(void);
+void profiler_dump(void);
+
+#endif /* PROFILER_PROFILER_H_ */
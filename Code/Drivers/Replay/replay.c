@@ -0,0 +1,266 @@
+/*
+ * replay.c
+ */
+
+#include "replay.h"
+#include "log.h"
+
+//kept across resets, not cleared by the startup code
+static TypeDef_Replay_Recording recording __attribute__((section(".noinit")));
+
+static REPLAY_Mode_Enum mode = REPLAY_OFF;
+static uint32_t signature = REPLAY_FNV_OFFSET;
+static uint32_t playback_index = 0;
+static uint32_t mismatch_iteration = REPLAY_NO_MISMATCH;
+
+//presses queued by the interrupts and the bots (thread mode), the enqueue masks the interrupts so the
+//producers cannot interleave, single consumer
+static struct {
+	uint16_t pins[REPLAY_PENDING_SZ];
+	uint32_t times[REPLAY_PENDING_SZ];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+} pending;
+
+/**
+ * @brief Fold a word into the output signature
+ * @param _word Word to add
+ */
+static void replay_hash(uint32_t _word)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		signature ^= (_word >> (8 * i)) & 0xFF;
+		signature *= REPLAY_FNV_PRIME;
+	}
+}
+
+/**
+ * @brief Compare the live signature with the recorded one, the first divergence is kept
+ * @param _event Recorded input about to be replayed
+ * @param _iteration Current iteration
+ */
+static void replay_check(const TypeDef_Replay_Event *_event, uint32_t _iteration)
+{
+	if (mismatch_iteration != REPLAY_NO_MISMATCH)
+		return;
+
+	if (_event->signature != signature || _event->iteration != _iteration)
+		mismatch_iteration = _iteration;
+}
+
+/**
+ * @brief Append an input to the recording
+ */
+static void replay_record(uint32_t _iteration, uint16_t _btn_pin, uint32_t _value)
+{
+	if (recording.count >= REPLAY_BUFFER_SZ)
+	{
+		// Reported once, the recording replays up to here
+		if (recording.overflow == 0)
+			printf("replay,overflow,%lu\n", _iteration);
+
+		recording.overflow = 1;
+		return;
+	}
+
+	TypeDef_Replay_Event *event = &recording.events[recording.count];
+
+	event->iteration = _iteration;
+	event->value = _value;
+	event->signature = signature;
+	event->pin = _btn_pin;
+	recording.count++;
+}
+
+/**
+ * @brief Print the playback result once every recorded input has been replayed
+ */
+static void replay_end_playback(void)
+{
+	if (mismatch_iteration == REPLAY_NO_MISMATCH)
+		printf("replay,match,%lu,%08lx\n", recording.count, signature);
+	else
+		printf("replay,mismatch,%lu,%lu\n", recording.count, mismatch_iteration);
+
+	mode = REPLAY_OFF;
+}
+
+/**
+ * @brief Start a new recording, or replay the one left by the previous run
+ * @param _playback 1 to replay the previous recording, if there is one
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef replay_init(uint8_t _playback)
+{
+	signature = REPLAY_FNV_OFFSET;
+	playback_index = 0;
+	mismatch_iteration = REPLAY_NO_MISMATCH;
+	pending.head = 0;
+	pending.tail = 0;
+
+	if (_playback && recording.magic == REPLAY_MAGIC && recording.count > 0 && recording.count <= REPLAY_BUFFER_SZ)
+	{
+		mode = REPLAY_PLAYBACK;
+		return HAL_OK;
+	}
+
+	recording.magic = REPLAY_MAGIC;
+	recording.count = 0;
+	recording.overflow = 0;
+	mode = REPLAY_RECORD;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Queue a press until the next iteration, called from the interrupts and the bots
+ * @param _btn_pin BTN1_Pin or BTN2_Pin
+ * @param _time_us Press time in microseconds
+ */
+RAMFUNC void replay_input(uint16_t _btn_pin, uint32_t _time_us)
+{
+	// A bot press may be preempted by a button interrupt between the head read and its store
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+
+	uint32_t head = pending.head;
+
+	if (head - pending.tail < REPLAY_PENDING_SZ)
+	{
+		pending.pins[head & (REPLAY_PENDING_SZ - 1)] = _btn_pin;
+		pending.times[head & (REPLAY_PENDING_SZ - 1)] = _time_us;
+		pending.head = head + 1;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Get the next press to give to the FSM at this iteration, to be called in a loop
+ * at the start of each iteration. Presses are recorded, or taken from the recording in playback.
+ * @param _iteration Current pong_run iteration
+ * @param _btn_pin Filled with the pin of the press
+ * @param _time_us Filled with the time of the press
+ * @retval 1 if a press was returned, 0 when there is none left for this iteration
+ */
+uint8_t replay_next(uint32_t _iteration, uint16_t *_btn_pin, uint32_t *_time_us)
+{
+	if (mode == REPLAY_PLAYBACK)
+	{
+		// The physical buttons are ignored
+		pending.tail = pending.head;
+
+		if (playback_index >= recording.count)
+		{
+			replay_end_playback();
+			return 0;
+		}
+
+		const TypeDef_Replay_Event *event = &recording.events[playback_index];
+
+		if (event->pin == 0 || event->iteration > _iteration)
+			return 0;
+
+		replay_check(event, _iteration);
+		playback_index++;
+
+		*_btn_pin = event->pin;
+		*_time_us = event->value;
+		return 1;
+	}
+
+	uint32_t tail = pending.tail;
+
+	if (tail == pending.head)
+		return 0;
+
+	*_btn_pin = pending.pins[tail & (REPLAY_PENDING_SZ - 1)];
+	*_time_us = pending.times[tail & (REPLAY_PENDING_SZ - 1)];
+	pending.tail = tail + 1;
+
+	if (mode == REPLAY_RECORD)
+		replay_record(_iteration, *_btn_pin, *_time_us);
+
+	return 1;
+}
+
+/**
+ * @brief Read of the clock by the FSM, recorded, or replaced by the recorded value in playback
+ * @param _iteration Current pong_run iteration
+ * @param _value Live clock value
+ * @retval Clock value to use
+ */
+uint32_t replay_clock(uint32_t _iteration, uint32_t _value)
+{
+	if (mode == REPLAY_RECORD)
+		replay_record(_iteration, 0, _value);
+
+	else if (mode == REPLAY_PLAYBACK && playback_index < recording.count)
+	{
+		const TypeDef_Replay_Event *event = &recording.events[playback_index];
+
+		replay_check(event, _iteration);
+
+		// Diverged, the live value is kept
+		if (event->pin != 0)
+			return _value;
+
+		playback_index++;
+		return event->value;
+	}
+
+	return _value;
+}
+
+/**
+ * @brief Fold an output of the FSM into the signature, outputs of the interrupts are ignored
+ * @param _kind Kind of output
+ * @param _a First argument (state left, LED index or register)
+ * @param _b Second argument (state entered, LED state or data)
+ */
+void replay_observe(REPLAY_Observe_Enum _kind, uint32_t _a, uint32_t _b)
+{
+	if (__get_IPSR() != 0 || mode == REPLAY_OFF)
+		return;
+
+	replay_hash(_kind);
+	replay_hash(_a);
+	replay_hash(_b);
+}
+
+/**
+ * @retval Current mode
+ */
+REPLAY_Mode_Enum replay_get_mode(void) { return mode; }
+
+/**
+ * @retval Current output signature
+ */
+uint32_t replay_get_signature(void) { return signature; }
+
+/**
+ * @retval Recording kept across resets, loaded and saved by the host simulator
+ */
+TypeDef_Replay_Recording *replay_get_recording(void) { return &recording; }
+
+/**
+ * @brief Print the recording, one line per input :
+ * replay,count,overflow,signature then iteration,pin,value,signature
+ * The text already logged is sent first, then each line before the next one : a whole recording
+ * does not fit in the log buffer, and a cut header would not load back.
+ */
+void replay_dump(void)
+{
+	log_flush();
+	printf("replay,%lu,%u,%08lx\n", recording.count, recording.overflow, signature);
+	log_flush();
+
+	for (uint32_t i = 0; i < recording.count && i < REPLAY_BUFFER_SZ; i++)
+	{
+		const TypeDef_Replay_Event *event = &recording.events[i];
+
+		printf("%lu,%u,%lu,%08lx\n", event->iteration, event->pin, event->value, event->signature);
+		log_flush();
+	}
+}
@@ -0,0 +1,86 @@
+/*
+ * replay.h
+ *
+ * Deterministic record and replay of the FSM inputs. The FSM only depends on the pong_run
+ * iteration count and on its inputs : the button presses and the clock reads of the ball arrival,
+ * which give the reaction times shown on the display. The other clock reads only feed the
+ * statistics, the telemetry and the bots, and are not recorded. Presses are queued by the
+ * interrupts and handed to the FSM at the start of an iteration, every input is recorded with its
+ * iteration into a RAM buffer which survives a reset (.noinit section). A full buffer is reported
+ * once by a replay,overflow,iteration line and by the overflow flag of replay_dump.
+ *
+ * The outputs of the FSM (LED writes, MAX7219 SPI writes and state transitions made in thread mode)
+ * are folded into a FNV-1a signature, stored with each recorded input. Holding BTN1 during a reset
+ * replays the last recording : the physical buttons are ignored, the recorded inputs are fed back
+ * at the same iterations and the signatures are compared, the result is printed at the end.
+ * The display blinker runs from the timer interrupt and is not part of the signature.
+ *
+ * The recording is printed by replay_dump at the end of each match. Its text is also the file
+ * format of pong_sim --record and --replay : a recording captured on the board replays on the
+ * host, the recordings of Host/Tests are golden outputs.
+ */
+
+#ifndef REPLAY_REPLAY_H_
+#define REPLAY_REPLAY_H_
+
+#include "stm32l1xx_hal.h"
+#include "pong_config.h"
+#include "board_config.h"
+
+#include <stdio.h>
+
+#ifndef REPLAY_ENABLE
+#define REPLAY_ENABLE 1
+#endif
+
+#define REPLAY_MAGIC 0x5E91A7ED		   // Marks a recording left in RAM by the previous run
+#define REPLAY_PENDING_SZ 8			   // Presses queued between two iterations, power of 2
+#define REPLAY_FNV_OFFSET 0x811C9DC5   // FNV-1a 32-bit offset basis
+#define REPLAY_FNV_PRIME 0x01000193	   // FNV-1a 32-bit prime
+#define REPLAY_NO_MISMATCH 0xFFFFFFFF
+
+typedef enum {
+	REPLAY_OFF = 0,
+	REPLAY_RECORD = 1,
+	REPLAY_PLAYBACK = 2,
+}REPLAY_Mode_Enum;
+
+typedef enum {
+	REPLAY_OBSERVE_TRANSITION = 0,
+	REPLAY_OBSERVE_LED = 1,
+	REPLAY_OBSERVE_SPI = 2,
+}REPLAY_Observe_Enum;
+
+typedef struct {
+	uint32_t iteration;	// pong_run iteration at which the FSM got the input
+	uint32_t value;		// Press time or clock value in microseconds
+	uint32_t signature;	// Output signature before the input
+	uint16_t pin;		// BTN1_Pin or BTN2_Pin, 0 for a clock read
+}TypeDef_Replay_Event;
+
+typedef struct {
+	uint32_t magic;		// REPLAY_MAGIC once initialized
+	uint32_t count;		// Number of recorded inputs
+	uint8_t overflow;	// Inputs were lost, the recording is only valid up to count
+	TypeDef_Replay_Event events[REPLAY_BUFFER_SZ];
+}TypeDef_Replay_Recording;
+
+#if REPLAY_ENABLE
+#define REPLAY_OBSERVE(_kind, _a, _b) replay_observe((_kind), (_a), (_b))
+#define REPLAY_CLOCK(_iteration, _value) replay_clock((_iteration), (_value))
+#else
+#define REPLAY_OBSERVE(_kind, _a, _b) do {} while (0)
+#define REPLAY_CLOCK(_iteration, _value) (_value)
+#endif
+
+HAL_StatusTypeDef replay_init(uint8_t _playback);
+void replay_input(uint16_t _btn_pin, uint32_t _time_us);
+uint8_t replay_next(uint32_t _iteration, uint16_t *_btn_pin, uint32_t *_time_us);
+uint32_t replay_clock(uint32_t _iteration, uint32_t _value);
+void replay_observe(REPLAY_Observe_Enum _kind, uint32_t _a, uint32_t _b);
+REPLAY_Mode_Enum replay_get_mode(void);
+uint32_t replay_get_signature(void);
+TypeDef_Replay_Recording *replay_get_recording(void);
+void replay_dump(void);
+
+#endif /* REPLAY_REPLAY_H_ */
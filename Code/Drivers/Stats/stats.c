@@ -0,0 +1,163 @@
+/*
+ * stats.c
+ */
+
+#include "stats.h"
+
+static TypeDef_Stats_Accumulator stats[STATS_PLAYERS_COUNT][STATS_KINDS_COUNT][STATS_SCOPES_COUNT];
+
+static const char * kind_names[] = {
+	"reaction",
+	"early",
+};
+
+static const char * scope_names[] = {
+	"match",
+	"session",
+};
+
+/**
+ * @brief Get the log2 histogram bucket of a duration
+ * @param _value_us Duration in microseconds
+ * @retval Bucket index, 0 for 0us, the last bucket for longer durations
+ */
+static inline uint32_t stats_bucket(uint32_t _value_us)
+{
+	uint32_t bucket = 32 - __CLZ(_value_us);
+
+	return (bucket < STATS_BUCKETS) ? bucket : STATS_BUCKETS - 1;
+}
+
+/**
+ * @brief Empty an accumulator
+ * @param _accumulator Accumulator to reset
+ */
+static void stats_reset_accumulator(TypeDef_Stats_Accumulator * _accumulator)
+{
+	_accumulator->count = 0;
+	_accumulator->min_us = 0xFFFFFFFF;
+	_accumulator->max_us = 0;
+	_accumulator->mean_us = 0;
+	_accumulator->m2 = 0;
+
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		_accumulator->histogram[i] = 0;
+}
+
+/**
+ * @brief Add a value to an accumulator, Welford's update of the mean and variance
+ * @param _accumulator Accumulator to update
+ * @param _value_us Duration in microseconds
+ */
+static void stats_update(TypeDef_Stats_Accumulator * _accumulator, uint32_t _value_us)
+{
+	float delta = (float) _value_us - _accumulator->mean_us;
+
+	_accumulator->count++;
+	_accumulator->mean_us += delta / _accumulator->count;
+	_accumulator->m2 += delta * ((float) _value_us - _accumulator->mean_us);
+
+	if (_value_us < _accumulator->min_us)
+		_accumulator->min_us = _value_us;
+
+	if (_value_us > _accumulator->max_us)
+		_accumulator->max_us = _value_us;
+
+	//saturate instead of wrapping, the histogram shape stays right
+	uint16_t * bin = &_accumulator->histogram[stats_bucket(_value_us)];
+	if (*bin < 0xFFFF)
+		(*bin)++;
+}
+
+/**
+ * @brief Reset every accumulator
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef stats_init(void)
+{
+	for (int i = 0; i < STATS_PLAYERS_COUNT; i++)
+		for (int j = 0; j < STATS_KINDS_COUNT; j++)
+			for (int k = 0; k < STATS_SCOPES_COUNT; k++)
+				stats_reset_accumulator(&stats[i][j][k]);
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Record an event in the match and session accumulators of the player
+ * @param _player Player concerned
+ * @param _kind Kind of event
+ * @param _value_us Measured duration in microseconds
+ */
+void stats_record(STATS_Player_Enum _player, STATS_Kind_Enum _kind, uint32_t _value_us)
+{
+	if (_player >= STATS_PLAYERS_COUNT || _kind >= STATS_KINDS_COUNT)
+		return;
+
+	for (int k = 0; k < STATS_SCOPES_COUNT; k++)
+		stats_update(&stats[_player][_kind][k], _value_us);
+}
+
+/**
+ * @brief Reset the accumulators of the current match, the session ones are kept
+ */
+void stats_reset_match(void)
+{
+	for (int i = 0; i < STATS_PLAYERS_COUNT; i++)
+		for (int j = 0; j < STATS_KINDS_COUNT; j++)
+			stats_reset_accumulator(&stats[i][j][STATS_MATCH]);
+}
+
+/**
+ * @param _player Player concerned
+ * @param _kind Kind of event
+ * @param _scope Match or session
+ * @retval The accumulator, NULL for an invalid argument
+ */
+const TypeDef_Stats_Accumulator * stats_get(STATS_Player_Enum _player, STATS_Kind_Enum _kind, STATS_Scope_Enum _scope)
+{
+	if (_player >= STATS_PLAYERS_COUNT || _kind >= STATS_KINDS_COUNT || _scope >= STATS_SCOPES_COUNT)
+		return NULL;
+
+	return &stats[_player][_kind][_scope];
+}
+
+/**
+ * @param _accumulator Accumulator to look at
+ * @retval Sample variance in us^2, 0 with less than 2 values
+ */
+float stats_get_variance(const TypeDef_Stats_Accumulator * _accumulator)
+{
+	if (_accumulator->count < 2)
+		return 0;
+
+	return _accumulator->m2 / (_accumulator->count - 1);
+}
+
+/**
+ * @brief Print the statistics, one line per accumulator :
+ * player,kind,scope,count,min_us,max_us,mean_us,variance_ms2,bucket0,bucket1,...
+ */
+void stats_dump(void)
+{
+	for (int i = 0; i < STATS_PLAYERS_COUNT; i++)
+	{
+		for (int j = 0; j < STATS_KINDS_COUNT; j++)
+		{
+			for (int k = 0; k < STATS_SCOPES_COUNT; k++)
+			{
+				const TypeDef_Stats_Accumulator * acc = &stats[i][j][k];
+
+				if (acc->count == 0)
+					continue;
+
+				//integer printing, the float printf support is not linked
+				printf("P%d,%s,%s,%lu,%lu,%lu,%lu,%lu", i + 1, kind_names[j], scope_names[k], acc->count,
+					   acc->min_us, acc->max_us, (uint32_t) acc->mean_us, (uint32_t) (stats_get_variance(acc) / 1000000));
+				for (int b = 0; b < STATS_BUCKETS; b++)
+					printf(",%u", acc->histogram[b]);
+				printf("\n");
+			}
+		}
+	}
+}
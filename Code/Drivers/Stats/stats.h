@@ -0,0 +1,54 @@
+/*
+ * stats.h
+ *
+ * Reaction time statistics of the players. Each event updates in O(1) a fixed size accumulator :
+ * count, min, max, streaming mean and variance (Welford) and a log2 histogram of microseconds.
+ * Accumulators are kept per player, per kind of event and per scope : the current match, reset
+ * with stats_reset_match(), and the whole session since power-up.
+ */
+
+#ifndef STATS_STATS_H_
+#define STATS_STATS_H_
+
+#include "stm32l1xx_hal.h"
+
+#include <stdio.h>
+
+//one bucket per power of two of microseconds, bucket n holds values in [2^(n-1), 2^n[, the last one up to 8.4s
+#define STATS_BUCKETS 24
+
+typedef enum {
+	STATS_P1 = 0,
+	STATS_P2 = 1,
+	STATS_PLAYERS_COUNT,
+}STATS_Player_Enum;
+
+typedef enum {
+	STATS_REACTION = 0,		// From the ball on the border to the return press
+	STATS_EARLY_MARGIN = 1,	// From an early press to the expected ball arrival
+	STATS_KINDS_COUNT,
+}STATS_Kind_Enum;
+
+typedef enum {
+	STATS_MATCH = 0,
+	STATS_SESSION = 1,
+	STATS_SCOPES_COUNT,
+}STATS_Scope_Enum;
+
+typedef struct {
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	float mean_us;			// Streaming mean
+	float m2;				// Sum of the squared distances to the mean, variance = m2 / (count - 1)
+	uint16_t histogram[STATS_BUCKETS];
+}TypeDef_Stats_Accumulator;
+
+HAL_StatusTypeDef stats_init(void);
+void stats_record(STATS_Player_Enum _player, STATS_Kind_Enum _kind, uint32_t _value_us);
+void stats_reset_match(void);
+const TypeDef_Stats_Accumulator * stats_get(STATS_Player_Enum _player, STATS_Kind_Enum _kind, STATS_Scope_Enum _scope);
+float stats_get_variance(const TypeDef_Stats_Accumulator * _accumulator);
+void stats_dump(void);
+
+#endif /* STATS_STATS_H_ */
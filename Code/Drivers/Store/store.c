@@ -0,0 +1,203 @@
+/*
+ * store.c
+ */
+
+#include "store.h"
+
+#define STORE_DATA_WORDS (STORE_RECORD_WORDS - 1)
+#define STORE_NO_SLOT 0xFFFFFFFF
+
+//the data must fill the record but the CRC word
+typedef char store_data_size_check[(sizeof(TypeDef_Store_Data) == STORE_DATA_WORDS * 4) ? 1 : -1];
+
+static TypeDef_Store_Record image;	 // Latest state, updated by store_add_match
+static TypeDef_Store_Record record;	 // Snapshot being written
+static uint32_t last_slot = STORE_NO_SLOT; // Slot of the latest valid record
+static uint32_t write_slot = 0;		 // Slot being written
+static uint8_t write_word = 0;		 // Next word of record to write
+static uint8_t writing = 0;			 // A record is being written
+static uint8_t dirty = 0;			 // image changed since the last snapshot
+
+/**
+ * @param _slot Slot index
+ * @retval Address of the first word of the slot
+ */
+static inline uint32_t store_slot_address(uint32_t _slot)
+{
+	return STORE_BASE + _slot * STORE_RECORD_WORDS * 4;
+}
+
+/**
+ * @brief CRC of the data words of a record, with the CRC unit (CRC-32, polynomial 0x04C11DB7)
+ * @param _record Record to check
+ * @retval CRC
+ */
+static uint32_t store_crc(const TypeDef_Store_Record *_record)
+{
+	CRC->CR = CRC_CR_RESET;
+
+	for (int i = 0; i < STORE_DATA_WORDS; i++)
+		CRC->DR = _record->words[i];
+
+	return CRC->DR;
+}
+
+/**
+ * @brief Read the latest valid record, one scan of every slot
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef store_init(void)
+{
+	__HAL_RCC_CRC_CLK_ENABLE();
+
+	TypeDef_Store_Record slot_record;
+	uint32_t best_sequence = 0;
+
+	last_slot = STORE_NO_SLOT;
+
+	for (uint32_t slot = 0; slot < STORE_SLOTS_COUNT; slot++)
+	{
+		const uint32_t *words = (const uint32_t *)store_slot_address(slot);
+
+		for (int i = 0; i < STORE_RECORD_WORDS; i++)
+			slot_record.words[i] = words[i];
+
+		// Erased slot, or torn by a reset during its write
+		if (slot_record.data.sequence == 0 || store_crc(&slot_record) != slot_record.words[STORE_DATA_WORDS])
+			continue;
+
+		if (slot_record.data.sequence > best_sequence)
+		{
+			best_sequence = slot_record.data.sequence;
+			last_slot = slot;
+			image = slot_record;
+		}
+	}
+
+	// Empty store, start from scratch
+	if (last_slot == STORE_NO_SLOT)
+	{
+		for (int i = 0; i < STORE_RECORD_WORDS; i++)
+			image.words[i] = 0;
+	}
+
+	writing = 0;
+	dirty = 0;
+
+	return HAL_OK;
+}
+
+/**
+ * @retval The latest state, including the matches not yet written
+ */
+const TypeDef_Store_Data *store_get(void) { return &image.data; }
+
+/**
+ * @brief Account a finished match and the reaction statistics of the match,
+ * written later by store_flush. The reaction times of a player whose mean is out of
+ * [0, STORE_REACTION_MAX_US] are left out, they would spoil the stored mean for good.
+ * @param _winner Player who won
+ * @param _p1_score Final score of P1
+ * @param _p2_score Final score of P2
+ * @retval HAL status
+ */
+HAL_StatusTypeDef store_add_match(STATS_Player_Enum _winner, uint8_t _p1_score, uint8_t _p2_score)
+{
+	if (_winner >= STATS_PLAYERS_COUNT)
+		return HAL_ERROR;
+
+	TypeDef_Store_Data *data = &image.data;
+
+	data->matches++;
+	data->wins[_winner]++;
+	data->last_scores[STATS_P1] = _p1_score;
+	data->last_scores[STATS_P2] = _p2_score;
+
+	for (int i = 0; i < STATS_PLAYERS_COUNT; i++)
+	{
+		const TypeDef_Stats_Accumulator *reaction = stats_get(i, STATS_REACTION, STATS_MATCH);
+
+		if (reaction->count == 0)
+			continue;
+
+		// Written this way, a NaN is out of range too
+		if (!(reaction->mean_us >= 0 && reaction->mean_us <= STORE_REACTION_MAX_US))
+			continue;
+
+		// Weighted mean of the stored returns and the returns of the match
+		uint32_t count = data->reaction_count[i] + reaction->count;
+		uint64_t sum_us = (uint64_t)data->reaction_mean_us[i] * data->reaction_count[i] +
+						  (uint64_t)reaction->mean_us * reaction->count;
+
+		data->reaction_mean_us[i] = sum_us / count;
+		data->reaction_count[i] = count;
+
+		if (data->reaction_best_us[i] == 0 || reaction->min_us < data->reaction_best_us[i])
+			data->reaction_best_us[i] = reaction->min_us;
+	}
+
+	dirty = 1;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Write one word of the latest snapshot to the data EEPROM. Several matches added
+ * before the write starts go in a single record.
+ */
+void store_flush(void)
+{
+	if (writing == 0)
+	{
+		if (dirty == 0)
+			return;
+
+		// Snapshot the image in the slot after the latest record
+		image.data.sequence++;
+		record = image;
+		record.words[STORE_DATA_WORDS] = store_crc(&record);
+
+		write_slot = (last_slot == STORE_NO_SLOT) ? 0 : (last_slot + 1) % STORE_SLOTS_COUNT;
+		write_word = 0;
+		writing = 1;
+		dirty = 0;
+
+		HAL_FLASHEx_DATAEEPROM_Unlock();
+	}
+
+	uint32_t address = store_slot_address(write_slot) + write_word * 4;
+
+	// Writing the value already there would only wear the cell
+	if (*(const uint32_t *)address != record.words[write_word])
+		HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, address, record.words[write_word]);
+
+	// The CRC is written last, the record is valid once it is written
+	if (++write_word < STORE_RECORD_WORDS)
+		return;
+
+	HAL_FLASHEx_DATAEEPROM_Lock();
+
+	last_slot = write_slot;
+	writing = 0;
+}
+
+/**
+ * @retval 1 while some data is not written yet
+ */
+uint8_t store_is_pending(void) { return writing || dirty; }
+
+/**
+ * @brief Print the stored data :
+ * store,sequence,slot,matches,wins1,wins2 then one line per player
+ */
+void store_dump(void)
+{
+	const TypeDef_Store_Data *data = &image.data;
+
+	printf("store,%lu,%lu,%lu,%u,%u\n", data->sequence, last_slot, data->matches,
+		   data->wins[STATS_P1], data->wins[STATS_P2]);
+
+	for (int i = 0; i < STATS_PLAYERS_COUNT; i++)
+		printf("P%d,%lu,%lu,%lu,%u\n", i + 1, data->reaction_count[i], data->reaction_mean_us[i],
+			   data->reaction_best_us[i], data->last_scores[i]);
+}
@@ -0,0 +1,59 @@
+/*
+ * store.h
+ *
+ * Persistent match results and reaction statistics, kept in the data EEPROM. The store region is
+ * an append-only circular log of fixed size records : each record is a full snapshot with an
+ * increasing sequence number and a CRC (hardware CRC unit). Writing each snapshot in the next slot
+ * spreads the wear over the whole region, a torn record fails its CRC and the previous one is used.
+ *
+ * store_init() finds the latest valid record in a single scan. store_add_match() only updates the
+ * RAM image, store_flush() writes the latest snapshot one word per call and is meant to be called
+ * while the game is idle, a word write takes a few milliseconds.
+ *
+ * On the host the data EEPROM may be a file (pong_sim --eeprom FILE), the CRC unit is simulated :
+ * the file holds the same records as the board.
+ */
+
+#ifndef STORE_STORE_H_
+#define STORE_STORE_H_
+
+#include "stm32l1xx_hal.h"
+#include "stats.h"
+
+#include <stdio.h>
+
+#define STORE_BASE FLASH_EEPROM_BASE	// First byte of the region
+#define STORE_SIZE 4096					// Size of the region in bytes
+#define STORE_RECORD_WORDS 11			// Size of a record in words, the last one is the CRC
+#define STORE_SLOTS_COUNT (STORE_SIZE / (STORE_RECORD_WORDS * 4))
+#define STORE_REACTION_MAX_US (1UL << (STATS_BUCKETS - 1))	// Longest mean kept, the range of the stats histogram
+
+/**
+ * @brief Persistent data, followed by the CRC in a record
+ */
+typedef struct
+{
+	uint32_t sequence;								// Record number, 0 for an erased slot
+	uint32_t matches;								// Number of matches played
+	uint16_t wins[STATS_PLAYERS_COUNT];				// Matches won by each player
+	uint32_t reaction_count[STATS_PLAYERS_COUNT];	// Returns of each player
+	uint32_t reaction_mean_us[STATS_PLAYERS_COUNT];	// Mean reaction time of each player
+	uint32_t reaction_best_us[STATS_PLAYERS_COUNT];	// Best reaction time of each player, 0 before the first return
+	uint8_t last_scores[STATS_PLAYERS_COUNT];		// Scores of the last match
+	uint16_t reserved;
+} TypeDef_Store_Data;
+
+typedef union
+{
+	TypeDef_Store_Data data;
+	uint32_t words[STORE_RECORD_WORDS];
+} TypeDef_Store_Record;
+
+HAL_StatusTypeDef store_init(void);
+const TypeDef_Store_Data *store_get(void);
+HAL_StatusTypeDef store_add_match(STATS_Player_Enum _winner, uint8_t _p1_score, uint8_t _p2_score);
+void store_flush(void);
+uint8_t store_is_pending(void);
+void store_dump(void);
+
+#endif /* STORE_STORE_H_ */
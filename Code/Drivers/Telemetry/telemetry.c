@@ -0,0 +1,203 @@
+/*
+ * telemetry.c
+ */
+
+#include "telemetry.h"
+#include "capture.h"
+
+#define TELEMETRY_USART USART2
+#define TELEMETRY_DMA_TX DMA1_Channel7
+
+//the layout is the wire format, no padding
+typedef char telemetry_record_size_check[(sizeof(TypeDef_Telemetry_Record) == 16) ? 1 : -1];
+
+static TypeDef_Telemetry telemetry;
+
+/**
+ * @brief COBS encode a frame : no 0x00 byte is left in the data, the frame ends with 0x00
+ * @param _data Data to encode
+ * @param _length Data length, below 254 bytes
+ * @param _out Filled with the frame, _length + 2 bytes
+ * @retval Frame length
+ */
+static uint32_t telemetry_cobs_encode(const uint8_t *_data, uint32_t _length, uint8_t *_out)
+{
+	uint32_t code_index = 0;
+	uint32_t out_index = 1;
+	uint8_t code = 1;
+
+	for (uint32_t i = 0; i < _length; i++)
+	{
+		// Each 0x00 is replaced by the distance to the next one
+		if (_data[i] == 0)
+		{
+			_out[code_index] = code;
+			code_index = out_index++;
+			code = 1;
+		}
+		else
+		{
+			_out[out_index++] = _data[i];
+			code++;
+		}
+	}
+
+	_out[code_index] = code;
+	_out[out_index++] = 0;
+
+	return out_index;
+}
+
+/**
+ * @brief Start USART2 TX and its DMA channel
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef telemetry_init(void)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	__HAL_RCC_GPIOA_CLK_ENABLE();
+	__HAL_RCC_USART2_CLK_ENABLE();
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	// PA2 USART2_TX
+	GPIO_InitStruct.Pin = GPIO_PIN_2;
+	GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+	GPIO_InitStruct.Alternate = GPIO_AF7_USART2;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+	telemetry.head = 0;
+	telemetry.tail = 0;
+	telemetry.sequence = 0;
+	telemetry.period_us = TELEMETRY_PERIOD_MIN_US;
+	telemetry.sample_time_us = 0;
+	telemetry.dropped = 0;
+	telemetry.throttled = 0;
+	telemetry.sending = 0;
+
+	// 8N1, oversampling by 16, TX only
+	TELEMETRY_USART->CR1 = 0;
+	TELEMETRY_USART->BRR = (HAL_RCC_GetPCLK1Freq() + TELEMETRY_BAUDRATE / 2) / TELEMETRY_BAUDRATE;
+	TELEMETRY_USART->CR3 = USART_CR3_DMAT;
+
+	// Memory to peripheral, one transfer per flush
+	TELEMETRY_DMA_TX->CCR = 0;
+	TELEMETRY_DMA_TX->CPAR = (uint32_t)&TELEMETRY_USART->DR;
+	TELEMETRY_DMA_TX->CCR = DMA_CCR_MINC | DMA_CCR_DIR;
+
+	TELEMETRY_USART->CR1 = USART_CR1_UE | USART_CR1_TE;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Write a record to the ring buffer, stamped with its sequence number and the time.
+ * Never blocks : the record is dropped and counted if the buffer is full.
+ * @param _record Record to publish, kind and game state filled
+ */
+void telemetry_publish(TypeDef_Telemetry_Record *_record)
+{
+	uint32_t now = capture_now_us();
+	uint32_t head = telemetry.head;
+
+	// Ball records are sampled, the transitions always go
+	if (_record->kind == TELEMETRY_BALL)
+	{
+		if (now - telemetry.sample_time_us < telemetry.period_us)
+		{
+			telemetry.throttled++;
+			telemetry.sequence++;
+			return;
+		}
+		telemetry.sample_time_us = now;
+	}
+
+	_record->sequence = telemetry.sequence++;
+	_record->time_us = now;
+
+	if (head - telemetry.tail >= TELEMETRY_BUFFER_SZ)
+	{
+		telemetry.dropped++;
+		return;
+	}
+
+	telemetry.records[head & (TELEMETRY_BUFFER_SZ - 1)] = *_record;
+	telemetry.head = head + 1;
+}
+
+/**
+ * @brief Adapt the sample period to the ring fill, then send the pending records by DMA.
+ * To be called from the main loop, it returns at once while a transfer is running.
+ */
+void telemetry_flush(void)
+{
+	if ((TELEMETRY_DMA_TX->CCR & DMA_CCR_EN) && TELEMETRY_DMA_TX->CNDTR != 0)
+		return;
+
+	TELEMETRY_DMA_TX->CCR &= ~DMA_CCR_EN;
+
+	uint32_t pending = telemetry.head - telemetry.tail;
+
+	// At the end of each transfer, the link falls behind : sample less, it caught up : sample more
+	if (telemetry.sending)
+	{
+		telemetry.sending = 0;
+
+		if (pending > TELEMETRY_BUFFER_SZ / 2 && telemetry.period_us < TELEMETRY_PERIOD_MAX_US)
+			telemetry.period_us *= 2;
+		else if (pending == 0 && telemetry.period_us > TELEMETRY_PERIOD_MIN_US)
+			telemetry.period_us /= 2;
+	}
+
+	if (pending == 0)
+		return;
+
+	if (pending > TELEMETRY_TX_RECORDS)
+		pending = TELEMETRY_TX_RECORDS;
+
+	uint32_t length = 0;
+
+	for (uint32_t i = 0; i < pending; i++)
+	{
+		const TypeDef_Telemetry_Record *record = &telemetry.records[telemetry.tail & (TELEMETRY_BUFFER_SZ - 1)];
+
+		length += telemetry_cobs_encode((const uint8_t *)record, sizeof(*record), &telemetry.tx_buffer[length]);
+		telemetry.tail++;
+	}
+
+	TELEMETRY_DMA_TX->CMAR = (uint32_t)telemetry.tx_buffer;
+	TELEMETRY_DMA_TX->CNDTR = length;
+	TELEMETRY_DMA_TX->CCR |= DMA_CCR_EN;
+	telemetry.sending = 1;
+}
+
+/**
+ * @brief Set the baud rate for a new USART2 clock. A frame on the wire at that time may be
+ * corrupted, the dashboard resynchronizes on the next delimiter.
+ * @param _pclk New USART2 clock in Hz
+ */
+void telemetry_retime(uint32_t _pclk)
+{
+	TELEMETRY_USART->BRR = (_pclk + TELEMETRY_BAUDRATE / 2) / TELEMETRY_BAUDRATE;
+}
+
+/**
+ * @retval Number of records lost because the buffer was full
+ */
+uint32_t telemetry_get_dropped(void) { return telemetry.dropped; }
+
+/**
+ * @retval Number of ball records skipped by the sample period
+ */
+uint32_t telemetry_get_throttled(void) { return telemetry.throttled; }
+
+/**
+ * @brief Print the records lost since the boot :
+ * telemetry,dropped,throttled
+ */
+void telemetry_dump(void)
+{
+	printf("telemetry,%lu,%lu\n", telemetry_get_dropped(), telemetry_get_throttled());
+}
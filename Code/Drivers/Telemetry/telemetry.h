@@ -0,0 +1,86 @@
+/*
+ * telemetry.h
+ *
+ * Live game state stream for an external dashboard, over USART2 TX (PA2, the ST-LINK virtual COM
+ * port). A record is written to a RAM ring buffer in a few cycles, never blocking : it is dropped
+ * and counted when the buffer is full. telemetry_flush() is called from the main loop, it COBS
+ * encodes the pending records into the TX buffer and sends them with a one-shot DMA transfer.
+ *
+ * Ball records are throttled : they are published at most every sample period, which doubles while
+ * the ring is more than half full and halves back once it is drained. Transitions always go.
+ *
+ * Frame : COBS encoded record followed by a 0x00 delimiter. Record, 16 bytes little endian :
+ * 	byte 0 : kind (TELEMETRY_TRANSITION, TELEMETRY_BALL)
+ * 	byte 1 : FSM state
+ * 	byte 2 : LED index (signed)
+ * 	byte 3 : pass count (saturated at 255)
+ * 	byte 4 : P1 score, byte 5 : P2 score
+ * 	bytes 6-7 : sequence number, a gap counts the records dropped or throttled
+ * 	bytes 8-11 : time in microseconds (TIM5 counter)
+ * 	bytes 12-15 : last reaction time in microseconds
+ *
+ * Host/Tools/telemetry_decode.c prints the records of a capture, or replays them at their pace.
+ */
+
+#ifndef TELEMETRY_TELEMETRY_H_
+#define TELEMETRY_TELEMETRY_H_
+
+#include "stm32l1xx_hal.h"
+#include "pong_config.h"
+
+#include <stdio.h>
+
+#ifndef TELEMETRY_ENABLE
+#define TELEMETRY_ENABLE 1
+#endif
+
+#define TELEMETRY_BAUDRATE 115200
+#define TELEMETRY_PERIOD_MIN_US 2000		// Shortest sample period of the ball records
+#define TELEMETRY_PERIOD_MAX_US 128000		// Longest sample period, when the link cannot keep up
+#define TELEMETRY_FRAME_MAX (sizeof(TypeDef_Telemetry_Record) + 2) // COBS overhead byte and delimiter
+
+typedef enum {
+	TELEMETRY_TRANSITION = 1,	// State entered
+	TELEMETRY_BALL = 2,			// LED shift of the ball
+}TELEMETRY_Kind_Enum;
+
+typedef struct {
+	uint8_t kind;
+	uint8_t state;
+	int8_t led_index;
+	uint8_t pass_count;
+	uint8_t p1_score;
+	uint8_t p2_score;
+	uint16_t sequence;
+	uint32_t time_us;
+	uint32_t reaction_time_us;
+}TypeDef_Telemetry_Record;
+
+typedef struct {
+	TypeDef_Telemetry_Record records[TELEMETRY_BUFFER_SZ];
+	volatile uint32_t head;		// Number of records written
+	volatile uint32_t tail;		// Number of records sent
+	uint8_t tx_buffer[TELEMETRY_TX_RECORDS * TELEMETRY_FRAME_MAX];
+	uint16_t sequence;			// Sequence number of the next record
+	uint32_t period_us;			// Sample period of the ball records
+	uint32_t sample_time_us;	// Time of the last ball record published
+	uint32_t dropped;			// Records lost because the buffer was full
+	uint32_t throttled;			// Ball records skipped by the sample period
+	uint8_t sending;			// A DMA transfer was started
+}TypeDef_Telemetry;
+
+#if TELEMETRY_ENABLE
+#define TELEMETRY_PUBLISH(_record) telemetry_publish(_record)
+#else
+#define TELEMETRY_PUBLISH(_record) do { (void)(_record); } while (0)
+#endif
+
+HAL_StatusTypeDef telemetry_init(void);
+void telemetry_publish(TypeDef_Telemetry_Record *_record);
+void telemetry_flush(void);
+void telemetry_retime(uint32_t _pclk);
+uint32_t telemetry_get_dropped(void);
+uint32_t telemetry_get_throttled(void);
+void telemetry_dump(void);
+
+#endif /* TELEMETRY_TELEMETRY_H_ */
@@ -1,70 +1,347 @@
 #include "timer.h"
+#include "profiler.h"
+
+#include <stdio.h>
 
 
 static TypeDef_Timer_Handler * timer_handler;
 
+#if BOARD_STATIC_CONFIG
+#define TIMER_TIM BOARD_TIMER_TIM
+#else
+#define TIMER_TIM (timer_handler->htim->Instance)
+#endif
+
 
 //init the list of callback function
 static const TypeDef_Timer_Callback function_list[] = {
-		{MUSIC, &play_music, 69},
-		{SEGMENT, &callback_display, 499},
-		//TODO
+		{MUSIC, &play_music, MUSIC_TICK_MS / TIMER_TICK_MS},
+		{SEGMENT, &callback_display, 500 / TIMER_TICK_MS},
+		{MEMORY, &memory_check, MEMORY_CHECK_PERIOD_MS / TIMER_TICK_MS},
+		{INPUT, &debounce_sample, DEBOUNCE_SAMPLE_MS / TIMER_TICK_MS},
 };
 
 /**
- * If the timer is running, call the interrupt function
+ * It resets the TIM4 prescaler and counter without raising an update interrupt
+ *
+ * @param tim the scheduler timer
+ */
+static RAMFUNC void timer_restart_prescaler(TIM_TypeDef * tim) {
+	tim->CR1 |= TIM_CR1_URS;
+	tim->EGR = TIM_EGR_UG;
+	tim->CR1 &= ~TIM_CR1_URS;
+}
+
+#if TIMER_TICKLESS
+/**
+ * It loads TIM4 with the delay to the closest task deadline, or stops TIM4 when no task is enabled.
+ * Must be called from the timer interrupt or with interrupts masked.
+ */
+static RAMFUNC void timer_program_next_deadline(void) {
+	TIM_TypeDef * tim = TIMER_TIM;
+	uint32_t delay = TIMER_MAX_DELAY;
+	uint8_t has_deadline = 0;
+
+	if (timer_handler->timer_is_running == 1) {
+		for (uint8_t i=0;i<TIMER_TASKS_COUNT;i++) {
+			TypeDef_Timer_Task * task = &timer_handler->tasks[i];
+
+			if (task->enabled == 0)
+				continue;
+
+			int32_t remaining = (int32_t)(task->next_tick - timer_handler->tick);
+			if (remaining < 1)
+				remaining = 1;
+
+			if ((uint32_t) remaining < delay)
+				delay = remaining;
+
+			has_deadline = 1;
+		}
+	}
+
+	//nothing to wait for : no interrupt until a task is enabled
+	if (has_deadline == 0) {
+		tim->CR1 &= ~TIM_CR1_CEN;
+		tim->CNT = 0;
+		timer_handler->armed_ticks = 0;
+		return;
+	}
+
+	//a stopped counter restarts from a whole count, the first deadline is not cut short
+	uint8_t stopped = (tim->CR1 & TIM_CR1_CEN) == 0;
+	if (stopped)
+		timer_restart_prescaler(tim);
+
+	timer_handler->armed_ticks = delay;
+	tim->ARR = delay * TIMER_COUNTS_PER_TICK - 1;
+
+	//the deadline is already behind the counter, update right now
+	if (tim->CNT >= tim->ARR) {
+		tim->EGR = TIM_EGR_UG;
+		PROFILER_TIMER_RESTART();
+	}
+
+	tim->CR1 |= TIM_CR1_CEN;
+	if (stopped)
+		PROFILER_TIMER_RESTART();
+}
+
+/**
+ * It accounts the ticks elapsed since the last interrupt and programs the new closest deadline.
+ * Called after the task table or the running flag has been modified.
  */
-void timer_interrupt(void) {
+static RAMFUNC void timer_resync(void) {
+	TIM_TypeDef * tim = TIMER_TIM;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+
+	//an update is pending, the interrupt will program the deadline itself
+	if ((tim->SR & TIM_SR_UIF) == 0) {
+		if (tim->CR1 & TIM_CR1_CEN) {
+			uint32_t elapsed = tim->CNT / TIMER_COUNTS_PER_TICK;
+
+			timer_handler->tick += elapsed;
+			timer_handler->armed_ticks -= elapsed;
+			tim->CNT -= elapsed * TIMER_COUNTS_PER_TICK;
+		}
+
+		timer_program_next_deadline();
+	}
+
+	__set_PRIMASK(primask);
+}
+#endif
+
+/**
+ * Called at each TIM4 interrupt. If the timer is running, call every enabled task which is due,
+ * and keep the worst execution time of each task.
+ * In tickless mode, TIM4 is then programmed with the next deadline.
+ */
+RAMFUNC void timer_interrupt(void) {
+
+	timer_handler->wakeup_count++;
+
+#if TIMER_TICKLESS
+	uint32_t tick = timer_handler->tick + timer_handler->armed_ticks;
+	timer_handler->tick = tick;
+#else
+	uint32_t tick = ++timer_handler->tick;
+#endif
 
 	if (timer_handler->timer_is_running == 1) {
-		timer_handler->chosen_function.interrupt_function();
+		for (uint8_t i=0;i<TIMER_TASKS_COUNT;i++) {
+			TypeDef_Timer_Task * task = &timer_handler->tasks[i];
+
+			if (task->enabled == 0 || (int32_t)(tick - task->next_tick) < 0)
+				continue;
+
+			task->next_tick += task->period;
+
+			uint32_t start = DWT->CYCCNT;
+			task->interrupt_function();
+			uint32_t cycles = DWT->CYCCNT - start;
+
+			if (cycles > task->max_cycles)
+				task->max_cycles = cycles;
+		}
 	}
+
+#if TIMER_TICKLESS
+	timer_program_next_deadline();
+#endif
 }
 
 /**
- * This function initializes the timer and sets the timer interrupt frequency to 100Hz
- * 
+ * This function initializes the task table and sets the timer interrupt frequency to the base tick
+ *
  * @param _timer_handler pointer to the timer handler
- * 
+ *
  * @return HAL_OK
  */
 HAL_StatusTypeDef timer_init(TypeDef_Timer_Handler * _timer_handler) {
 
 	timer_handler = _timer_handler;
 
-	//start timer
-	HAL_TIM_Base_Start_IT(timer_handler->htim);
+	timer_handler->callback_function = function_list;
+	timer_handler->tick = 0;
+	timer_handler->armed_ticks = 0;
+	timer_handler->wakeup_count = 0;
+	timer_handler->wakeup_mark_count = 0;
+	timer_handler->wakeup_mark_time = HAL_GetTick();
+	timer_handler->timer_is_running = 0;
+
+	for (uint8_t i=0;i<TIMER_TASKS_COUNT;i++) {
+		timer_handler->tasks[i].interrupt_function = function_list[i].interrupt_function;
+		timer_handler->tasks[i].period = function_list[i].period;
+		timer_handler->tasks[i].next_tick = 0;
+		timer_handler->tasks[i].enabled = 0;
+		timer_handler->tasks[i].max_cycles = 0;
+	}
+
+	//enable the cycle counter used to measure the tasks
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
 	//init interrupt frequence
-	timer_handler->htim->Instance->ARR = 100;
+	TIMER_TIM->ARR = TIMER_TICK_ARR;
 
-	timer_handler->callback_function = function_list;
-	timer_handler->timer_frequence = 0;
-	timer_handler->timer_is_running = 0;
+	//start timer
+	HAL_TIM_Base_Start_IT(timer_handler->htim);
+	timer_restart_prescaler(TIMER_TIM);
+	PROFILER_TIMER_RESTART();
+
+#if TIMER_TICKLESS
+	//no task enabled yet, TIM4 stays stopped
+	timer_resync();
+#endif
 
 	return HAL_OK;
 }
 
 
 /**
- * It sets the interrupt handler to the chosen function
- * 
+ * It enables a task, the task is first called one period later. The other tasks keep running.
+ * Called by the button wakeup of the debouncer, from the EXTI interrupt.
+ *
  * @param _chosen_function the function you want to call
  */
-void set_interrupt_launcher(TIMER_Enum _chosen_function) {
-	timer_handler->chosen_function = timer_handler->callback_function[_chosen_function];
-	timer_handler->htim->Instance->ARR = timer_handler->callback_function[_chosen_function].frequence;
+RAMFUNC void set_interrupt_launcher(TIMER_Enum _chosen_function) {
+	TypeDef_Timer_Task * task = &timer_handler->tasks[_chosen_function];
+
+	task->enabled = 0;
+	task->next_tick = get_timer_tick() + task->period;
+	task->enabled = 1;
+
+#if TIMER_TICKLESS
+	timer_resync();
+#endif
+}
+
+/**
+ * It disables a task. Called by the debouncer, from the TIM4 interrupt.
+ *
+ * @param _chosen_function the function you want to stop
+ */
+RAMFUNC void stop_interrupt_launcher(TIMER_Enum _chosen_function) {
+	timer_handler->tasks[_chosen_function].enabled = 0;
+
+#if TIMER_TICKLESS
+	timer_resync();
+#endif
+}
+
+/**
+ * It changes the period of a task, applied after its next call
+ *
+ * @param _chosen_function the task to modify
+ * @param _period the new period in ticks
+ */
+void set_interrupt_period(TIMER_Enum _chosen_function, uint32_t _period) {
+	if (_period > 0)
+		timer_handler->tasks[_chosen_function].period = _period;
+}
+
+/**
+ * @param _chosen_function the task to look at
+ *
+ * @return The worst execution time of the task in CPU cycles
+ */
+uint32_t get_interrupt_max_cycles(TIMER_Enum _chosen_function) { return timer_handler->tasks[_chosen_function].max_cycles; }
+
+/**
+ * @return The number of ticks elapsed since timer_init
+ */
+RAMFUNC uint32_t get_timer_tick(void) {
+#if TIMER_TICKLESS
+	TIM_TypeDef * tim = TIMER_TIM;
+	uint32_t primask = __get_PRIMASK();
+	uint32_t tick;
+
+	__disable_irq();
+	tick = timer_handler->tick;
+	if ((tim->CR1 & TIM_CR1_CEN) && (tim->SR & TIM_SR_UIF) == 0)
+		tick += tim->CNT / TIMER_COUNTS_PER_TICK;
+	__set_PRIMASK(primask);
+
+	return tick;
+#else
+	return timer_handler->tick;
+#endif
+}
+
+/**
+ * It measures the TIM4 interrupt rate since the previous call. In periodic mode the rate is
+ * 1000 / TIMER_TICK_MS whatever the tasks, in tickless mode it only follows the task deadlines.
+ *
+ * @return The number of TIM4 interrupts per second since the previous call
+ */
+uint32_t get_timer_wakeups_per_second(void) {
+	uint32_t now = HAL_GetTick();
+	uint32_t count = timer_handler->wakeup_count;
+	uint32_t elapsed = now - timer_handler->wakeup_mark_time;
+	uint32_t rate = 0;
+
+	if (elapsed > 0)
+		rate = ((count - timer_handler->wakeup_mark_count) * 1000) / elapsed;
+
+	timer_handler->wakeup_mark_count = count;
+	timer_handler->wakeup_mark_time = now;
+
+	return rate;
+}
+
+/**
+ * It sets the TIM4 prescaler for a new timer clock. The counter keeps its value, the tick
+ * accounting and the programmed deadline are not disturbed.
+ *
+ * @param _timer_clock the new TIM4 clock in Hz
+ */
+void timer_retime(uint32_t _timer_clock) {
+	TIM_TypeDef * tim = TIMER_TIM;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	uint32_t cnt = tim->CNT;
+
+	//the prescaler is only loaded by an update event, which must not be taken for a deadline
+	tim->PSC = (_timer_clock + TIMER_COUNTER_FREQ / 2) / TIMER_COUNTER_FREQ - 1;
+	timer_restart_prescaler(tim);
+	PROFILER_TIMER_RESTART();
+	tim->CNT = cnt;
+
+	__set_PRIMASK(primask);
 }
 
 /**
  * It sets the timer_is_running flag to 1
  */
-void start_timer(void) { timer_handler->timer_is_running = 1; }
+void start_timer(void) {
+	timer_handler->timer_is_running = 1;
+
+#if TIMER_TICKLESS
+	timer_resync();
+#endif
+}
 
 /**
  * > The function `stop_timer()` sets the `timer_is_running` flag to 0
  */
-void stop_timer(void) { timer_handler->timer_is_running = 0; }
-
+void stop_timer(void) {
+	timer_handler->timer_is_running = 0;
 
+#if TIMER_TICKLESS
+	timer_resync();
+#endif
+}
 
+/**
+ * It prints the TIM4 interrupt rate since the previous call and the worst execution time of each task :
+ * timer,tickless,wakeups_per_second,music_cycles,segment_cycles,memory_cycles,input_cycles
+ */
+void timer_dump(void) {
+	printf("timer,%d,%lu,%lu,%lu,%lu,%lu\n", TIMER_TICKLESS, get_timer_wakeups_per_second(),
+			timer_handler->tasks[MUSIC].max_cycles, timer_handler->tasks[SEGMENT].max_cycles,
+			timer_handler->tasks[MEMORY].max_cycles, timer_handler->tasks[INPUT].max_cycles);
+}
@@ -3,27 +3,56 @@
 
 //includes
 #include "stm32l1xx_hal.h"
+#include "board_config.h"
 #include "music.h"
 #include "max7219.h"
+#include "memory.h"
+#include "debounce.h"
 
-#include <stdio.h>
-#include <stdlib.h>
+//base tick of the scheduler, TIM4 counts at 10kHz
+#define TIMER_COUNTER_FREQ 10000
+#define TIMER_TICK_MS 1
+#define TIMER_COUNTS_PER_TICK (10 * TIMER_TICK_MS)
+#define TIMER_TICK_ARR (TIMER_COUNTS_PER_TICK - 1)
+
+//longest delay TIM4 can be programmed with, in ticks
+#define TIMER_MAX_DELAY (65536 / TIMER_COUNTS_PER_TICK)
+
+//set to 1 to program TIM4 with the next task deadline instead of interrupting at each tick
+#ifndef TIMER_TICKLESS
+#define TIMER_TICKLESS 1
+#endif
 
 //structures
 typedef enum {
 	MUSIC = 0,
-	SEGMENT = 1
+	SEGMENT = 1,
+	MEMORY = 2,
+	INPUT = 3,
+	TIMER_TASKS_COUNT,
 }TIMER_Enum;
 
 typedef struct {
 	TIMER_Enum function_name;
 	void (*interrupt_function)();
-	uint32_t frequence;
+	uint32_t period;	// Period of the task in ticks
 }TypeDef_Timer_Callback;
 
 typedef struct {
-	TypeDef_Timer_Callback chosen_function;
-	uint32_t timer_frequence;
+	void (*interrupt_function)();
+	uint32_t period;		// Period of the task in ticks
+	uint32_t next_tick;		// Tick at which the task is due (phase)
+	uint8_t enabled;
+	uint32_t max_cycles;	// Worst execution time of the task in CPU cycles
+}TypeDef_Timer_Task;
+
+typedef struct {
+	TypeDef_Timer_Task tasks[TIMER_TASKS_COUNT];
+	volatile uint32_t tick;
+	uint32_t armed_ticks;			// Ticks until the next interrupt, tickless mode only
+	volatile uint32_t wakeup_count;	// Number of TIM4 interrupts
+	uint32_t wakeup_mark_count;		// Wakeup count at the last rate measure
+	uint32_t wakeup_mark_time;		// HAL tick of the last rate measure
 	uint8_t timer_is_running;
 	const TypeDef_Timer_Callback * callback_function;
 	TIM_HandleTypeDef * htim;
@@ -33,7 +62,14 @@ typedef struct {
 void timer_interrupt(void);
 HAL_StatusTypeDef timer_init(TypeDef_Timer_Handler * _timer_handler);
 void set_interrupt_launcher(TIMER_Enum _chosen_function);
+void stop_interrupt_launcher(TIMER_Enum _chosen_function);
+void set_interrupt_period(TIMER_Enum _chosen_function, uint32_t _period);
+uint32_t get_interrupt_max_cycles(TIMER_Enum _chosen_function);
+uint32_t get_timer_tick(void);
+uint32_t get_timer_wakeups_per_second(void);
+void timer_retime(uint32_t _timer_clock);
 void start_timer(void);
 void stop_timer(void);
+void timer_dump(void);
 
 #endif
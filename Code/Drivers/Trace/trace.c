@@ -0,0 +1,88 @@
+/*
+ * trace.c
+ */
+
+#include "trace.h"
+
+static TypeDef_Trace trace;
+
+/**
+ * @brief Reset the trace buffer and enable the DWT cycle counter used as timestamp
+ * @retval HAL_OK
+ */
+HAL_StatusTypeDef trace_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	trace.head = 0;
+	trace.tail = 0;
+	trace.tail_word = 0;
+	trace.dropped = 0;
+
+	return HAL_OK;
+}
+
+/**
+ * @brief Write a transition record to the ring buffer. Never blocks : the record is dropped
+ * and counted if the buffer is full.
+ * @param _from Previous state
+ * @param _to New state
+ * @param _btn1 BTN1 press count
+ * @param _btn2 BTN2 press count
+ * @param _pass_count Pass count
+ */
+void trace_transition(uint8_t _from, uint8_t _to, uint8_t _btn1, uint8_t _btn2, uint32_t _pass_count)
+{
+	uint32_t head = trace.head;
+
+	if (head - trace.tail >= TRACE_BUFFER_SZ)
+	{
+		trace.dropped++;
+		return;
+	}
+
+	uint32_t *record = trace.words[head & (TRACE_BUFFER_SZ - 1)];
+
+	record[0] = ((uint32_t)TRACE_SYNC << 24) | (_from << 16) | (_to << 8) |
+				((_btn1 > 15 ? 15 : _btn1) << 4) | (_btn2 > 15 ? 15 : _btn2);
+	record[1] = DWT->CYCCNT;
+	record[2] = _pass_count;
+
+	trace.head = head + 1;
+}
+
+/**
+ * @brief Send the pending records over ITM, as long as the stimulus port accepts data.
+ * To be called from the main loop, it returns as soon as the ITM FIFO is full.
+ */
+void trace_flush(void)
+{
+	// No debugger listening : nothing can be sent, forget the records
+	if (((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0) || ((ITM->TER & (1UL << TRACE_ITM_PORT)) == 0))
+	{
+		trace.tail = trace.head;
+		trace.tail_word = 0;
+		return;
+	}
+
+	while (trace.tail != trace.head)
+	{
+		// Stimulus port busy, try again at next call
+		if (ITM->PORT[TRACE_ITM_PORT].u32 == 0)
+			return;
+
+		ITM->PORT[TRACE_ITM_PORT].u32 = trace.words[trace.tail & (TRACE_BUFFER_SZ - 1)][trace.tail_word];
+
+		if (++trace.tail_word == TRACE_RECORD_WORDS)
+		{
+			trace.tail_word = 0;
+			trace.tail++;
+		}
+	}
+}
+
+/**
+ * @retval Number of records lost because the buffer was full
+ */
+uint32_t trace_get_dropped(void) { return trace.dropped; }
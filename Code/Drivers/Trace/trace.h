@@ -0,0 +1,50 @@
+/*
+ * trace.h
+ *
+ * Binary trace of the FSM transitions. A transition is written to a RAM ring buffer in a few
+ * cycles, the buffer is drained in the background with 32-bit writes to an ITM stimulus port.
+ *
+ * Record format, 3 little endian words on stimulus port TRACE_ITM_PORT :
+ * 	word 0 : [31:24] TRACE_SYNC, [23:16] from state, [15:8] to state,
+ * 	         [7:4] BTN1 presses, [3:0] BTN2 presses (saturated at 15)
+ * 	word 1 : DWT cycle counter at the transition
+ * 	word 2 : pass count
+ *
+ * Host/Tools/trace_decode.c turns a SWO capture into a timeline of the transitions.
+ */
+
+#ifndef TRACE_TRACE_H_
+#define TRACE_TRACE_H_
+
+#include "stm32l1xx_hal.h"
+#include "pong_config.h"
+
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 1
+#endif
+
+#define TRACE_RECORD_WORDS 3
+#define TRACE_ITM_PORT 1
+#define TRACE_SYNC 0xA5
+
+typedef struct
+{
+	uint32_t words[TRACE_BUFFER_SZ][TRACE_RECORD_WORDS];
+	volatile uint32_t head;	// Number of records written
+	volatile uint32_t tail;	// Number of records sent
+	uint8_t tail_word;		// Next word of the tail record to send
+	uint32_t dropped;		// Records lost because the buffer was full
+} TypeDef_Trace;
+
+#if TRACE_ENABLE
+#define TRACE_TRANSITION(_from, _to, _btn1, _btn2, _pass_count) trace_transition((_from), (_to), (_btn1), (_btn2), (_pass_count))
+#else
+#define TRACE_TRANSITION(_from, _to, _btn1, _btn2, _pass_count) do {} while (0)
+#endif
+
+HAL_StatusTypeDef trace_init(void);
+void trace_transition(uint8_t _from, uint8_t _to, uint8_t _btn1, uint8_t _btn2, uint32_t _pass_count);
+void trace_flush(void);
+uint32_t trace_get_dropped(void);
+
+#endif /* TRACE_TRACE_H_ */
@@ -2,62 +2,176 @@
 
 static TypeDef_Music_Handler * music_handler;
 
+/* An array of notes, from the board configuration. */
+#define MUSIC_NOTE_ENTRY(_name, _frequency) {_name, _frequency, (uint16_t)((TIMER_FREQ / _frequency) - 1)},
+
+static TypeDef_Note notes_array[] = {BOARD_NOTE_LIST(MUSIC_NOTE_ENTRY)};
+
+#define MUSIC_NOTES_COUNT (sizeof(notes_array) / sizeof(TypeDef_Note))
+
+#if BOARD_STATIC_CONFIG
+#define MUSIC_TIM BOARD_MUSIC_TIM
+#define MUSIC_NOTES notes_array
+#define MUSIC_NOTES_SZ MUSIC_NOTES_COUNT
+#else
+#define MUSIC_TIM (music_handler->htim->Instance)
+#define MUSIC_NOTES (music_handler->notes)
+#define MUSIC_NOTES_SZ (music_handler->notes_sz)
+#endif
+
+/* Shape of the envelope slopes, from 0 to 255 */
+static const uint8_t envelope_curve[] = {
+	0, 6, 16, 30, 48, 68, 90, 113, 136, 158, 180, 200, 218, 233, 246, 255
+};
+
+/* Default envelope : short attack, light decay and a soft release */
+static const TypeDef_Envelope default_envelope = {1, 2, 200, 3};
+
+/**
+ * It converts a number of TIMER_FREQ cycles to the TIM3 clock
+ *
+ * @param _counts cycles at TIMER_FREQ
+ */
+static inline uint32_t music_scale(uint32_t _counts)
+{
+	if (music_handler->timer_clock == TIMER_FREQ)
+		return _counts;
+
+	return ((uint64_t) _counts * music_handler->timer_clock + TIMER_FREQ / 2) / TIMER_FREQ;
+}
+
 /**
- * It sets the timer's ARR register to the note's ARR value, and sets the timer's CCR2 register to the
- * CRR value
+ * It sets the timer's ARR register to the note's ARR value, computes the peak value of CCR2 from
+ * the global and song volumes and restarts the envelope of the note
  * 
  * @param _note a pointer to a note structure
  */
-void buzzer_play_note(TypeDef_Note * _note)
+RAMFUNC void buzzer_play_note(TypeDef_Note * _note)
+{
+	MUSIC_TIM->ARR = music_scale(_note->arr + 1) - 1;
+	music_handler->envelope_index = 0;
+	music_handler->envelope_hold_index = MUSIC_NOTE_TICKS - 1;
+	music_handler->note_peak = music_scale(((uint32_t) CRR * music_handler->volume) >> 8);
+}
+
+/**
+ * It moves the buzzer to a new TIM3 clock : the playing note keeps its pitch and its volume,
+ * the next notes are computed for the new clock
+ *
+ * @param _timer_clock the new TIM3 clock in Hz
+ */
+void music_retime(uint32_t _timer_clock)
+{
+	TIM_TypeDef * tim = MUSIC_TIM;
+	uint32_t old_clock = music_handler->timer_clock;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	music_handler->timer_clock = _timer_clock;
+	tim->ARR = (((uint64_t) (tim->ARR + 1) * _timer_clock) / old_clock) - 1;
+	tim->CCR2 = ((uint64_t) tim->CCR2 * _timer_clock) / old_clock;
+	music_handler->note_peak = ((uint64_t) music_handler->note_peak * _timer_clock) / old_clock;
+
+	//a shorter period would leave the counter above it until the 16-bit wrap
+	if (tim->CNT > tim->ARR)
+		tim->CNT = 0;
+	__set_PRIMASK(primask);
+}
+
+RAMFUNC void buzzer_mute()
+{
+	music_handler->note_peak = 0;
+	MUSIC_TIM->CCR2 = 0;
+}
+
+/**
+ * It writes the envelope level of the playing note to CCR2 and moves to the next level.
+ * The cost is the same at each call : a table read, a multiplication and a shift.
+ *
+ * this function is called at each music tick
+ */
+RAMFUNC void music_envelope_step(void)
 {
-	music_handler->htim->Instance->ARR = _note->arr;
-	music_handler->htim->Instance->CCR2 = CRR;
+#if MUSIC_PROFILE_ENVELOPE
+	uint32_t start = DWT->CYCCNT;
+#endif
+
+	uint8_t index = music_handler->envelope_index;
+
+	MUSIC_TIM->CCR2 = (music_handler->note_peak * music_handler->envelope_levels[index]) >> 8;
+
+	if (index < music_handler->envelope_hold_index)
+		music_handler->envelope_index = index + 1;
+
+#if MUSIC_PROFILE_ENVELOPE
+	uint32_t cycles = DWT->CYCCNT - start;
+	if (cycles > music_handler->envelope_max_cycles)
+		music_handler->envelope_max_cycles = cycles;
+#endif
 }
 
-void buzzer_mute()
+/**
+ * It precomputes the envelope levels of a note from the attack, decay, sustain and release
+ * parameters, so the envelope step only has to read the table
+ *
+ * @param _envelope a pointer to the envelope parameters
+ *
+ * @return HAL_ERROR if the envelope does not fit in a note, HAL_OK otherwise
+ */
+HAL_StatusTypeDef set_envelope(const TypeDef_Envelope * _envelope)
 {
-	music_handler->htim->Instance->CCR2 = 0;
+	const uint8_t curve_max = sizeof(envelope_curve) - 1;
+	uint8_t attack = _envelope->attack_ticks;
+	uint8_t decay = _envelope->decay_ticks;
+	uint8_t release = _envelope->release_ticks;
+	uint8_t sustain = _envelope->sustain_level;
+
+	if (attack + decay + release > MUSIC_NOTE_TICKS)
+		return HAL_ERROR;
+
+	for (uint8_t tick=0;tick<MUSIC_NOTE_TICKS;tick++) {
+		uint8_t level;
+
+		if (tick < attack)
+			level = envelope_curve[((tick + 1) * curve_max) / attack];
+		else if (tick < attack + decay)
+			level = 255 - (((255 - sustain) * envelope_curve[((tick - attack + 1) * curve_max) / decay]) >> 8);
+		else if (tick < MUSIC_NOTE_TICKS - release)
+			level = sustain;
+		else
+			level = (sustain * (255 - envelope_curve[((tick - (MUSIC_NOTE_TICKS - release) + 1) * curve_max) / release])) >> 8;
+
+		music_handler->envelope_levels[tick] = level;
+	}
+
+	music_handler->envelope_sustain_end = MUSIC_NOTE_TICKS - 1 - release;
+
+	return HAL_OK;
 }
 
 /**
- * It plays a note by name
+ * It sets the global volume, applied from the next note
+ *
+ * @param _volume the volume, from 0 (mute) to 255
+ */
+void set_volume(uint8_t _volume) { music_handler->volume = _volume; }
+
+/**
+ * It plays a note of a partition, from the note index resolved by init_music
  * 
  * @param _index the index of the note in the partition
  * @param _choice the song you want to play
  */
-void buzzer_play_note_by_name(uint16_t _index, MUSIC_Enum _choice)
+RAMFUNC void buzzer_play_note_by_name(uint16_t _index, MUSIC_Enum _choice)
 {
-	if(!strcmp(MUTE, music_handler->partitions[_choice].partition[_index]))
-	{
+	uint8_t note = music_handler->partitions[_choice].notes[_index];
+
+	if (note == MUSIC_NOTE_MUTE)
 		buzzer_mute();
-	}
 	else
-	{
-		for(uint8_t i=0;i<music_handler->notes_sz;i++){
-			if (!strcmp(music_handler->notes[i].name, music_handler->partitions[_choice].partition[_index])){
-				buzzer_play_note(&music_handler->notes[i]);
-				break;
-			}
-		}
-	}
+		buzzer_play_note(&MUSIC_NOTES[note]);
 }
 
-/* An array of notes. */
-static TypeDef_Note notes_array[] = {
-	{"C5", 1046.50, 30576},
-	{"C#5", 1108.73, 28860},
-	{"D5", 1174.66, 27240},
-	{"Eb5", 1244.51, 25711},
-	{"E5", 1318.51, 24268},
-	{"F5", 1396.91, 22906},
-	{"F#5", 1479.98, 21620},
-	{"G5", 1567.98, 20406},
-	{"G#5", 1661.22,19261},
-	{"A5", 1760.00, 18180},
-	{"A#5", 1864.66, 17159},
-	{"B5", 1975.53, 16196}
-};
-
 /* A partition of the song Pacman. */
 static const char* partition_pacman[] = {
 		"C5",MUTE,"G5",MUTE,"E5",MUTE,"C5",MUTE,"G5","E5",MUTE,"C5",MUTE,MUTE,MUTE,
@@ -76,6 +190,12 @@ static const char * partition_P1_reflexe[] = {"C5","G5",MUTE};
 
 static const char * partition_P2_reflexe[] = {"D5","A5",MUTE};
 
+/* Sound effect played when a player misses the ball. */
+static const char * partition_miss[] = {"E5","Eb5","D5","C#5","C5",MUTE};
+
+/* Sound effect played when a player scores a point. */
+static const char * partition_score[] = {"C5","E5","G5","C5","G5",MUTE};
+
 /* A partition of the song win. */
 static const char * partition_win[] = {
 		"C5","C#5","D5","Eb5","E5","E5","F5","F5","F5","F5","F5",MUTE,MUTE,MUTE,
@@ -84,27 +204,67 @@ static const char * partition_win[] = {
 		"F5","F#5","G5","G#5","A5","A#5","B5","B5","B5","B5","B5","B5","B5","B5",MUTE
 };
 
+#define MUSIC_PARTITION_SZ(_partition) (sizeof(_partition) / sizeof((_partition)[0]))
+
+/* Note indexes of the partitions, resolved from the names by init_music. */
+static uint8_t notes_pacman[MUSIC_PARTITION_SZ(partition_pacman)];
+static uint8_t notes_auClairDeLaLune[MUSIC_PARTITION_SZ(partition_auClairDeLaLune)];
+static uint8_t notes_P1_reflexe[MUSIC_PARTITION_SZ(partition_P1_reflexe)];
+static uint8_t notes_P2_reflexe[MUSIC_PARTITION_SZ(partition_P2_reflexe)];
+static uint8_t notes_win[MUSIC_PARTITION_SZ(partition_win)];
+static uint8_t notes_miss[MUSIC_PARTITION_SZ(partition_miss)];
+static uint8_t notes_score[MUSIC_PARTITION_SZ(partition_score)];
+
 /* An array of partitions. */
 static TypeDef_Partition partition_array[] = {
 	{
 		partition_pacman,
 		57,
+		0,
+		192,
+		notes_pacman,
 	},
 	{
 		partition_auClairDeLaLune,
 		29,
+		0,
+		192,
+		notes_auClairDeLaLune,
 	},
 	{
 		partition_P1_reflexe,
 		3,
+		1,
+		255,
+		notes_P1_reflexe,
 	},
 	{
 		partition_P2_reflexe,
 		3,
+		1,
+		255,
+		notes_P2_reflexe,
 	},
 	{
 		partition_win,
 		57,
+		0,
+		192,
+		notes_win,
+	},
+	{
+		partition_miss,
+		6,
+		3,
+		255,
+		notes_miss,
+	},
+	{
+		partition_score,
+		6,
+		2,
+		255,
+		notes_score,
 	}
 };
 
@@ -113,7 +273,7 @@ static TypeDef_Partition partition_array[] = {
  * 
  * @param _music_handler a pointer to the music handler structure
  * 
- * @return HAL_OK
+ * @return HAL_ERROR if a partition has an unknown note, HAL_OK otherwise
  */
 HAL_StatusTypeDef init_music(TypeDef_Music_Handler * _music_handler) {
 
@@ -121,13 +281,57 @@ HAL_StatusTypeDef init_music(TypeDef_Music_Handler * _music_handler) {
 
 	music_handler->notes = notes_array;
 
-	music_handler->notes_sz = 12;
-
-	music_handler->chosen_music = 0;
+	music_handler->notes_sz = MUSIC_NOTES_COUNT;
 
 	music_handler->partitions = partition_array;
 
-	music_handler->music_running = 0;
+	music_handler->volume = 255;
+
+	music_handler->note_tick = MUSIC_NOTE_TICKS;
+
+	music_handler->note_peak = 0;
+
+	music_handler->envelope_index = 0;
+
+	music_handler->envelope_hold_index = MUSIC_NOTE_TICKS - 1;
+
+	music_handler->envelope_max_cycles = 0;
+
+	music_handler->timer_clock = TIMER_FREQ;
+
+	set_envelope(&default_envelope);
+
+#if MUSIC_PROFILE_ENVELOPE
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+	for (uint8_t i=0;i<CHANNELS_COUNT;i++) {
+		music_handler->channels[i].partition = 0;
+		music_handler->channels[i].index = 0;
+		music_handler->channels[i].priority = 0;
+		music_handler->channels[i].is_running = 0;
+	}
+
+	//the names are looked up once here, the timer interrupt only reads the indexes
+	for (uint8_t i=0;i<sizeof(partition_array)/sizeof(TypeDef_Partition);i++) {
+		TypeDef_Partition * partition = &partition_array[i];
+
+		for (uint16_t j=0;j<partition->array_sz;j++) {
+			uint8_t note = MUSIC_NOTE_MUTE;
+
+			if (strcmp(MUTE, partition->partition[j])) {
+				for (note=0;note<MUSIC_NOTES_SZ;note++)
+					if (!strcmp(MUSIC_NOTES[note].name, partition->partition[j]))
+						break;
+
+				if (note == MUSIC_NOTES_SZ)
+					return HAL_ERROR;
+			}
+
+			partition->notes[j] = note;
+		}
+	}
 
 	/*
 	for (uint8_t i=0; i<_music_handler.notes_sz;i++){
@@ -140,21 +344,70 @@ HAL_StatusTypeDef init_music(TypeDef_Music_Handler * _music_handler) {
 }
 
 /**
- * If the music is running, play the next note in the partition
+ * Mix the channels : every MUSIC_NOTE_TICKS ticks, every running channel moves forward by one note
+ * and the one with the highest priority drives the buzzer. A sound effect therefore covers the
+ * background music without pausing it, and the music is heard again as soon as the sound effect is over.
+ * The envelope of the playing note is stepped at every tick.
  *
  * this function is called by the interrupt function in timer
  */
-void play_music(void) {
-	if (music_handler->music_running == 1) {
-		static uint8_t music_index = 0;
-		if (music_index >= get_partition_sz(music_handler->chosen_music)) {
-			music_index = 0;
-			music_handler->music_running = 0;
-		}
-		else {
-			buzzer_play_note_by_name(music_index, music_handler->chosen_music);
-			music_index++;
+RAMFUNC void play_music(void) {
+	static uint8_t last_note = MUSIC_NOTE_NONE;
+	TypeDef_Music_Channel * output_channel = NULL;
+
+	music_handler->note_tick++;
+
+	if (music_handler->note_tick < MUSIC_NOTE_TICKS) {
+		music_envelope_step();
+		return;
+	}
+
+	music_handler->note_tick = 0;
+
+	//stop the channels which reached the end of their partition and elect the output channel
+	for (uint8_t i=0;i<CHANNELS_COUNT;i++) {
+		TypeDef_Music_Channel * channel = &music_handler->channels[i];
+
+		if (channel->is_running == 0)
+			continue;
+
+		if (channel->index >= music_handler->partitions[channel->partition].array_sz) {
+			channel->is_running = 0;
+			continue;
 		}
+
+		if (output_channel == NULL || channel->priority >= output_channel->priority)
+			output_channel = channel;
+	}
+
+	if (output_channel == NULL) {
+		buzzer_mute();
+		last_note = MUSIC_NOTE_NONE;
+		return;
+	}
+
+	const TypeDef_Partition * partition = &music_handler->partitions[output_channel->partition];
+	uint8_t note = partition->notes[output_channel->index];
+	uint8_t envelope_index = music_handler->envelope_index;
+	uint8_t was_tied = (music_handler->envelope_hold_index < MUSIC_NOTE_TICKS - 1);
+
+	buzzer_play_note_by_name(output_channel->index, output_channel->partition);
+	music_handler->note_peak = (music_handler->note_peak * partition->volume) >> 8;
+
+	//a note repeated in the partition is held : no new attack, no release in between
+	if (was_tied && note == last_note)
+		music_handler->envelope_index = envelope_index;
+	if (output_channel->index + 1 < partition->array_sz && note == partition->notes[output_channel->index + 1])
+		music_handler->envelope_hold_index = music_handler->envelope_sustain_end;
+
+	last_note = note;
+
+	music_envelope_step();
+
+	//move every running channel forward
+	for (uint8_t i=0;i<CHANNELS_COUNT;i++) {
+		if (music_handler->channels[i].is_running == 1)
+			music_handler->channels[i].index++;
 	}
 }
 
@@ -164,8 +417,49 @@ void play_music(void) {
  * @param _music_name The name of the music you want to play.
  */
 void set_music(MUSIC_Enum _music_name) {
-	music_handler->chosen_music = _music_name;
-	music_handler->music_running = 1;
+	TypeDef_Music_Channel * channel = &music_handler->channels[CHANNEL_MUSIC];
+
+	//the channel is stopped while it is modified so the timer interrupt never reads it half written
+	channel->is_running = 0;
+	channel->partition = _music_name;
+	channel->index = 0;
+	channel->priority = music_handler->partitions[_music_name].priority;
+	channel->is_running = 1;
+}
+
+/**
+ * It starts a sound effect over the background music. It only writes the sound effect channel,
+ * so it can be called from an interrupt.
+ * A running sound effect is only replaced by a sound effect with an higher or equal priority.
+ *
+ * @param _sfx_name The name of the sound effect you want to play.
+ *
+ * @return HAL_OK if the sound effect is started, HAL_BUSY if a more important one is playing
+ */
+HAL_StatusTypeDef play_sfx(MUSIC_Enum _sfx_name) {
+	TypeDef_Music_Channel * channel = &music_handler->channels[CHANNEL_SFX];
+	uint8_t priority = music_handler->partitions[_sfx_name].priority;
+
+	if (channel->is_running == 1 && priority < channel->priority)
+		return HAL_BUSY;
+
+	channel->is_running = 0;
+	channel->partition = _sfx_name;
+	channel->index = 0;
+	channel->priority = priority;
+	channel->is_running = 1;
+
+	return HAL_OK;
+}
+
+/**
+ * It stops every channel and mutes the buzzer
+ */
+void stop_music(void) {
+	for (uint8_t i=0;i<CHANNELS_COUNT;i++)
+		music_handler->channels[i].is_running = 0;
+
+	buzzer_mute();
 }
 
 /**
@@ -2,9 +2,8 @@
 #define HEADER_MUSIC_H
 
 #include "stm32l1xx_hal.h"
+#include "board_config.h"
 #include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
 
 //enum of the diffrents musics initialised in music_init
 typedef enum {
@@ -14,8 +13,17 @@ typedef enum {
 	P1_REFLEXE = 2,
 	P2_REFLEXE = 3,
 	WIN = 4,
+	MISS = 5,
+	SCORE = 6,
 }MUSIC_Enum;
 
+//enum of the mixer channels, the buzzer plays the note of the running channel with the highest priority
+typedef enum {
+	CHANNEL_MUSIC = 0,	// Background music, started with set_music
+	CHANNEL_SFX = 1,	// Short sound effects, started with play_sfx
+	CHANNELS_COUNT = 2,
+}MUSIC_Channel_Enum;
+
 //structure note
 typedef struct {
 	const char * name;
@@ -27,22 +35,59 @@ typedef struct {
 typedef struct {
 	const char ** partition;
 	size_t array_sz;
+	uint8_t priority;	// 0 for background musics, the higher the more important for sound effects
+	uint8_t volume;		// Volume of the song, 0-255
+	uint8_t * notes;	// Index of each note in the notes array or MUSIC_NOTE_MUTE, filled by init_music
 }TypeDef_Partition;
 
+//structure mixer channel
+typedef struct {
+	MUSIC_Enum partition;		// Partition played by the channel
+	uint16_t index;				// Index of the next note to play
+	uint8_t priority;			// Priority of the partition played
+	volatile uint8_t is_running;
+}TypeDef_Music_Channel;
+
+//structure envelope, durations are given in music ticks
+typedef struct {
+	uint8_t attack_ticks;	// Rise from silence to the peak
+	uint8_t decay_ticks;	// Fall from the peak to the sustain level
+	uint8_t sustain_level;	// Level held until the release, 0-255
+	uint8_t release_ticks;	// Fall from the sustain level to silence at the end of the note
+}TypeDef_Envelope;
+
+#define MUSIC_TICK_MS 5		// Period of play_music, the envelope is stepped at each tick
+#define MUSIC_NOTE_TICKS 14	// Duration of a partition note in ticks (70ms)
+
 typedef struct {
 	TIM_HandleTypeDef * htim;
 	TypeDef_Note * notes;
 	size_t notes_sz;
 	TypeDef_Partition * partitions;
-	MUSIC_Enum chosen_music;
-	uint8_t music_running;
+	TypeDef_Music_Channel channels[CHANNELS_COUNT];
+	uint8_t volume;								// Global volume, 0-255
+	uint8_t envelope_levels[MUSIC_NOTE_TICKS];	// Envelope level at each tick of a note, 0-255
+	uint8_t envelope_index;						// Position of the playing note in envelope_levels
+	uint8_t envelope_hold_index;				// Last position reached, the sustain end for tied notes
+	uint8_t envelope_sustain_end;				// Last position of the sustain in envelope_levels
+	uint8_t note_tick;							// Ticks elapsed since the last note change
+	uint16_t note_peak;							// CCR2 value of the playing note at level 255
+	uint32_t envelope_max_cycles;				// Worst envelope step duration, with MUSIC_PROFILE_ENVELOPE
+	uint32_t timer_clock;						// TIM3 clock, the notes ARR are computed for TIMER_FREQ
 }TypeDef_Music_Handler;
 
 #define TIMER_FREQ 32000000
 #define CRR 6400 //max 6400
 #define MUTE (char *)"-"
+#define MUSIC_NOTE_MUTE 0xFF	// Index of MUTE in TypeDef_Partition.notes
+#define MUSIC_NOTE_NONE 0xFE	// No note played yet
 #define NoteFrequency 100
 
+//set to 1 to measure the envelope step duration with the DWT cycle counter
+#ifndef MUSIC_PROFILE_ENVELOPE
+#define MUSIC_PROFILE_ENVELOPE 0
+#endif
+
 HAL_StatusTypeDef init_music(TypeDef_Music_Handler * _music_handler);
 void buzzer_play_note(TypeDef_Note * _note);
 void buzzer_mute(void);
@@ -50,6 +95,12 @@ void buzzer_play_note_by_name(uint16_t _index, MUSIC_Enum choice);
 uint16_t get_partition_sz(MUSIC_Enum name);
 void play_music(void);
 void set_music(MUSIC_Enum music_name);
+HAL_StatusTypeDef play_sfx(MUSIC_Enum _sfx_name);
+void stop_music(void);
+HAL_StatusTypeDef set_envelope(const TypeDef_Envelope * _envelope);
+void set_volume(uint8_t _volume);
+void music_envelope_step(void);
+void music_retime(uint32_t _timer_clock);
 
 
 #endif
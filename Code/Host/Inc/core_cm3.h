@@ -0,0 +1,98 @@
+/*
+ * core_cm3.h
+ *
+ * Host replacement of the Cortex-M3 intrinsics, found before the CMSIS header by the host build.
+ * The compiler macros of cmsis_gcc.h are defined here for x86, the interrupt mask, the exception
+ * number and the sleep instructions are given to the simulator. The CMSIS core_cm3.h is then
+ * included for the register definitions, NVIC and SysTick functions.
+ */
+
+#ifndef HOST_CORE_CM3_H_
+#define HOST_CORE_CM3_H_
+
+#include <stdint.h>
+
+#define __CMSIS_GCC_H
+
+#define __ASM __asm
+#define __INLINE inline
+#define __STATIC_INLINE static inline
+#define __STATIC_FORCEINLINE __attribute__((always_inline)) static inline
+#define __NO_RETURN __attribute__((__noreturn__))
+#define __USED __attribute__((used))
+#define __WEAK __attribute__((weak))
+#define __PACKED __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#define __RESTRICT __restrict
+#define __COMPILER_BARRIER() __ASM volatile("" ::: "memory")
+
+/* Simulator side of the core, sim_core.c */
+extern volatile uint32_t sim_primask;
+extern volatile uint32_t sim_ipsr;
+void sim_irq_unmasked(void);
+void sim_irq_sync(void);
+void sim_wfi(void);
+void sim_wfe(void);
+void sim_sev(void);
+
+__STATIC_FORCEINLINE void __enable_irq(void) { sim_primask = 0; sim_irq_unmasked(); }
+__STATIC_FORCEINLINE void __disable_irq(void) { sim_primask = 1; __COMPILER_BARRIER(); }
+__STATIC_FORCEINLINE uint32_t __get_PRIMASK(void) { return sim_primask; }
+
+__STATIC_FORCEINLINE void __set_PRIMASK(uint32_t priMask)
+{
+	sim_primask = priMask & 1;
+	if (sim_primask == 0)
+		sim_irq_unmasked();
+}
+
+__STATIC_FORCEINLINE uint32_t __get_IPSR(void) { return sim_ipsr; }
+__STATIC_FORCEINLINE uint32_t __get_xPSR(void) { return sim_ipsr; }
+__STATIC_FORCEINLINE uint32_t __get_APSR(void) { return 0; }
+__STATIC_FORCEINLINE uint32_t __get_CONTROL(void) { return 0; }
+__STATIC_FORCEINLINE void __set_CONTROL(uint32_t control) { (void)control; }
+__STATIC_FORCEINLINE uint32_t __get_BASEPRI(void) { return 0; }
+__STATIC_FORCEINLINE void __set_BASEPRI(uint32_t basePri) { (void)basePri; }
+__STATIC_FORCEINLINE uint32_t __get_FAULTMASK(void) { return 0; }
+__STATIC_FORCEINLINE void __set_FAULTMASK(uint32_t faultMask) { (void)faultMask; }
+__STATIC_FORCEINLINE uint32_t __get_PSP(void) { return 0; }
+__STATIC_FORCEINLINE void __set_PSP(uint32_t topOfProcStack) { (void)topOfProcStack; }
+__STATIC_FORCEINLINE void __set_MSP(uint32_t topOfMainStack) { (void)topOfMainStack; }
+
+// The firmware stack of the simulator is mapped in the low 4GB
+__STATIC_FORCEINLINE uint32_t __get_MSP(void) { return (uint32_t)(uintptr_t)__builtin_frame_address(0); }
+
+#define __NOP() __ASM volatile("nop")
+#define __WFI() sim_wfi()
+#define __WFE() sim_wfe()
+#define __SEV() sim_sev()
+#define __BKPT(value) __builtin_trap()
+
+// A pending interrupt is taken at a barrier, as after an instruction on the target
+__STATIC_FORCEINLINE void __ISB(void) { __COMPILER_BARRIER(); sim_irq_sync(); }
+__STATIC_FORCEINLINE void __DSB(void) { __COMPILER_BARRIER(); sim_irq_sync(); }
+__STATIC_FORCEINLINE void __DMB(void) { __COMPILER_BARRIER(); }
+
+__STATIC_FORCEINLINE uint32_t __REV(uint32_t value) { return __builtin_bswap32(value); }
+__STATIC_FORCEINLINE uint32_t __REV16(uint32_t value) { return ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8); }
+__STATIC_FORCEINLINE int16_t __REVSH(int16_t value) { return (int16_t)__builtin_bswap16((uint16_t)value); }
+__STATIC_FORCEINLINE uint32_t __ROR(uint32_t op1, uint32_t op2) { op2 %= 32; return op2 ? (op1 >> op2) | (op1 << (32 - op2)) : op1; }
+
+__STATIC_FORCEINLINE uint32_t __RBIT(uint32_t value)
+{
+	uint32_t result = 0;
+
+	for (int i = 0; i < 32; i++)
+		result |= ((value >> i) & 1) << (31 - i);
+
+	return result;
+}
+
+// CLZ of 0 is 32 on the target, undefined for the builtin
+__STATIC_FORCEINLINE uint8_t __CLZ(uint32_t value) { return value ? (uint8_t)__builtin_clz(value) : 32; }
+
+#include_next <core_cm3.h>
+
+#endif /* HOST_CORE_CM3_H_ */
@@ -0,0 +1,90 @@
+/*
+ * sim.h
+ *
+ * Host simulator of the board. The firmware objects are built for the host unchanged : the device
+ * registers are mapped at their addresses, read-only, and every write traps into a model of the
+ * peripheral (sim_bus.c) which gives it the register semantics (flags cleared by writing 0 or 1,
+ * update events, ready bits). Reads see the state the models keep up to date with the simulated
+ * time : counters, RTC calendar, DMA counts, button inputs.
+ *
+ * The time is simulated : the CPU runs SIM_LOOP_CYCLES cycles per main loop iteration at the HCLK
+ * set by the RCC registers, the interrupts are taken between two iterations, when they are unmasked,
+ * at a barrier or in WFI/WFE. In Stop mode the time jumps to the next wakeup, the timers and the
+ * cycle counter are frozen. The cycles spent in the interrupt handlers are not counted.
+ *
+ * The EEPROM may be backed by a file.
+ *
+ * The tests drive the drivers they check directly. pong_sim (sim_main.c) runs the firmware main
+ * on its own stack in the firmware RAM of firmware.ld, with the buttons pressed from the command
+ * line and the log, SWO, LED, display and telemetry outputs written to files. Two pong_sim may be
+ * linked through pipes, each one simulating a board of the link (sim_link.c).
+ */
+
+#ifndef HOST_SIM_H_
+#define HOST_SIM_H_
+
+#include "stm32l1xx.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_PS_PER_S 1000000000000ULL
+#define SIM_PS_PER_MS 1000000000ULL
+#define SIM_PS_PER_US 1000000ULL
+#define SIM_NEVER UINT64_MAX
+
+#ifndef SIM_LOOP_CYCLES
+#define SIM_LOOP_CYCLES 128		// CPU cycles of a main loop iteration
+#endif
+
+#define SIM_RAM_BASE 0x20000000	// Firmware RAM, as on the target
+#define SIM_RAM_SIZE 0x14000
+
+typedef enum {
+	SIM_OUT_LOG = 0,		// ITM port 0 text, stdout by default
+	SIM_OUT_SWO = 1,		// ITM packets of every port, as sent on the SWO pin
+	SIM_OUT_EVENTS = 2,		// LED, display and buzzer changes, one line each
+	SIM_OUT_TELEMETRY = 3,	// USART2 bytes
+	SIM_OUT_COUNT,
+}SIM_Out_Enum;
+
+typedef struct {
+	uint32_t sysclk;
+	uint32_t hclk;
+	uint32_t pclk1;
+	uint32_t pclk2;
+	uint32_t tim_apb1;	// Clock of the APB1 timers
+}TypeDef_Sim_Clocks;
+
+/* sim_bus.c */
+void sim_init(const char *_eeprom_path);
+void *sim_alias(uintptr_t _addr);
+
+/* sim_core.c */
+uint64_t sim_now_ps(void);
+uint64_t sim_cycles(void);
+void sim_run_cycles(uint32_t _cycles);
+void sim_run_until(uint64_t _ps);
+void sim_irq_dispatch(void);
+void sim_set_out(SIM_Out_Enum _out, FILE *_file);
+FILE *sim_get_out(SIM_Out_Enum _out);
+void sim_event(const char *_format, ...) __attribute__((format(printf, 1, 2)));
+
+/* sim_rcc.c */
+const TypeDef_Sim_Clocks *sim_clocks(void);
+
+/* sim_gpio.c */
+void sim_gpio_input(GPIO_TypeDef *_port, uint16_t _pin, uint8_t _level);
+void sim_button_set(uint16_t _pin, uint8_t _pressed);
+uint8_t sim_led_get(uint8_t _index);
+uint8_t sim_digit_get(uint8_t _index);
+
+/* sim_link.c */
+int sim_link_open(const char *_tx_path, const char *_rx_path);
+void sim_link_delay(uint64_t _latency_ps, uint64_t _jitter_ps);
+
+/* sim_io.c */
+int sim_printf(const char *_format, ...);
+int sim_snprintf(char *_buffer, size_t _size, const char *_format, ...);
+
+#endif /* HOST_SIM_H_ */
@@ -0,0 +1,84 @@
+/*
+ * sim_periph.h
+ *
+ * Interface between the trapped bus, the simulated core and the peripheral models.
+ * A write to a device register is given to the model with the register value before the write
+ * and the value written (merged into the 32-bit word for a byte or halfword write), the model
+ * stores the resulting register value in the alias. A model raising flags over time gives the
+ * time of its next flag, the core stops there to update it.
+ */
+
+#ifndef HOST_SIM_PERIPH_H_
+#define HOST_SIM_PERIPH_H_
+
+#include "sim.h"
+
+#define SIM_MODELS_MAX 8
+
+typedef void (*Sim_Write_Handler)(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+
+typedef struct {
+	uintptr_t base;
+	uint32_t size;
+	Sim_Write_Handler write;	// NULL : plain memory
+}TypeDef_Sim_Device;
+
+typedef struct {
+	void (*update)(uint64_t _now);			// Catch up with the time
+	uint64_t (*next_event)(uint64_t _now);	// Time of the next flag raised, SIM_NEVER if none
+	void (*levels)(void);					// Assert the interrupt lines still active
+	void (*clock_changed)(void);			// A bus clock changed
+	void (*stop)(uint8_t _stopped);			// Stop mode entered (1) or left (0)
+}TypeDef_Sim_Model;
+
+// Register of a device in the alias, written without trapping
+#define SIM_REGS(_periph) ((__typeof__(_periph))sim_alias((uintptr_t)(_periph)))
+
+/* sim_bus.c */
+void sim_bus_init(const char *_eeprom_path);
+
+/* sim_core.c */
+void sim_core_init(void);
+void sim_add_model(const TypeDef_Sim_Model *_model);
+void sim_irq_line(IRQn_Type _irqn, uint8_t _level);
+void sim_irq_levels(void);
+void sim_core_event(void);
+void sim_core_clock_changed(void);
+uint8_t sim_core_stopped(void);
+void sim_core_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_itm_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_out_write(SIM_Out_Enum _out, const void *_data, size_t _size);
+
+/* sim_rcc.c */
+void sim_rcc_init(void);
+void sim_rcc_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_pwr_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_flash_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_eeprom_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_crc_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_rcc_wake(void);
+
+/* sim_tim.c */
+void sim_tim_init(void);
+void sim_tim_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+
+/* sim_rtc.c */
+void sim_rtc_init(void);
+void sim_rtc_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+
+/* sim_gpio.c */
+void sim_gpio_init(void);
+void sim_gpio_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_exti_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_exti_edge(uint8_t _line, uint8_t _rising);
+void sim_spi_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+
+/* sim_uart.c */
+void sim_uart_init(void);
+void sim_uart_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+void sim_uart_receive(USART_TypeDef *_usart, uint8_t _byte);
+
+/* sim_link.c */
+void sim_link_send(uint8_t _byte, uint64_t _end_ps);
+
+#endif /* HOST_SIM_PERIPH_H_ */
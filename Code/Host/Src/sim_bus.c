@@ -0,0 +1,330 @@
+/*
+ * sim_bus.c
+ *
+ * Device regions mapped at their target addresses. Each region is a shared memory object mapped
+ * twice : read-only at the device address for the firmware, writable elsewhere for the models
+ * (the alias). A firmware write faults, the page is opened for the single faulting instruction
+ * (trap flag) and the write is then given to the model of the device.
+ * A write to the peripheral bit-band alias is given to the device as a write of its word. The
+ * bit-band alias is not read back from the devices. The polled pages are writable, not trapped.
+ */
+
+#define _GNU_SOURCE
+
+#include "sim_periph.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define SIM_TRAP_FLAG 0x100			// EFLAGS.TF
+#define SIM_SIGNAL_STACK_SZ 0x10000
+#define SIM_PERIPH_SIZE 0x27000
+
+typedef struct {
+	uintptr_t base;
+	size_t size;
+	uint8_t *alias;
+}TypeDef_Sim_Region;
+
+static TypeDef_Sim_Region regions[] = {
+	{PERIPH_BASE, SIM_PERIPH_SIZE, NULL},			// APB1, APB2 and AHB up to DMA2
+	{PERIPH_BB_BASE, SIM_PERIPH_SIZE * 32, NULL},	// Its bit-band alias
+	{ITM_BASE, 0x43000, NULL},						// Private peripheral bus up to DBGMCU
+	{FLASH_EEPROM_BASE, 0x4000, NULL},				// Data EEPROM, 16KB
+};
+
+#define SIM_REGIONS_COUNT (sizeof(regions) / sizeof(regions[0]))
+
+static void sim_bitband_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size);
+
+static const TypeDef_Sim_Device devices[] = {
+	{TIM2_BASE, 0x400, sim_tim_write},
+	{TIM3_BASE, 0x400, sim_tim_write},
+	{TIM4_BASE, 0x400, sim_tim_write},
+	{TIM5_BASE, 0x400, sim_tim_write},
+	{RTC_BASE, 0x400, sim_rtc_write},
+	{USART2_BASE, 0x400, sim_uart_write},
+	{PWR_BASE, 0x400, sim_pwr_write},
+	{EXTI_BASE, 0x400, sim_exti_write},
+	{SPI1_BASE, 0x400, sim_spi_write},
+	{USART1_BASE, 0x400, sim_uart_write},
+	{GPIOA_BASE, 0x1C00, sim_gpio_write},
+	{CRC_BASE, 0x400, sim_crc_write},
+	{RCC_BASE, 0x400, sim_rcc_write},
+	{FLASH_R_BASE, 0x400, sim_flash_write},
+	{FLASH_EEPROM_BASE, 0x4000, sim_eeprom_write},
+	{ITM_BASE, 0x1000, sim_itm_write},
+	{DWT_BASE, 0x1000, sim_core_write},
+	{SCS_BASE, 0x1000, sim_core_write},
+	{PERIPH_BB_BASE, SIM_PERIPH_SIZE * 32, sim_bitband_write},
+};
+
+#define SIM_DEVICES_COUNT (sizeof(devices) / sizeof(devices[0]))
+
+// Pages written at each main loop iteration, not trapped : their model polls them
+static const uintptr_t polled_pages[] = {
+	DMA1_BASE,
+};
+
+static struct {
+	uintptr_t addr;		// Address written by the trapped instruction
+	uint32_t old[2];	// Words before the write
+	uint8_t size;
+	uint8_t active;
+} trap;
+
+static long page_size;
+
+/**
+ * @brief Region holding an address
+ * @retval Region, NULL if the address is not a device address
+ */
+static TypeDef_Sim_Region *sim_bus_region(uintptr_t _addr)
+{
+	for (size_t i = 0; i < SIM_REGIONS_COUNT; i++)
+		if (_addr >= regions[i].base && _addr < regions[i].base + regions[i].size)
+			return &regions[i];
+
+	return NULL;
+}
+
+/**
+ * @brief Size of the memory access of an instruction, from its opcode
+ * @param _ip First byte of the instruction
+ * @retval 1, 2, 4 or 8
+ */
+static uint8_t sim_bus_access_size(const uint8_t *_ip)
+{
+	uint8_t size = 4;
+
+	// Legacy prefixes
+	for (;; _ip++)
+	{
+		if (*_ip == 0x66)
+			size = 2;
+		else if (*_ip != 0xF0 && *_ip != 0xF2 && *_ip != 0xF3 && *_ip != 0x2E && *_ip != 0x3E &&
+				 *_ip != 0x26 && *_ip != 0x36 && *_ip != 0x64 && *_ip != 0x65)
+			break;
+	}
+
+	// REX
+	if ((*_ip & 0xF0) == 0x40)
+	{
+		if (*_ip & 0x08)
+			size = 8;
+		_ip++;
+	}
+
+	switch (*_ip)
+	{
+	case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30:
+	case 0x80: case 0x86: case 0x88: case 0xA4: case 0xAA: case 0xC0: case 0xC6:
+	case 0xD0: case 0xD2: case 0xF6: case 0xFE:
+		return 1;
+	case 0x0F:
+		// SETcc, CMPXCHG and XADD on bytes
+		if ((_ip[1] & 0xF0) == 0x90 || _ip[1] == 0xB0 || _ip[1] == 0xC0)
+			return 1;
+		return size;
+	default:
+		return size;
+	}
+}
+
+/**
+ * @brief Model of the device at an address
+ * @retval Write handler, NULL for plain memory
+ */
+static Sim_Write_Handler sim_bus_device(uintptr_t _addr)
+{
+	for (size_t d = 0; d < SIM_DEVICES_COUNT; d++)
+		if (_addr >= devices[d].base && _addr < devices[d].base + devices[d].size)
+			return devices[d].write;
+
+	return NULL;
+}
+
+/**
+ * @brief Write to the bit-band alias : the bit is set or cleared in its peripheral word
+ */
+static void sim_bitband_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	uint32_t offset = (_addr - PERIPH_BB_BASE) / 32;
+	uint32_t bit = 8 * (offset & 3) + ((_addr - PERIPH_BB_BASE) / 4) % 8;
+	uintptr_t word = PERIPH_BASE + (offset & ~(uint32_t)3);
+	uint32_t *target = sim_alias(word);
+	uint32_t target_old = *target;
+	Sim_Write_Handler write = sim_bus_device(word);
+
+	(void)_old;
+	(void)_size;
+
+	*target = (_value & 1) ? (target_old | (1UL << bit)) : (target_old & ~(1UL << bit));
+
+	if (write != NULL)
+		write(word, target_old, *target, 4);
+}
+
+/**
+ * @brief Give a trapped write to the model of the device
+ */
+static void sim_bus_dispatch(uintptr_t _addr, const uint32_t *_old, uint8_t _size)
+{
+	uintptr_t word = _addr & ~(uintptr_t)3;
+	uintptr_t last = (_addr + _size - 1) & ~(uintptr_t)3;
+
+	for (int i = 0; word <= last; word += 4, i++)
+	{
+		Sim_Write_Handler write = sim_bus_device(word);
+
+		if (write != NULL)
+			write(word, _old[i & 1], *(uint32_t *)sim_alias(word), (_size < 4) ? _size : 4);
+	}
+}
+
+/**
+ * @brief Write to a device page : open the page for the faulting instruction only
+ */
+static void sim_bus_fault(int _signal, siginfo_t *_info, void *_context)
+{
+	ucontext_t *context = _context;
+	uintptr_t addr = (uintptr_t)_info->si_addr;
+	TypeDef_Sim_Region *region = sim_bus_region(addr);
+
+	(void)_signal;
+
+	// Not a device write : crash at the faulting instruction
+	if (region == NULL || trap.active)
+	{
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	uintptr_t word = addr & ~(uintptr_t)3;
+
+	trap.addr = addr;
+	trap.size = sim_bus_access_size((const uint8_t *)context->uc_mcontext.gregs[REG_RIP]);
+	trap.old[0] = *(uint32_t *)sim_alias(word);
+	trap.old[1] = (word + 4 < region->base + region->size) ? *(uint32_t *)sim_alias(word + 4) : 0;
+	trap.active = 1;
+
+	mprotect((void *)(addr & ~(uintptr_t)(page_size - 1)), page_size, PROT_READ | PROT_WRITE);
+	context->uc_mcontext.gregs[REG_EFL] |= SIM_TRAP_FLAG;
+}
+
+/**
+ * @brief The trapped write is done : protect the page again and run the model
+ */
+static void sim_bus_step(int _signal, siginfo_t *_info, void *_context)
+{
+	ucontext_t *context = _context;
+
+	(void)_signal;
+	(void)_info;
+
+	if (trap.active == 0)
+	{
+		signal(SIGTRAP, SIG_DFL);
+		return;
+	}
+
+	context->uc_mcontext.gregs[REG_EFL] &= ~SIM_TRAP_FLAG;
+	mprotect((void *)(trap.addr & ~(uintptr_t)(page_size - 1)), page_size, PROT_READ);
+	trap.active = 0;
+
+	sim_bus_dispatch(trap.addr, trap.old, trap.size);
+}
+
+/**
+ * @brief Map a region at its device address and its alias
+ * @param _fd Backing file, -1 for an anonymous one
+ */
+static void sim_bus_map(TypeDef_Sim_Region *_region, int _fd)
+{
+	int fd = (_fd >= 0) ? _fd : memfd_create("sim_region", 0);
+
+	if (fd < 0 || ftruncate(fd, _region->size) != 0)
+	{
+		perror("sim: region");
+		exit(EXIT_FAILURE);
+	}
+
+	void *device = mmap((void *)_region->base, _region->size, PROT_READ, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+	void *alias = mmap(NULL, _region->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (device != (void *)_region->base || alias == MAP_FAILED)
+	{
+		fprintf(stderr, "sim: cannot map %#lx\n", (unsigned long)_region->base);
+		exit(EXIT_FAILURE);
+	}
+
+	_region->alias = alias;
+	close(fd);
+}
+
+/**
+ * @brief Map the device regions and install the write trap
+ * @param _eeprom_path File backing the data EEPROM, NULL for an erased one lost at exit
+ */
+void sim_bus_init(const char *_eeprom_path)
+{
+	struct sigaction action = {0};
+	stack_t stack = {0};
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	for (size_t i = 0; i < SIM_REGIONS_COUNT; i++)
+	{
+		int fd = -1;
+
+		if (regions[i].base == FLASH_EEPROM_BASE && _eeprom_path != NULL)
+		{
+			fd = open(_eeprom_path, O_RDWR | O_CREAT, 0644);
+			if (fd < 0)
+			{
+				perror(_eeprom_path);
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		sim_bus_map(&regions[i], fd);
+	}
+
+	for (size_t i = 0; i < sizeof(polled_pages) / sizeof(polled_pages[0]); i++)
+		mprotect((void *)polled_pages[i], page_size, PROT_READ | PROT_WRITE);
+
+	// The firmware stack may be small, the handlers get their own
+	stack.ss_sp = malloc(SIM_SIGNAL_STACK_SZ);
+	stack.ss_size = SIM_SIGNAL_STACK_SZ;
+	sigaltstack(&stack, NULL);
+
+	action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+	sigemptyset(&action.sa_mask);
+	action.sa_sigaction = sim_bus_fault;
+	sigaction(SIGSEGV, &action, NULL);
+	action.sa_sigaction = sim_bus_step;
+	sigaction(SIGTRAP, &action, NULL);
+}
+
+/**
+ * @brief Writable view of a device address
+ * @param _addr Device address
+ * @retval Address of the same byte in the alias
+ */
+void *sim_alias(uintptr_t _addr)
+{
+	TypeDef_Sim_Region *region = sim_bus_region(_addr);
+
+	if (region == NULL)
+	{
+		fprintf(stderr, "sim: %#lx is not a device address\n", (unsigned long)_addr);
+		abort();
+	}
+
+	return region->alias + (_addr - region->base);
+}
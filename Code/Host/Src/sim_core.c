@@ -0,0 +1,549 @@
+/*
+ * sim_core.c
+ *
+ * Simulated time, NVIC, interrupt mask, sleep modes, DWT cycle counter and ITM.
+ */
+
+#include "sim_periph.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+#define SIM_IRQS_COUNT 64
+#define SIM_THREAD_PRIORITY 0x100	// Below every interrupt priority
+#define SIM_ITM_PORTS 32
+
+volatile uint32_t sim_primask = 0;
+volatile uint32_t sim_ipsr = 0;
+
+/* Handlers of the firmware, an interrupt without one stops the simulation */
+#define SIM_HANDLER_LIST(X) \
+	X(RTC_WKUP) X(EXTI0) X(EXTI1) X(EXTI2) X(EXTI3) X(EXTI4) \
+	X(DMA1_Channel1) X(DMA1_Channel2) X(DMA1_Channel3) X(DMA1_Channel4) X(DMA1_Channel5) \
+	X(DMA1_Channel6) X(DMA1_Channel7) X(EXTI9_5) X(TIM2) X(TIM3) X(TIM4) X(TIM5) X(SPI1) \
+	X(USART1) X(USART2) X(EXTI15_10) X(RTC_Alarm)
+
+#define SIM_HANDLER_DECLARE(_name) void _name##_IRQHandler(void) __attribute__((weak));
+#define SIM_HANDLER_ENTRY(_name) [_name##_IRQn] = _name##_IRQHandler,
+
+SIM_HANDLER_LIST(SIM_HANDLER_DECLARE)
+
+static void (*const vectors[SIM_IRQS_COUNT])(void) = {
+	SIM_HANDLER_LIST(SIM_HANDLER_ENTRY)
+};
+
+static struct {
+	uint64_t now_ps;
+	uint64_t cycle_base;		// CPU cycles at cycle_base_ps
+	uint64_t cycle_base_ps;
+	uint32_t hclk;				// Clock of the cycles counted from cycle_base_ps
+	uint64_t dwt_offset;		// CPU cycles at which CYCCNT was 0
+	uint64_t pending;
+	uint64_t enabled;
+	uint64_t active;
+	uint32_t active_priority;	// Priority of the running handler
+	uint8_t event;				// Event register of WFE
+	uint8_t stopped;			// In Stop mode
+	const TypeDef_Sim_Model *models[SIM_MODELS_MAX];
+	uint8_t models_count;
+	FILE *outs[SIM_OUT_COUNT];
+} core;
+
+/**
+ * @brief CPU cycles run up to a time, the core does not run in Stop mode
+ */
+static uint64_t sim_core_cycles_at(uint64_t _ps)
+{
+	if (core.stopped)
+		return core.cycle_base;
+
+	return core.cycle_base + (uint64_t)(((unsigned __int128)(_ps - core.cycle_base_ps) * core.hclk) / SIM_PS_PER_S);
+}
+
+/**
+ * @brief Restart the cycle count from now, before a change of the clock or of the Stop mode
+ */
+static void sim_core_rebase_cycles(void)
+{
+	core.cycle_base = sim_core_cycles_at(core.now_ps);
+	core.cycle_base_ps = core.now_ps;
+}
+
+/**
+ * @retval 1 if the DWT cycle counter counts
+ */
+static uint8_t sim_dwt_enabled(void)
+{
+	return (SIM_REGS(CoreDebug)->DEMCR & CoreDebug_DEMCR_TRCENA_Msk) && (SIM_REGS(DWT)->CTRL & DWT_CTRL_CYCCNTENA_Msk);
+}
+
+/**
+ * @brief Show the registers following the time : the DWT cycle counter
+ */
+static void sim_core_refresh(void)
+{
+	if (sim_dwt_enabled())
+		SIM_REGS(DWT)->CYCCNT = (uint32_t)(sim_core_cycles_at(core.now_ps) - core.dwt_offset);
+}
+
+/**
+ * @brief Show the NVIC enable and pending bits in its registers
+ */
+static void sim_nvic_refresh(void)
+{
+	NVIC_Type *nvic = SIM_REGS(NVIC);
+
+	for (int i = 0; i < SIM_IRQS_COUNT / 32; i++)
+	{
+		nvic->ISER[i] = nvic->ICER[i] = (uint32_t)(core.enabled >> (32 * i));
+		nvic->ISPR[i] = nvic->ICPR[i] = (uint32_t)(core.pending >> (32 * i));
+		nvic->IABR[i] = (uint32_t)(core.active >> (32 * i));
+	}
+}
+
+/**
+ * @brief Update every model up to a time, stopping at each flag they raise
+ * @param _target Time to reach
+ */
+static void sim_advance(uint64_t _target)
+{
+	while (core.now_ps < _target)
+	{
+		uint64_t next = _target;
+
+		for (int i = 0; i < core.models_count; i++)
+		{
+			if (core.models[i]->next_event == NULL)
+				continue;
+
+			uint64_t event = core.models[i]->next_event(core.now_ps);
+
+			if (event <= core.now_ps)
+				event = core.now_ps + 1;
+			if (event < next)
+				next = event;
+		}
+
+		core.now_ps = next;
+
+		for (int i = 0; i < core.models_count; i++)
+			if (core.models[i]->update != NULL)
+				core.models[i]->update(core.now_ps);
+
+		sim_irq_levels();
+	}
+
+	sim_core_refresh();
+}
+
+/**
+ * @brief Highest priority interrupt which may preempt the running code
+ * @retval IRQ number, -1 if none
+ */
+static int sim_irq_next(void)
+{
+	uint64_t ready = core.pending & core.enabled;
+	uint32_t best_priority = core.active_priority;
+	int best = -1;
+
+	for (int irq = 0; ready != 0; irq++, ready >>= 1)
+	{
+		if ((ready & 1) == 0)
+			continue;
+
+		uint32_t priority = SIM_REGS(NVIC)->IP[irq] >> (8U - __NVIC_PRIO_BITS);
+
+		if (priority < best_priority)
+		{
+			best_priority = priority;
+			best = irq;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * @brief Sleep until an enabled interrupt is pending, or an event for WFE. In deep sleep the
+ * core enters the Stop mode : its clocks and the timers are stopped.
+ * @param _wfe 1 for WFE, 0 for WFI
+ */
+static void sim_core_sleep(uint8_t _wfe)
+{
+	uint8_t deep = (SIM_REGS(SCB)->SCR & SCB_SCR_SLEEPDEEP_Msk) != 0;
+
+	if (deep)
+	{
+		sim_core_rebase_cycles();
+		core.stopped = 1;
+		for (int i = 0; i < core.models_count; i++)
+			if (core.models[i]->stop != NULL)
+				core.models[i]->stop(1);
+	}
+
+	while ((core.pending & core.enabled) == 0 && (_wfe == 0 || core.event == 0))
+	{
+		uint64_t next = SIM_NEVER;
+
+		for (int i = 0; i < core.models_count; i++)
+		{
+			if (core.models[i]->next_event == NULL)
+				continue;
+
+			uint64_t event = core.models[i]->next_event(core.now_ps);
+
+			if (event < next)
+				next = event;
+		}
+
+		if (next == SIM_NEVER)
+		{
+			fprintf(stderr, "sim: sleeping with no wakeup source\n");
+			exit(EXIT_FAILURE);
+		}
+
+		sim_advance(next);
+	}
+
+	if (deep)
+	{
+		core.cycle_base_ps = core.now_ps;
+		core.stopped = 0;
+		sim_rcc_wake();
+		for (int i = 0; i < core.models_count; i++)
+			if (core.models[i]->stop != NULL)
+				core.models[i]->stop(0);
+		sim_core_refresh();
+	}
+
+	// Woken by an event, it is consumed
+	if ((core.pending & core.enabled) == 0)
+		core.event = 0;
+
+	sim_irq_dispatch();
+}
+
+/**
+ * @brief Reset the core
+ */
+void sim_core_init(void)
+{
+	core.now_ps = 0;
+	core.cycle_base = 0;
+	core.cycle_base_ps = 0;
+	core.hclk = sim_clocks()->hclk;
+	core.dwt_offset = 0;
+	core.pending = 0;
+	core.enabled = 0;
+	core.active = 0;
+	core.active_priority = SIM_THREAD_PRIORITY;
+	core.event = 0;
+	core.stopped = 0;
+	core.outs[SIM_OUT_LOG] = stdout;
+
+	sim_primask = 0;
+	sim_ipsr = 0;
+
+	// A debugger is attached, the ITM is enabled and ready
+	ITM_Type *itm = SIM_REGS(ITM);
+
+	itm->TCR = ITM_TCR_ITMENA_Msk;
+	itm->TER = 0xFFFFFFFF;
+	for (int i = 0; i < SIM_ITM_PORTS; i++)
+		itm->PORT[i].u32 = 1;
+
+	*(uint32_t *)&SIM_REGS(SCB)->CPUID = 0x412FC231;
+	sim_nvic_refresh();
+}
+
+/**
+ * @brief Add a model updated with the time
+ */
+void sim_add_model(const TypeDef_Sim_Model *_model)
+{
+	if (core.models_count >= SIM_MODELS_MAX)
+	{
+		fprintf(stderr, "sim: too many models\n");
+		exit(EXIT_FAILURE);
+	}
+
+	core.models[core.models_count++] = _model;
+}
+
+/**
+ * @retval Simulated time in picoseconds
+ */
+uint64_t sim_now_ps(void) { return core.now_ps; }
+
+/**
+ * @retval CPU cycles run
+ */
+uint64_t sim_cycles(void) { return sim_core_cycles_at(core.now_ps); }
+
+/**
+ * @brief Run the CPU, then take the pending interrupts
+ * @param _cycles CPU cycles at the current clock
+ */
+void sim_run_cycles(uint32_t _cycles)
+{
+	uint64_t cycles = sim_core_cycles_at(core.now_ps) + _cycles - core.cycle_base;
+	uint64_t ps = (uint64_t)(((unsigned __int128)cycles * SIM_PS_PER_S + core.hclk - 1) / core.hclk);
+
+	sim_run_until(core.cycle_base_ps + ps);
+}
+
+/**
+ * @brief Let the time run up to a date, then take the pending interrupts
+ * @param _ps Date in picoseconds
+ */
+void sim_run_until(uint64_t _ps)
+{
+	sim_advance(_ps);
+	sim_irq_dispatch();
+}
+
+/**
+ * @brief Assert an interrupt line, the interrupt stays pending until taken or cleared
+ * @param _irqn Interrupt
+ * @param _level 1 if the line is active
+ */
+void sim_irq_line(IRQn_Type _irqn, uint8_t _level)
+{
+	if (_level == 0 || _irqn < 0)
+		return;
+
+	uint64_t bit = 1ULL << _irqn;
+
+	if ((core.pending & bit) == 0)
+	{
+		core.pending |= bit;
+		sim_nvic_refresh();
+
+		// SEVONPEND is not used : an enabled interrupt wakes WFE by itself
+	}
+}
+
+/**
+ * @brief Pend again the interrupts whose source is still active
+ */
+void sim_irq_levels(void)
+{
+	for (int i = 0; i < core.models_count; i++)
+		if (core.models[i]->levels != NULL)
+			core.models[i]->levels();
+}
+
+/**
+ * @brief Take the pending interrupts of a higher priority than the running code
+ */
+void sim_irq_dispatch(void)
+{
+	int irq;
+
+	while (sim_primask == 0 && (irq = sim_irq_next()) >= 0)
+	{
+		uint64_t bit = 1ULL << irq;
+		uint32_t priority = core.active_priority;
+		uint32_t ipsr = sim_ipsr;
+
+		if (vectors[irq] == NULL)
+		{
+			fprintf(stderr, "sim: no handler for IRQ %d\n", irq);
+			exit(EXIT_FAILURE);
+		}
+
+		core.pending &= ~bit;
+		core.active |= bit;
+		core.active_priority = SIM_REGS(NVIC)->IP[irq] >> (8U - __NVIC_PRIO_BITS);
+		sim_ipsr = irq + 16;
+		sim_nvic_refresh();
+
+		vectors[irq]();
+
+		sim_ipsr = ipsr;
+		core.active_priority = priority;
+		core.active &= ~bit;
+
+		// The exception return sets the event register
+		core.event = 1;
+		sim_irq_levels();
+		sim_nvic_refresh();
+	}
+}
+
+/**
+ * @brief Interrupts unmasked by the firmware
+ */
+void sim_irq_unmasked(void) { sim_irq_dispatch(); }
+
+/**
+ * @brief Barrier of the firmware, a pending interrupt is taken
+ */
+void sim_irq_sync(void) { sim_irq_dispatch(); }
+
+void sim_wfi(void) { sim_core_sleep(0); }
+
+void sim_wfe(void)
+{
+	if (core.event)
+	{
+		core.event = 0;
+		return;
+	}
+
+	sim_core_sleep(1);
+}
+
+void sim_sev(void) { core.event = 1; }
+
+/**
+ * @brief Wakeup event of an EXTI line
+ */
+void sim_core_event(void) { core.event = 1; }
+
+/**
+ * @retval 1 in Stop mode
+ */
+uint8_t sim_core_stopped(void) { return core.stopped; }
+
+/**
+ * @brief The HCLK or a bus clock changed, the models were updated up to now at the old clocks
+ */
+void sim_core_clock_changed(void)
+{
+	sim_core_rebase_cycles();
+	core.hclk = sim_clocks()->hclk;
+
+	for (int i = 0; i < core.models_count; i++)
+		if (core.models[i]->clock_changed != NULL)
+			core.models[i]->clock_changed();
+}
+
+/**
+ * @brief Write to the DWT or the system control space : NVIC, SCB, SysTick, CoreDebug
+ */
+void sim_core_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	(void)_size;
+
+	if (_addr == (uintptr_t)&DWT->CYCCNT)
+	{
+		core.dwt_offset = sim_core_cycles_at(core.now_ps) - _value;
+		return;
+	}
+
+	if (_addr == (uintptr_t)&DWT->CTRL || _addr == (uintptr_t)&CoreDebug->DEMCR)
+	{
+		// The counter goes on from its value when enabled
+		uint32_t cyccnt = SIM_REGS(DWT)->CYCCNT;
+
+		core.dwt_offset = sim_core_cycles_at(core.now_ps) - cyccnt;
+		return;
+	}
+
+	uintptr_t nvic = NVIC_BASE;
+	uint32_t word = (_addr & 0x7F) / 4;
+	uint64_t bits = (uint64_t)_value << (32 * word);
+
+	if (word >= SIM_IRQS_COUNT / 32)
+		bits = 0;
+
+	if (_addr >= nvic && _addr < nvic + 0x80)
+		core.enabled |= bits;
+	else if (_addr >= nvic + 0x80 && _addr < nvic + 0x100)
+		core.enabled &= ~bits;
+	else if (_addr >= nvic + 0x100 && _addr < nvic + 0x180)
+		core.pending |= bits;
+	else if (_addr >= nvic + 0x180 && _addr < nvic + 0x200)
+		core.pending &= ~bits;
+	else if (_addr >= nvic + 0x200 && _addr < nvic + 0x280)
+		*(uint32_t *)sim_alias(_addr) = _old;
+	else if (_addr == (uintptr_t)&NVIC->STIR)
+		core.pending |= 1ULL << (_value & (SIM_IRQS_COUNT - 1));
+	else
+		return;
+
+	sim_nvic_refresh();
+}
+
+/**
+ * @brief Write to the ITM : a stimulus port write is sent, the port is ready again
+ */
+void sim_itm_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	ITM_Type *itm = SIM_REGS(ITM);
+	uint32_t port = (_addr - ITM_BASE) / 4;
+
+	(void)_old;
+
+	if (port >= SIM_ITM_PORTS)
+		return;
+
+	itm->PORT[port].u32 = 1;
+
+	if ((itm->TCR & ITM_TCR_ITMENA_Msk) == 0 || (itm->TER & (1UL << port)) == 0)
+		return;
+
+	// Source packet : header with the port and the size, then the payload little endian
+	uint8_t packet[5];
+
+	packet[0] = (port << 3) | ((_size == 1) ? 1 : (_size == 2) ? 2 : 3);
+	for (int i = 0; i < _size; i++)
+		packet[1 + i] = (_value >> (8 * i)) & 0xFF;
+
+	sim_out_write(SIM_OUT_SWO, packet, 1 + _size);
+	if (port == 0)
+		sim_out_write(SIM_OUT_LOG, &packet[1], _size);
+}
+
+/**
+ * @brief Set the destination of an output, NULL to drop it
+ */
+void sim_set_out(SIM_Out_Enum _out, FILE *_file) { core.outs[_out] = _file; }
+
+/**
+ * @retval Destination of an output
+ */
+FILE *sim_get_out(SIM_Out_Enum _out) { return core.outs[_out]; }
+
+/**
+ * @brief Write bytes to an output
+ */
+void sim_out_write(SIM_Out_Enum _out, const void *_data, size_t _size)
+{
+	if (core.outs[_out] != NULL)
+		fwrite(_data, 1, _size, core.outs[_out]);
+}
+
+/**
+ * @brief Add a line to the events output, prefixed by the time in microseconds
+ */
+void sim_event(const char *_format, ...)
+{
+	FILE *file = core.outs[SIM_OUT_EVENTS];
+	va_list args;
+
+	if (file == NULL)
+		return;
+
+	fprintf(file, "%llu,", (unsigned long long)(core.now_ps / SIM_PS_PER_US));
+	va_start(args, _format);
+	vfprintf(file, _format, args);
+	va_end(args);
+	fputc('\n', file);
+}
+
+/**
+ * @brief Map the devices and reset the simulated board
+ * @param _eeprom_path File backing the data EEPROM, NULL for an erased one
+ */
+void sim_init(const char *_eeprom_path)
+{
+	sim_bus_init(_eeprom_path);
+	sim_rcc_init();
+	sim_core_init();
+	sim_tim_init();
+	sim_rtc_init();
+	sim_gpio_init();
+	sim_uart_init();
+}
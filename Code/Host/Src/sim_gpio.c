@@ -0,0 +1,325 @@
+/*
+ * sim_gpio.c
+ *
+ * GPIO ports and EXTI. The input levels of the pins are set by the simulation, the buttons are
+ * active low with their pull-up. IDR shows the output register for the output pins and the input
+ * levels for the others. An edge of an input selected by SYSCFG for its EXTI line sets the pending
+ * bit of an unmasked line, an event line wakes WFE up. The LEDs are logged as events.
+ * The input capture pins of BUTTON_INPUT_CAPTURE are not modelled.
+ *
+ * SPI1 drives the MAX7219 : the bytes sent while its NCS pin is low are shifted in, the last
+ * 16 bits are taken as its register write at the NCS rising edge. The digits are logged as events.
+ * The SPI transfers are immediate, nothing is received.
+ */
+
+#include "sim_periph.h"
+#include "main.h"
+#include "board_config.h"
+
+#define SIM_GPIO_PORTS 8
+#define SIM_MAX7219_DIGITS 8
+#define SIM_MAX7219_SHUTDOWN 0x0C
+
+// In the order of the SYSCFG EXTI configuration
+static GPIO_TypeDef *const ports[SIM_GPIO_PORTS] = {GPIOA, GPIOB, GPIOC, GPIOD, GPIOE, GPIOH, GPIOF, GPIOG};
+
+static uint16_t inputs[SIM_GPIO_PORTS];	// Levels driven on the pins
+static uint8_t leds[BOARD_LED_COUNT];
+
+static struct {
+	uint8_t ncs;		// Level of the NCS pin
+	uint16_t word;		// Bits shifted in since NCS went low
+	uint8_t digits[SIM_MAX7219_DIGITS];
+	uint8_t on;			// Out of the shutdown mode
+} max7219;
+
+#define SIM_LED_ENTRY(_index, _port, _pin) {_port, _pin},
+
+static const struct {
+	GPIO_TypeDef *port;
+	uint16_t pin;
+} led_pins[BOARD_LED_COUNT] = {BOARD_LED_LIST(SIM_LED_ENTRY)};
+
+/**
+ * @retval Index of a port, -1 if not a port address
+ */
+static int sim_gpio_port(uintptr_t _addr)
+{
+	for (int i = 0; i < SIM_GPIO_PORTS; i++)
+		if ((_addr & ~(uintptr_t)0x3FF) == (uintptr_t)ports[i])
+			return i;
+
+	return -1;
+}
+
+/**
+ * @brief Pins driven by the port itself, from MODER
+ */
+static uint16_t sim_gpio_outputs(const GPIO_TypeDef *_gpio)
+{
+	uint16_t outputs = 0;
+
+	for (int pin = 0; pin < 16; pin++)
+		if (((_gpio->MODER >> (2 * pin)) & 3) == 1)
+			outputs |= 1U << pin;
+
+	return outputs;
+}
+
+/**
+ * @brief Show the LEDs which changed
+ */
+static void sim_gpio_leds(void)
+{
+	for (int i = 0; i < BOARD_LED_COUNT; i++)
+	{
+		uint8_t on = (SIM_REGS(led_pins[i].port)->ODR & led_pins[i].pin) != 0;
+
+		if (on != leds[i])
+		{
+			leds[i] = on;
+			sim_event("led,%d,%u", i, on);
+		}
+	}
+}
+
+/**
+ * @brief Latch the MAX7219 register write at the rising edge of its NCS pin
+ */
+static void sim_max7219_ncs(void)
+{
+	uint8_t ncs = (SIM_REGS(BOARD_MAX7219_NCS_PORT)->ODR & BOARD_MAX7219_NCS_PIN) != 0;
+	uint8_t address = max7219.word >> 8;
+	uint8_t data = max7219.word & 0xFF;
+
+	if (ncs == max7219.ncs)
+		return;
+
+	max7219.ncs = ncs;
+	if (ncs == 0)
+	{
+		max7219.word = 0;
+		return;
+	}
+
+	if (address >= 1 && address <= SIM_MAX7219_DIGITS && max7219.digits[address - 1] != data)
+	{
+		max7219.digits[address - 1] = data;
+		sim_event("digit,%u,%u", address - 1, data);
+	}
+	else if (address == SIM_MAX7219_SHUTDOWN && max7219.on != (data & 1))
+	{
+		max7219.on = data & 1;
+		sim_event("display,%u", max7219.on);
+	}
+}
+
+/**
+ * @brief Refresh IDR, the edges of the pins are given to the EXTI
+ */
+static void sim_gpio_refresh(int _port)
+{
+	GPIO_TypeDef *gpio = SIM_REGS(ports[_port]);
+	uint16_t outputs = sim_gpio_outputs(gpio);
+	uint16_t old = gpio->IDR;
+	uint16_t idr = (gpio->ODR & outputs) | (inputs[_port] & ~outputs);
+	uint16_t changed = old ^ idr;
+
+	gpio->IDR = idr;
+
+	for (uint8_t line = 0; line < 16 && changed != 0; line++, changed >>= 1)
+	{
+		if ((changed & 1) == 0)
+			continue;
+
+		// The line follows the port selected by SYSCFG
+		uint32_t selected = (SIM_REGS(SYSCFG)->EXTICR[line / 4] >> (4 * (line % 4))) & 0xF;
+
+		if (selected == (uint32_t)_port)
+			sim_exti_edge(line, (idr >> line) & 1);
+	}
+}
+
+static void sim_gpio_levels(void)
+{
+	EXTI_TypeDef *exti = SIM_REGS(EXTI);
+	uint32_t pending = exti->PR & exti->IMR;
+
+	for (int line = 0; line < 5; line++)
+		sim_irq_line(EXTI0_IRQn + line, (pending >> line) & 1);
+
+	sim_irq_line(EXTI9_5_IRQn, (pending & 0x03E0) != 0);
+	sim_irq_line(EXTI15_10_IRQn, (pending & 0xFC00) != 0);
+	sim_irq_line(RTC_WKUP_IRQn, (pending >> 20) & 1);
+}
+
+static const TypeDef_Sim_Model sim_gpio_model = {
+	NULL,
+	NULL,
+	sim_gpio_levels,
+	NULL,
+	NULL,
+};
+
+/**
+ * @brief Reset the ports, the buttons are released
+ */
+void sim_gpio_init(void)
+{
+	for (int i = 0; i < SIM_GPIO_PORTS; i++)
+	{
+		inputs[i] = 0;
+		SIM_REGS(ports[i])->IDR = 0;
+	}
+
+	for (int i = 0; i < BOARD_LED_COUNT; i++)
+		leds[i] = 0;
+
+	max7219.ncs = 0;
+	max7219.word = 0;
+	max7219.on = 0;
+	for (int i = 0; i < SIM_MAX7219_DIGITS; i++)
+		max7219.digits[i] = 0;
+
+	SIM_REGS(SPI1)->SR = SPI_SR_TXE;
+
+	sim_add_model(&sim_gpio_model);
+
+	sim_button_set(BTN1_Pin, 0);
+	sim_button_set(BTN2_Pin, 0);
+}
+
+/**
+ * @brief Drive an input pin
+ * @param _port GPIO port
+ * @param _pin Pin mask
+ * @param _level 0 or 1
+ */
+void sim_gpio_input(GPIO_TypeDef *_port, uint16_t _pin, uint8_t _level)
+{
+	int port = sim_gpio_port((uintptr_t)_port);
+
+	if (_level)
+		inputs[port] |= _pin;
+	else
+		inputs[port] &= ~_pin;
+
+	sim_gpio_refresh(port);
+}
+
+/**
+ * @brief Press or release a button
+ * @param _pin BTN1_Pin or BTN2_Pin
+ * @param _pressed 1 to press
+ */
+void sim_button_set(uint16_t _pin, uint8_t _pressed)
+{
+	GPIO_TypeDef *port = (_pin == BTN1_Pin) ? BTN1_GPIO_Port : BTN2_GPIO_Port;
+
+	// Active low
+	sim_gpio_input(port, _pin, _pressed == 0);
+}
+
+/**
+ * @retval 1 if the LED is on
+ */
+uint8_t sim_led_get(uint8_t _index) { return leds[_index]; }
+
+/**
+ * @retval Segments of a MAX7219 digit, as last written
+ */
+uint8_t sim_digit_get(uint8_t _index) { return max7219.digits[_index]; }
+
+/**
+ * @brief Edge on an EXTI line
+ * @param _line Line 0 to 22
+ * @param _rising 1 for a rising edge
+ */
+void sim_exti_edge(uint8_t _line, uint8_t _rising)
+{
+	EXTI_TypeDef *exti = SIM_REGS(EXTI);
+	uint32_t bit = 1UL << _line;
+
+	if ((_rising ? exti->RTSR : exti->FTSR) & bit)
+	{
+		if (exti->IMR & bit)
+		{
+			exti->PR |= bit;
+			sim_gpio_levels();
+		}
+		if (exti->EMR & bit)
+			sim_core_event();
+	}
+}
+
+/**
+ * @brief GPIO write : set/reset registers, IDR is read-only
+ */
+void sim_gpio_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	int port = sim_gpio_port(_addr);
+	GPIO_TypeDef *gpio = SIM_REGS(ports[port]);
+	uint32_t offset = _addr & 0x3FF;
+
+	(void)_size;
+
+	if (offset == offsetof(GPIO_TypeDef, IDR))
+	{
+		gpio->IDR = _old;
+		return;
+	}
+
+	if (offset == offsetof(GPIO_TypeDef, BSRR))
+	{
+		// Set wins over reset
+		gpio->ODR = (gpio->ODR & ~(_value >> 16)) | (_value & 0xFFFF);
+		gpio->BSRR = 0;
+	}
+	else if (offset == offsetof(GPIO_TypeDef, BRR))
+	{
+		gpio->ODR &= ~(_value & 0xFFFF);
+		gpio->BRR = 0;
+	}
+
+	sim_gpio_refresh(port);
+	sim_gpio_leds();
+	sim_max7219_ncs();
+}
+
+/**
+ * @brief SPI write : a byte written to DR is sent at once, the flags stay at TXE
+ */
+void sim_spi_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	SPI_TypeDef *spi = SIM_REGS(SPI1);
+
+	(void)_old;
+	(void)_size;
+
+	if (_addr == (uintptr_t)&SPI1->DR && max7219.ncs == 0 && (spi->CR1 & SPI_CR1_SPE))
+		max7219.word = (max7219.word << 8) | (_value & 0xFF);
+
+	spi->SR = SPI_SR_TXE;
+}
+
+/**
+ * @brief EXTI write : pending bits cleared by writing 1, the software interrupts set them
+ */
+void sim_exti_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	EXTI_TypeDef *exti = SIM_REGS(EXTI);
+
+	(void)_size;
+
+	if (_addr == (uintptr_t)&EXTI->PR)
+	{
+		exti->PR = _old & ~_value;
+		exti->SWIER &= ~_value;
+	}
+	else if (_addr == (uintptr_t)&EXTI->SWIER)
+	{
+		exti->PR |= _value & ~_old & exti->IMR;
+	}
+
+	sim_gpio_levels();
+}
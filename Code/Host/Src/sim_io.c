@@ -0,0 +1,86 @@
+/*
+ * sim_io.c
+ *
+ * printf of the firmware objects, renamed at the build. The firmware formats uint32_t with %lu
+ * and %lx, which is right on the target where uint32_t is an unsigned long but reads 64 bits on
+ * the host : the single l modifiers are removed before formatting. The text is then written
+ * through _write like the newlib printf of the target, so it goes out on the ITM port 0.
+ */
+
+#include "sim.h"
+
+#include <stdarg.h>
+#include <string.h>
+
+#define SIM_FORMAT_SZ 512
+#define SIM_PRINTF_SZ 1024
+
+int _write(int _file, char *_ptr, int _len);
+
+/**
+ * @brief Copy a format without the l length modifiers, ll is kept
+ */
+static const char *sim_format(const char *_format, char *_buffer, size_t _size)
+{
+	size_t out = 0;
+
+	for (const char *c = _format; *c != '\0'; c++)
+	{
+		if (out + 1 >= _size)
+			return _format;
+
+		_buffer[out++] = *c;
+		if (*c != '%')
+			continue;
+
+		// Flags, width and precision up to the length modifier
+		for (c++; *c != '\0' && strchr("-+ #0123456789.*", *c) != NULL && out + 1 < _size; c++)
+			_buffer[out++] = *c;
+
+		if (*c == '\0')
+			break;
+		if (c[0] == 'l' && c[1] != 'l')
+			continue;
+
+		if (c[0] == 'l' && c[1] == 'l' && out + 2 < _size)
+		{
+			_buffer[out++] = *c++;
+		}
+		if (out + 1 < _size)
+			_buffer[out++] = *c;
+	}
+
+	_buffer[out] = '\0';
+
+	return _buffer;
+}
+
+int sim_printf(const char *_format, ...)
+{
+	char format[SIM_FORMAT_SZ];
+	char buffer[SIM_PRINTF_SZ];
+	va_list args;
+
+	va_start(args, _format);
+	int len = vsnprintf(buffer, sizeof(buffer), sim_format(_format, format, sizeof(format)), args);
+	va_end(args);
+
+	if (len <= 0)
+		return len;
+	if (len >= (int)sizeof(buffer))
+		len = sizeof(buffer) - 1;
+
+	return _write(1, buffer, len);
+}
+
+int sim_snprintf(char *_buffer, size_t _size, const char *_format, ...)
+{
+	char format[SIM_FORMAT_SZ];
+	va_list args;
+
+	va_start(args, _format);
+	int len = vsnprintf(_buffer, _size, sim_format(_format, format, sizeof(format)), args);
+	va_end(args);
+
+	return len;
+}
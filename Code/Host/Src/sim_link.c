@@ -0,0 +1,259 @@
+/*
+ * sim_link.c
+ *
+ * Wire of the link between two boards, each simulated by its own pong_sim process : the USART1
+ * TX bytes of a board are written to a pipe and received by the USART1 of the other. A pty may
+ * replace the two pipes, such as one end of a pair of ptys relayed by socat, it is set in raw mode.
+ * A byte is sent at the start of its frame with the time of its end, its delivery time.
+ *
+ * The two simulated times are kept consistent by conservative synchronization : a process only
+ * runs up to the time promised by the other, its horizon. Before waiting at its horizon it
+ * promises its own, its time plus the lookahead : no byte sent from now ends before
+ * SIM_LINK_LOOKAHEAD_PS, shorter than a frame at the link baud rate. The two processes thus run
+ * in lockstep, at most a lookahead apart. The end of the pipe frees the other process.
+ *
+ * A network may be put on the wire : each byte sent is delayed by a latency plus a random jitter,
+ * drawn from a fixed seed for the runs to be repeatable. The bytes stay in order, the lookahead
+ * grows by the latency.
+ *
+ *   message : time_ps (64 bits), kind (32 bits), byte (32 bits), in the byte order of the host
+ */
+
+#include "sim_periph.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SIM_LINK_LOOKAHEAD_PS (10 * SIM_PS_PER_US)	// A frame is 10.9 us at 921600 baud
+#define SIM_LINK_QUEUE_SZ 16384						// Bytes on the wire, power of 2
+#define SIM_LINK_SEED 1
+
+typedef enum {
+	SIM_LINK_BYTE = 0,		// A byte ends at time_ps
+	SIM_LINK_TIME = 1,		// No byte will end before time_ps
+}SIM_Link_Kind_Enum;
+
+typedef struct {
+	uint64_t time_ps;
+	uint32_t kind;
+	uint32_t byte;
+}TypeDef_Sim_Link_Message;
+
+static struct {
+	int tx;						// -1 : not connected
+	int rx;
+	uint8_t connected;			// A message was received, the end of the pipe is the end of the peer
+	uint64_t horizon_ps;		// Time promised by the peer
+	uint64_t promised_ps;		// Time promised to the peer
+	uint64_t latency_ps;		// Added to each byte sent
+	uint64_t jitter_ps;			// Most random time added to the latency
+	uint64_t last_end_ps;		// End of the last byte sent, with its delay
+	unsigned int seed;
+	TypeDef_Sim_Link_Message queue[SIM_LINK_QUEUE_SZ];
+	uint32_t head;
+	uint32_t tail;
+} wire = {.tx = -1, .rx = -1};
+
+/**
+ * @brief Write a message to the peer, ignored once it is gone
+ */
+static void sim_link_write(uint64_t _time_ps, SIM_Link_Kind_Enum _kind, uint8_t _byte)
+{
+	TypeDef_Sim_Link_Message message = {_time_ps, _kind, _byte};
+	const uint8_t *data = (const uint8_t *)&message;
+	size_t done = 0;
+
+	while (wire.tx >= 0 && done < sizeof(message))
+	{
+		ssize_t size = write(wire.tx, data + done, sizeof(message) - done);
+
+		if (size > 0)
+			done += size;
+		else if (size < 0 && errno != EINTR)
+			wire.tx = -1;
+	}
+}
+
+/**
+ * @brief Read a message from the peer, waiting for it
+ * @retval 0 at the end of the pipe
+ */
+static int sim_link_read(TypeDef_Sim_Link_Message *_message)
+{
+	uint8_t *data = (uint8_t *)_message;
+	size_t done = 0;
+
+	while (done < sizeof(*_message))
+	{
+		ssize_t size = read(wire.rx, data + done, sizeof(*_message) - done);
+
+		if (size > 0)
+		{
+			done += size;
+			continue;
+		}
+
+		if (size < 0 && errno == EINTR)
+			continue;
+
+		// No writer yet : the peer has not opened its end
+		if (size == 0 && !wire.connected)
+		{
+			usleep(1000);
+			continue;
+		}
+
+		return 0;
+	}
+
+	wire.connected = 1;
+	return 1;
+}
+
+/**
+ * @brief Wait for the peer to promise a time after _now
+ */
+static void sim_link_wait(uint64_t _now)
+{
+	TypeDef_Sim_Link_Message message;
+
+	if (wire.horizon_ps > _now)
+		return;
+
+	if (_now + SIM_LINK_LOOKAHEAD_PS + wire.latency_ps > wire.promised_ps)
+	{
+		wire.promised_ps = _now + SIM_LINK_LOOKAHEAD_PS + wire.latency_ps;
+		sim_link_write(wire.promised_ps, SIM_LINK_TIME, 0);
+	}
+
+	while (wire.horizon_ps <= _now)
+	{
+		if (!sim_link_read(&message))
+		{
+			wire.horizon_ps = SIM_NEVER;
+			break;
+		}
+
+		// Sent in time order : a byte is also a promise
+		if (message.time_ps > wire.horizon_ps)
+			wire.horizon_ps = message.time_ps;
+
+		if (message.kind != SIM_LINK_BYTE)
+			continue;
+
+		if (wire.tail - wire.head == SIM_LINK_QUEUE_SZ)
+		{
+			fprintf(stderr, "sim: link queue full\n");
+			exit(EXIT_FAILURE);
+		}
+
+		wire.queue[wire.tail++ & (SIM_LINK_QUEUE_SZ - 1)] = message;
+	}
+}
+
+static void sim_link_update(uint64_t _now)
+{
+	sim_link_wait(_now);
+
+	while (wire.head != wire.tail && wire.queue[wire.head & (SIM_LINK_QUEUE_SZ - 1)].time_ps <= _now)
+	{
+		sim_uart_receive(USART1, wire.queue[wire.head & (SIM_LINK_QUEUE_SZ - 1)].byte);
+		wire.head++;
+	}
+}
+
+static uint64_t sim_link_next_event(uint64_t _now)
+{
+	uint64_t next = wire.horizon_ps;
+
+	(void)_now;
+
+	if (wire.head != wire.tail && wire.queue[wire.head & (SIM_LINK_QUEUE_SZ - 1)].time_ps < next)
+		next = wire.queue[wire.head & (SIM_LINK_QUEUE_SZ - 1)].time_ps;
+
+	return next;
+}
+
+static const TypeDef_Sim_Model sim_link_model = {
+	sim_link_update,
+	sim_link_next_event,
+	NULL,
+	NULL,
+	NULL,
+};
+
+/**
+ * @brief Connect the USART1 to another simulator
+ * @param _tx_path Pipe or pty written with the bytes sent
+ * @param _rx_path Pipe or pty read for the bytes received, written by the other simulator
+ * @retval 0 if connected
+ */
+int sim_link_open(const char *_tx_path, const char *_rx_path)
+{
+	// The reading end first, without waiting : the opening of the writing end waits for the
+	// reader, each simulator opens its reading end before
+	wire.rx = open(_rx_path, O_RDONLY | O_NONBLOCK);
+	if (wire.rx < 0)
+		return -1;
+
+	wire.tx = open(_tx_path, O_WRONLY);
+	if (wire.tx < 0)
+		return -1;
+
+	fcntl(wire.rx, F_SETFL, fcntl(wire.rx, F_GETFL) & ~O_NONBLOCK);
+
+	// A pty passes the bytes as they are
+	if (isatty(wire.rx))
+	{
+		struct termios termios;
+
+		tcgetattr(wire.rx, &termios);
+		cfmakeraw(&termios);
+		tcsetattr(wire.rx, TCSANOW, &termios);
+	}
+
+	// The peer may exit first
+	signal(SIGPIPE, SIG_IGN);
+
+	wire.horizon_ps = 0;
+	wire.promised_ps = 0;
+	wire.last_end_ps = 0;
+	wire.seed = SIM_LINK_SEED;
+	sim_add_model(&sim_link_model);
+
+	return 0;
+}
+
+/**
+ * @brief Delay the bytes sent, as a network would
+ * @param _latency_ps Delay of every byte
+ * @param _jitter_ps Most random delay added to the latency
+ */
+void sim_link_delay(uint64_t _latency_ps, uint64_t _jitter_ps)
+{
+	wire.latency_ps = _latency_ps;
+	wire.jitter_ps = _jitter_ps;
+}
+
+/**
+ * @brief A USART1 byte starts on the wire
+ * @param _end_ps End of its frame, at least SIM_LINK_LOOKAHEAD_PS from now
+ */
+void sim_link_send(uint8_t _byte, uint64_t _end_ps)
+{
+	uint64_t end_ps = _end_ps + wire.latency_ps;
+
+	if (wire.jitter_ps != 0)
+		end_ps += (uint64_t)((double)rand_r(&wire.seed) / RAND_MAX * wire.jitter_ps);
+
+	// Not before the previous byte
+	if (end_ps < wire.last_end_ps)
+		end_ps = wire.last_end_ps;
+	wire.last_end_ps = end_ps;
+
+	sim_link_write(end_ps, SIM_LINK_BYTE, _byte);
+}
@@ -0,0 +1,516 @@
+/*
+ * sim_main.c
+ *
+ * pong_sim : the firmware main on the simulated board. The firmware runs on its own stack in the
+ * firmware RAM (firmware.ld), each pong_run iteration of its main loop takes SIM_LOOP_CYCLES.
+ *
+ *   pong_sim [options]
+ *     --time S                stop after S simulated seconds, exit status 1 (default 3600)
+ *     --until PREFIX[:N]      stop at the Nth log line starting with PREFIX, exit status 0
+ *     --log FILE              ITM port 0 text (default stdout)
+ *     --swo FILE              ITM packets of every port
+ *     --events FILE           LEDs, digits and buzzer changes
+ *     --telemetry FILE        USART2 bytes
+ *     --eeprom FILE           data EEPROM kept in a file
+ *     --states FILE           accounting of each FSM state, written at the exit
+ *     --record FILE           inputs recorded by replay.c, written at the exit
+ *     --replay FILE           replay a recording, BTN1 is held through the reset
+ *     --press T_MS:BTN:D_MS   press BTN (1 or 2) at T_MS for D_MS, may be repeated
+ *     --link TX:RX            USART1 linked to another pong_sim : bytes sent written to TX, bytes
+ *                             received read from RX (pipes, or the same pty for both)
+ *     --link-delay US[:J_US]  bytes sent delayed by US plus a random jitter up to J_US
+ *
+ * FILE is - for stdout. Not linked in libsim.a : pong_run is wrapped at the link.
+ *
+ * The state accounting is the host side of PONG_STATS_ENABLE, the cycles of the target are not
+ * simulated : each pong_run step is charged to the state it runs, with the host CPU time of the
+ * step (the traps of its register writes included) and the simulated time up to the next step.
+ *   state,entries,steps,host_ns,max_host_ns,time_ms
+ *
+ * The recordings are in the text of replay_dump, the lines before its header are skipped : a log
+ * of the board replays as is. The playback prints replay,match or replay,mismatch at its end.
+ *
+ * Two linked simulators run in lockstep (sim_link.c), the presses of each one at its own time :
+ *   mkfifo a b
+ *   pong_sim --link a:b & pong_sim --link b:a
+ */
+
+#define _GNU_SOURCE
+
+#include "sim_periph.h"
+#include "main.h"
+#include "pong.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define SIM_MAIN_PRESSES_MAX 32
+#define SIM_MAIN_LINE_SZ 256
+#define SIM_MAIN_TIME_S 3600
+#define SIM_MAIN_REPLAY_HOLD_MS 10	// BTN1 held at the reset to replay
+
+typedef struct {
+	uint64_t start_ps;
+	uint64_t end_ps;
+	uint16_t pin;
+	uint8_t state;		// 0 waiting, 1 pressed, 2 released
+}TypeDef_Sim_Press;
+
+typedef struct {
+	uint32_t entries;
+	uint32_t steps;
+	uint64_t host_ns;
+	uint64_t max_host_ns;
+	uint64_t time_ps;
+}TypeDef_Sim_State;
+
+int firmware_main(void);
+HAL_StatusTypeDef __real_pong_run(void);
+
+/* firmware.ld */
+extern uint8_t fw_end[];
+extern uint8_t fw_estack[];
+
+static struct {
+	uint64_t end_ps;
+	const char *until;
+	size_t until_len;
+	uint32_t until_count;	// Lines matched still to go
+	FILE *log;				// Destination of the log lines
+	char line[SIM_MAIN_LINE_SZ];
+	size_t line_len;
+	TypeDef_Sim_Press presses[SIM_MAIN_PRESSES_MAX];
+	int presses_count;
+	FILE *states_out;		// Destination of the state accounting, NULL without it
+	const char *record;		// Recording file written at the exit
+	TypeDef_Sim_State states[STATES_COUNT];
+	int state;				// State after the last step, -1 before the first one
+	ucontext_t host;
+	ucontext_t firmware;
+} sim_main;
+
+static void sim_main_usage(void)
+{
+	fprintf(stderr, "usage: pong_sim [--time S] [--until PREFIX[:N]] [--log FILE] [--swo FILE] [--events FILE]\n"
+					"                [--telemetry FILE] [--eeprom FILE] [--states FILE] [--record FILE] [--replay FILE]\n"
+					"                [--press T_MS:BTN:D_MS]... [--link TX:RX] [--link-delay US[:J_US]]\n");
+	exit(2);
+}
+
+/**
+ * @brief Open an output, - for stdout
+ */
+static FILE *sim_main_open(const char *_path)
+{
+	if (strcmp(_path, "-") == 0)
+		return stdout;
+
+	FILE *file = fopen(_path, "wb");
+
+	if (file == NULL)
+	{
+		perror(_path);
+		exit(2);
+	}
+
+	return file;
+}
+
+/**
+ * @brief Log output : the text is passed on and its lines are matched with --until
+ */
+static ssize_t sim_main_log_write(void *_cookie, const char *_data, size_t _size)
+{
+	(void)_cookie;
+
+	if (sim_main.log != NULL)
+		fwrite(_data, 1, _size, sim_main.log);
+
+	for (size_t i = 0; i < _size; i++)
+	{
+		if (_data[i] != '\n')
+		{
+			if (sim_main.line_len < SIM_MAIN_LINE_SZ)
+				sim_main.line[sim_main.line_len++] = _data[i];
+			continue;
+		}
+
+		if (sim_main.until != NULL && sim_main.until_count > 0 && sim_main.line_len >= sim_main.until_len &&
+			memcmp(sim_main.line, sim_main.until, sim_main.until_len) == 0)
+			sim_main.until_count--;
+
+		sim_main.line_len = 0;
+	}
+
+	return _size;
+}
+
+/**
+ * @brief Buttons pressed and released at their time, the run stopped at its end
+ */
+static void sim_main_update(uint64_t _now)
+{
+	for (int i = 0; i < sim_main.presses_count; i++)
+	{
+		TypeDef_Sim_Press *press = &sim_main.presses[i];
+
+		if (press->state == 0 && _now >= press->start_ps)
+		{
+			press->state = 1;
+			sim_button_set(press->pin, 1);
+		}
+		if (press->state == 1 && _now >= press->end_ps)
+		{
+			press->state = 2;
+			sim_button_set(press->pin, 0);
+		}
+	}
+
+	if (_now >= sim_main.end_ps)
+	{
+		fflush(NULL);
+		fprintf(stderr, "sim: time out at %llu ms\n", (unsigned long long)(_now / SIM_PS_PER_MS));
+		exit(EXIT_FAILURE);
+	}
+}
+
+static uint64_t sim_main_next_event(uint64_t _now)
+{
+	uint64_t next = sim_main.end_ps;
+
+	(void)_now;
+
+	for (int i = 0; i < sim_main.presses_count; i++)
+	{
+		TypeDef_Sim_Press *press = &sim_main.presses[i];
+		uint64_t event = (press->state == 0) ? press->start_ps : (press->state == 1) ? press->end_ps : SIM_NEVER;
+
+		if (event < next)
+			next = event;
+	}
+
+	return next;
+}
+
+static const TypeDef_Sim_Model sim_main_model = {
+	sim_main_update,
+	sim_main_next_event,
+	NULL,
+	NULL,
+	NULL,
+};
+
+static uint64_t sim_main_host_ns(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+
+	return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+static FSM_State_Enum sim_main_fsm_state(void)
+{
+	FSM_Snapshot_TypeDef snapshot;
+
+	pong_save_snapshot(&snapshot);
+
+	return snapshot.state.state;
+}
+
+/**
+ * @brief Step of the firmware charged to its state
+ */
+static HAL_StatusTypeDef sim_main_run_state(void)
+{
+	FSM_State_Enum state = sim_main_fsm_state();
+	TypeDef_Sim_State *stats = &sim_main.states[state];
+	uint64_t start_ps = sim_now_ps();
+	uint64_t start_ns = sim_main_host_ns();
+	HAL_StatusTypeDef status = __real_pong_run();
+	uint64_t host_ns = sim_main_host_ns() - start_ns;
+
+	sim_run_cycles(SIM_LOOP_CYCLES);
+
+	if (sim_main.state != (int)state)
+		stats->entries++;
+
+	stats->steps++;
+	stats->host_ns += host_ns;
+	if (host_ns > stats->max_host_ns)
+		stats->max_host_ns = host_ns;
+	stats->time_ps += sim_now_ps() - start_ps;
+
+	sim_main.state = state;
+
+	return status;
+}
+
+static void sim_main_dump_states(void)
+{
+	fprintf(sim_main.states_out, "state,entries,steps,host_ns,max_host_ns,time_ms\n");
+
+	for (int i = 0; i < STATES_COUNT; i++)
+	{
+		TypeDef_Sim_State *stats = &sim_main.states[i];
+
+		fprintf(sim_main.states_out, "%s,%u,%u,%llu,%llu,%llu\n", pong_state_name(i), stats->entries, stats->steps,
+				(unsigned long long)stats->host_ns, (unsigned long long)stats->max_host_ns,
+				(unsigned long long)(stats->time_ps / SIM_PS_PER_MS));
+	}
+
+	fflush(sim_main.states_out);
+}
+
+/**
+ * @brief Load a recording into the RAM kept across resets, as left by a previous run
+ */
+static void sim_main_load_recording(const char *_path)
+{
+	TypeDef_Replay_Recording *recording = replay_get_recording();
+	FILE *file = fopen(_path, "r");
+	char line[SIM_MAIN_LINE_SZ];
+	unsigned long count = 0;
+	unsigned overflow = 0;
+	unsigned long signature;
+
+	if (file == NULL)
+	{
+		perror(_path);
+		exit(2);
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL)
+		if (sscanf(line, "replay,%lu,%u,%lx", &count, &overflow, &signature) == 3)
+			break;
+
+	if (count == 0 || count > REPLAY_BUFFER_SZ)
+	{
+		fprintf(stderr, "%s: no recording\n", _path);
+		exit(2);
+	}
+
+	for (unsigned long i = 0; i < count; i++)
+	{
+		TypeDef_Replay_Event *event = &recording->events[i];
+		unsigned long iteration, value;
+		unsigned pin;
+
+		if (fgets(line, sizeof(line), file) == NULL ||
+			sscanf(line, "%lu,%u,%lu,%lx", &iteration, &pin, &value, &signature) != 4)
+		{
+			fprintf(stderr, "%s: input %lu unreadable\n", _path, i);
+			exit(2);
+		}
+
+		*event = (TypeDef_Replay_Event){iteration, value, signature, pin};
+	}
+
+	fclose(file);
+
+	recording->magic = REPLAY_MAGIC;
+	recording->count = count;
+	recording->overflow = overflow;
+}
+
+/**
+ * @brief Write the recording, in the format of replay_dump
+ */
+static void sim_main_save_recording(void)
+{
+	const TypeDef_Replay_Recording *recording = replay_get_recording();
+	FILE *file = fopen(sim_main.record, "w");
+
+	if (file == NULL)
+	{
+		perror(sim_main.record);
+		return;
+	}
+
+	fprintf(file, "replay,%u,%u,%08x\n", recording->count, recording->overflow, replay_get_signature());
+
+	for (uint32_t i = 0; i < recording->count && i < REPLAY_BUFFER_SZ; i++)
+	{
+		const TypeDef_Replay_Event *event = &recording->events[i];
+
+		fprintf(file, "%u,%u,%u,%08x\n", event->iteration, event->pin, event->value, event->signature);
+	}
+
+	fclose(file);
+}
+
+/**
+ * @brief Main loop iteration of the firmware, then the time of its cycles
+ */
+HAL_StatusTypeDef __wrap_pong_run(void)
+{
+	HAL_StatusTypeDef status;
+
+	if (sim_main.states_out != NULL)
+	{
+		status = sim_main_run_state();
+	}
+	else
+	{
+		status = __real_pong_run();
+		sim_run_cycles(SIM_LOOP_CYCLES);
+	}
+
+	if (sim_main.until != NULL && sim_main.until_count == 0)
+	{
+		fflush(NULL);
+		exit(EXIT_SUCCESS);
+	}
+
+	return status;
+}
+
+static void sim_main_firmware(void)
+{
+	firmware_main();
+}
+
+int main(int _argc, char **_argv)
+{
+	const char *eeprom = NULL;
+	const char *replay = NULL;
+	char *link_tx = NULL;
+	const char *link_rx = NULL;
+	FILE *outs[SIM_OUT_COUNT] = {stdout, NULL, NULL, NULL};
+
+	sim_main.end_ps = SIM_MAIN_TIME_S * SIM_PS_PER_S;
+
+	for (int i = 1; i < _argc; i++)
+	{
+		const char *option = _argv[i];
+		const char *value = (i + 1 < _argc) ? _argv[++i] : NULL;
+
+		if (value == NULL)
+			sim_main_usage();
+
+		if (strcmp(option, "--time") == 0)
+		{
+			sim_main.end_ps = (uint64_t)(strtod(value, NULL) * SIM_PS_PER_S);
+		}
+		else if (strcmp(option, "--until") == 0)
+		{
+			const char *count = strrchr(value, ':');
+
+			sim_main.until = value;
+			sim_main.until_len = (count != NULL) ? (size_t)(count - value) : strlen(value);
+			sim_main.until_count = (count != NULL) ? strtoul(count + 1, NULL, 10) : 1;
+		}
+		else if (strcmp(option, "--log") == 0)
+		{
+			outs[SIM_OUT_LOG] = sim_main_open(value);
+		}
+		else if (strcmp(option, "--swo") == 0)
+		{
+			outs[SIM_OUT_SWO] = sim_main_open(value);
+		}
+		else if (strcmp(option, "--events") == 0)
+		{
+			outs[SIM_OUT_EVENTS] = sim_main_open(value);
+		}
+		else if (strcmp(option, "--telemetry") == 0)
+		{
+			outs[SIM_OUT_TELEMETRY] = sim_main_open(value);
+		}
+		else if (strcmp(option, "--eeprom") == 0)
+		{
+			eeprom = value;
+		}
+		else if (strcmp(option, "--states") == 0)
+		{
+			sim_main.states_out = sim_main_open(value);
+		}
+		else if (strcmp(option, "--record") == 0)
+		{
+			sim_main.record = value;
+		}
+		else if (strcmp(option, "--replay") == 0 && sim_main.presses_count < SIM_MAIN_PRESSES_MAX)
+		{
+			replay = value;
+			sim_main.presses[sim_main.presses_count++] = (TypeDef_Sim_Press){
+				0, SIM_MAIN_REPLAY_HOLD_MS * SIM_PS_PER_MS, BTN1_Pin, 0};
+		}
+		else if (strcmp(option, "--link") == 0)
+		{
+			const char *separator = strchr(value, ':');
+
+			if (separator == NULL)
+				sim_main_usage();
+
+			link_tx = strndup(value, separator - value);
+			link_rx = separator + 1;
+		}
+		else if (strcmp(option, "--link-delay") == 0)
+		{
+			unsigned long latency_us = 0;
+			unsigned long jitter_us = 0;
+
+			if (sscanf(value, "%lu:%lu", &latency_us, &jitter_us) < 1)
+				sim_main_usage();
+
+			sim_link_delay(latency_us * SIM_PS_PER_US, jitter_us * SIM_PS_PER_US);
+		}
+		else if (strcmp(option, "--press") == 0 && sim_main.presses_count < SIM_MAIN_PRESSES_MAX)
+		{
+			unsigned long start_ms;
+			unsigned btn;
+			unsigned long duration_ms;
+
+			if (sscanf(value, "%lu:%u:%lu", &start_ms, &btn, &duration_ms) != 3 || btn < 1 || btn > 2)
+				sim_main_usage();
+
+			sim_main.presses[sim_main.presses_count++] = (TypeDef_Sim_Press){
+				start_ms * SIM_PS_PER_MS, (start_ms + duration_ms) * SIM_PS_PER_MS, (btn == 1) ? BTN1_Pin : BTN2_Pin, 0};
+		}
+		else
+		{
+			sim_main_usage();
+		}
+	}
+
+	sim_init(eeprom);
+	sim_add_model(&sim_main_model);
+
+	if (link_tx != NULL && sim_link_open(link_tx, link_rx) != 0)
+	{
+		perror("sim: link");
+		exit(2);
+	}
+
+	sim_main.state = -1;
+	if (sim_main.states_out != NULL)
+		atexit(sim_main_dump_states);
+
+	if (replay != NULL)
+		sim_main_load_recording(replay);
+	if (sim_main.record != NULL)
+		atexit(sim_main_save_recording);
+
+	// The log lines are watched on their way out
+	sim_main.log = outs[SIM_OUT_LOG];
+	outs[SIM_OUT_LOG] = fopencookie(NULL, "w", (cookie_io_functions_t){.write = sim_main_log_write});
+	setvbuf(outs[SIM_OUT_LOG], NULL, _IONBF, 0);
+
+	for (int i = 0; i < SIM_OUT_COUNT; i++)
+		sim_set_out(i, outs[i]);
+
+	// The presses at time 0 are seen by the reset
+	sim_main_update(0);
+
+	getcontext(&sim_main.firmware);
+	sim_main.firmware.uc_stack.ss_sp = fw_end;
+	sim_main.firmware.uc_stack.ss_size = fw_estack - fw_end;
+	sim_main.firmware.uc_link = &sim_main.host;
+	makecontext(&sim_main.firmware, sim_main_firmware, 0);
+	swapcontext(&sim_main.host, &sim_main.firmware);
+
+	fprintf(stderr, "sim: firmware_main returned\n");
+
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,275 @@
+/*
+ * sim_rcc.c
+ *
+ * Clock tree (RCC), power controller, flash interface, data EEPROM and CRC unit. The oscillators
+ * and the PLL are ready as soon as they are switched on, the clock switch and the regulator range
+ * change are immediate. The CRC is the CRC-32 of the unit (polynomial 0x04C11DB7, words fed MSB
+ * first, no reflection nor final XOR), a store written on the host reads back on the board.
+ */
+
+#include "sim_periph.h"
+
+#define SIM_PEKEY1 0x89ABCDEF
+#define SIM_PEKEY2 0x02030405
+#define SIM_CRC_POLY 0x04C11DB7
+#define SIM_CRC_INIT 0xFFFFFFFF
+
+static const uint8_t pll_mul[16] = {3, 4, 6, 8, 12, 16, 24, 32, 48};
+static const uint16_t ahb_div[16] = {1, 1, 1, 1, 1, 1, 1, 1, 2, 4, 8, 16, 64, 128, 256, 512};
+static const uint8_t apb_div[8] = {1, 1, 1, 1, 2, 4, 8, 16};
+
+static TypeDef_Sim_Clocks clocks;
+
+// Last key written to PEKEYR, the data EEPROM is unlocked by the sequence of both keys
+static uint32_t pe_key = 0;
+
+/**
+ * @brief Compute the clocks from the RCC registers, the models are told of a change
+ * @param _notify 0 at reset
+ */
+static void sim_rcc_update(uint8_t _notify)
+{
+	RCC_TypeDef *rcc = SIM_REGS(RCC);
+	uint32_t cfgr = rcc->CFGR;
+	uint32_t sysclk;
+
+	switch (cfgr & RCC_CFGR_SWS)
+	{
+	case RCC_CFGR_SWS_HSI:
+		sysclk = HSI_VALUE;
+		break;
+	case RCC_CFGR_SWS_HSE:
+		sysclk = HSE_VALUE;
+		break;
+	case RCC_CFGR_SWS_PLL:
+	{
+		uint32_t source = (cfgr & RCC_CFGR_PLLSRC) ? HSE_VALUE : HSI_VALUE;
+		uint32_t mul = pll_mul[(cfgr & RCC_CFGR_PLLMUL) >> RCC_CFGR_PLLMUL_Pos];
+		uint32_t div = ((cfgr & RCC_CFGR_PLLDIV) >> RCC_CFGR_PLLDIV_Pos) + 1;
+
+		sysclk = (mul != 0 && div > 1) ? source * mul / div : HSI_VALUE;
+		break;
+	}
+	default:
+		sysclk = 65536U << ((rcc->ICSCR & RCC_ICSCR_MSIRANGE) >> RCC_ICSCR_MSIRANGE_Pos);
+		break;
+	}
+
+	TypeDef_Sim_Clocks new_clocks;
+	uint32_t ppre1 = apb_div[(cfgr & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos];
+
+	new_clocks.sysclk = sysclk;
+	new_clocks.hclk = sysclk / ahb_div[(cfgr & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+	new_clocks.pclk1 = new_clocks.hclk / ppre1;
+	new_clocks.pclk2 = new_clocks.hclk / apb_div[(cfgr & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos];
+	new_clocks.tim_apb1 = (ppre1 == 1) ? new_clocks.pclk1 : 2 * new_clocks.pclk1;
+
+	uint8_t changed = new_clocks.hclk != clocks.hclk || new_clocks.pclk1 != clocks.pclk1 ||
+					  new_clocks.pclk2 != clocks.pclk2;
+
+	clocks = new_clocks;
+
+	if (_notify && changed)
+		sim_core_clock_changed();
+}
+
+/**
+ * @brief Reset : the core runs on the MSI at 2MHz
+ */
+void sim_rcc_init(void)
+{
+	RCC_TypeDef *rcc = SIM_REGS(RCC);
+
+	rcc->CR = RCC_CR_MSION | RCC_CR_MSIRDY;
+	rcc->ICSCR = RCC_ICSCR_MSIRANGE_5;
+	rcc->CFGR = 0;
+	rcc->CSR = 0x0C000000;
+
+	PWR_TypeDef *pwr = SIM_REGS(PWR);
+
+	pwr->CR = PWR_CR_VOS_1;
+	pwr->CSR = 0;
+
+	FLASH_TypeDef *flash = SIM_REGS(FLASH);
+
+	flash->PECR = FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK | FLASH_PECR_OPTLOCK;
+	flash->SR = FLASH_SR_ENDHV | FLASH_SR_READY;
+	pe_key = 0;
+
+	SIM_REGS(CRC)->DR = SIM_CRC_INIT;
+
+	sim_rcc_update(0);
+}
+
+/**
+ * @retval Current clocks
+ */
+const TypeDef_Sim_Clocks *sim_clocks(void) { return &clocks; }
+
+/**
+ * @brief Wakeup from the Stop mode : the core restarts on the MSI, the PLL and the HSI are off
+ */
+void sim_rcc_wake(void)
+{
+	RCC_TypeDef *rcc = SIM_REGS(RCC);
+
+	rcc->CR = (rcc->CR & ~(RCC_CR_PLLON | RCC_CR_PLLRDY | RCC_CR_HSION | RCC_CR_HSIRDY)) | RCC_CR_MSION | RCC_CR_MSIRDY;
+	rcc->CFGR &= ~(RCC_CFGR_SW | RCC_CFGR_SWS);
+
+	sim_rcc_update(1);
+}
+
+/**
+ * @brief RCC write : the oscillators are ready at once, the clock switch is immediate
+ */
+void sim_rcc_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	RCC_TypeDef *rcc = SIM_REGS(RCC);
+
+	(void)_old;
+	(void)_size;
+
+	if (_addr == (uintptr_t)&RCC->CR)
+	{
+		uint32_t cr = _value & ~(RCC_CR_MSIRDY | RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY);
+
+		if (cr & RCC_CR_MSION)
+			cr |= RCC_CR_MSIRDY;
+		if (cr & RCC_CR_HSION)
+			cr |= RCC_CR_HSIRDY;
+		if (cr & RCC_CR_HSEON)
+			cr |= RCC_CR_HSERDY;
+		if (cr & RCC_CR_PLLON)
+			cr |= RCC_CR_PLLRDY;
+
+		rcc->CR = cr;
+	}
+	else if (_addr == (uintptr_t)&RCC->CFGR)
+	{
+		rcc->CFGR = (_value & ~RCC_CFGR_SWS) | ((_value & RCC_CFGR_SW) << (RCC_CFGR_SWS_Pos - RCC_CFGR_SW_Pos));
+	}
+	else if (_addr == (uintptr_t)&RCC->ICSCR)
+	{
+		// MSIRANGE and the trimming are written, the calibration values are read-only
+		rcc->ICSCR = (_value & (RCC_ICSCR_MSIRANGE | RCC_ICSCR_MSITRIM | RCC_ICSCR_HSITRIM)) |
+					 (_old & ~(RCC_ICSCR_MSIRANGE | RCC_ICSCR_MSITRIM | RCC_ICSCR_HSITRIM));
+	}
+	else if (_addr == (uintptr_t)&RCC->CSR)
+	{
+		uint32_t csr = _value & ~(RCC_CSR_LSIRDY | RCC_CSR_LSERDY);
+
+		if (csr & RCC_CSR_LSION)
+			csr |= RCC_CSR_LSIRDY;
+		if (csr & RCC_CSR_LSEON)
+			csr |= RCC_CSR_LSERDY;
+		// Remove the reset flags
+		if (csr & RCC_CSR_RMVF)
+			csr &= ~(RCC_CSR_RMVF | 0xFE000000);
+
+		rcc->CSR = csr;
+	}
+	else
+	{
+		return;
+	}
+
+	sim_rcc_update(1);
+}
+
+/**
+ * @brief PWR write : the regulator range changes at once, CWUF and CSBF clear the flags
+ */
+void sim_pwr_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	PWR_TypeDef *pwr = SIM_REGS(PWR);
+
+	(void)_old;
+	(void)_size;
+
+	if (_addr != (uintptr_t)&PWR->CR)
+		return;
+
+	if (_value & PWR_CR_CWUF)
+		pwr->CSR &= ~PWR_CSR_WUF;
+	if (_value & PWR_CR_CSBF)
+		pwr->CSR &= ~PWR_CSR_SBF;
+
+	pwr->CR = _value & ~(PWR_CR_CWUF | PWR_CR_CSBF);
+}
+
+/**
+ * @brief Flash interface write : key sequences and status flags cleared by writing 1
+ */
+void sim_flash_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	FLASH_TypeDef *flash = SIM_REGS(FLASH);
+
+	(void)_size;
+
+	if (_addr == (uintptr_t)&FLASH->PEKEYR)
+	{
+		if (_value == SIM_PEKEY2 && pe_key == SIM_PEKEY1)
+			flash->PECR &= ~FLASH_PECR_PELOCK;
+		pe_key = _value;
+		flash->PEKEYR = 0;
+	}
+	else if (_addr == (uintptr_t)&FLASH->PECR)
+	{
+		// The lock bits can only be set by a write
+		uint32_t locks = FLASH_PECR_PELOCK | FLASH_PECR_PRGLOCK | FLASH_PECR_OPTLOCK;
+
+		flash->PECR = (_value & ~locks) | ((_old | _value) & locks);
+		if (flash->PECR & FLASH_PECR_PELOCK)
+			pe_key = 0;
+	}
+	else if (_addr == (uintptr_t)&FLASH->SR)
+	{
+		flash->SR = (_old & ~_value) | FLASH_SR_ENDHV | FLASH_SR_READY;
+	}
+}
+
+/**
+ * @brief Data EEPROM write : kept when unlocked, refused otherwise
+ */
+void sim_eeprom_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	FLASH_TypeDef *flash = SIM_REGS(FLASH);
+
+	(void)_value;
+	(void)_size;
+
+	if (SIM_REGS(FLASH)->PECR & FLASH_PECR_PELOCK)
+	{
+		*(uint32_t *)sim_alias(_addr) = _old;
+		flash->SR |= FLASH_SR_WRPERR;
+		return;
+	}
+
+	flash->SR |= FLASH_SR_EOP;
+}
+
+/**
+ * @brief CRC unit write : a data word is fed to the CRC, RESET starts a new one
+ */
+void sim_crc_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	CRC_TypeDef *crc = SIM_REGS(CRC);
+
+	(void)_size;
+
+	if (_addr == (uintptr_t)&CRC->DR)
+	{
+		uint32_t value = _old ^ _value;
+
+		for (int i = 0; i < 32; i++)
+			value = (value & 0x80000000) ? (value << 1) ^ SIM_CRC_POLY : value << 1;
+
+		crc->DR = value;
+	}
+	else if (_addr == (uintptr_t)&CRC->CR)
+	{
+		if (_value & CRC_CR_RESET)
+			crc->DR = SIM_CRC_INIT;
+		crc->CR = 0;
+	}
+}
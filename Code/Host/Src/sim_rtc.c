@@ -0,0 +1,195 @@
+/*
+ * sim_rtc.c
+ *
+ * RTC clocked by the LSI. The calendar (TR, SSR) counts from the end of the initialization mode,
+ * the wakeup timer sets WUTF and gives a rising edge on the EXTI line 20 at each period. The RTC
+ * keeps counting in Stop mode. The write protection and the shadow registers are not modelled,
+ * the dates and the alarms neither.
+ */
+
+#include "sim_periph.h"
+
+#define SIM_RTC_DAY_S 86400
+#define SIM_RTC_ISR_RC_W0 (RTC_ISR_RSF | RTC_ISR_ALRAF | RTC_ISR_ALRBF | RTC_ISR_WUTF | RTC_ISR_TSF | \
+						   RTC_ISR_TSOVF | RTC_ISR_TAMP1F | RTC_ISR_TAMP2F | RTC_ISR_TAMP3F)
+#define SIM_RTC_ISR_RO (RTC_ISR_ALRAWF | RTC_ISR_ALRBWF | RTC_ISR_INITS)
+#define SIM_RTC_EXTI_LINE 20
+
+static struct {
+	uint8_t running;		// The calendar counts
+	uint64_t base_ps;		// Time of base_seconds
+	uint32_t base_seconds;	// Time of the day at base_ps
+	uint64_t wakeup_ps;		// Next wakeup, SIM_NEVER when the wakeup timer is off
+	uint64_t wakeup_period_ps;
+} rtc;
+
+static uint32_t sim_rtc_from_bcd(uint32_t _tr)
+{
+	return ((_tr >> 20) & 0x3) * 36000 + ((_tr >> 16) & 0xF) * 3600 + ((_tr >> 12) & 0x7) * 600 +
+		   ((_tr >> 8) & 0xF) * 60 + ((_tr >> 4) & 0x7) * 10 + (_tr & 0xF);
+}
+
+static uint32_t sim_rtc_to_bcd(uint32_t _seconds)
+{
+	uint32_t h = _seconds / 3600;
+	uint32_t m = (_seconds / 60) % 60;
+	uint32_t s = _seconds % 60;
+
+	return ((h / 10) << 20) | ((h % 10) << 16) | ((m / 10) << 12) | ((m % 10) << 8) | ((s / 10) << 4) | (s % 10);
+}
+
+/**
+ * @brief Duration of a number of periods of the synchronous prescaler input (ck_apre)
+ */
+static uint64_t sim_rtc_apre_ps(uint64_t _ticks)
+{
+	uint32_t prediv_a = ((SIM_REGS(RTC)->PRER >> 16) & 0x7F) + 1;
+
+	return (uint64_t)(((unsigned __int128)_ticks * prediv_a * SIM_PS_PER_S) / LSI_VALUE);
+}
+
+/**
+ * @brief Period of the wakeup timer from WUCKSEL and WUTR
+ */
+static uint64_t sim_rtc_wakeup_period(void)
+{
+	RTC_TypeDef *regs = SIM_REGS(RTC);
+	uint32_t wucksel = (regs->CR & RTC_CR_WUCKSEL) >> RTC_CR_WUCKSEL_Pos;
+	uint64_t counts = (uint64_t)(regs->WUTR & 0xFFFF) + 1;
+
+	// RTCCLK divided by 16, 8, 4 or 2
+	if (wucksel < 4)
+		return (uint64_t)(((unsigned __int128)counts * (16U >> wucksel) * SIM_PS_PER_S) / LSI_VALUE);
+
+	// ck_spre, 2^16 more counts from 6
+	if (wucksel >= 6)
+		counts += 0x10000;
+
+	return sim_rtc_apre_ps(counts * ((regs->PRER & 0x7FFF) + 1));
+}
+
+/**
+ * @brief Show the calendar in TR and SSR
+ */
+static void sim_rtc_refresh(uint64_t _now)
+{
+	RTC_TypeDef *regs = SIM_REGS(RTC);
+
+	if (!rtc.running)
+		return;
+
+	uint32_t prediv_a = ((regs->PRER >> 16) & 0x7F) + 1;
+	uint32_t prediv_s = (regs->PRER & 0x7FFF) + 1;
+	uint64_t ticks = (uint64_t)(((unsigned __int128)(_now - rtc.base_ps) * LSI_VALUE) / ((uint64_t)prediv_a * SIM_PS_PER_S));
+
+	regs->TR = sim_rtc_to_bcd((rtc.base_seconds + ticks / prediv_s) % SIM_RTC_DAY_S);
+	regs->SSR = prediv_s - 1 - (uint32_t)(ticks % prediv_s);
+}
+
+static void sim_rtc_update(uint64_t _now)
+{
+	RTC_TypeDef *regs = SIM_REGS(RTC);
+
+	sim_rtc_refresh(_now);
+
+	while (rtc.wakeup_ps <= _now)
+	{
+		rtc.wakeup_ps += rtc.wakeup_period_ps;
+		regs->ISR |= RTC_ISR_WUTF;
+
+		if (regs->CR & RTC_CR_WUTIE)
+			sim_exti_edge(SIM_RTC_EXTI_LINE, 1);
+	}
+}
+
+static uint64_t sim_rtc_next_event(uint64_t _now)
+{
+	(void)_now;
+
+	return rtc.wakeup_ps;
+}
+
+static const TypeDef_Sim_Model sim_rtc_model = {
+	sim_rtc_update,
+	sim_rtc_next_event,
+	NULL,
+	NULL,
+	NULL,
+};
+
+/**
+ * @brief Reset of the backup domain, the calendar is stopped
+ */
+void sim_rtc_init(void)
+{
+	RTC_TypeDef *regs = SIM_REGS(RTC);
+
+	regs->TR = 0;
+	regs->CR = 0;
+	regs->ISR = RTC_ISR_ALRAWF | RTC_ISR_ALRBWF | RTC_ISR_WUTWF;
+	regs->PRER = 0x007F00FF;
+	regs->WUTR = 0xFFFF;
+	regs->SSR = 0;
+
+	rtc.running = 0;
+	rtc.wakeup_ps = SIM_NEVER;
+
+	sim_add_model(&sim_rtc_model);
+}
+
+/**
+ * @brief RTC write : initialization mode, wakeup timer and flags cleared by writing 0
+ */
+void sim_rtc_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	RTC_TypeDef *regs = SIM_REGS(RTC);
+	uint64_t now = sim_now_ps();
+
+	(void)_size;
+
+	if (_addr == (uintptr_t)&RTC->ISR)
+	{
+		uint32_t isr = (_value & RTC_ISR_INIT) | (_old & _value & SIM_RTC_ISR_RC_W0) | (_old & SIM_RTC_ISR_RO);
+
+		if (isr & RTC_ISR_INIT)
+		{
+			// The calendar stops, it may be written
+			sim_rtc_refresh(now);
+			rtc.running = 0;
+			isr |= RTC_ISR_INITF;
+		}
+		else if (_old & RTC_ISR_INIT)
+		{
+			rtc.running = 1;
+			rtc.base_ps = now;
+			rtc.base_seconds = sim_rtc_from_bcd(regs->TR);
+			isr |= RTC_ISR_INITS;
+		}
+
+		regs->ISR = isr;
+	}
+	else if (_addr == (uintptr_t)&RTC->CR)
+	{
+		if ((_value & RTC_CR_WUTE) && !(_old & RTC_CR_WUTE))
+		{
+			rtc.wakeup_period_ps = sim_rtc_wakeup_period();
+			rtc.wakeup_ps = now + rtc.wakeup_period_ps;
+		}
+		else if (!(_value & RTC_CR_WUTE))
+		{
+			rtc.wakeup_ps = SIM_NEVER;
+		}
+	}
+	else if (_addr == (uintptr_t)&RTC->TR || _addr == (uintptr_t)&RTC->SSR)
+	{
+		// Written in the initialization mode only, SSR is read-only
+		if (rtc.running || _addr == (uintptr_t)&RTC->SSR)
+			*(uint32_t *)sim_alias(_addr) = _old;
+	}
+
+	// The wakeup timer can be written while it is off
+	if (regs->CR & RTC_CR_WUTE)
+		regs->ISR &= ~RTC_ISR_WUTWF;
+	else
+		regs->ISR |= RTC_ISR_WUTWF;
+}
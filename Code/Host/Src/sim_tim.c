@@ -0,0 +1,304 @@
+/*
+ * sim_tim.c
+ *
+ * General purpose timers TIM2 to TIM5, counting up on the APB1 timer clock. The prescaler is
+ * loaded at the update events, the auto-reload too when ARPE is set. Update events come from
+ * the overflows and from UG (no UIF with URS). The counter is frozen in Stop mode.
+ * TIM3 drives the buzzer : its period and its channel 2 duty cycle are logged as events.
+ */
+
+#include "sim_periph.h"
+
+typedef struct {
+	TIM_TypeDef *instance;
+	IRQn_Type irqn;
+	uint32_t max;		// Counter mask, 16 or 32 bits
+	uint8_t running;
+	uint64_t base_ps;	// Time of base_cnt
+	uint32_t base_cnt;
+	uint32_t clock;		// Counter clock before the prescaler, at base_ps
+	uint32_t psc;		// Active prescaler
+	uint32_t arr;		// Active auto-reload
+}TypeDef_Sim_Timer;
+
+static TypeDef_Sim_Timer timers[] = {
+	{TIM2, TIM2_IRQn, 0xFFFF},
+	{TIM3, TIM3_IRQn, 0xFFFF},
+	{TIM4, TIM4_IRQn, 0xFFFF},
+	{TIM5, TIM5_IRQn, 0xFFFFFFFF},
+};
+
+#define SIM_TIMERS_COUNT (sizeof(timers) / sizeof(timers[0]))
+
+/**
+ * @brief Counts of a timer over a duration
+ */
+static uint64_t sim_tim_counts(const TypeDef_Sim_Timer *_timer, uint64_t _ps)
+{
+	return (uint64_t)(((unsigned __int128)_ps * _timer->clock) / ((unsigned __int128)(_timer->psc + 1) * SIM_PS_PER_S));
+}
+
+/**
+ * @brief Time taken by a number of counts, rounded up
+ */
+static uint64_t sim_tim_duration(const TypeDef_Sim_Timer *_timer, uint64_t _counts)
+{
+	unsigned __int128 ps = (unsigned __int128)_counts * (_timer->psc + 1) * SIM_PS_PER_S;
+
+	return (uint64_t)((ps + _timer->clock - 1) / _timer->clock);
+}
+
+/**
+ * @brief Counts from the base up to the next overflow
+ */
+static uint64_t sim_tim_counts_to_overflow(const TypeDef_Sim_Timer *_timer)
+{
+	// Above the auto-reload, the counter goes on up to its maximum
+	if (_timer->base_cnt > _timer->arr)
+		return (uint64_t)_timer->max + 1 - _timer->base_cnt;
+
+	return (uint64_t)_timer->arr + 1 - _timer->base_cnt;
+}
+
+/**
+ * @brief Restart the counting from now at the counter value
+ */
+static void sim_tim_rebase(TypeDef_Sim_Timer *_timer, uint32_t _cnt)
+{
+	_timer->base_ps = sim_now_ps();
+	_timer->base_cnt = _cnt & _timer->max;
+	_timer->clock = sim_clocks()->tim_apb1;
+}
+
+/**
+ * @brief Update event : prescaler and auto-reload loaded, UIF set unless asked otherwise
+ * @param _flag 1 to set UIF
+ */
+static void sim_tim_update_event(TypeDef_Sim_Timer *_timer, uint8_t _flag)
+{
+	TIM_TypeDef *tim = SIM_REGS(_timer->instance);
+
+	if (tim->CR1 & TIM_CR1_UDIS)
+		return;
+
+	_timer->psc = tim->PSC;
+	_timer->arr = tim->ARR;
+
+	if (_flag)
+		tim->SR |= TIM_SR_UIF;
+}
+
+/**
+ * @brief Show the period and the duty cycle of the buzzer
+ */
+static void sim_tim_buzzer(void)
+{
+	static uint32_t last_hz = 0xFFFFFFFF;
+	static uint32_t last_ccr = 0xFFFFFFFF;
+	TIM_TypeDef *tim = SIM_REGS(TIM3);
+	uint32_t hz = 0;
+	uint32_t ccr = tim->CCR2;
+
+	if ((tim->CR1 & TIM_CR1_CEN) && (tim->CCER & TIM_CCER_CC2E))
+		hz = sim_clocks()->tim_apb1 / ((tim->PSC + 1) * (tim->ARR + 1));
+	else
+		ccr = 0;
+
+	if (hz == last_hz && ccr == last_ccr)
+		return;
+
+	last_hz = hz;
+	last_ccr = ccr;
+	sim_event("buzzer,%u,%u", hz, ccr);
+}
+
+/**
+ * @brief Catch up with the time : overflows and counter value
+ */
+static void sim_tim_advance(TypeDef_Sim_Timer *_timer, uint64_t _now)
+{
+	TIM_TypeDef *tim = SIM_REGS(_timer->instance);
+
+	if (!_timer->running)
+		return;
+
+	while (_timer->arr != 0)
+	{
+		uint64_t overflow = _timer->base_ps + sim_tim_duration(_timer, sim_tim_counts_to_overflow(_timer));
+
+		if (overflow > _now)
+			break;
+
+		_timer->base_ps = overflow;
+		_timer->base_cnt = 0;
+		sim_tim_update_event(_timer, 1);
+
+		if (tim->CR1 & TIM_CR1_OPM)
+		{
+			tim->CR1 &= ~TIM_CR1_CEN;
+			_timer->running = 0;
+			break;
+		}
+
+		// Without an interrupt to serve, the remaining periods are skipped at once
+		if ((tim->DIER & TIM_DIER_UIE) == 0 && _timer->arr != 0)
+		{
+			uint64_t periods = sim_tim_counts(_timer, _now - _timer->base_ps) / ((uint64_t)_timer->arr + 1);
+
+			_timer->base_ps += sim_tim_duration(_timer, periods * ((uint64_t)_timer->arr + 1));
+		}
+	}
+
+	tim->CNT = (uint32_t)((_timer->base_cnt + sim_tim_counts(_timer, _now - _timer->base_ps)) & _timer->max);
+}
+
+static void sim_tim_model_update(uint64_t _now)
+{
+	// No clock in Stop mode, the counters hold
+	if (sim_core_stopped())
+		return;
+
+	for (size_t i = 0; i < SIM_TIMERS_COUNT; i++)
+		sim_tim_advance(&timers[i], _now);
+}
+
+static uint64_t sim_tim_next_event(uint64_t _now)
+{
+	uint64_t next = SIM_NEVER;
+
+	(void)_now;
+
+	if (sim_core_stopped())
+		return SIM_NEVER;
+
+	for (size_t i = 0; i < SIM_TIMERS_COUNT; i++)
+	{
+		TypeDef_Sim_Timer *timer = &timers[i];
+		TIM_TypeDef *tim = SIM_REGS(timer->instance);
+
+		if (!timer->running || timer->arr == 0)
+			continue;
+		if ((tim->DIER & TIM_DIER_UIE) == 0 && (tim->CR1 & TIM_CR1_OPM) == 0)
+			continue;
+
+		uint64_t overflow = timer->base_ps + sim_tim_duration(timer, sim_tim_counts_to_overflow(timer));
+
+		if (overflow < next)
+			next = overflow;
+	}
+
+	return next;
+}
+
+static void sim_tim_levels(void)
+{
+	for (size_t i = 0; i < SIM_TIMERS_COUNT; i++)
+	{
+		TIM_TypeDef *tim = SIM_REGS(timers[i].instance);
+
+		sim_irq_line(timers[i].irqn, (tim->SR & tim->DIER & 0x5F) != 0);
+	}
+}
+
+static void sim_tim_clock_changed(void)
+{
+	for (size_t i = 0; i < SIM_TIMERS_COUNT; i++)
+		sim_tim_rebase(&timers[i], SIM_REGS(timers[i].instance)->CNT);
+
+	sim_tim_buzzer();
+}
+
+static void sim_tim_stop(uint8_t _stopped)
+{
+	// The counters keep their value over the Stop mode, they restart from it
+	if (_stopped == 0)
+		sim_tim_clock_changed();
+}
+
+static const TypeDef_Sim_Model sim_tim_model = {
+	sim_tim_model_update,
+	sim_tim_next_event,
+	sim_tim_levels,
+	sim_tim_clock_changed,
+	sim_tim_stop,
+};
+
+/**
+ * @brief Reset the timers
+ */
+void sim_tim_init(void)
+{
+	for (size_t i = 0; i < SIM_TIMERS_COUNT; i++)
+	{
+		TypeDef_Sim_Timer *timer = &timers[i];
+		TIM_TypeDef *tim = SIM_REGS(timer->instance);
+
+		tim->ARR = timer->max;
+		timer->running = 0;
+		timer->psc = 0;
+		timer->arr = timer->max;
+		sim_tim_rebase(timer, 0);
+	}
+
+	sim_add_model(&sim_tim_model);
+}
+
+/**
+ * @brief Timer register write
+ */
+void sim_tim_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	TypeDef_Sim_Timer *timer = NULL;
+
+	(void)_size;
+
+	for (size_t i = 0; i < SIM_TIMERS_COUNT; i++)
+		if ((_addr & ~(uintptr_t)0x3FF) == (uintptr_t)timers[i].instance)
+			timer = &timers[i];
+
+	TIM_TypeDef *tim = SIM_REGS(timer->instance);
+	uint32_t offset = _addr & 0x3FF;
+
+	// In the frozen Stop mode the counters do not run, their position is still up to date
+	if (offset == offsetof(TIM_TypeDef, CR1))
+	{
+		if (!(_old & TIM_CR1_CEN) && (_value & TIM_CR1_CEN))
+		{
+			timer->running = 1;
+			sim_tim_rebase(timer, tim->CNT);
+		}
+		else if ((_old & TIM_CR1_CEN) && !(_value & TIM_CR1_CEN))
+		{
+			timer->running = 0;
+		}
+	}
+	else if (offset == offsetof(TIM_TypeDef, SR))
+	{
+		// The flags are cleared by writing 0
+		tim->SR = _old & _value;
+	}
+	else if (offset == offsetof(TIM_TypeDef, EGR))
+	{
+		tim->EGR = 0;
+		if (_value & TIM_EGR_UG)
+		{
+			tim->CNT = 0;
+			sim_tim_update_event(timer, (tim->CR1 & TIM_CR1_URS) == 0);
+			sim_tim_rebase(timer, 0);
+		}
+	}
+	else if (offset == offsetof(TIM_TypeDef, CNT))
+	{
+		sim_tim_rebase(timer, _value);
+	}
+	else if (offset == offsetof(TIM_TypeDef, ARR))
+	{
+		if ((tim->CR1 & TIM_CR1_ARPE) == 0)
+			timer->arr = _value & timer->max;
+	}
+
+	sim_tim_levels();
+
+	if (timer->instance == TIM3)
+		sim_tim_buzzer();
+}
@@ -0,0 +1,315 @@
+/*
+ * sim_uart.c
+ *
+ * USART1, USART2 and the DMA1 channels. A byte written to DR, by the core or by a memory to
+ * peripheral DMA channel, takes its frame time on the wire (10 bits at the BRR baud rate of the
+ * bus clock) : it is sent at its start with the time of its end. The USART2 bytes go to the
+ * telemetry output, the USART1 ones to the link (sim_link.c). A byte received by USART1 is written
+ * to memory by its peripheral to memory DMA channel, or left in DR with RXNE set. The DMA counts,
+ * flags and interrupts follow the bytes, the circular mode reloads the count. The transfers are
+ * frozen and the bytes received are lost in Stop mode. The TX flags stay at TXE and TC, the reads
+ * of DR are not seen : RXNE is only cleared by the DMA.
+ *
+ * The DMA registers are not trapped, the telemetry writes them at each main loop iteration : the
+ * channels are polled at each step of the time, a write takes effect at the next step. A channel
+ * is started when it is enabled, or when its count was written while enabled (disabled and enabled
+ * again in between).
+ */
+
+#include "sim_periph.h"
+
+#define SIM_DMA_CHANNELS 7
+#define SIM_UART_FRAME_BITS 10
+
+typedef struct {
+	DMA_Channel_TypeDef *instance;
+	uint8_t enabled;		// EN seen by the last poll
+	uint8_t running;		// Bytes to move between memory and a USART DR
+	uint8_t rx;				// From the USART DR to memory
+	USART_TypeDef *usart;	// USART fed or read
+	uint32_t address;		// Next memory address
+	uint32_t count;			// Count left, as shown in CNDTR
+	uint32_t reload;		// Count at enable, for the circular mode
+	uint64_t next_ps;		// End of the byte on the wire
+}TypeDef_Sim_Dma;
+
+static TypeDef_Sim_Dma channels[SIM_DMA_CHANNELS] = {
+	{DMA1_Channel1}, {DMA1_Channel2}, {DMA1_Channel3}, {DMA1_Channel4},
+	{DMA1_Channel5}, {DMA1_Channel6}, {DMA1_Channel7},
+};
+
+static uint64_t last_ps;	// Time of the last update
+
+/**
+ * @brief Frame time of a byte at the baud rate of a USART
+ */
+static uint64_t sim_uart_frame_ps(const USART_TypeDef *_usart)
+{
+	const TypeDef_Sim_Clocks *clocks = sim_clocks();
+	uint32_t pclk = (_usart == USART1) ? clocks->pclk2 : clocks->pclk1;
+	uint32_t brr = SIM_REGS(_usart)->BRR & 0xFFFF;
+
+	if (brr == 0)
+		brr = 1;
+
+	return (uint64_t)(((unsigned __int128)SIM_UART_FRAME_BITS * brr * SIM_PS_PER_S) / pclk);
+}
+
+/**
+ * @brief A byte starts on the wire
+ * @param _end_ps End of its frame
+ */
+static void sim_uart_send(const USART_TypeDef *_usart, uint8_t _byte, uint64_t _end_ps)
+{
+	if (_usart == USART2)
+		sim_out_write(SIM_OUT_TELEMETRY, &_byte, 1);
+	else
+		sim_link_send(_byte, _end_ps);
+}
+
+/**
+ * @brief Channel moving bytes of a USART : enabled, DR as peripheral
+ */
+static USART_TypeDef *sim_dma_usart(const DMA_Channel_TypeDef *_regs)
+{
+	if ((_regs->CCR & DMA_CCR_EN) == 0)
+		return NULL;
+	if (_regs->CPAR == (uint32_t)(uintptr_t)&USART1->DR)
+		return USART1;
+	if (_regs->CPAR == (uint32_t)(uintptr_t)&USART2->DR)
+		return USART2;
+
+	return NULL;
+}
+
+/**
+ * @brief Byte of a channel moved : address, count, flags and reload
+ */
+static void sim_dma_next(TypeDef_Sim_Dma *_dma, int _index)
+{
+	DMA_Channel_TypeDef *regs = SIM_REGS(_dma->instance);
+	uint32_t shift = 4 * _index;
+
+	if (regs->CCR & DMA_CCR_MINC)
+		_dma->address++;
+
+	_dma->count--;
+
+	if (_dma->count == _dma->reload / 2)
+		SIM_REGS(DMA1)->ISR |= (DMA_ISR_GIF1 | DMA_ISR_HTIF1) << shift;
+
+	if (_dma->count == 0)
+	{
+		SIM_REGS(DMA1)->ISR |= (DMA_ISR_GIF1 | DMA_ISR_TCIF1) << shift;
+
+		if (regs->CCR & DMA_CCR_CIRC)
+		{
+			_dma->count = _dma->reload;
+			_dma->address = regs->CMAR;
+		}
+		else
+		{
+			_dma->running = 0;
+		}
+	}
+
+	regs->CNDTR = _dma->count;
+}
+
+/**
+ * @brief Byte of a channel at its end on the wire, the next one starts
+ */
+static void sim_dma_byte(TypeDef_Sim_Dma *_dma, int _index)
+{
+	sim_dma_next(_dma, _index);
+
+	if (!_dma->running)
+		return;
+
+	_dma->next_ps += sim_uart_frame_ps(_dma->usart);
+	sim_uart_send(_dma->usart, *(const uint8_t *)(uintptr_t)_dma->address, _dma->next_ps);
+}
+
+/**
+ * @brief Catch up with the writes to the DMA : flags cleared, channels started and stopped
+ */
+static void sim_dma_poll(void)
+{
+	DMA_TypeDef *dma = SIM_REGS(DMA1);
+
+	if (dma->IFCR != 0)
+	{
+		dma->ISR &= ~dma->IFCR;
+		dma->IFCR = 0;
+	}
+
+	for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+	{
+		TypeDef_Sim_Dma *channel = &channels[i];
+		DMA_Channel_TypeDef *regs = SIM_REGS(channel->instance);
+
+		if ((regs->CCR & DMA_CCR_EN) == 0)
+		{
+			channel->enabled = 0;
+			channel->running = 0;
+			continue;
+		}
+
+		if (channel->enabled && regs->CNDTR == channel->count)
+			continue;
+
+		channel->enabled = 1;
+		channel->usart = sim_dma_usart(regs);
+		channel->rx = (regs->CCR & DMA_CCR_DIR) == 0;
+		channel->running = channel->usart != NULL && regs->CNDTR != 0;
+		channel->count = regs->CNDTR;
+
+		if (channel->running)
+		{
+			channel->address = regs->CMAR;
+			channel->reload = regs->CNDTR;
+		}
+
+		if (channel->running && !channel->rx)
+		{
+			channel->next_ps = sim_now_ps() + sim_uart_frame_ps(channel->usart);
+			sim_uart_send(channel->usart, *(const uint8_t *)(uintptr_t)channel->address, channel->next_ps);
+		}
+	}
+}
+
+static void sim_uart_update(uint64_t _now)
+{
+	sim_dma_poll();
+
+	// Frozen in Stop mode : the bytes on the wire are delayed by the stop
+	if (sim_core_stopped())
+	{
+		for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+			channels[i].next_ps += _now - last_ps;
+		last_ps = _now;
+		return;
+	}
+
+	last_ps = _now;
+
+	for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+		while (channels[i].running && !channels[i].rx && channels[i].next_ps <= _now)
+			sim_dma_byte(&channels[i], i);
+}
+
+static uint64_t sim_uart_next_event(uint64_t _now)
+{
+	uint64_t next = SIM_NEVER;
+
+	(void)_now;
+
+	if (sim_core_stopped())
+		return SIM_NEVER;
+
+	sim_dma_poll();
+
+	// Without an interrupt the bytes are caught up with at the next update, but the link ones :
+	// each starts at its time, the lookahead promised to the other board holds
+	for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+		if (channels[i].running && !channels[i].rx &&
+			((SIM_REGS(channels[i].instance)->CCR & (DMA_CCR_TCIE | DMA_CCR_HTIE)) || channels[i].usart == USART1) &&
+			channels[i].next_ps < next)
+			next = channels[i].next_ps;
+
+	return next;
+}
+
+static void sim_uart_levels(void)
+{
+	uint32_t isr;
+
+	// The flags cleared by the handler just run
+	sim_dma_poll();
+	isr = SIM_REGS(DMA1)->ISR;
+
+	for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+	{
+		uint32_t ccr = SIM_REGS(channels[i].instance)->CCR;
+		uint32_t flags = (isr >> (4 * i)) & (DMA_ISR_TCIF1 | DMA_ISR_HTIF1 | DMA_ISR_TEIF1);
+
+		sim_irq_line(DMA1_Channel1_IRQn + i, (flags & ccr & (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE)) != 0);
+	}
+}
+
+static const TypeDef_Sim_Model sim_uart_model = {
+	sim_uart_update,
+	sim_uart_next_event,
+	sim_uart_levels,
+	NULL,
+	NULL,
+};
+
+/**
+ * @brief Reset the USARTs and the DMA channels
+ */
+void sim_uart_init(void)
+{
+	SIM_REGS(USART1)->SR = USART_SR_TXE | USART_SR_TC;
+	SIM_REGS(USART2)->SR = USART_SR_TXE | USART_SR_TC;
+
+	for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+	{
+		channels[i].enabled = 0;
+		channels[i].running = 0;
+	}
+
+	last_ps = sim_now_ps();
+	sim_add_model(&sim_uart_model);
+}
+
+/**
+ * @brief USART write : a byte written to DR is sent, the status flags stay set
+ */
+void sim_uart_write(uintptr_t _addr, uint32_t _old, uint32_t _value, uint8_t _size)
+{
+	USART_TypeDef *usart = ((_addr & ~(uintptr_t)0x3FF) == USART1_BASE) ? USART1 : USART2;
+
+	(void)_size;
+
+	if (_addr == (uintptr_t)&usart->DR && (SIM_REGS(usart)->CR1 & (USART_CR1_UE | USART_CR1_TE)) == (USART_CR1_UE | USART_CR1_TE))
+		sim_uart_send(usart, _value & 0xFF, sim_now_ps() + sim_uart_frame_ps(usart));
+
+	// A write of DR replaces the byte received, the TX data register is not kept
+	if (_addr == (uintptr_t)&usart->DR)
+		SIM_REGS(usart)->DR = _old;
+
+	SIM_REGS(usart)->SR = (SIM_REGS(usart)->SR & (USART_SR_RXNE | USART_SR_ORE)) | USART_SR_TXE | USART_SR_TC;
+}
+
+/**
+ * @brief Byte at the end of its frame on the RX pin : written to memory by the DMA channel reading
+ * DR, or left in DR
+ */
+void sim_uart_receive(USART_TypeDef *_usart, uint8_t _byte)
+{
+	USART_TypeDef *regs = SIM_REGS(_usart);
+
+	if (sim_core_stopped() || (regs->CR1 & (USART_CR1_UE | USART_CR1_RE)) != (USART_CR1_UE | USART_CR1_RE))
+		return;
+
+	sim_dma_poll();
+
+	for (int i = 0; i < SIM_DMA_CHANNELS; i++)
+	{
+		TypeDef_Sim_Dma *channel = &channels[i];
+
+		if (!channel->running || !channel->rx || channel->usart != _usart || (regs->CR3 & USART_CR3_DMAR) == 0)
+			continue;
+
+		*(uint8_t *)(uintptr_t)channel->address = _byte;
+		sim_dma_next(channel, i);
+		return;
+	}
+
+	if (regs->SR & USART_SR_RXNE)
+		regs->SR |= USART_SR_ORE;
+
+	regs->DR = _byte;
+	regs->SR |= USART_SR_RXNE;
+}
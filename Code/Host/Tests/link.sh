@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# link.sh
+#
+# Linked field of two boards, each one simulated by its own pong_sim and linked through two pipes
+# in place of the wire : P1 serves at 5 s on the right board, the ball is handed off to the left
+# board, P2 misses it. The FSM traces of both boards must show the hand-off and the state synced
+# back to the right board.
+#
+#   sh Tests/link.sh LEFT_BUILD RIGHT_BUILD
+
+if [ $# -ne 2 ]; then
+	echo "usage: link.sh LEFT_BUILD RIGHT_BUILD" >&2
+	exit 2
+fi
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+mkfifo "$dir/to_left" "$dir/to_right"
+
+# Both time out at the end of the point
+"$2/pong_sim" --time 12 --press 5000:1:50 --link "$dir/to_left:$dir/to_right" --log /dev/null \
+	--swo "$dir/right.swo" 2>/dev/null &
+"$1/pong_sim" --time 12 --link "$dir/to_right:$dir/to_left" --log /dev/null \
+	--swo "$dir/left.swo" 2>/dev/null
+wait
+
+right=$("$2/trace_decode" "$dir/right.swo" | cut -d, -f4-)
+left=$("$1/trace_decode" "$dir/left.swo" | cut -d, -f4-)
+expected_right="START,START,0,0,0
+START,WPP1,0,0,0
+WPP1,GTP2,1,0,0
+GTP2,AWAY,0,0,0
+AWAY,IP1S,0,0,0
+IP1S,WPP2,0,0,0"
+expected_left="START,START,0,0,0
+START,WPP1,0,0,0
+WPP1,GTP2,0,0,0
+GTP2,RPP2,0,0,0
+RPP2,IP1S,0,0,1
+IP1S,WPP2,0,0,0"
+
+if [ "$right" != "$expected_right" ] || [ "$left" != "$expected_left" ]; then
+	echo "FAIL: linked field timelines" >&2
+	echo "right:" >&2
+	echo "$right" >&2
+	echo "left:" >&2
+	echo "$left" >&2
+	exit 1
+fi
+
+echo "Tests/link.sh: passed"
@@ -0,0 +1,34 @@
+#!/bin/sh
+#
+# memory.sh
+#
+# RAM budget of a whole match on pong_sim, from the memory lines of the match end report. Each
+# player serves in turn and the other one never returns : P1 wins 5-4. The stack high-water mark
+# must stay below its reserve, with the guard words intact (a breach traps in the DEBUG build).
+#
+#   sh Tests/memory.sh BUILD
+
+if [ $# -ne 1 ]; then
+	echo "usage: memory.sh BUILD" >&2
+	exit 2
+fi
+
+# A serve every 5 s from 5 s, once the previous point is over : P1 first, then P2
+presses=""
+for i in 1 2 3 4 5 6 7 8 9; do
+	presses="$presses --press $((i * 5000)):$(((i + 1) % 2 + 1)):50"
+done
+
+report=$("$1/pong_sim" --time 80 $presses --until memory,guard_breaches | grep '^memory,')
+
+stack_used=$(echo "$report" | awk -F, '$2 == "stack" { print $3 }')
+stack_reserved=$(echo "$report" | awk -F, '$2 == "stack" { print $4 }')
+breaches=$(echo "$report" | awk -F, '$2 == "guard_breaches" { print $3 }')
+
+if [ -z "$stack_used" ] || [ "$stack_used" -eq 0 ] || [ "$stack_used" -ge "$stack_reserved" ] || [ "$breaches" != 0 ]; then
+	echo "FAIL: RAM budget" >&2
+	echo "$report" >&2
+	exit 1
+fi
+
+echo "Tests/memory.sh: passed"
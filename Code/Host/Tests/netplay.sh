@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# netplay.sh
+#
+# Remote match over a slow link : two pong_sim linked through pipes, each byte delayed by 3 ms
+# plus a jitter up to 2 ms, more than the input delay of the netplay. P1 serves at 5 s on the
+# right board, P2 returns the ball at 7.6 s on the left board : the right board gets that press
+# frames after stepping them and rolls back. P1 misses the ball. Both boards must step the same
+# FSM timeline, the expected one.
+#
+#   sh Tests/netplay.sh LEFT_BUILD RIGHT_BUILD
+
+if [ $# -ne 2 ]; then
+	echo "usage: netplay.sh LEFT_BUILD RIGHT_BUILD" >&2
+	exit 2
+fi
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+mkfifo "$dir/to_left" "$dir/to_right"
+
+# Both time out at the end of the point
+"$2/pong_sim" --time 12 --press 5000:1:50 --link "$dir/to_left:$dir/to_right" --link-delay 3000:2000 \
+	--log /dev/null --swo "$dir/right.swo" 2>/dev/null &
+"$1/pong_sim" --time 12 --press 7600:2:50 --link "$dir/to_right:$dir/to_left" --link-delay 3000:2000 \
+	--log /dev/null --swo "$dir/left.swo" 2>/dev/null
+wait
+
+# The cycles differ, the frame a press is given at does not
+right=$("$2/trace_decode" "$dir/right.swo" | cut -d, -f4-)
+left=$("$1/trace_decode" "$dir/left.swo" | cut -d, -f4-)
+expected="START,START,0,0,0
+START,WPP1,0,0,0
+WPP1,GTP2,1,0,0
+GTP2,RPP2,0,0,0
+RPP2,GTP1,0,1,1
+GTP1,RPP1,0,0,1
+RPP1,IP2S,0,0,2"
+
+if [ "$right" != "$expected" ] || [ "$left" != "$expected" ]; then
+	echo "FAIL: netplay timelines" >&2
+	echo "right:" >&2
+	echo "$right" >&2
+	echo "left:" >&2
+	echo "$left" >&2
+	exit 1
+fi
+
+echo "Tests/netplay.sh: passed"
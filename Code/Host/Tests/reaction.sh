@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# reaction.sh
+#
+# Reaction time of a return, read from the telemetry of pong_sim : P1 serves at 5 s, P2 returns
+# the ball. A press stamped just before the ball reaches the border of P2 (6.98 s) counts as a
+# reaction of 0, not a wrapped negative one, a press after it as the time since the arrival.
+#
+#   sh Tests/reaction.sh BUILD
+
+if [ $# -ne 1 ]; then
+	echo "usage: reaction.sh BUILD" >&2
+	exit 2
+fi
+
+capture=$(mktemp)
+trap 'rm -f "$capture"' EXIT
+
+# Reaction time of the return pressed at $1 ms
+reaction() {
+	"$build/pong_sim" --time 9 --press 5000:1:50 --press "$1:2:50" --log /dev/null --telemetry "$capture" 2>/dev/null
+	"$build/telemetry_decode" "$capture" | awk -F, '$4 == "transition" && $5 == "GTP1" { print $10 }'
+}
+
+build=$1
+
+early=$(reaction 6921)
+late=$(reaction 7100)
+
+if [ "$early" != 0 ] || [ -z "$late" ] || [ "$late" -le 0 ] || [ "$late" -ge 1000000 ]; then
+	echo "FAIL: reaction times $early $late" >&2
+	exit 1
+fi
+
+echo "Tests/reaction.sh: passed"
@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# replay.sh
+#
+# Golden recordings of Tests/Goldens replayed on pong_sim : the FSM outputs (LED and display
+# writes, transitions) must give the recorded signature at each input. A recording is made with
+# pong_sim --record FILE of the default configuration, or copied from the replay_dump log of the
+# board. The host time of each replay is printed, to follow the cost of the firmware and the
+# simulator.
+#
+#   sh Tests/replay.sh BUILD
+
+if [ $# -ne 1 ]; then
+	echo "usage: replay.sh BUILD" >&2
+	exit 2
+fi
+
+status=0
+
+for golden in Tests/Goldens/*.replay; do
+	start=$(date +%s%N)
+	result=$("$1/pong_sim" --time 600 --replay "$golden" --until replay, | grep '^replay,')
+	end=$(date +%s%N)
+
+	echo "replay,$(basename "$golden"),$(((end - start) / 1000000))ms,$result"
+
+	case "$result" in
+	replay,match,*) ;;
+	*) status=1 ;;
+	esac
+done
+
+if [ $status -ne 0 ]; then
+	echo "FAIL: golden replays" >&2
+	exit 1
+fi
+
+echo "Tests/replay.sh: passed"
@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# telemetry.sh
+#
+# Telemetry stream of the scripted point of trace.sh, captured on the USART2 output of pong_sim and
+# decoded by telemetry_decode : the transitions and the ball path must be the expected ones. A
+# capture started in the middle of a frame loses that frame only, the replay at a high speed prints
+# the same records.
+#
+#   sh Tests/telemetry.sh BUILD
+
+if [ $# -ne 1 ]; then
+	echo "usage: telemetry.sh BUILD" >&2
+	exit 2
+fi
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+	echo "FAIL: $1" >&2
+	exit 1
+}
+
+# Times out at the end of the point
+"$1/pong_sim" --time 12 --press 5000:1:50 --press 7000:2:50 --log /dev/null --telemetry "$dir/capture" 2>/dev/null
+
+"$1/telemetry_decode" "$dir/capture" > "$dir/records" 2> "$dir/errors" || fail "no records"
+[ -s "$dir/errors" ] && fail "$(cat "$dir/errors")"
+
+# State entered, pass count and scores
+transitions=$(awk -F, '$4 == "transition" { print $5 "," $7 "," $8 "," $9 }' "$dir/records")
+expected="START,0,0,0
+WPP1,0,0,0
+GTP2,0,0,0
+RPP2,0,0,0
+GTP1,1,0,0
+RPP1,1,0,0
+IP2S,2,0,0
+WPP1,0,0,1"
+[ "$transitions" = "$expected" ] || fail "transitions
+$transitions"
+
+# The ball goes from P1 to P2, then back
+ball=$(awk -F, '$4 == "ball" { printf "%s%s:%s", sep, $5, $6; sep = " " }' "$dir/records")
+[ "$ball" = "GTP2:4 GTP2:3 GTP2:2 GTP2:1 GTP2:0 GTP2:-1 GTP1:3 GTP1:4 GTP1:5 GTP1:6 GTP1:7 GTP1:8" ] ||
+	fail "ball path $ball"
+
+# Capture started in the first frame
+tail -c +5 "$dir/capture" | "$1/telemetry_decode" > "$dir/cut" 2> "$dir/errors"
+grep -q "1 bad frames, 0 records missing" "$dir/errors" || fail "cut capture $(cat "$dir/errors")"
+tail -n +2 "$dir/records" | cmp -s - "$dir/cut" || fail "cut capture records"
+
+# 11.4 s of records in about 11 ms
+"$1/telemetry_decode" --replay 1000 "$dir/capture" | cmp -s - "$dir/records" || fail "replay"
+
+echo "Tests/telemetry.sh: passed"
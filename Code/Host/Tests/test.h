@@ -0,0 +1,47 @@
+/*
+ * test.h
+ *
+ * Checks of the host tests : a failed check is reported with its line, the test goes on and
+ * exits with the failure status at the end.
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_failures = 0;
+
+#define TEST_CHECK(_cond) do { \
+	if (!(_cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #_cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_CHECK_EQ(_actual, _expected) do { \
+	long long actual_ = (long long)(_actual); \
+	long long expected_ = (long long)(_expected); \
+	if (actual_ != expected_) { \
+		fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #_actual, actual_, expected_); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_CHECK_STR(_actual, _expected) do { \
+	const char *actual_ = (_actual); \
+	const char *expected_ = (_expected); \
+	if (strcmp(actual_, expected_) != 0) { \
+		fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #_actual, actual_, expected_); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_END() do { \
+	printf("%s: %s\n", __FILE__, test_failures ? "FAILED" : "passed"); \
+	return test_failures ? EXIT_FAILURE : EXIT_SUCCESS; \
+} while (0)
+
+#endif /* HOST_TEST_H_ */
@@ -0,0 +1,180 @@
+/*
+ * test_debounce.c
+ *
+ * Bounce waveforms on BTN1/BTN2, sampled by debounce_sample as by the INPUT task. The EXTI wakes
+ * the debouncer up through the handler below, as the BOARD_LL_FAST_PATHS one of stm32l1xx_it.c.
+ * The timer driver is replaced by a flag, the microsecond time is the simulated one.
+ */
+
+#include "sim.h"
+#include "main.h"
+#include "debounce.h"
+#include "timer.h"
+#include "capture.h"
+#include "test.h"
+
+#define TEST_EVENTS_MAX 16
+
+typedef struct {
+	uint16_t pin;
+	uint8_t pressed;
+	uint32_t time_us;
+}TypeDef_Test_Event;
+
+static TypeDef_Debounce_Handler debounce;
+static uint8_t input_task = 0;
+static uint32_t wakeups = 0;
+static uint32_t ms = 0;
+
+static TypeDef_Test_Event events[TEST_EVENTS_MAX];
+static int events_count = 0;
+
+void set_interrupt_launcher(TIMER_Enum _chosen_function)
+{
+	if (_chosen_function == INPUT)
+		input_task = 1;
+}
+
+void stop_interrupt_launcher(TIMER_Enum _chosen_function)
+{
+	if (_chosen_function == INPUT)
+		input_task = 0;
+}
+
+uint32_t capture_now_us(void) { return (uint32_t)(sim_now_ps() / SIM_PS_PER_US); }
+
+void EXTI15_10_IRQHandler(void)
+{
+	uint32_t time_us = capture_now_us();
+	uint32_t pending = EXTI->PR & (BTN1_Pin | BTN2_Pin);
+
+	EXTI->PR = pending;
+	wakeups++;
+
+	while (pending != 0)
+	{
+		uint32_t line = pending & -pending;
+
+		pending &= ~line;
+		debounce_wakeup(line, time_us);
+	}
+}
+
+void debounce_event_callback(uint16_t _btn_pin, uint8_t _pressed, uint32_t _time_us)
+{
+	if (events_count < TEST_EVENTS_MAX)
+		events[events_count++] = (TypeDef_Test_Event){_btn_pin, _pressed, _time_us};
+}
+
+/**
+ * @brief Play the waveforms of both buttons, one level per millisecond, '1' when pressed.
+ * A level is set in the middle of its millisecond, the INPUT task samples at its end.
+ */
+static void test_feed(const char *_btn1, const char *_btn2)
+{
+	for (size_t i = 0; _btn1[i] != '\0'; i++, ms++)
+	{
+		sim_run_until(ms * SIM_PS_PER_MS + 500 * SIM_PS_PER_US);
+		sim_button_set(BTN1_Pin, _btn1[i] == '1');
+		sim_button_set(BTN2_Pin, _btn2[i] == '1');
+		sim_irq_dispatch();
+
+		sim_run_until((ms + 1) * SIM_PS_PER_MS);
+		if (input_task)
+			debounce_sample();
+	}
+}
+
+static void test_check_event(int _index, uint16_t _pin, uint8_t _pressed, uint32_t _time_us)
+{
+	TEST_CHECK(_index < events_count);
+	if (_index >= events_count)
+		return;
+
+	TEST_CHECK_EQ(events[_index].pin, _pin);
+	TEST_CHECK_EQ(events[_index].pressed, _pressed);
+	TEST_CHECK_EQ(events[_index].time_us, _time_us);
+}
+
+/**
+ * @brief Idle again : sampling stopped, both lines unmasked, nothing pending
+ */
+static void test_check_idle(void)
+{
+	TEST_CHECK_EQ(input_task, 0);
+	TEST_CHECK_EQ(debounce.sampling, 0);
+	TEST_CHECK_EQ(EXTI->IMR & (BTN1_Pin | BTN2_Pin), BTN1_Pin | BTN2_Pin);
+	TEST_CHECK_EQ(EXTI->PR & (BTN1_Pin | BTN2_Pin), 0);
+}
+
+/**
+ * @brief A bouncing press and release : one event each, the press at its first edge
+ */
+static void test_bounces(void)
+{
+	events_count = 0;
+	test_feed("1010111111111110100000000",
+			  "0000000000000000000000000");
+
+	TEST_CHECK_EQ(events_count, 2);
+	test_check_event(0, BTN1_Pin, 1, 500);
+	test_check_event(1, BTN1_Pin, 0, 22000);
+
+	// The bounces after the first edge are masked
+	TEST_CHECK_EQ(wakeups, 1);
+	test_check_idle();
+}
+
+/**
+ * @brief A glitch is forgotten, the next press is stamped with its own edge
+ */
+static void test_glitch(void)
+{
+	events_count = 0;
+	test_feed("10000000011111110000000",
+			  "00000000000000000000000");
+
+	TEST_CHECK_EQ(events_count, 2);
+	test_check_event(0, BTN1_Pin, 1, 34500);
+	test_check_event(1, BTN1_Pin, 0, 46000);
+
+	TEST_CHECK_EQ(wakeups, 3);
+	test_check_idle();
+}
+
+/**
+ * @brief BTN2 pressed while BTN1 is held : its line is still unmasked, both have their time
+ */
+static void test_both_buttons(void)
+{
+	events_count = 0;
+	test_feed("11111111000000000000",
+			  "00111111111100000000");
+
+	TEST_CHECK_EQ(events_count, 4);
+	test_check_event(0, BTN1_Pin, 1, 48500);
+	test_check_event(1, BTN2_Pin, 1, 50500);
+	test_check_event(2, BTN1_Pin, 0, 61000);
+	test_check_event(3, BTN2_Pin, 0, 65000);
+
+	TEST_CHECK_EQ(wakeups, 5);
+	test_check_idle();
+}
+
+int main(void)
+{
+	sim_init(NULL);
+
+	// Falling edges of the buttons on EXTI15_10, as set by the GPIO init
+	EXTI->FTSR |= BTN1_Pin | BTN2_Pin;
+	EXTI->IMR |= BTN1_Pin | BTN2_Pin;
+	NVIC_EnableIRQ(EXTI15_10_IRQn);
+
+	TEST_CHECK_EQ(debounce_init(&debounce), HAL_OK);
+
+	test_bounces();
+	test_glitch();
+	test_both_buttons();
+
+	TEST_END();
+}
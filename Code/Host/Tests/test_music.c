@@ -0,0 +1,107 @@
+/*
+ * test_music.c
+ *
+ * Timeline of the notes rendered by the mixer when sound effects cover the background music.
+ * play_music is called as by the music tick, the elected note is read back from the TIM3 period.
+ */
+
+#include "sim.h"
+#include "music.h"
+#include "test.h"
+
+static TIM_HandleTypeDef htim3 = {.Instance = TIM3};
+static TypeDef_Music_Handler music = {.htim = &htim3};
+
+/**
+ * @brief Play one partition note : its election tick and the envelope ticks
+ * @retval Name of the note on the buzzer, "-" when muted
+ */
+static const char *music_next_note(void)
+{
+	const char *name = "?";
+
+	play_music();
+
+	if (music.note_peak == 0)
+		name = "-";
+	else
+		for (size_t i = 0; i < music.notes_sz; i++)
+			if (music.notes[i].arr == TIM3->ARR)
+				name = music.notes[i].name;
+
+	for (int tick = 1; tick < MUSIC_NOTE_TICKS; tick++)
+		play_music();
+
+	return name;
+}
+
+/**
+ * @brief Sound effects over the music : the most important one is heard, the music goes on below
+ */
+static void test_sfx_over_music(void)
+{
+	static const char *const expected[] = {
+		"C5", "-",							// Pacman
+		"C5", "E5", "G5",					// Score over the music
+		"E5", "Eb5", "D5", "C#5", "C5", "-",	// Miss replaces the score
+		"C5", "-", "-", "-", "C#5",			// Pacman where it went on
+	};
+	const char *timeline[sizeof(expected) / sizeof(expected[0])];
+	int note = 0;
+
+	set_music(PACMAN);
+	timeline[note++] = music_next_note();
+	timeline[note++] = music_next_note();
+
+	TEST_CHECK_EQ(play_sfx(SCORE), HAL_OK);
+	timeline[note++] = music_next_note();
+	timeline[note++] = music_next_note();
+
+	// A less important sound effect does not cover the score
+	TEST_CHECK_EQ(play_sfx(P1_REFLEXE), HAL_BUSY);
+	timeline[note++] = music_next_note();
+
+	TEST_CHECK_EQ(play_sfx(MISS), HAL_OK);
+	while (note < (int)(sizeof(expected) / sizeof(expected[0])))
+		timeline[note++] = music_next_note();
+
+	for (int i = 0; i < note; i++)
+		TEST_CHECK_STR(timeline[i], expected[i]);
+
+	TEST_CHECK_EQ(music.channels[CHANNEL_SFX].is_running, 0);
+	TEST_CHECK_EQ(music.channels[CHANNEL_MUSIC].index, 16);
+}
+
+/**
+ * @brief A sound effect of the same priority restarts, the buzzer is muted once all are over
+ */
+static void test_sfx_alone(void)
+{
+	stop_music();
+	TEST_CHECK_EQ(TIM3->CCR2, 0);
+
+	TEST_CHECK_EQ(play_sfx(SCORE), HAL_OK);
+	TEST_CHECK_STR(music_next_note(), "C5");
+	TEST_CHECK_STR(music_next_note(), "E5");
+
+	TEST_CHECK_EQ(play_sfx(SCORE), HAL_OK);
+	TEST_CHECK_STR(music_next_note(), "C5");
+
+	for (int i = 1; i < 6; i++)
+		music_next_note();
+
+	TEST_CHECK_STR(music_next_note(), "-");
+	TEST_CHECK_EQ(music.channels[CHANNEL_SFX].is_running, 0);
+	TEST_CHECK_EQ(TIM3->CCR2, 0);
+}
+
+int main(void)
+{
+	sim_init(NULL);
+	init_music(&music);
+
+	test_sfx_over_music();
+	test_sfx_alone();
+
+	TEST_END();
+}
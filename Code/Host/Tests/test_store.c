@@ -0,0 +1,186 @@
+/*
+ * test_store.c
+ *
+ * Store of the match results on a data EEPROM backed by a file. The records written by
+ * store_flush are read back from the file, store_init plays the startup scan of the next run.
+ */
+
+#include "sim.h"
+#include "store.h"
+#include "test.h"
+
+#include <unistd.h>
+
+#define TEST_STORE_FLUSHES_MAX 64
+
+static char path[] = "/tmp/test_store_XXXXXX";
+
+/**
+ * @brief Write the pending record, one word per idle iteration
+ * @retval Number of store_flush calls
+ */
+static int test_flush(void)
+{
+	int calls = 0;
+
+	while (store_is_pending() && calls < TEST_STORE_FLUSHES_MAX)
+	{
+		store_flush();
+		calls++;
+	}
+
+	return calls;
+}
+
+/**
+ * @brief Read a record of a slot from the file
+ */
+static void test_read_slot(uint32_t _slot, TypeDef_Store_Record *_record)
+{
+	FILE *file = fopen(path, "rb");
+
+	TEST_CHECK(file != NULL);
+	if (file == NULL)
+		return;
+
+	fseek(file, STORE_BASE - FLASH_EEPROM_BASE + _slot * sizeof(*_record), SEEK_SET);
+	TEST_CHECK_EQ(fread(_record, sizeof(*_record), 1, file), 1);
+	fclose(file);
+}
+
+/**
+ * @brief CRC unit, as the store computes its record CRC
+ */
+static void test_crc(void)
+{
+	CRC->CR = CRC_CR_RESET;
+	CRC->DR = 0x12345678;
+
+	TEST_CHECK_EQ(CRC->DR, 0xDF8A8A2B);
+}
+
+/**
+ * @brief A match is written in the first slot of an erased store, then found by the next startup
+ */
+static void test_first_record(void)
+{
+	TypeDef_Store_Record record;
+
+	TEST_CHECK_EQ(store_init(), HAL_OK);
+	TEST_CHECK_EQ(store_get()->sequence, 0);
+	TEST_CHECK_EQ(store_get()->matches, 0);
+
+	stats_record(STATS_P1, STATS_REACTION, 200000);
+	stats_record(STATS_P1, STATS_REACTION, 300000);
+	TEST_CHECK_EQ(store_add_match(STATS_P1, 5, 3), HAL_OK);
+	TEST_CHECK_EQ(test_flush(), STORE_RECORD_WORDS);
+
+	test_read_slot(0, &record);
+	TEST_CHECK_EQ(record.data.sequence, 1);
+	TEST_CHECK_EQ(record.data.matches, 1);
+	TEST_CHECK_EQ(record.data.wins[STATS_P1], 1);
+	TEST_CHECK_EQ(record.data.reaction_count[STATS_P1], 2);
+	TEST_CHECK_EQ(record.data.reaction_mean_us[STATS_P1], 250000);
+	TEST_CHECK_EQ(record.data.reaction_best_us[STATS_P1], 200000);
+	TEST_CHECK_EQ(record.data.last_scores[STATS_P1], 5);
+	TEST_CHECK_EQ(record.data.last_scores[STATS_P2], 3);
+
+	// Next run
+	TEST_CHECK_EQ(store_init(), HAL_OK);
+	TEST_CHECK_EQ(store_get()->sequence, 1);
+	TEST_CHECK_EQ(store_get()->matches, 1);
+	TEST_CHECK_EQ(store_get()->reaction_mean_us[STATS_P1], 250000);
+}
+
+/**
+ * @brief The next record goes in the next slot, and a record torn by a reset is ignored
+ */
+static void test_torn_record(void)
+{
+	TypeDef_Store_Record record;
+
+	stats_reset_match();
+	TEST_CHECK_EQ(store_add_match(STATS_P2, 4, 5), HAL_OK);
+
+	// Reset with the CRC not written
+	for (int i = 0; i < STORE_RECORD_WORDS - 1; i++)
+		store_flush();
+
+	test_read_slot(1, &record);
+	TEST_CHECK_EQ(record.data.sequence, 2);
+
+	TEST_CHECK_EQ(store_init(), HAL_OK);
+	TEST_CHECK_EQ(store_get()->sequence, 1);
+	TEST_CHECK_EQ(store_get()->matches, 1);
+	TEST_CHECK_EQ(store_get()->wins[STATS_P2], 0);
+
+	// Written again in the same slot, complete this time
+	TEST_CHECK_EQ(store_add_match(STATS_P2, 4, 5), HAL_OK);
+	TEST_CHECK_EQ(test_flush(), STORE_RECORD_WORDS);
+
+	TEST_CHECK_EQ(store_init(), HAL_OK);
+	TEST_CHECK_EQ(store_get()->sequence, 2);
+	TEST_CHECK_EQ(store_get()->matches, 2);
+	TEST_CHECK_EQ(store_get()->wins[STATS_P2], 1);
+	TEST_CHECK_EQ(store_get()->reaction_count[STATS_P1], 2);
+}
+
+/**
+ * @brief Reaction times out of range do not change the stored mean, the match is still counted
+ */
+static void test_mean_range(void)
+{
+	stats_reset_match();
+	stats_record(STATS_P1, STATS_REACTION, 0xF0000000);
+	TEST_CHECK_EQ(store_add_match(STATS_P1, 5, 2), HAL_OK);
+
+	TEST_CHECK_EQ(store_get()->matches, 3);
+	TEST_CHECK_EQ(store_get()->reaction_count[STATS_P1], 2);
+	TEST_CHECK_EQ(store_get()->reaction_mean_us[STATS_P1], 250000);
+	TEST_CHECK_EQ(store_get()->reaction_best_us[STATS_P1], 200000);
+	test_flush();
+	stats_reset_match();
+}
+
+/**
+ * @brief The slots are used in turn, the log wraps around and the latest record is still found
+ */
+static void test_wear_leveling(void)
+{
+	TypeDef_Store_Record record;
+
+	for (int i = 3; i < STORE_SLOTS_COUNT + 1; i++)
+	{
+		TEST_CHECK_EQ(store_add_match(STATS_P1, 5, 0), HAL_OK);
+		test_flush();
+	}
+
+	// Slot 0 holds the record after the last slot
+	test_read_slot(0, &record);
+	TEST_CHECK_EQ(record.data.sequence, STORE_SLOTS_COUNT + 1);
+
+	TEST_CHECK_EQ(store_init(), HAL_OK);
+	TEST_CHECK_EQ(store_get()->sequence, STORE_SLOTS_COUNT + 1);
+	TEST_CHECK_EQ(store_get()->matches, STORE_SLOTS_COUNT + 1);
+}
+
+int main(void)
+{
+	int fd = mkstemp(path);
+
+	TEST_CHECK(fd >= 0);
+	close(fd);
+
+	sim_init(path);
+	stats_init();
+
+	test_crc();
+	test_first_record();
+	test_torn_record();
+	test_mean_range();
+	test_wear_leveling();
+
+	unlink(path);
+
+	TEST_END();
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# trace.sh
+#
+# FSM trace of a scripted point, captured on the SWO output of pong_sim and decoded by
+# trace_decode : P1 serves at 5 s, P2 returns the ball at 7 s, P1 misses it. The transitions,
+# their press counts and pass counts must be the expected ones, the cycles are not checked.
+#
+#   sh Tests/trace.sh BUILD
+
+if [ $# -ne 1 ]; then
+	echo "usage: trace.sh BUILD" >&2
+	exit 2
+fi
+
+swo=$(mktemp)
+trap 'rm -f "$swo"' EXIT
+
+# Times out at the end of the point
+"$1/pong_sim" --time 12 --press 5000:1:50 --press 7000:2:50 --log /dev/null --swo "$swo" 2>/dev/null
+
+timeline=$("$1/trace_decode" "$swo" | cut -d, -f4-)
+expected="START,START,0,0,0
+START,WPP1,0,0,0
+WPP1,GTP2,1,0,0
+GTP2,RPP2,0,0,0
+RPP2,GTP1,0,1,1
+GTP1,RPP1,0,0,1
+RPP1,IP2S,0,0,2
+IP2S,WPP1,0,0,0"
+
+if [ "$timeline" != "$expected" ]; then
+	echo "FAIL: trace timeline" >&2
+	echo "$timeline" >&2
+	exit 1
+fi
+
+echo "Tests/trace.sh: passed"
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# wake.sh
+#
+# Wakeup from the deep idle of pong_sim by a glitch : the board enters the Stop mode after
+# POWER_IDLE_TIMEOUT_MS without a press, a zero-length press at 130 s wakes it up, then P1 serves
+# at 200 s. The serve must start the point, for either button glitching.
+#
+#   sh Tests/wake.sh BUILD
+
+if [ $# -ne 1 ]; then
+	echo "usage: wake.sh BUILD" >&2
+	exit 2
+fi
+
+swo=$(mktemp)
+trap 'rm -f "$swo"' EXIT
+
+for btn in 1 2; do
+	"$1/pong_sim" --time 205 --press 130000:$btn:0 --press 200000:1:50 --log /dev/null --swo "$swo" 2>/dev/null
+
+	if ! "$1/trace_decode" "$swo" | cut -d, -f4-6 | grep -q '^WPP1,GTP2,1$'; then
+		echo "FAIL: no serve after a glitch of BTN$btn" >&2
+		exit 1
+	fi
+done
+
+echo "Tests/wake.sh: passed"
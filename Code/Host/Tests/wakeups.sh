@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# wakeups.sh
+#
+# TIM4 wakeups per second over the same bot match, played by a periodic and a tickless build of
+# pong_sim (the bots draw from a fixed seed). The rate is the one of the timer line of the match
+# end report. Fails when the tickless scheduler does not wake the core up less often.
+#
+#   sh Tests/wakeups.sh PERIODIC_SIM TICKLESS_SIM
+
+MATCH_TIME_S=1200
+
+if [ $# -ne 2 ]; then
+	echo "usage: wakeups.sh PERIODIC_SIM TICKLESS_SIM" >&2
+	exit 2
+fi
+
+# Wakeups per second of a match, field 3 of timer,tickless,wakeups_per_second,...
+wakeups() {
+	"$1" --time $MATCH_TIME_S --until timer, | awk -F, '$1 == "timer" { print $3 }'
+}
+
+periodic=$(wakeups "$1") || exit 1
+tickless=$(wakeups "$2") || exit 1
+
+echo "wakeups,periodic,$periodic"
+echo "wakeups,tickless,$tickless"
+
+if [ -z "$periodic" ] || [ -z "$tickless" ] || [ "$tickless" -ge "$periodic" ]; then
+	echo "FAIL: tickless wakeups not below the periodic ones" >&2
+	exit 1
+fi
@@ -0,0 +1,32 @@
+/*
+ * decode.h
+ *
+ * Shared by the host tools decoding the outputs of the board : names of FSM_State_Enum, as printed
+ * in the decoded lines.
+ */
+
+#ifndef HOST_DECODE_H_
+#define HOST_DECODE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+static const char *decode_states_names[] = {
+	"START", "WPP1", "WPP2", "GTP1", "GTP2", "RPP1",
+	"RPP2", "IP1S", "IP2S", "P1WN", "P2WN", "AWAY",
+};
+
+#define DECODE_STATES_COUNT (sizeof(decode_states_names) / sizeof(decode_states_names[0]))
+
+/**
+ * @brief Print a state by its name, by its number if unknown
+ */
+static inline void decode_print_state(uint8_t _state)
+{
+	if (_state < DECODE_STATES_COUNT)
+		printf("%s", decode_states_names[_state]);
+	else
+		printf("%u", _state);
+}
+
+#endif /* HOST_DECODE_H_ */
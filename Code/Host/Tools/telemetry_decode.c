@@ -0,0 +1,173 @@
+/*
+ * telemetry_decode.c
+ *
+ * Records of the telemetry stream (telemetry.h), from a capture of USART2 such as the --telemetry
+ * output of pong_sim or a dump of the virtual COM port. The bytes are split into frames at the 0x00
+ * delimiters and COBS decoded : a frame of the wrong length, or left unfinished by a capture started
+ * in its middle, is counted and skipped. The gaps of the sequence numbers count the records dropped
+ * by the board or throttled.
+ *
+ *   telemetry_decode [--replay SPEED] [FILE]
+ *
+ * One line per record, FILE or stdin by default :
+ *   telemetry,sequence,time_us,kind,state,led_index,pass_count,p1_score,p2_score,reaction_us
+ * kind is transition or ball, state the state entered or the one of the ball.
+ *
+ * --replay prints the lines at the pace of their record times divided by SPEED, flushed one by
+ * one, to feed a dashboard with a capture as if the board were playing.
+ */
+
+#include "decode.h"
+#include "telemetry.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TELEMETRY_DECODE_FRAME_MAX 256
+
+static struct {
+	uint8_t frame[TELEMETRY_DECODE_FRAME_MAX];
+	uint32_t length;
+	uint8_t overflow;			// Frame longer than the buffer, skipped up to its delimiter
+	double speed;				// Replay speed, 0 to print at once
+	uint32_t records;
+	uint32_t bad_frames;		// COBS error or wrong length
+	uint32_t missing;			// Sequence gaps : dropped or throttled records
+	uint16_t next_sequence;
+	uint32_t last_time_us;
+} decoder;
+
+/**
+ * @brief COBS decode a frame, without its delimiter
+ * @retval Decoded length, -1 if the frame is malformed
+ */
+static int telemetry_decode_cobs(const uint8_t *_frame, uint32_t _length, uint8_t *_out, uint32_t _size)
+{
+	uint32_t in = 0;
+	uint32_t out = 0;
+
+	while (in < _length)
+	{
+		uint8_t code = _frame[in++];
+
+		if (code == 0 || in + code - 1 > _length)
+			return -1;
+
+		for (uint8_t i = 1; i < code; i++)
+		{
+			if (out == _size)
+				return -1;
+			_out[out++] = _frame[in++];
+		}
+
+		// A block shorter than 255 bytes ended with a 0x00, but the last one
+		if (code != 0xFF && in < _length)
+		{
+			if (out == _size)
+				return -1;
+			_out[out++] = 0;
+		}
+	}
+
+	return out;
+}
+
+/**
+ * @brief Wait for the time of a record, at the replay speed
+ */
+static void telemetry_decode_wait(uint32_t _time_us)
+{
+	if (decoder.speed <= 0 || decoder.records == 0)
+		return;
+
+	double delay_s = (uint32_t)(_time_us - decoder.last_time_us) / 1e6 / decoder.speed;
+	struct timespec delay = {(time_t)delay_s, (long)((delay_s - (time_t)delay_s) * 1e9)};
+
+	nanosleep(&delay, NULL);
+}
+
+/**
+ * @brief Print a complete frame
+ */
+static void telemetry_decode_frame(void)
+{
+	TypeDef_Telemetry_Record record;
+
+	if (telemetry_decode_cobs(decoder.frame, decoder.length, (uint8_t *)&record, sizeof(record)) != sizeof(record))
+	{
+		decoder.bad_frames++;
+		return;
+	}
+
+	if (decoder.records != 0)
+		decoder.missing += (uint16_t)(record.sequence - decoder.next_sequence);
+	decoder.next_sequence = record.sequence + 1;
+
+	telemetry_decode_wait(record.time_us);
+	decoder.last_time_us = record.time_us;
+	decoder.records++;
+
+	printf("telemetry,%u,%u,%s,", record.sequence, record.time_us,
+		   (record.kind == TELEMETRY_TRANSITION) ? "transition" : (record.kind == TELEMETRY_BALL) ? "ball" : "unknown");
+	decode_print_state(record.state);
+	printf(",%d,%u,%u,%u,%u\n", record.led_index, record.pass_count, record.p1_score, record.p2_score,
+		   record.reaction_time_us);
+
+	if (decoder.speed > 0)
+		fflush(stdout);
+}
+
+int main(int _argc, char **_argv)
+{
+	FILE *input = stdin;
+	int first = 1;
+	int byte;
+
+	if (_argc > 2 && strcmp(_argv[1], "--replay") == 0)
+	{
+		decoder.speed = strtod(_argv[2], NULL);
+		first = 3;
+	}
+
+	if (_argc - first > 1 || (first == 3 && decoder.speed <= 0))
+	{
+		fprintf(stderr, "usage: telemetry_decode [--replay SPEED] [FILE]\n");
+		return 2;
+	}
+
+	if (_argc - first == 1 && (input = fopen(_argv[first], "rb")) == NULL)
+	{
+		perror(_argv[first]);
+		return 2;
+	}
+
+	while ((byte = fgetc(input)) != EOF)
+	{
+		if (byte != 0)
+		{
+			if (decoder.length == TELEMETRY_DECODE_FRAME_MAX)
+				decoder.overflow = 1;
+			else
+				decoder.frame[decoder.length++] = byte;
+			continue;
+		}
+
+		if (decoder.overflow)
+			decoder.bad_frames++;
+		else if (decoder.length != 0)
+			telemetry_decode_frame();
+
+		decoder.length = 0;
+		decoder.overflow = 0;
+	}
+
+	// Cut by the end of the capture
+	if (decoder.length != 0)
+		decoder.bad_frames++;
+
+	if (decoder.bad_frames != 0 || decoder.missing != 0)
+		fprintf(stderr, "telemetry_decode: %u bad frames, %u records missing\n", decoder.bad_frames, decoder.missing);
+
+	return (decoder.records != 0) ? 0 : 1;
+}
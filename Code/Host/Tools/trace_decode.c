@@ -0,0 +1,129 @@
+/*
+ * trace_decode.c
+ *
+ * Timeline of the FSM transitions from a SWO capture, such as the --swo output of pong_sim. The
+ * ITM source packets of the port TRACE_ITM_PORT are gathered into the 3 words records of trace.h,
+ * the other ports are skipped. A record is only started by a word 0 carrying TRACE_SYNC : a capture
+ * starting in the middle of a record is synchronized on the next one, and so is a record cut by an
+ * ITM overflow packet.
+ *
+ *   trace_decode [FILE]
+ *
+ * One line per transition, FILE or stdin by default :
+ *   trace,cycles,delta,from,to,btn1,btn2,pass_count
+ * cycles is the DWT cycle counter, unwrapped on the assumption that two transitions are less than
+ * 2^32 cycles apart, delta the cycles since the previous transition. The cycles are at the HCLK of
+ * the time, which the clock policy changes between the states.
+ */
+
+#include "decode.h"
+#include "trace.h"
+
+#define TRACE_DECODE_OVERFLOW 0x70	// ITM overflow packet header
+
+static struct {
+	uint32_t words[TRACE_RECORD_WORDS];
+	int words_count;		// Words of the current record, 0 while looking for a sync
+	uint64_t cycles;		// Unwrapped cycles of the last record
+	uint32_t last_cyccnt;
+	uint32_t records;
+	uint32_t skipped;		// Words out of sync
+	uint32_t overflows;		// ITM overflow packets, records cut
+} decoder;
+
+/**
+ * @brief Print a complete record
+ */
+static void trace_decode_record(void)
+{
+	uint32_t header = decoder.words[0];
+	uint32_t cyccnt = decoder.words[1];
+	uint64_t delta = (decoder.records == 0) ? 0 : (uint32_t)(cyccnt - decoder.last_cyccnt);
+
+	decoder.cycles = (decoder.records == 0) ? cyccnt : decoder.cycles + delta;
+	decoder.last_cyccnt = cyccnt;
+	decoder.records++;
+
+	printf("trace,%llu,%llu,", (unsigned long long)decoder.cycles, (unsigned long long)delta);
+	decode_print_state((header >> 16) & 0xFF);
+	printf(",");
+	decode_print_state((header >> 8) & 0xFF);
+	printf(",%u,%u,%u\n", (header >> 4) & 0xF, header & 0xF, decoder.words[2]);
+}
+
+/**
+ * @brief Word received on the trace port
+ */
+static void trace_decode_word(uint32_t _word)
+{
+	// Out of sync : skipped up to the first word 0 of a record
+	if (decoder.words_count == 0 && (_word >> 24) != TRACE_SYNC)
+	{
+		decoder.skipped++;
+		return;
+	}
+
+	decoder.words[decoder.words_count++] = _word;
+
+	if (decoder.words_count == TRACE_RECORD_WORDS)
+	{
+		trace_decode_record();
+		decoder.words_count = 0;
+	}
+}
+
+int main(int _argc, char **_argv)
+{
+	FILE *input = stdin;
+	int header;
+
+	if (_argc > 2)
+	{
+		fprintf(stderr, "usage: trace_decode [FILE]\n");
+		return 2;
+	}
+
+	if (_argc == 2 && (input = fopen(_argv[1], "rb")) == NULL)
+	{
+		perror(_argv[1]);
+		return 2;
+	}
+
+	while ((header = fgetc(input)) != EOF)
+	{
+		// Source packets : size in [1:0], hardware source in [2], port in [7:3]. The sync and
+		// overflow packets have no payload, the local timestamps are not enabled by the firmware.
+		int size = (header & 0x3) == 3 ? 4 : header & 0x3;
+		uint32_t payload = 0;
+
+		// The ITM dropped packets, the current record is incomplete
+		if (header == TRACE_DECODE_OVERFLOW)
+		{
+			decoder.overflows++;
+			decoder.words_count = 0;
+			continue;
+		}
+
+		if (size == 0)
+			continue;
+
+		for (int i = 0; i < size; i++)
+		{
+			int byte = fgetc(input);
+
+			if (byte == EOF)
+				break;
+
+			payload |= (uint32_t)byte << (8 * i);
+		}
+
+		// Only 32 bits writes are made on the trace port
+		if ((header & 0x4) == 0 && (header >> 3) == TRACE_ITM_PORT && size == 4)
+			trace_decode_word(payload);
+	}
+
+	if (decoder.skipped != 0 || decoder.overflows != 0)
+		fprintf(stderr, "trace_decode: %u words out of sync, %u overflows\n", decoder.skipped, decoder.overflows);
+
+	return (decoder.records != 0) ? 0 : 1;
+}